@@ -0,0 +1,38 @@
+#!/usr/bin/env bash
+
+set -o errexit
+set -o pipefail
+set -o nounset
+# set -o xtrace
+
+__dir="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+__root="$(cd "$(dirname "${__dir}")" && pwd)"
+
+###
+
+cd "${__root}"
+
+# benchmark executables, build them in Release, see `bin/release.sh`
+benchmarks=("demux_bench" "flatbuffers_bench" "order_book_bench" "columnar_bench" "doorbell_bench" "merge_bench")
+
+out_dir="${1:-./build/benchmarks}"
+shift || true
+
+version=$(grep -m 1 -E '^\s*version\s*=' ./conanfile.py | sed -E 's/.*"(.*)".*/\1/')
+commit=$(git rev-parse --short HEAD 2>/dev/null || echo "unknown")
+
+mkdir -p "${out_dir}"
+
+for bench in "${benchmarks[@]}"; do
+    out_file="${out_dir}/${bench}-${version}-${commit}.json"
+    echo "Running ${bench}, results: ${out_file} ..."
+    # the remaining arguments are passed to the benchmarks, e.g. --benchmark_filter=BM_DemuxWriter
+    ./build/"${bench}" \
+        --benchmark_out="${out_file}" \
+        --benchmark_out_format=json \
+        --benchmark_repetitions=5 \
+        --benchmark_report_aggregates_only=true \
+        "$@"
+done
+
+echo "Done"
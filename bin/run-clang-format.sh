@@ -32,6 +32,6 @@ echo "Running clang-format..."
 # shellcheck source=/dev/null
 source ./.envrc
 
-"${LLVM_HOME}"/bin/clang-format "${options}" --Werror ./src/**/**/*
+"${LLVM_HOME}"/bin/clang-format "${options}" --Werror ./src/**/**/*.h ./src/**/**/*.cpp
 
 echo "Done"
@@ -19,7 +19,7 @@ jobs=$(( $(nproc) > 2 ? $(nproc) - 2 : 1 ))
 echo ""
 echo "Running clang-tidy, mode: ${mode}, jobs: ${jobs} ..."
 
-all_src_folders=(./src/demux/core/* ./src/demux/util/* ./src/demux/example/* ./src/demux/test/*)
+all_src_folders=(./src/demux/core/* ./src/demux/util/* ./src/demux/example/* ./src/demux/test/* ./src/demux/bench/*)
 
 # shellcheck source=/dev/null
 source ./.envrc
@@ -20,13 +20,10 @@ msg_num=${2:-10000000}
 ./build/shm_demux writer 2 "${msg_num}" "${zero_copy}" > ./example-writer.log 2>&1 &
 writer_pid="$!"
 
-# let the writer start and initialize all shared memory objects, it will wait for both readers
-sleep 2s
+# start 2 readers, they wait for the writer to initialize the shared memory, the writer waits for both readers
 
-# start 2 readers
-
-./build/shm_demux reader 1 "${msg_num}" "${zero_copy}" &> ./example-reader-1.log &
-./build/shm_demux reader 2 "${msg_num}" "${zero_copy}" &> ./example-reader-2.log &
+./build/shm_demux reader 1 "${msg_num}" "${zero_copy}" ./example-reader-1.hlog &> ./example-reader-1.log &
+./build/shm_demux reader 2 "${msg_num}" "${zero_copy}" ./example-reader-2.hlog &> ./example-reader-2.log &
 
 # report the state
 #ps -ef|grep -F "./build/shm_demux"
@@ -62,5 +59,8 @@ else
   exit 100
 fi
 
+# latency of both readers, merged from the per-second interval logs
+./build/demux_harness --merge=./example-reader-1.hlog,./example-reader-2.hlog
+
 # generate profiler report
 #google-pprof --text ./build/shm_demux ./shm_demux_writer.prof &> pprof-report.log
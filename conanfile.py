@@ -32,6 +32,12 @@ class DemuxCppRecipe(ConanFile):
         self.requires("hdrhistogram-c/0.11.8")
         self.requires("gtest/1.16.0")
         self.requires("rapidcheck/cci.20231215")
+        self.requires("flatbuffers/24.3.25")
+        self.requires("benchmark/1.9.1")
+
+    def build_requirements(self):
+        # flatc generates the MoldUDP64 schema code, see CMakeLists.txt
+        self.tool_requires("flatbuffers/24.3.25")
 
     def configure(self):
         if self.options.shared:
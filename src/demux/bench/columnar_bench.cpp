@@ -0,0 +1,122 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+// Per-instrument VWAP of `MarketDataUpdate`s: the per-message loop (`VwapAggregator::add(md)`, what a reader does with
+// `next_unsafe<MarketDataUpdate>`) against the columnar batch path (transpose into `MarketDataBatch`, then the SIMD
+// kernels), scalar and AVX2. One iteration processes a run of `BATCH_SIZE` updates, `items_per_second` is updates per
+// second. `BM_Dot` is the total notional kernel alone. The AVX2 cases are skipped if the CPU does not support AVX2.
+
+#include <benchmark/benchmark.h>
+#include <boost/log/core.hpp>         // NOLINT(misc-include-cleaner)
+#include <boost/log/expressions.hpp>  // NOLINT(misc-include-cleaner)
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "../example/columnar_batch.h"
+#include "../example/market_data.h"
+
+namespace {
+
+using lshl::demux::example::detect_simd_level;
+using lshl::demux::example::MarketDataBatch;
+using lshl::demux::example::MarketDataUpdate;
+using lshl::demux::example::MarketDataUpdateGenerator;
+using lshl::demux::example::SimdLevel;
+using lshl::demux::example::VwapAggregator;
+using std::size_t;
+using std::uint32_t;
+using std::uint64_t;
+
+constexpr size_t BATCH_SIZE = 256;
+constexpr uint32_t INSTRUMENTS = 64;
+
+// deterministic, the same updates for every run
+auto generate_updates() -> std::vector<MarketDataUpdate> {
+  std::vector<MarketDataUpdate> result(BATCH_SIZE);
+  std::mt19937_64 engine{};
+  for (MarketDataUpdate& md : result) {
+    const uint64_t x = engine();
+    md.instrument_id = static_cast<uint32_t>(x % INSTRUMENTS);
+    md.price = MarketDataUpdateGenerator::PRICE_MULTIPLIER * ((x >> 8U) % 1000);
+    md.size = static_cast<uint32_t>(x >> 48U);
+  }
+  return result;
+}
+
+auto skip_unsupported(benchmark::State& state, const SimdLevel simd) -> bool {
+  if (simd != SimdLevel::Scalar && detect_simd_level() != simd) {
+    state.SkipWithError("SIMD level is not supported by the CPU");
+    return true;
+  }
+  return false;
+}
+
+auto BM_Vwap_PerMessage(benchmark::State& state) -> void {
+  const std::vector<MarketDataUpdate> xs = generate_updates();
+  VwapAggregator vwap(INSTRUMENTS, BATCH_SIZE, SimdLevel::Scalar);
+  for (auto _ : state) {
+    for (const MarketDataUpdate& md : xs) {
+      benchmark::DoNotOptimize(vwap.add(md));
+    }
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(BATCH_SIZE));
+}
+
+template <SimdLevel S>
+auto BM_Vwap_Batch(benchmark::State& state) -> void {
+  if (skip_unsupported(state, S)) {
+    return;
+  }
+  const std::vector<MarketDataUpdate> xs = generate_updates();
+  VwapAggregator vwap(INSTRUMENTS, BATCH_SIZE, S);
+  MarketDataBatch batch(BATCH_SIZE);
+  for (auto _ : state) {
+    batch.clear();
+    for (const MarketDataUpdate& md : xs) {
+      batch.append(md);
+    }
+    benchmark::DoNotOptimize(vwap.add(batch));
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(BATCH_SIZE));
+}
+
+template <SimdLevel S>
+auto BM_Dot(benchmark::State& state) -> void {
+  if (skip_unsupported(state, S)) {
+    return;
+  }
+  const std::vector<MarketDataUpdate> xs = generate_updates();
+  MarketDataBatch batch(BATCH_SIZE);
+  for (const MarketDataUpdate& md : xs) {
+    batch.append(md);
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(lshl::demux::example::dot(S, batch.prices(), batch.sizes()));
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(BATCH_SIZE));
+}
+
+}  // namespace
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables, cppcoreguidelines-owning-memory)
+BENCHMARK(BM_Vwap_PerMessage);
+BENCHMARK_TEMPLATE(BM_Vwap_Batch, SimdLevel::Scalar);
+BENCHMARK_TEMPLATE(BM_Vwap_Batch, SimdLevel::Avx2);
+BENCHMARK_TEMPLATE(BM_Dot, SimdLevel::Scalar);
+BENCHMARK_TEMPLATE(BM_Dot, SimdLevel::Avx2);
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables, cppcoreguidelines-owning-memory)
+
+auto main(int argc, char** argv) -> int {
+  namespace logging = boost::log;
+  logging::core::get()->set_filter(logging::trivial::severity >= logging::trivial::warning);
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,546 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+// Microbenchmarks of the individual MessageBuffer, DemuxWriter and DemuxReader operations. Everything runs on one
+// thread. The writer-only benchmarks use a writer without readers (`all_readers_mask == 0`), wraparound never waits.
+// `*Wraparound` benchmarks use a buffer that fits exactly one message, so every message wraps around, compare them
+// with the same benchmark over a large buffer to get the cost of the wraparound alone.
+// `BM_MessageBuffer_WriteFixed` and `BM_MessageBuffer_WriteStreaming` are the copy kernels of doc/adr/ADR004.md,
+// compare them with `BM_MessageBuffer_Write` of the same message size. `BM_CopyStreaming` is the streaming copy alone
+// up to 4 MiB, against `std::copy_n`. The kernels the CPU does not support are skipped.
+// `*Prefetch` benchmarks take the software prefetch distance in cache lines, 0 is no prefetch.
+// Build in Release, see `bin/run-benchmarks.sh`. `--perf_counters` adds hardware counters per iteration (cycles,
+// instructions, L1d, LLC and branch misses), see `util/perf_counters.h`.
+
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <boost/log/core.hpp>         // NOLINT(misc-include-cleaner)
+#include <boost/log/expressions.hpp>  // NOLINT(misc-include-cleaner)
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+#include "../core/checksum_frame.h"
+#include "../core/copy_kernels.h"
+#include "../core/demultiplexer.h"
+#include "../core/message_buffer.h"
+#include "../core/reader_id.h"
+#include "../util/perf_counters.h"
+
+namespace {
+
+using lshl::demux::core::ChecksumReader;
+using lshl::demux::core::ChecksumWriter;
+using lshl::demux::core::copy_streaming;
+using lshl::demux::core::DemuxReader;
+using lshl::demux::core::DemuxWriter;
+using lshl::demux::core::detect_streaming_copy;
+using lshl::demux::core::MessageBuffer;
+using lshl::demux::core::ReaderId;
+using lshl::demux::core::StreamingCopy;
+using lshl::demux::core::WriteResult;
+using lshl::demux::util::PERF_EVENT_NAMES;
+using lshl::demux::util::PERF_EVENT_NUM;
+using lshl::demux::util::PerfCounters;
+using lshl::demux::util::PerfCounterValues;
+using std::array;
+using std::atomic;
+using std::size_t;
+using std::span;
+using std::uint16_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::uint8_t;
+using std::vector;
+
+constexpr uint16_t M = 1024;
+constexpr size_t SMALL_L = 4 * 1024;
+constexpr size_t LARGE_L = 1024 * 1024;
+constexpr size_t HUGE_L = 256 * 1024 * 1024;  // several times larger than a typical LLC, for the streaming copy
+
+// message sizes for the benchmarks that take the size at runtime
+constexpr int64_t MIN_MESSAGE_SIZE = 8;
+constexpr int64_t MAX_MESSAGE_SIZE = M;
+
+// fixed-size message for `allocate<A>`, `write_safe<T>` and `next_unsafe<T>`
+template <size_t N>
+struct Payload {
+  array<uint8_t, N> data;
+};
+
+// exactly one `Payload<N>` fits, every message wraps around
+template <size_t N>
+constexpr size_t ONE_MESSAGE_L = MessageBuffer<0>::required<Payload<N>>();
+
+// heap-allocated, `LARGE_L` is too big for the benchmark thread stack
+template <size_t L>
+struct Ring {
+  std::unique_ptr<array<uint8_t, L>> buffer = std::make_unique<array<uint8_t, L>>();
+  atomic<uint64_t> message_count_sync{0};
+  atomic<uint64_t> wraparound_sync{0};
+
+  [[nodiscard]] auto data() const -> span<uint8_t, L> { return span<uint8_t, L>{*this->buffer}; }
+};
+
+// set by `--perf_counters`
+bool perf_counters_enabled = false;  // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+// hardware counters of the benchmark thread, started right before the benchmark loop
+class PerfScope {
+ public:
+  PerfScope() {
+    if (perf_counters_enabled) {
+      this->counters_.emplace();
+      this->counters_->start();
+    }
+  }
+
+  // excludes the untimed part of the loop, call with `state.PauseTiming()` and `state.ResumeTiming()`
+  auto pause() noexcept -> void {
+    if (this->counters_.has_value()) {
+      this->counters_->stop();
+    }
+  }
+
+  auto resume() noexcept -> void {
+    if (this->counters_.has_value()) {
+      this->counters_->resume();
+    }
+  }
+
+  auto stop(benchmark::State& state) -> void {
+    if (!this->counters_.has_value()) {
+      return;
+    }
+    this->counters_->stop();
+    const PerfCounterValues values = this->counters_->read();
+    for (size_t i = 0; i < PERF_EVENT_NUM; ++i) {
+      const std::optional<uint64_t>& v = values.values.at(i);
+      if (v.has_value()) {
+        state.counters[PERF_EVENT_NAMES.at(i)] =
+            benchmark::Counter(static_cast<double>(v.value()), benchmark::Counter::kAvgIterations);
+      }
+    }
+  }
+
+ private:
+  std::optional<PerfCounters> counters_{};
+};
+
+auto skip_unsupported(benchmark::State& state, const StreamingCopy kernel) -> bool {
+  if (kernel > detect_streaming_copy()) {
+    state.SkipWithError("streaming copy is not supported by the CPU");
+    return true;
+  }
+  return false;
+}
+
+auto set_counters(benchmark::State& state, const size_t message_size, PerfScope* perf) -> void {
+  perf->stop(state);
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(message_size));
+}
+
+// removes `--perf_counters` from the arguments, `benchmark::Initialize` rejects unknown flags
+auto parse_perf_counters_flag(int* argc, char** argv) -> void {
+  const std::span<char*> args(argv, static_cast<size_t>(*argc));
+  int n = 0;
+  for (char* arg : args) {
+    if (std::string_view(arg) == "--perf_counters") {
+      perf_counters_enabled = true;
+    } else {
+      args[static_cast<size_t>(n++)] = arg;
+    }
+  }
+  *argc = n;
+}
+
+//
+// MessageBuffer
+//
+
+template <size_t L>
+auto BM_MessageBuffer_Write(benchmark::State& state) -> void {
+  const Ring<L> ring;
+  MessageBuffer<L> buffer(ring.data());
+  vector<uint8_t> message(static_cast<size_t>(state.range(0)), 1);
+  size_t position = 0;
+  PerfScope perf{};
+  for (auto _ : state) {
+    size_t n = buffer.write(position, message);
+    if (n == 0) {
+      position = 0;
+      n = buffer.write(position, message);
+    }
+    position += n;
+    benchmark::DoNotOptimize(n);
+  }
+  set_counters(state, message.size(), &perf);
+}
+
+// a message of a compile-time size, the `write_safe<T>` path
+template <size_t L, size_t N>
+auto BM_MessageBuffer_WriteFixed(benchmark::State& state) -> void {
+  const Ring<L> ring;
+  MessageBuffer<L> buffer(ring.data());
+  Payload<N> payload{};
+  payload.data.fill(1);
+  const span<uint8_t, N> message{payload.data};
+  size_t position = 0;
+  PerfScope perf{};
+  for (auto _ : state) {
+    size_t n = buffer.write(position, message);
+    if (n == 0) {
+      position = 0;
+      n = buffer.write(position, message);
+    }
+    position += n;
+    benchmark::DoNotOptimize(n);
+  }
+  set_counters(state, N, &perf);
+}
+
+// the kernel is forced, `StreamingCopy::None` is the `std::copy_n` of `BM_MessageBuffer_Write` over the same ring
+template <StreamingCopy K>
+auto BM_MessageBuffer_WriteStreaming(benchmark::State& state) -> void {
+  if (skip_unsupported(state, K)) {
+    return;
+  }
+  const Ring<HUGE_L> ring;
+  MessageBuffer<HUGE_L> buffer(ring.data(), K);
+  vector<uint8_t> message(static_cast<size_t>(state.range(0)), 1);
+  size_t position = 0;
+  PerfScope perf{};
+  for (auto _ : state) {
+    size_t n = buffer.write(position, message);
+    if (n == 0) {
+      position = 0;
+      n = buffer.write(position, message);
+    }
+    position += n;
+    benchmark::DoNotOptimize(n);
+  }
+  set_counters(state, message.size(), &perf);
+}
+
+// the destination walks through `HUGE_L` bytes, it is never in the cache when the copy starts
+template <StreamingCopy K>
+auto BM_CopyStreaming(benchmark::State& state) -> void {
+  if (skip_unsupported(state, K)) {
+    return;
+  }
+  const Ring<HUGE_L> ring;
+  const span<uint8_t, HUGE_L> dst = ring.data();
+  const auto n = static_cast<size_t>(state.range(0));
+  vector<uint8_t> src(n, 1);
+  size_t position = 0;
+  PerfScope perf{};
+  for (auto _ : state) {
+    if (position + n > HUGE_L) {
+      position = 0;
+    }
+    if constexpr (K == StreamingCopy::None) {
+      std::copy_n(src.data(), n, dst.subspan(position).data());
+    } else {
+      copy_streaming(K, dst.subspan(position).data(), src.data(), n);
+    }
+    position += n;
+    benchmark::ClobberMemory();
+  }
+  set_counters(state, n, &perf);
+}
+
+template <size_t L, size_t N>
+auto BM_MessageBuffer_Allocate(benchmark::State& state) -> void {
+  const Ring<L> ring;
+  MessageBuffer<L> buffer(ring.data());
+  size_t position = 0;
+  PerfScope perf{};
+  for (auto _ : state) {
+    std::optional<Payload<N>*> x = buffer.template allocate<Payload<N>>(position);
+    if (!x.has_value()) {
+      position = 0;
+      x = buffer.template allocate<Payload<N>>(position);
+    }
+    position += MessageBuffer<L>::template required<Payload<N>>();
+    benchmark::DoNotOptimize(x.value());
+  }
+  set_counters(state, N, &perf);
+}
+
+template <size_t L>
+auto BM_MessageBuffer_Read(benchmark::State& state) -> void {
+  const Ring<L> ring;
+  MessageBuffer<L> buffer(ring.data());
+  vector<uint8_t> message(static_cast<size_t>(state.range(0)), 1);
+
+  // fill up the buffer, then read it in a loop
+  size_t end = 0;
+  for (size_t n = buffer.write(end, message); n > 0; n = buffer.write(end, message)) {
+    end += n;
+  }
+
+  size_t position = 0;
+  PerfScope perf{};
+  for (auto _ : state) {
+    const span<uint8_t> x = buffer.read(position);
+    position += sizeof(lshl::demux::core::message_length_t) + x.size();
+    if (position >= end) {
+      position = 0;
+    }
+    benchmark::DoNotOptimize(x.data());
+  }
+  set_counters(state, message.size(), &perf);
+}
+
+//
+// DemuxWriter
+//
+
+template <size_t L, bool B>
+auto BM_DemuxWriter_Write(benchmark::State& state) -> void {
+  Ring<L> ring;
+  DemuxWriter<L, M, B> writer(0, ring.data(), &ring.message_count_sync, &ring.wraparound_sync);
+  vector<uint8_t> message(static_cast<size_t>(state.range(0)), 1);
+  PerfScope perf{};
+  for (auto _ : state) {
+    while (writer.write(message) != WriteResult::Success) {
+    }
+  }
+  set_counters(state, message.size(), &perf);
+}
+
+template <size_t L, bool B, size_t N>
+auto BM_DemuxWriter_WriteSafe(benchmark::State& state) -> void {
+  Ring<L> ring;
+  DemuxWriter<L, N, B> writer(0, ring.data(), &ring.message_count_sync, &ring.wraparound_sync);
+  Payload<N> message{};
+  PerfScope perf{};
+  for (auto _ : state) {
+    message.data[0] += 1;
+    while (writer.write_safe(message) != WriteResult::Success) {
+    }
+  }
+  set_counters(state, N, &perf);
+}
+
+template <bool B, size_t N>
+auto BM_DemuxWriter_WriteSafeWraparound(benchmark::State& state) -> void {
+  BM_DemuxWriter_WriteSafe<ONE_MESSAGE_L<N>, B, N>(state);
+}
+
+//
+// DemuxReader
+//
+
+// fills up the buffer, the non-blocking writer stops when it initiates wraparound
+template <class W, class A>
+auto fill_up(W* writer, const A& message) -> void {
+  while (writer->write_safe(message) == WriteResult::Success) {
+  }
+}
+
+template <size_t L, size_t N>
+auto BM_DemuxReader_Next(benchmark::State& state) -> void {
+  Ring<L> ring;
+  const ReaderId id{1};
+  DemuxWriter<L, N, false> writer(id.mask(), ring.data(), &ring.message_count_sync, &ring.wraparound_sync);
+  DemuxReader<L, N> reader(id, ring.data(), &ring.message_count_sync, &ring.wraparound_sync);
+  const Payload<N> message{};
+
+  fill_up(&writer, message);
+  PerfScope perf{};
+  for (auto _ : state) {
+    const span<uint8_t> x = reader.next();
+    if (x.empty()) {
+      // wraparound marker or drained, the refill is not measured
+      state.PauseTiming();
+      perf.pause();
+      fill_up(&writer, message);
+      perf.resume();
+      state.ResumeTiming();
+    }
+    benchmark::DoNotOptimize(x.data());
+  }
+  set_counters(state, N, &perf);
+}
+
+// `state.range(0)` prefetch distance in cache lines, compare a ring that fits into L2 with one that does not
+template <size_t L, size_t N>
+auto BM_DemuxReader_NextPrefetch(benchmark::State& state) -> void {
+  Ring<L> ring;
+  const ReaderId id{1};
+  DemuxWriter<L, N, false> writer(id.mask(), ring.data(), &ring.message_count_sync, &ring.wraparound_sync);
+  DemuxReader<L, N> reader(id, ring.data(), &ring.message_count_sync, &ring.wraparound_sync);
+  reader.set_prefetch_distance(static_cast<size_t>(state.range(0)));
+  const Payload<N> message{};
+
+  fill_up(&writer, message);
+  PerfScope perf{};
+  for (auto _ : state) {
+    const span<uint8_t> x = reader.next();
+    if (x.empty()) {
+      state.PauseTiming();
+      perf.pause();
+      fill_up(&writer, message);
+      perf.resume();
+      state.ResumeTiming();
+    }
+    benchmark::DoNotOptimize(x.data());
+    benchmark::DoNotOptimize(x.back());  // touch the message, the prefetch hides the miss
+  }
+  set_counters(state, N, &perf);
+}
+
+template <size_t L, size_t N>
+auto BM_DemuxWriter_WriteSafePrefetch(benchmark::State& state) -> void {
+  Ring<L> ring;
+  DemuxWriter<L, N, false> writer(0, ring.data(), &ring.message_count_sync, &ring.wraparound_sync);
+  writer.set_prefetch_distance(static_cast<size_t>(state.range(0)));
+  Payload<N> message{};
+  PerfScope perf{};
+  for (auto _ : state) {
+    message.data[0] += 1;
+    while (writer.write_safe(message) != WriteResult::Success) {
+    }
+  }
+  set_counters(state, N, &perf);
+}
+
+// one `write_safe` and one `next_unsafe` per iteration
+template <size_t L, size_t N>
+auto BM_DemuxWriterReader_RoundTrip(benchmark::State& state) -> void {
+  Ring<L> ring;
+  const ReaderId id{1};
+  DemuxWriter<L, N, false> writer(id.mask(), ring.data(), &ring.message_count_sync, &ring.wraparound_sync);
+  DemuxReader<L, N> reader(id, ring.data(), &ring.message_count_sync, &ring.wraparound_sync);
+  Payload<N> message{};
+  PerfScope perf{};
+  for (auto _ : state) {
+    message.data[0] += 1;
+    while (writer.write_safe(message) != WriteResult::Success) {
+      benchmark::DoNotOptimize(reader.next());  // consumes the wraparound marker
+    }
+    const std::optional<const Payload<N>*> x = reader.template next_unsafe<Payload<N>>();
+    benchmark::DoNotOptimize(x.value()->data[0]);
+  }
+  set_counters(state, N, &perf);
+}
+
+template <size_t N>
+auto BM_DemuxWriterReader_RoundTripWraparound(benchmark::State& state) -> void {
+  BM_DemuxWriterReader_RoundTrip<ONE_MESSAGE_L<N>, N>(state);
+}
+
+// `BM_DemuxWriterReader_RoundTrip` with XXH3 checksum frames, the writer computes and the reader verifies the checksum
+template <class C, size_t N>
+auto BM_ChecksumWriterReader_RoundTrip(benchmark::State& state) -> void {
+  constexpr auto F = static_cast<uint16_t>(N + sizeof(C));  // frame size
+  Ring<LARGE_L> ring;
+  const ReaderId id{1};
+  DemuxWriter<LARGE_L, F, false> demux_writer(id.mask(), ring.data(), &ring.message_count_sync, &ring.wraparound_sync);
+  DemuxReader<LARGE_L, F> demux_reader(id, ring.data(), &ring.message_count_sync, &ring.wraparound_sync);
+  ChecksumWriter<C, LARGE_L, F, false> writer(&demux_writer);
+  ChecksumReader<C, LARGE_L, F> reader(&demux_reader, true);
+  Payload<N> message{};
+  PerfScope perf{};
+  for (auto _ : state) {
+    message.data[0] += 1;
+    while (writer.write_safe(message) != WriteResult::Success) {
+      benchmark::DoNotOptimize(demux_reader.next());  // consumes the wraparound marker
+    }
+    const std::optional<const Payload<N>*> x = reader.template next_unsafe<Payload<N>>();
+    benchmark::DoNotOptimize(x.value()->data[0]);
+  }
+  set_counters(state, N, &perf);
+}
+
+}  // namespace
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables, cppcoreguidelines-owning-memory)
+BENCHMARK_TEMPLATE(BM_MessageBuffer_Write, SMALL_L)->RangeMultiplier(4)->Range(MIN_MESSAGE_SIZE, MAX_MESSAGE_SIZE);
+BENCHMARK_TEMPLATE(BM_MessageBuffer_Write, LARGE_L)->RangeMultiplier(4)->Range(MIN_MESSAGE_SIZE, MAX_MESSAGE_SIZE);
+BENCHMARK_TEMPLATE(BM_MessageBuffer_Write, LARGE_L)->Arg(32)->Arg(128)->Arg(512);  // the `WriteFixed` sizes
+BENCHMARK_TEMPLATE(BM_MessageBuffer_WriteFixed, LARGE_L, 8);
+BENCHMARK_TEMPLATE(BM_MessageBuffer_WriteFixed, LARGE_L, 32);
+BENCHMARK_TEMPLATE(BM_MessageBuffer_WriteFixed, LARGE_L, 64);
+BENCHMARK_TEMPLATE(BM_MessageBuffer_WriteFixed, LARGE_L, 128);
+BENCHMARK_TEMPLATE(BM_MessageBuffer_WriteFixed, LARGE_L, 256);
+BENCHMARK_TEMPLATE(BM_MessageBuffer_WriteFixed, LARGE_L, 512);
+BENCHMARK_TEMPLATE(BM_MessageBuffer_WriteStreaming, StreamingCopy::None)->RangeMultiplier(4)->Range(8, 32 * 1024);
+BENCHMARK_TEMPLATE(BM_MessageBuffer_WriteStreaming, StreamingCopy::Sse2)->RangeMultiplier(4)->Range(8, 32 * 1024);
+BENCHMARK_TEMPLATE(BM_MessageBuffer_WriteStreaming, StreamingCopy::Avx2)->RangeMultiplier(4)->Range(8, 32 * 1024);
+BENCHMARK_TEMPLATE(BM_MessageBuffer_WriteStreaming, StreamingCopy::Avx512)->RangeMultiplier(4)->Range(8, 32 * 1024);
+BENCHMARK_TEMPLATE(BM_CopyStreaming, StreamingCopy::None)->RangeMultiplier(8)->Range(8, 4 * 1024 * 1024);
+BENCHMARK_TEMPLATE(BM_CopyStreaming, StreamingCopy::Sse2)->RangeMultiplier(8)->Range(8, 4 * 1024 * 1024);
+BENCHMARK_TEMPLATE(BM_CopyStreaming, StreamingCopy::Avx2)->RangeMultiplier(8)->Range(8, 4 * 1024 * 1024);
+BENCHMARK_TEMPLATE(BM_CopyStreaming, StreamingCopy::Avx512)->RangeMultiplier(8)->Range(8, 4 * 1024 * 1024);
+BENCHMARK_TEMPLATE(BM_MessageBuffer_Allocate, SMALL_L, 8);
+BENCHMARK_TEMPLATE(BM_MessageBuffer_Allocate, SMALL_L, 64);
+BENCHMARK_TEMPLATE(BM_MessageBuffer_Allocate, SMALL_L, 512);
+BENCHMARK_TEMPLATE(BM_MessageBuffer_Allocate, LARGE_L, 8);
+BENCHMARK_TEMPLATE(BM_MessageBuffer_Allocate, LARGE_L, 64);
+BENCHMARK_TEMPLATE(BM_MessageBuffer_Allocate, LARGE_L, 512);
+BENCHMARK_TEMPLATE(BM_MessageBuffer_Read, SMALL_L)->RangeMultiplier(4)->Range(MIN_MESSAGE_SIZE, MAX_MESSAGE_SIZE);
+BENCHMARK_TEMPLATE(BM_MessageBuffer_Read, LARGE_L)->RangeMultiplier(4)->Range(MIN_MESSAGE_SIZE, MAX_MESSAGE_SIZE);
+
+BENCHMARK_TEMPLATE(BM_DemuxWriter_Write, SMALL_L, false)->RangeMultiplier(4)->Range(MIN_MESSAGE_SIZE, MAX_MESSAGE_SIZE);
+BENCHMARK_TEMPLATE(BM_DemuxWriter_Write, SMALL_L, true)->RangeMultiplier(4)->Range(MIN_MESSAGE_SIZE, MAX_MESSAGE_SIZE);
+BENCHMARK_TEMPLATE(BM_DemuxWriter_Write, LARGE_L, false)->RangeMultiplier(4)->Range(MIN_MESSAGE_SIZE, MAX_MESSAGE_SIZE);
+BENCHMARK_TEMPLATE(BM_DemuxWriter_Write, LARGE_L, true)->RangeMultiplier(4)->Range(MIN_MESSAGE_SIZE, MAX_MESSAGE_SIZE);
+BENCHMARK_TEMPLATE(BM_DemuxWriter_WriteSafe, LARGE_L, false, 8);
+BENCHMARK_TEMPLATE(BM_DemuxWriter_WriteSafe, LARGE_L, false, 64);
+BENCHMARK_TEMPLATE(BM_DemuxWriter_WriteSafe, LARGE_L, false, 512);
+BENCHMARK_TEMPLATE(BM_DemuxWriter_WriteSafe, LARGE_L, true, 8);
+BENCHMARK_TEMPLATE(BM_DemuxWriter_WriteSafe, LARGE_L, true, 64);
+BENCHMARK_TEMPLATE(BM_DemuxWriter_WriteSafe, LARGE_L, true, 512);
+BENCHMARK_TEMPLATE(BM_DemuxWriter_WriteSafeWraparound, false, 8);
+BENCHMARK_TEMPLATE(BM_DemuxWriter_WriteSafeWraparound, false, 64);
+BENCHMARK_TEMPLATE(BM_DemuxWriter_WriteSafeWraparound, false, 512);
+BENCHMARK_TEMPLATE(BM_DemuxWriter_WriteSafeWraparound, true, 8);
+BENCHMARK_TEMPLATE(BM_DemuxWriter_WriteSafeWraparound, true, 64);
+BENCHMARK_TEMPLATE(BM_DemuxWriter_WriteSafeWraparound, true, 512);
+
+BENCHMARK_TEMPLATE(BM_DemuxReader_Next, LARGE_L, 8);
+BENCHMARK_TEMPLATE(BM_DemuxReader_Next, LARGE_L, 64);
+BENCHMARK_TEMPLATE(BM_DemuxReader_Next, LARGE_L, 512);
+BENCHMARK_TEMPLATE(BM_DemuxReader_NextPrefetch, SMALL_L, 64)->Arg(0)->Arg(1)->Arg(2)->Arg(4);
+BENCHMARK_TEMPLATE(BM_DemuxReader_NextPrefetch, HUGE_L, 64)->Arg(0)->Arg(1)->Arg(2)->Arg(4);
+BENCHMARK_TEMPLATE(BM_DemuxReader_NextPrefetch, HUGE_L, 512)->Arg(0)->Arg(1)->Arg(2)->Arg(4);
+BENCHMARK_TEMPLATE(BM_DemuxWriter_WriteSafePrefetch, SMALL_L, 64)->Arg(0)->Arg(1)->Arg(2)->Arg(4);
+BENCHMARK_TEMPLATE(BM_DemuxWriter_WriteSafePrefetch, HUGE_L, 64)->Arg(0)->Arg(1)->Arg(2)->Arg(4);
+BENCHMARK_TEMPLATE(BM_DemuxWriter_WriteSafePrefetch, HUGE_L, 512)->Arg(0)->Arg(1)->Arg(2)->Arg(4);
+BENCHMARK_TEMPLATE(BM_DemuxWriterReader_RoundTrip, SMALL_L, 64);
+BENCHMARK_TEMPLATE(BM_DemuxWriterReader_RoundTrip, LARGE_L, 8);
+BENCHMARK_TEMPLATE(BM_DemuxWriterReader_RoundTrip, LARGE_L, 32);
+BENCHMARK_TEMPLATE(BM_DemuxWriterReader_RoundTrip, LARGE_L, 64);
+BENCHMARK_TEMPLATE(BM_DemuxWriterReader_RoundTrip, LARGE_L, 256);
+BENCHMARK_TEMPLATE(BM_DemuxWriterReader_RoundTrip, LARGE_L, 512);
+BENCHMARK_TEMPLATE(BM_DemuxWriterReader_RoundTripWraparound, 8);
+BENCHMARK_TEMPLATE(BM_DemuxWriterReader_RoundTripWraparound, 64);
+BENCHMARK_TEMPLATE(BM_DemuxWriterReader_RoundTripWraparound, 512);
+BENCHMARK_TEMPLATE(BM_ChecksumWriterReader_RoundTrip, uint32_t, 32);
+BENCHMARK_TEMPLATE(BM_ChecksumWriterReader_RoundTrip, uint32_t, 64);
+BENCHMARK_TEMPLATE(BM_ChecksumWriterReader_RoundTrip, uint32_t, 256);
+BENCHMARK_TEMPLATE(BM_ChecksumWriterReader_RoundTrip, uint64_t, 32);
+BENCHMARK_TEMPLATE(BM_ChecksumWriterReader_RoundTrip, uint64_t, 64);
+BENCHMARK_TEMPLATE(BM_ChecksumWriterReader_RoundTrip, uint64_t, 256);
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables, cppcoreguidelines-owning-memory)
+
+auto main(int argc, char** argv) -> int {
+  namespace logging = boost::log;
+  logging::core::get()->set_filter(logging::trivial::severity >= logging::trivial::warning);
+  parse_perf_counters_flag(&argc, argv);
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
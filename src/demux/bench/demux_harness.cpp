@@ -0,0 +1,569 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+// In-process throughput and latency harness: one writer thread and K reader threads share a heap-allocated circular
+// buffer. Sweeps the number of readers and the message size, reports throughput and latency percentiles per
+// configuration. Every message carries the writer's TSC timestamp in its first 8 bytes, `steady_clock` timestamp when
+// the CPU has no invariant TSC. With a fixed send rate the timestamp is the scheduled send time, so the writer stalls
+// (e.g. a blocked wraparound) are not omitted from the latency distribution. `--prefetch` sweeps the software prefetch
+// distance of the writer and the readers, compare the default ring that fits into L2 with `--large-ring`.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <boost/exception/diagnostic_information.hpp>
+#include <boost/exception/exception.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/log/expressions.hpp>  // NOLINT(misc-include-cleaner)
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+#include "../core/demultiplexer.h"
+#include "../core/reader_id.h"
+#include "../util/boost_log_util.h"
+#include "../util/hdr_histogram_util.h"
+#include "../util/perf_counters.h"
+#include "../util/shm_util.h"
+#include "../util/thread_util.h"
+#include "../util/tsc_clock.h"
+
+namespace {
+auto print_usage(const char* prog) -> void {
+  std::cerr << "Usage: " << prog
+            << " [--readers=<list>] [--sizes=<list>] [--messages=<number>] [--cores=<list>] [--blocking] [--csv]"
+            << " [--rate=<number>] [--interval-log=<dir>] [--perf] [--prefetch=<list>] [--large-ring]"
+            << " | [--merge=<list>]\n"
+            << "  where\n"
+            << "    --readers   numbers of readers to sweep, within the interval [1, "
+            << static_cast<int>(lshl::demux::core::MAX_READER_NUM) << "], default: 1,2,4,8,16,32,64\n"
+            << "    --sizes     message sizes in bytes to sweep, default: 8,16,32,...,1024\n"
+            << "    --messages  number of messages per configuration, default: 1000000\n"
+            << "    --cores     CPU cores, the writer is pinned to the first core, readers to the following cores\n"
+            << "                round-robin, no pinning if omitted\n"
+            << "    --blocking  use the blocking writer, the non-blocking writer is used by default\n"
+            << "    --csv       print comma separated values\n"
+            << "    --rate      fixed send rate, messages per second, as fast as possible if omitted\n"
+            << "    --interval-log\n"
+            << "                directory for per-second latency interval logs (HdrHistogram log format) and\n"
+            << "                wraparound timestamps, one pair of files per configuration\n"
+            << "    --perf      hardware performance counters per message around the writer and reader loops,\n"
+            << "                reader counters are averaged over the readers, see perf_event_open(2)\n"
+            << "    --prefetch  software prefetch distances in cache lines to sweep, 0 disables it, default: 0\n"
+            << "    --large-ring\n"
+            << "                16 MiB circular buffer, larger than L2, the default 64 KiB one fits into L2\n"
+            << "    --merge     merges HdrHistogram logs, e.g. written by different processes, prints the percentiles\n"
+            << "  <list> is a comma separated list of numbers (file names for --merge), e.g. 1,2,4\n";
+}
+}  // namespace
+
+namespace lshl::demux::bench {
+
+using lshl::demux::core::DemuxReader;
+using lshl::demux::core::DemuxWriter;
+using lshl::demux::core::ReaderId;
+using lshl::demux::core::WriteResult;
+using lshl::demux::util::HDR_histogram_util;
+using lshl::demux::util::HDR_interval_log;
+using lshl::demux::util::NS_IN_SECOND;
+using lshl::demux::util::PERF_EVENT_NAMES;
+using lshl::demux::util::PerfCounters;
+using lshl::demux::util::PerfCounterValues;
+using lshl::demux::util::TscClock;
+using std::array;
+using std::atomic;
+using std::size_t;
+using std::span;
+using std::uint16_t;
+using std::uint64_t;
+using std::uint8_t;
+using std::vector;
+
+using std::chrono::steady_clock;
+
+// circular buffer size in bytes, the same as in the shared memory example
+constexpr size_t SMALL_L = 16 * lshl::demux::util::LINUX_PAGE_SIZE;
+
+// `--large-ring`, several times larger than L2
+constexpr size_t LARGE_L = 16 * 1024 * 1024;
+
+// max message size
+constexpr uint16_t M = 1024;
+
+// NOLINTBEGIN(misc-non-private-member-variables-in-classes)
+struct HarnessConfig {
+  vector<uint8_t> reader_nums{1, 2, 4, 8, 16, 32, 64};
+  vector<uint16_t> message_sizes{8, 16, 32, 64, 128, 256, 512, 1024};
+  uint64_t message_num{1'000'000};
+  vector<int> cores{};
+  bool blocking{false};
+  bool csv{false};
+  uint64_t rate{0};  // messages per second, zero - as fast as possible
+  std::string interval_log{};
+  bool perf{false};
+  vector<size_t> prefetch_distances{0};
+  bool large_ring{false};
+  vector<std::string> merge{};
+};
+
+struct HarnessResult {
+  uint8_t reader_num{0};
+  uint16_t message_size{0};
+  size_t prefetch_distance{0};
+  uint64_t message_num{0};
+  std::chrono::nanoseconds elapsed{0};
+  uint64_t wraparound_num{0};
+  std::unique_ptr<HDR_histogram_util> latency = std::make_unique<HDR_histogram_util>();
+  PerfCounterValues writer_perf{};
+  PerfCounterValues reader_perf{};  // sum over all readers
+};
+// NOLINTEND(misc-non-private-member-variables-in-classes)
+
+template <class T>
+auto parse_list(const std::string& x) noexcept(false) -> vector<T> {
+  vector<T> result;
+  std::stringstream ss(x);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if constexpr (std::is_same_v<T, std::string>) {
+      result.push_back(item);
+    } else {
+      // lexical_cast<uint8_t> would parse a character
+      const auto n = boost::lexical_cast<int64_t>(item);
+      if (n < 0 || static_cast<uint64_t>(n) > static_cast<uint64_t>(std::numeric_limits<T>::max())) {
+        throw std::invalid_argument(
+            "list item must be within the inclusive interval: [0, " + std::to_string(std::numeric_limits<T>::max()) +
+            "], item: " + item
+        );
+      }
+      result.push_back(static_cast<T>(n));
+    }
+  }
+  if (result.empty()) {
+    throw std::invalid_argument("empty list: " + x);
+  }
+  return result;
+}
+
+auto parse_args(const span<char*> args) noexcept(false) -> HarnessConfig {
+  HarnessConfig result{};
+  for (const char* arg : args.subspan(1)) {
+    const std::string x(arg);
+    const size_t eq = x.find('=');
+    const std::string key = x.substr(0, eq);
+    const std::string value = eq == std::string::npos ? std::string() : x.substr(eq + 1);
+    if (key == "--readers") {
+      result.reader_nums = parse_list<uint8_t>(value);
+    } else if (key == "--sizes") {
+      result.message_sizes = parse_list<uint16_t>(value);
+    } else if (key == "--messages") {
+      result.message_num = boost::lexical_cast<uint64_t>(value);
+    } else if (key == "--cores") {
+      result.cores = parse_list<int>(value);
+    } else if (key == "--blocking") {
+      result.blocking = true;
+    } else if (key == "--csv") {
+      result.csv = true;
+    } else if (key == "--rate") {
+      result.rate = boost::lexical_cast<uint64_t>(value);
+      if (result.rate == 0 || result.rate > NS_IN_SECOND) {
+        throw std::invalid_argument(
+            "rate must be within the inclusive interval: [1, " + std::to_string(NS_IN_SECOND) + "]"
+        );
+      }
+    } else if (key == "--interval-log") {
+      result.interval_log = value;
+    } else if (key == "--perf") {
+      result.perf = true;
+    } else if (key == "--prefetch") {
+      result.prefetch_distances = parse_list<size_t>(value);
+    } else if (key == "--large-ring") {
+      result.large_ring = true;
+    } else if (key == "--merge") {
+      result.merge = parse_list<std::string>(value);
+    } else {
+      throw std::invalid_argument("unexpected argument: " + x);
+    }
+  }
+  for (const uint8_t x : result.reader_nums) {
+    lshl::demux::core::validate_reader_id(x);
+  }
+  for (const uint16_t x : result.message_sizes) {
+    if (x < sizeof(uint64_t) || x > M) {
+      throw std::invalid_argument(
+          "message size must be within the inclusive interval: [" + std::to_string(sizeof(uint64_t)) + ", " +
+          std::to_string(M) + "]"
+      );
+    }
+  }
+  return result;
+}
+
+auto pin(const vector<int>& cores, const size_t thread_index) noexcept -> void {
+  if (!cores.empty()) {
+    std::ignore = lshl::demux::util::pin_current_thread(cores[thread_index % cores.size()]);
+  }
+}
+
+/// @brief Records the value into the per-second interval histogram `k`, the intervals are allocated on demand.
+auto record_interval(vector<std::unique_ptr<HDR_histogram_util>>* intervals, const size_t k, const int64_t value)
+    noexcept(false) -> void {
+  while (intervals->size() <= k) {
+    intervals->emplace_back(std::make_unique<HDR_histogram_util>());
+  }
+  (*intervals)[k]->record_value(value);
+}
+
+auto write_interval_log(
+    const HarnessConfig& config,
+    const HarnessResult& result,
+    const uint64_t start_ns,
+    const vector<vector<std::unique_ptr<HDR_histogram_util>>>& intervals,
+    const vector<uint64_t>& wraparounds
+) noexcept(false) -> void {
+  std::string name = "demux_harness-r" + std::to_string(result.reader_num) + "-s" +
+                     std::to_string(result.message_size);
+  if (result.prefetch_distance > 0) {
+    name += "-p" + std::to_string(result.prefetch_distance);
+  }
+  const std::filesystem::path dir(config.interval_log);
+  std::filesystem::create_directories(dir);
+
+  // one log per configuration, the intervals of all readers are merged
+  HDR_interval_log log((dir / (name + ".hlog")).string(), start_ns);
+  size_t interval_num = 0;
+  for (const auto& x : intervals) {
+    interval_num = std::max(interval_num, x.size());
+  }
+  HDR_histogram_util merged{};
+  for (size_t k = 0; k < interval_num; ++k) {
+    merged.reset();
+    for (const auto& x : intervals) {
+      if (k < x.size()) {
+        merged.add(*x[k]);
+      }
+    }
+    log.write(merged, start_ns + (k * NS_IN_SECOND), start_ns + ((k + 1) * NS_IN_SECOND));
+  }
+
+  std::ofstream csv(dir / (name + "-wraparounds.csv"));
+  csv << "timestamp_ns,elapsed_sec\n";
+  for (const uint64_t x : wraparounds) {
+    csv << x << ',' << static_cast<double>(x - start_ns) / static_cast<double>(NS_IN_SECOND) << '\n';
+  }
+}
+
+template <size_t L, bool B>
+auto run(
+    const HarnessConfig& config,
+    const TscClock& clock,
+    const uint8_t reader_num,
+    const uint16_t message_size,
+    const size_t prefetch_distance
+) noexcept(false) -> HarnessResult {
+  HarnessResult result{};
+  result.reader_num = reader_num;
+  result.message_size = message_size;
+  result.prefetch_distance = prefetch_distance;
+  result.message_num = config.message_num;
+
+  const bool log_intervals = !config.interval_log.empty();
+  const uint64_t send_interval_ns = config.rate == 0 ? 0 : NS_IN_SECOND / config.rate;
+
+  const auto buffer = std::make_unique<array<uint8_t, L>>();
+  atomic<uint64_t> message_count_sync{0};
+  atomic<uint64_t> wraparound_sync{0};
+  atomic<uint64_t> ready_num{0};
+  atomic<uint64_t> start_ns{0};
+
+  DemuxWriter<L, M, B> writer(
+      ReaderId::all_readers_mask(reader_num), span{*buffer}, &message_count_sync, &wraparound_sync
+  );
+  writer.set_prefetch_distance(prefetch_distance);
+
+  vector<DemuxReader<L, M>> readers{};
+  vector<std::unique_ptr<HDR_histogram_util>> histograms{};
+  vector<vector<std::unique_ptr<HDR_histogram_util>>> intervals(reader_num);
+  vector<steady_clock::time_point> completed(reader_num);
+  vector<PerfCounterValues> reader_perf(reader_num);
+  readers.reserve(reader_num);
+  for (uint8_t i = 1; i <= reader_num; ++i) {
+    readers.emplace_back(ReaderId{i}, span{*buffer}, &message_count_sync, &wraparound_sync);
+    readers.back().set_prefetch_distance(prefetch_distance);
+    histograms.emplace_back(std::make_unique<HDR_histogram_util>());
+  }
+
+  vector<std::thread> threads{};
+  threads.reserve(reader_num);
+  for (size_t i = 0; i < reader_num; ++i) {
+    threads.emplace_back([&, i] {
+      pin(config.cores, i + 1);
+      DemuxReader<L, M>& reader = readers[i];
+      HDR_histogram_util& histogram = *histograms[i];
+      // opened by the reader thread, the counters count the calling thread only
+      std::optional<PerfCounters> perf{};
+      if (config.perf) {
+        perf.emplace();
+      }
+      ready_num.fetch_add(1);
+      uint64_t t0 = 0;
+      while ((t0 = start_ns.load()) == 0) {
+      }
+      if (perf.has_value()) {
+        perf->start();
+      }
+      for (uint64_t n = 0; n < config.message_num;) {
+        const span<uint8_t> m = reader.next();
+        if (!m.empty()) {
+          uint64_t timestamp = 0;
+          std::memcpy(&timestamp, m.data(), sizeof(uint64_t));
+          const uint64_t now = clock.now_serialized();
+          const auto latency = static_cast<int64_t>(now - timestamp);
+          histogram.record_value(latency);
+          if (log_intervals) {
+            record_interval(&intervals[i], now > t0 ? (now - t0) / NS_IN_SECOND : 0, latency);
+          }
+          n += 1;
+        }
+      }
+      completed[i] = steady_clock::now();
+      if (perf.has_value()) {
+        perf->stop();
+        reader_perf[i] = perf->read();
+      }
+    });
+  }
+
+  pin(config.cores, 0);
+  vector<uint8_t> message(message_size, 0);
+  vector<uint64_t> wraparounds{};
+  wraparounds.reserve(log_intervals ? config.message_num * message_size / L + 1 : 0);
+  std::optional<PerfCounters> perf{};
+  if (config.perf) {
+    perf.emplace();
+  }
+  while (ready_num.load() != reader_num) {
+  }
+  const steady_clock::time_point start = steady_clock::now();
+  const uint64_t t0 = clock.now();
+  start_ns.store(t0);
+  if (perf.has_value()) {
+    perf->start();
+  }
+
+  uint64_t message_count = 0;
+  for (uint64_t n = 0; n < config.message_num;) {
+    uint64_t timestamp = 0;
+    if (send_interval_ns == 0) {
+      timestamp = clock.now();
+    } else {
+      // scheduled send time, the message is late if the writer stalled
+      timestamp = t0 + (n * send_interval_ns);
+      while (clock.now() < timestamp) {
+      }
+    }
+    std::memcpy(message.data(), &timestamp, sizeof(uint64_t));
+    const WriteResult x = writer.write(message);
+    if (x == WriteResult::Success) {
+      n += 1;
+      // the wraparound marker is counted as a message
+      if (writer.message_count() - message_count > 1) {
+        result.wraparound_num += 1;
+        if (log_intervals) {
+          wraparounds.push_back(clock.now());
+        }
+      }
+      message_count = writer.message_count();
+    } else if (x == WriteResult::Error) {
+      throw std::domain_error("could not write message, size: " + std::to_string(message_size));
+    }
+  }
+  if (perf.has_value()) {
+    perf->stop();
+    result.writer_perf = perf->read();
+  }
+
+  for (std::thread& t : threads) {
+    t.join();
+  }
+
+  result.elapsed = *std::max_element(completed.begin(), completed.end()) - start;
+  for (const auto& h : histograms) {
+    result.latency->add(*h);
+  }
+  for (const PerfCounterValues& x : reader_perf) {
+    result.reader_perf += x;
+  }
+  if (log_intervals) {
+    write_interval_log(config, result, t0, intervals, wraparounds);
+  }
+  return result;
+}
+
+auto run_any(
+    const HarnessConfig& config,
+    const TscClock& clock,
+    const uint8_t reader_num,
+    const uint16_t message_size,
+    const size_t prefetch_distance
+) noexcept(false) -> HarnessResult {
+  if (config.large_ring) {
+    return config.blocking ? run<LARGE_L, true>(config, clock, reader_num, message_size, prefetch_distance)
+                           : run<LARGE_L, false>(config, clock, reader_num, message_size, prefetch_distance);
+  }
+  return config.blocking ? run<SMALL_L, true>(config, clock, reader_num, message_size, prefetch_distance)
+                         : run<SMALL_L, false>(config, clock, reader_num, message_size, prefetch_distance);
+}
+
+auto print_header(const bool csv, const bool perf) -> void {
+  const array<const char*, 14> base_columns{
+      "readers", "size",   "prefetch", "messages", "elapsed_ms", "msgs_per_sec", "MiB_per_sec",
+      "p50_ns",  "p90_ns", "p99_ns",   "p99.9_ns", "p99.99_ns",  "max_ns",       "wraparounds"
+  };
+  vector<std::string> columns(base_columns.begin(), base_columns.end());
+  if (perf) {
+    // per message, writer and average reader
+    for (const char* prefix : {"w_", "r_"}) {
+      for (const char* name : PERF_EVENT_NAMES) {
+        columns.push_back(std::string(prefix) + name);
+      }
+    }
+  }
+  constexpr int WIDTH = 13;
+  for (size_t i = 0; i < columns.size(); ++i) {
+    if (csv) {
+      std::cout << (i == 0 ? "" : ",") << columns[i];
+    } else {
+      std::cout << std::setw(WIDTH) << columns[i];
+    }
+  }
+  std::cout << '\n';
+}
+
+auto print_result(const HarnessResult& x, const bool csv, const bool perf) -> void {
+  constexpr double NS_IN_MS = 1'000'000.0;
+  constexpr double BYTES_IN_MIB = 1024.0 * 1024.0;
+  constexpr int WIDTH = 13;
+
+  const auto elapsed_ns = static_cast<double>(x.elapsed.count());
+  const double msgs_per_sec = static_cast<double>(x.message_num) * static_cast<double>(NS_IN_SECOND) / elapsed_ns;
+  const double mib_per_sec = msgs_per_sec * x.message_size / BYTES_IN_MIB;
+  const HDR_histogram_util& h = *x.latency;
+
+  std::stringstream row;
+  row << std::fixed << std::setprecision(1);
+  const auto column = [&row, csv](const auto& value, const bool first = false) {
+    if (csv) {
+      row << (first ? "" : ",") << value;
+    } else {
+      row << std::setw(WIDTH) << value;
+    }
+  };
+  column(static_cast<int>(x.reader_num), true);
+  column(x.message_size);
+  column(x.prefetch_distance);
+  column(x.message_num);
+  column(elapsed_ns / NS_IN_MS);
+  column(msgs_per_sec);
+  column(mib_per_sec);
+  column(h.value_at_percentile(50.0));
+  column(h.value_at_percentile(90.0));
+  column(h.value_at_percentile(99.0));
+  column(h.value_at_percentile(99.9));
+  column(h.value_at_percentile(99.99));
+  column(h.max());
+  column(x.wraparound_num);
+  if (perf) {
+    const auto per_message = [&column](const PerfCounterValues& values, const uint64_t n) {
+      for (const std::optional<uint64_t>& v : values.values) {
+        if (v.has_value() && n > 0) {
+          column(static_cast<double>(v.value()) / static_cast<double>(n));
+        } else {
+          column("n/a");
+        }
+      }
+    };
+    per_message(x.writer_perf, x.message_num);
+    per_message(x.reader_perf, x.message_num * x.reader_num);
+  }
+  std::cout << row.str() << std::endl;  // flush, a sweep can take a while
+}
+
+auto main_(const span<char*> args) noexcept(false) -> int {
+  constexpr int ERROR = 200;
+
+  // NOLINTNEXTLINE(misc-include-cleaner)
+  boost::log::core::get()->set_filter(boost::log::trivial::severity >= boost::log::trivial::warning);
+
+  HarnessConfig config{};
+  try {
+    config = parse_args(args);
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << '\n';
+    print_usage(args[0]);
+    return ERROR;
+  }
+
+  if (!config.merge.empty()) {
+    HDR_histogram_util merged{};
+    for (const std::string& path : config.merge) {
+      const uint64_t intervals = merged.add_log(path);
+      std::cout << "# " << path << ", intervals: " << intervals << '\n';
+    }
+    merged.print_report();
+    return 0;
+  }
+
+  const TscClock clock{lshl::demux::util::calibrate_tsc()};
+
+  const size_t ring_size = config.large_ring ? LARGE_L : SMALL_L;
+  std::cout << "# L: " << ring_size << ", M: " << M << ", writer: " << (config.blocking ? "blocking" : "non-blocking")
+            << ", hardware_concurrency: " << std::thread::hardware_concurrency()
+            << ", clock: " << (clock.is_tsc() ? "tsc" : "steady_clock") << ", rate: "
+            << (config.rate == 0 ? std::string("max") : std::to_string(config.rate)) << '\n';
+  print_header(config.csv, config.perf);
+  for (const uint16_t size : config.message_sizes) {
+    for (const uint8_t reader_num : config.reader_nums) {
+      for (const size_t prefetch : config.prefetch_distances) {
+        const HarnessResult result = run_any(config, clock, reader_num, size, prefetch);
+        print_result(result, config.csv, config.perf);
+      }
+    }
+  }
+  return 0;
+}
+
+}  // namespace lshl::demux::bench
+
+auto main(int argc, char* argv[]) noexcept -> int {
+  constexpr int ERROR = 100;
+  try {
+    const auto args = std::span<char*>(argv, static_cast<size_t>(argc));
+    return lshl::demux::bench::main_(args);
+  } catch (const boost::exception& e) {
+    LOG_ERROR << "boost::exception: " << boost::diagnostic_information(e);
+    return ERROR;
+  } catch (const std::exception& e) {
+    LOG_ERROR << "std::exception: " << e.what();
+    return ERROR;
+  } catch (...) {
+    LOG_ERROR << "unexpected exception";
+    return ERROR;
+  }
+}
@@ -0,0 +1,143 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+// One consumer thread over many channels, a `DemuxWriter` and a `DemuxReader` per channel. `*_HasNext` calls
+// `has_next` on every channel in turn, `*_Doorbell` polls a `Doorbell` and visits the rung channels only. `*_Idle` is
+// the cost of one spin over channels without messages, `*_OneActive` writes one message to one channel, round robin,
+// and finds and reads it, `items_per_second` is messages. The argument is the number of channels.
+
+#include <benchmark/benchmark.h>
+#include <array>
+#include <atomic>
+#include <boost/log/core.hpp>         // NOLINT(misc-include-cleaner)
+#include <boost/log/expressions.hpp>  // NOLINT(misc-include-cleaner)
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <vector>
+#include "../core/demultiplexer.h"
+#include "../core/reader_id.h"
+#include "../util/doorbell.h"
+
+namespace {
+
+using lshl::demux::core::DemuxReader;
+using lshl::demux::core::DemuxWriter;
+using lshl::demux::core::ReaderId;
+using lshl::demux::core::WriteResult;
+using lshl::demux::util::Doorbell;
+using lshl::demux::util::DOORBELL_MAX_CHANNELS;
+using lshl::demux::util::DoorbellPoller;
+using std::array;
+using std::atomic;
+using std::size_t;
+using std::span;
+using std::uint16_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::uint8_t;
+
+constexpr uint16_t M = 64;
+constexpr size_t L = 4 * 1024;
+constexpr uint32_t N = DOORBELL_MAX_CHANNELS;
+
+const ReaderId READER_ID{1};
+
+// the sync counters in their own cache lines, like in shared memory
+struct Channel {
+  alignas(std::hardware_destructive_interference_size) atomic<uint64_t> message_count_sync{0};
+  alignas(std::hardware_destructive_interference_size) atomic<uint64_t> wraparound_sync{0};
+  array<uint8_t, L> buffer{};
+  DemuxWriter<L, M, false> writer{READER_ID.mask(), span{buffer}, &message_count_sync, &wraparound_sync};
+  DemuxReader<L, M> reader{READER_ID, span{buffer}, &message_count_sync, &wraparound_sync};
+};
+
+auto make_channels(const int64_t n) -> std::vector<std::unique_ptr<Channel>> {
+  std::vector<std::unique_ptr<Channel>> result;
+  for (int64_t i = 0; i < n; ++i) {
+    result.push_back(std::make_unique<Channel>());
+  }
+  return result;
+}
+
+// the reader of the channel takes the wraparound marker, the message is written again
+auto write(Channel* channel, const span<uint8_t> message) -> void {
+  while (channel->writer.write(message) != WriteResult::Success) {
+    benchmark::DoNotOptimize(channel->reader.next());
+  }
+}
+
+auto BM_Idle_HasNext(benchmark::State& state) -> void {
+  const std::vector<std::unique_ptr<Channel>> channels = make_channels(state.range(0));
+  for (auto _ : state) {
+    for (const std::unique_ptr<Channel>& x : channels) {
+      benchmark::DoNotOptimize(x->reader.has_next());
+    }
+  }
+}
+
+auto BM_Idle_Doorbell(benchmark::State& state) -> void {
+  const std::vector<std::unique_ptr<Channel>> channels = make_channels(state.range(0));
+  const auto doorbell = std::make_unique<Doorbell<N>>();
+  DoorbellPoller<N> poller(doorbell.get());
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(poller.poll([&channels](const uint32_t i) { return channels[i]->reader.has_next(); }));
+  }
+}
+
+auto BM_OneActive_HasNext(benchmark::State& state) -> void {
+  const std::vector<std::unique_ptr<Channel>> channels = make_channels(state.range(0));
+  array<uint8_t, M> message{};
+  size_t k = 0;
+  for (auto _ : state) {
+    write(channels[k].get(), message);
+    k = k + 1 == channels.size() ? 0 : k + 1;
+    for (const std::unique_ptr<Channel>& x : channels) {
+      if (x->reader.has_next()) {
+        benchmark::DoNotOptimize(x->reader.next());
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+auto BM_OneActive_Doorbell(benchmark::State& state) -> void {
+  const std::vector<std::unique_ptr<Channel>> channels = make_channels(state.range(0));
+  const auto doorbell = std::make_unique<Doorbell<N>>();
+  DoorbellPoller<N> poller(doorbell.get());
+  array<uint8_t, M> message{};
+  size_t k = 0;
+  for (auto _ : state) {
+    write(channels[k].get(), message);
+    doorbell->ring(static_cast<uint32_t>(k));
+    k = k + 1 == channels.size() ? 0 : k + 1;
+    benchmark::DoNotOptimize(poller.poll([&channels](const uint32_t i) {
+      benchmark::DoNotOptimize(channels[i]->reader.next());
+      return false;
+    }));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+}  // namespace
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables, cppcoreguidelines-owning-memory)
+BENCHMARK(BM_Idle_HasNext)->RangeMultiplier(16)->Range(16, N);
+BENCHMARK(BM_Idle_Doorbell)->RangeMultiplier(16)->Range(16, N);
+BENCHMARK(BM_OneActive_HasNext)->RangeMultiplier(16)->Range(16, N);
+BENCHMARK(BM_OneActive_Doorbell)->RangeMultiplier(16)->Range(16, N);
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables, cppcoreguidelines-owning-memory)
+
+auto main(int argc, char** argv) -> int {
+  namespace logging = boost::log;
+  logging::core::get()->set_filter(logging::trivial::severity >= logging::trivial::warning);
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,199 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+// Compares plain struct `DemuxWriter::write_safe` with FlatBuffers `DownstreamPacket` serialized directly into the
+// circular buffer and with FlatBuffers serialized into a heap buffer and then copied into the circular buffer.
+// The `Write*` benchmarks use a writer without readers, wraparound never waits. The `WriteRead*` benchmarks write and
+// read one message per iteration on the same thread.
+
+#include <benchmark/benchmark.h>
+#include <flatbuffers/flatbuffers.h>
+#include <moldudp64-schema_generated.h>
+#include <array>
+#include <atomic>
+#include <boost/log/core.hpp>         // NOLINT(misc-include-cleaner)
+#include <boost/log/expressions.hpp>  // NOLINT(misc-include-cleaner)
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include "../core/demultiplexer.h"
+#include "../core/reader_id.h"
+#include "../example/moldudp64.h"
+#include "../util/flatbuffers_util.h"
+
+namespace {
+
+using lshl::demux::core::DemuxReader;
+using lshl::demux::core::DemuxWriter;
+using lshl::demux::core::ReaderId;
+using lshl::demux::core::WriteResult;
+using lshl::demux::example::build_moldudp64_packet;
+using lshl::demux::example::moldudp64_packet_capacity;
+using lshl::demux::example::MOLDUDP64_SESSION_LENGTH;
+using lshl::demux::example::MoldUdp64Session;
+using lshl::demux::example::write_moldudp64_packet;
+using ShmSequencer::DownstreamPacket;
+using std::array;
+using std::atomic;
+using std::size_t;
+using std::span;
+using std::uint16_t;
+using std::uint64_t;
+using std::uint8_t;
+
+constexpr size_t MAX_MESSAGE_LENGTH = 256;
+constexpr auto M = static_cast<uint16_t>(moldudp64_packet_capacity(MAX_MESSAGE_LENGTH));
+constexpr size_t L = 64 * 1024;
+
+constexpr MoldUdp64Session SESSION{'S', 'E', 'S', 'S', 'I', 'O', 'N', '0', '0', '1'};
+
+// the plain struct equivalent of `DownstreamPacket` carrying `N` bytes of message data
+// NOLINTBEGIN(misc-non-private-member-variables-in-classes)
+template <size_t N>
+struct DownstreamPacketStruct {
+  array<uint8_t, MOLDUDP64_SESSION_LENGTH> session;
+  uint64_t sequence_number;
+  uint16_t message_count;
+  uint16_t message_length;
+  array<uint8_t, N> message_data;
+};
+// NOLINTEND(misc-non-private-member-variables-in-classes)
+
+// heap-allocated, `L` is too big for the benchmark thread stack
+struct Ring {
+  std::unique_ptr<array<uint8_t, L>> buffer = std::make_unique<array<uint8_t, L>>();
+  atomic<uint64_t> message_count_sync{0};
+  atomic<uint64_t> wraparound_sync{0};
+};
+
+template <size_t N>
+auto make_struct(const uint64_t sequence_number) -> DownstreamPacketStruct<N> {
+  DownstreamPacketStruct<N> result{};
+  result.session = SESSION;
+  result.sequence_number = sequence_number;
+  result.message_count = 1;
+  result.message_length = N;
+  result.message_data.fill(static_cast<uint8_t>(sequence_number));
+  return result;
+}
+
+// writes until success, consumes the wraparound marker if the writer has to wait for the reader
+template <class W>
+auto write_interleaved(DemuxReader<L, M>* reader, W write) -> void {
+  while (write() != WriteResult::Success) {
+    benchmark::DoNotOptimize(reader->next());
+  }
+}
+
+template <size_t N>
+auto BM_WriteStruct(benchmark::State& state) -> void {
+  Ring ring;
+  DemuxWriter<L, M, false> writer(0, span{*ring.buffer}, &ring.message_count_sync, &ring.wraparound_sync);
+  uint64_t sequence_number = 0;
+  for (auto _ : state) {
+    const DownstreamPacketStruct<N> packet = make_struct<N>(++sequence_number);
+    while (writer.write_safe(packet) != WriteResult::Success) {
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <size_t N>
+auto BM_WriteFlatBufferZeroCopy(benchmark::State& state) -> void {
+  Ring ring;
+  DemuxWriter<L, M, false> writer(0, span{*ring.buffer}, &ring.message_count_sync, &ring.wraparound_sync);
+  const array<uint8_t, N> message{};
+  uint64_t sequence_number = 0;
+  for (auto _ : state) {
+    sequence_number += 1;
+    while (write_moldudp64_packet<DownstreamPacket>(&writer, SESSION, sequence_number, message) !=
+           WriteResult::Success) {
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <size_t N>
+auto BM_WriteFlatBufferHeapCopy(benchmark::State& state) -> void {
+  Ring ring;
+  DemuxWriter<L, M, false> writer(0, span{*ring.buffer}, &ring.message_count_sync, &ring.wraparound_sync);
+  const array<uint8_t, N> message{};
+  flatbuffers::FlatBufferBuilder fbb(M);
+  uint64_t sequence_number = 0;
+  for (auto _ : state) {
+    sequence_number += 1;
+    fbb.Clear();
+    fbb.Finish(build_moldudp64_packet<DownstreamPacket>(fbb, SESSION, sequence_number, message));
+    const span<uint8_t> packet{fbb.GetBufferPointer(), fbb.GetSize()};
+    while (writer.write(packet) != WriteResult::Success) {
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <size_t N>
+auto BM_WriteReadStruct(benchmark::State& state) -> void {
+  Ring ring;
+  const ReaderId id{1};
+  DemuxWriter<L, M, false> writer(id.mask(), span{*ring.buffer}, &ring.message_count_sync, &ring.wraparound_sync);
+  DemuxReader<L, M> reader(id, span{*ring.buffer}, &ring.message_count_sync, &ring.wraparound_sync);
+  uint64_t sequence_number = 0;
+  for (auto _ : state) {
+    const DownstreamPacketStruct<N> packet = make_struct<N>(++sequence_number);
+    write_interleaved(&reader, [&writer, &packet] { return writer.write_safe(packet); });
+    const auto x = reader.template next_unsafe<DownstreamPacketStruct<N>>();
+    benchmark::DoNotOptimize(x.value()->sequence_number);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <size_t N, bool Verify>
+auto BM_WriteReadFlatBuffer(benchmark::State& state) -> void {
+  Ring ring;
+  const ReaderId id{1};
+  DemuxWriter<L, M, false> writer(id.mask(), span{*ring.buffer}, &ring.message_count_sync, &ring.wraparound_sync);
+  DemuxReader<L, M> reader(id, span{*ring.buffer}, &ring.message_count_sync, &ring.wraparound_sync);
+  const array<uint8_t, N> message{};
+  uint64_t sequence_number = 0;
+  for (auto _ : state) {
+    sequence_number += 1;
+    write_interleaved(&reader, [&writer, sequence_number, &message] {
+      return write_moldudp64_packet<DownstreamPacket>(&writer, SESSION, sequence_number, message);
+    });
+    const span<uint8_t> m = reader.next();
+    const DownstreamPacket* packet = Verify ? lshl::demux::util::read_flatbuffer<DownstreamPacket>(m)
+                                            : lshl::demux::util::read_flatbuffer_unverified<DownstreamPacket>(m);
+    benchmark::DoNotOptimize(packet->header()->sequence_number());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+}  // namespace
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables, cppcoreguidelines-owning-memory)
+BENCHMARK_TEMPLATE(BM_WriteStruct, 8);
+BENCHMARK_TEMPLATE(BM_WriteStruct, 64);
+BENCHMARK_TEMPLATE(BM_WriteStruct, 256);
+BENCHMARK_TEMPLATE(BM_WriteFlatBufferZeroCopy, 8);
+BENCHMARK_TEMPLATE(BM_WriteFlatBufferZeroCopy, 64);
+BENCHMARK_TEMPLATE(BM_WriteFlatBufferZeroCopy, 256);
+BENCHMARK_TEMPLATE(BM_WriteFlatBufferHeapCopy, 8);
+BENCHMARK_TEMPLATE(BM_WriteFlatBufferHeapCopy, 64);
+BENCHMARK_TEMPLATE(BM_WriteFlatBufferHeapCopy, 256);
+BENCHMARK_TEMPLATE(BM_WriteReadStruct, 64);
+BENCHMARK_TEMPLATE(BM_WriteReadFlatBuffer, 64, true);
+BENCHMARK_TEMPLATE(BM_WriteReadFlatBuffer, 64, false);
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables, cppcoreguidelines-owning-memory)
+
+auto main(int argc, char** argv) -> int {
+  namespace logging = boost::log;
+  logging::core::get()->set_filter(logging::trivial::severity >= logging::trivial::warning);
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
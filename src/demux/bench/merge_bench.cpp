@@ -0,0 +1,148 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+// `MergingReader` over K inputs, one thread. Input `i` carries the timestamps `i, i + K, i + 2K...`, the merge
+// alternates between all inputs. `BM_Merge` delivers the messages in timestamp order, `BM_RoundRobin` reads the same
+// messages with the `DemuxReader`s in turn, the difference is the merge overhead per message. `items_per_second` is
+// messages, the argument is K. The refill of the drained inputs is not measured.
+
+#include <benchmark/benchmark.h>
+#include <array>
+#include <atomic>
+#include <boost/log/core.hpp>         // NOLINT(misc-include-cleaner)
+#include <boost/log/expressions.hpp>  // NOLINT(misc-include-cleaner)
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <span>
+#include <vector>
+#include "../core/demultiplexer.h"
+#include "../core/merging_reader.h"
+#include "../core/reader_id.h"
+
+namespace {
+
+using lshl::demux::core::DemuxReader;
+using lshl::demux::core::DemuxWriter;
+using lshl::demux::core::MergingReader;
+using lshl::demux::core::ReaderId;
+using lshl::demux::core::WriteResult;
+using std::array;
+using std::atomic;
+using std::size_t;
+using std::span;
+using std::uint16_t;
+using std::uint64_t;
+using std::uint8_t;
+
+struct Message {
+  uint64_t timestamp;
+  uint64_t value;
+};
+
+constexpr uint16_t M = sizeof(Message);
+constexpr size_t L = 64 * 1024;
+
+const ReaderId READER_ID{1};
+
+struct Input {
+  array<uint8_t, L> buffer{};
+  atomic<uint64_t> message_count_sync{0};
+  atomic<uint64_t> wraparound_sync{0};
+  DemuxWriter<L, M, false> writer{READER_ID.mask(), span{buffer}, &message_count_sync, &wraparound_sync};
+  DemuxReader<L, M> reader{READER_ID, span{buffer}, &message_count_sync, &wraparound_sync};
+  uint64_t written{0};
+};
+
+// K inputs, every input is filled up to its wraparound
+class Inputs {
+ public:
+  explicit Inputs(const size_t k) {
+    for (size_t i = 0; i < k; ++i) {
+      this->inputs_.push_back(std::make_unique<Input>());
+      this->readers_.push_back(&this->inputs_.back()->reader);
+    }
+  }
+
+  auto fill_up() -> void {
+    const size_t k = this->inputs_.size();
+    for (size_t i = 0; i < k; ++i) {
+      Input& x = *this->inputs_[i];
+      while (x.writer.write_safe(Message{(x.written * k) + i, x.written}) == WriteResult::Success) {
+        x.written += 1;
+      }
+    }
+  }
+
+  [[nodiscard]] auto readers() const -> span<DemuxReader<L, M>* const> { return this->readers_; }
+
+ private:
+  std::vector<std::unique_ptr<Input>> inputs_;
+  std::vector<DemuxReader<L, M>*> readers_;
+};
+
+auto timestamp(const span<uint8_t> x) noexcept -> uint64_t {
+  uint64_t result = 0;
+  std::memcpy(&result, x.data(), sizeof(result));
+  return result;
+}
+
+auto BM_Merge(benchmark::State& state) -> void {
+  Inputs inputs(static_cast<size_t>(state.range(0)));
+  // strict order, an empty input holds the others back
+  MergingReader<L, M, decltype(&timestamp)> merger(inputs.readers(), &timestamp, std::numeric_limits<uint64_t>::max());
+  inputs.fill_up();
+  for (auto _ : state) {
+    const span<uint8_t> x = merger.next(0);
+    if (x.empty()) {
+      state.PauseTiming();
+      inputs.fill_up();
+      state.ResumeTiming();
+    }
+    benchmark::DoNotOptimize(x.data());
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(merger.delivered_count()));
+}
+
+auto BM_RoundRobin(benchmark::State& state) -> void {
+  Inputs inputs(static_cast<size_t>(state.range(0)));
+  const span<DemuxReader<L, M>* const> readers = inputs.readers();
+  inputs.fill_up();
+  size_t i = 0;
+  int64_t count = 0;
+  for (auto _ : state) {
+    const span<uint8_t> x = readers[i]->next();
+    if (x.empty()) {
+      // drained or a wraparound marker, the merge skips the markers too
+      state.PauseTiming();
+      inputs.fill_up();
+      state.ResumeTiming();
+    } else {
+      i = i + 1 == readers.size() ? 0 : i + 1;
+      count += 1;
+    }
+    benchmark::DoNotOptimize(x.data());
+  }
+  state.SetItemsProcessed(count);
+}
+
+}  // namespace
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables, cppcoreguidelines-owning-memory)
+BENCHMARK(BM_Merge)->Arg(2)->Arg(8)->Arg(32);
+BENCHMARK(BM_RoundRobin)->Arg(2)->Arg(8)->Arg(32);
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables, cppcoreguidelines-owning-memory)
+
+auto main(int argc, char** argv) -> int {
+  namespace logging = boost::log;
+  logging::core::get()->set_filter(logging::trivial::severity >= logging::trivial::warning);
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
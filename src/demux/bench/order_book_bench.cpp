@@ -0,0 +1,133 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+// Reference consumer workload: `OrderBooks` applying `MarketDataUpdate`s, one thread, `items_per_second` is updates
+// per second per core. `BM_OrderBook_Apply` applies pre-generated updates, `BM_OrderBook_ReadApply` reads them from the
+// circular buffer with `DemuxReader::next_unsafe` and applies them, the difference is the reader's share of the
+// consumer's time. The argument is the number of instruments, from L1-resident books to books that spill out of L2.
+// Levels are skewed to the top of the book: level `n` gets half of the updates of level `n - 1`.
+
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <boost/log/core.hpp>         // NOLINT(misc-include-cleaner)
+#include <boost/log/expressions.hpp>  // NOLINT(misc-include-cleaner)
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <random>
+#include <span>
+#include <vector>
+#include "../core/demultiplexer.h"
+#include "../core/reader_id.h"
+#include "../example/market_data.h"
+#include "../example/order_book.h"
+
+namespace {
+
+using lshl::demux::core::DemuxReader;
+using lshl::demux::core::DemuxWriter;
+using lshl::demux::core::ReaderId;
+using lshl::demux::core::WriteResult;
+using lshl::demux::example::MarketDataUpdate;
+using lshl::demux::example::OrderBooks;
+using lshl::demux::example::Side;
+using std::array;
+using std::atomic;
+using std::size_t;
+using std::span;
+using std::uint16_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::uint8_t;
+
+constexpr size_t LEVELS = 10;
+constexpr uint16_t M = sizeof(MarketDataUpdate);
+constexpr size_t L = 1024 * 1024;
+constexpr size_t UPDATE_NUM = 64 * 1024;
+
+// deterministic, the same updates for every run
+auto generate_updates(const uint32_t instruments) -> std::vector<MarketDataUpdate> {
+  std::vector<MarketDataUpdate> result(UPDATE_NUM);
+  std::mt19937_64 engine{};
+  uint64_t timestamp = 0;
+  for (MarketDataUpdate& md : result) {
+    const uint64_t x = engine();
+    md.timestamp = ++timestamp;
+    md.instrument_id = static_cast<uint32_t>(x % instruments);
+    md.side = (x >> 32U) % 2 == 0 ? Side::Bid : Side::Ask;
+    md.level = static_cast<uint8_t>(std::min<int>(std::countr_zero(engine() | (1ULL << LEVELS)), LEVELS - 1));
+    md.price = (x >> 33U) % 100000;
+    md.size = static_cast<uint32_t>(x >> 48U);
+  }
+  return result;
+}
+
+auto BM_OrderBook_Apply(benchmark::State& state) -> void {
+  const auto instruments = static_cast<uint32_t>(state.range(0));
+  const std::vector<MarketDataUpdate> xs = generate_updates(instruments);
+  OrderBooks<LEVELS> books(instruments);
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(books.apply(xs[i]));
+    i = i + 1 == xs.size() ? 0 : i + 1;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+auto BM_OrderBook_ReadApply(benchmark::State& state) -> void {
+  const auto instruments = static_cast<uint32_t>(state.range(0));
+  const std::vector<MarketDataUpdate> xs = generate_updates(instruments);
+  OrderBooks<LEVELS> books(instruments);
+
+  const auto buffer = std::make_unique<array<uint8_t, L>>();
+  atomic<uint64_t> message_count_sync{0};
+  atomic<uint64_t> wraparound_sync{0};
+  const ReaderId id{1};
+  DemuxWriter<L, M, false> writer(id.mask(), span{*buffer}, &message_count_sync, &wraparound_sync);
+  DemuxReader<L, M> reader(id, span{*buffer}, &message_count_sync, &wraparound_sync);
+
+  // fills up the buffer, the non-blocking writer stops when it initiates wraparound
+  size_t i = 0;
+  const auto fill_up = [&] {
+    while (writer.write_safe(xs[i]) == WriteResult::Success) {
+      i = i + 1 == xs.size() ? 0 : i + 1;
+    }
+  };
+
+  fill_up();
+  for (auto _ : state) {
+    const std::optional<const MarketDataUpdate*> x = reader.next_unsafe<MarketDataUpdate>();
+    if (x.has_value()) {
+      benchmark::DoNotOptimize(books.apply(*x.value()));
+    } else {
+      // wraparound marker or drained, the refill is not measured
+      state.PauseTiming();
+      fill_up();
+      state.ResumeTiming();
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+}  // namespace
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables, cppcoreguidelines-owning-memory)
+BENCHMARK(BM_OrderBook_Apply)->RangeMultiplier(16)->Range(16, 64 * 1024);
+BENCHMARK(BM_OrderBook_ReadApply)->RangeMultiplier(16)->Range(16, 64 * 1024);
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables, cppcoreguidelines-owning-memory)
+
+auto main(int argc, char** argv) -> int {
+  namespace logging = boost::log;
+  logging::core::get()->set_filter(logging::trivial::severity >= logging::trivial::warning);
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
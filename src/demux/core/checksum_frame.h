@@ -0,0 +1,173 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#ifndef XXH_INLINE_ALL
+#define XXH_INLINE_ALL  // header-only, the hash of a short message is inlined
+#endif
+#include <xxhash.h>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include "../util/boost_log_util.h"
+#include "./demultiplexer.h"
+
+namespace lshl::demux::core {
+
+using std::size_t;
+using std::span;
+using std::uint16_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::uint8_t;
+
+/// @brief Checksum width, `uint32_t` is the lower half of the 64-bit XXH3 hash.
+template <class C>
+concept FrameChecksum = std::same_as<C, uint32_t> || std::same_as<C, uint64_t>;
+
+/// @brief XXH3 of the payload, truncated to `C`.
+template <FrameChecksum C>
+[[nodiscard]] inline auto frame_checksum(const span<const uint8_t> payload) noexcept -> C {
+  return static_cast<C>(XXH3_64bits(payload.data(), payload.size()));
+}
+
+/// @brief Writes checksummed frames: the payload followed by its XXH3 checksum, `payload.size() + sizeof(C)` bytes in
+/// the circular buffer. The checksum is a trailer, so the payload starts at the same offset as a plain message and
+/// `ChecksumReader::next_unsafe<T>` casts the same bytes as `DemuxReader::next_unsafe<T>`. The writer always fills the
+/// checksum, whether the readers verify it or not, the format is the same in every environment.
+/// @tparam `C` checksum width, `uint32_t` or `uint64_t`.
+template <FrameChecksum C, size_t L, uint16_t M, bool B>
+  requires(M > sizeof(C))
+class ChecksumWriter {
+ public:
+  /// @brief Max payload length in bytes.
+  static constexpr auto MAX_PAYLOAD = static_cast<uint16_t>(M - sizeof(C));
+
+  /// @param `writer` underlying writer, must outlive the checksum writer.
+  explicit ChecksumWriter(DemuxWriter<L, M, B>* writer) noexcept : writer_(writer) {}
+
+  /// @brief Copies the `payload` into the buffer and appends the checksum.
+  /// @return the same results as `DemuxWriter::write`, `WriteResult::Repeat` when wraparound is required, the blocking
+  /// writer never returns it.
+  [[nodiscard]] auto write(const span<const uint8_t> payload) noexcept -> WriteResult {
+    if (payload.empty() || payload.size() > MAX_PAYLOAD) {
+      LOG_ERROR << "[ChecksumWriter::write] invalid payload length: " << payload.size();
+      return WriteResult::Error;
+    }
+    const auto n = static_cast<uint16_t>(payload.size());
+    const std::optional<span<uint8_t>> x = this->allocate(n);
+    if (!x.has_value()) {
+      // the blocking writer waits for the readers, its `std::nullopt` is an error, not back-pressure
+      if constexpr (B) {
+        return WriteResult::Error;
+      } else {
+        return WriteResult::Repeat;
+      }
+    }
+    std::memcpy(x.value().data(), payload.data(), n);
+    this->commit(n);
+    return WriteResult::Success;
+  }
+
+  /// @see `DemuxWriter::write_safe`.
+  template <class T>
+    requires(sizeof(T) <= MAX_PAYLOAD && sizeof(T) != 0)
+  [[nodiscard]] auto write_safe(const T& source) noexcept -> WriteResult {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    return this->write(span<const uint8_t>{reinterpret_cast<const uint8_t*>(&source), sizeof(T)});
+  }
+
+  /// @brief Reserves `n` payload bytes, for the zero-copy serialization, the checksum is computed in `commit(n)`.
+  /// @see `DemuxWriter::allocate(n)`.
+  [[nodiscard]] auto allocate(const uint16_t n) noexcept -> std::optional<span<uint8_t>> {
+    if (n == 0 || n > MAX_PAYLOAD) {
+      LOG_ERROR << "[ChecksumWriter::allocate] invalid payload length: " << n;
+      return std::nullopt;
+    }
+    const std::optional<span<uint8_t>> x = this->writer_->allocate(static_cast<uint16_t>(n + sizeof(C)));
+    if (!x.has_value()) {
+      return std::nullopt;
+    }
+    this->frame_ = x.value();
+    return this->frame_.first(n);
+  }
+
+  /// @brief Computes the checksum of the payload reserved with `allocate(n)`, appends it and publishes the frame.
+  auto commit(const uint16_t n) noexcept -> void {
+    const C checksum = frame_checksum<C>(this->frame_.first(n));
+    std::memcpy(this->frame_.subspan(n).data(), &checksum, sizeof(C));  // the trailer can be unaligned
+    this->writer_->commit(static_cast<uint16_t>(n + sizeof(C)));
+  }
+
+ private:
+  DemuxWriter<L, M, B>* writer_;
+  span<uint8_t> frame_{};  // reserved by the last `allocate`
+};
+
+/// @brief Reads the frames of `ChecksumWriter` and, if `verify` is set, checks the checksum of every frame. A frame
+/// with a wrong checksum is logged, counted in `corrupted_count()` and still delivered, the caller decides whether to
+/// drop it. Frames shorter than the checksum are counted and skipped.
+template <FrameChecksum C, size_t L, uint16_t M>
+class ChecksumReader {
+ public:
+  /// @param `reader` underlying reader, must outlive the checksum reader.
+  /// @param `verify` `false` skips the verification, the checksum is only stripped.
+  ChecksumReader(DemuxReader<L, M>* reader, const bool verify) noexcept : reader_(reader), verify_(verify) {}
+
+  /// @brief Does not block.
+  /// @return payload without the checksum or empty span if no data available.
+  [[nodiscard]] auto next() noexcept -> const span<uint8_t> {
+    const span<uint8_t> frame = this->reader_->next();
+    if (frame.empty()) {
+      return {};
+    }
+    if (frame.size() <= sizeof(C)) {
+      this->corrupted(frame.size(), "frame is shorter than the checksum");
+      return {};
+    }
+    const size_t n = frame.size() - sizeof(C);
+    const span<uint8_t> payload = frame.first(n);
+    if (this->verify_) {
+      C expected{};
+      std::memcpy(&expected, frame.subspan(n).data(), sizeof(C));
+      if (frame_checksum<C>(payload) != expected) {
+        this->corrupted(frame.size(), "checksum mismatch");
+      }
+    }
+    return payload;
+  }
+
+  /// @see `DemuxReader::next_unsafe`, the payload length must be `sizeof(T)`.
+  template <class T>
+  [[nodiscard]] auto next_unsafe() noexcept -> std::optional<const T*> {
+    const span<uint8_t> payload = this->next();
+    if (payload.size() != sizeof(T)) {
+      return std::nullopt;
+    }
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    return reinterpret_cast<const T*>(payload.data());
+  }
+
+  /// @brief Frames with a wrong checksum or too short for one.
+  [[nodiscard]] auto corrupted_count() const noexcept -> uint64_t { return this->corrupted_count_; }
+
+  [[nodiscard]] auto verify() const noexcept -> bool { return this->verify_; }
+
+ private:
+  auto corrupted(const size_t frame_size, const char* reason) noexcept -> void {
+    this->corrupted_count_ += 1;
+    LOG_ERROR << "[ChecksumReader::next] " << reason << ", " << this->reader_->id()
+              << ", message_count: " << this->reader_->message_count() << ", frame_size: " << frame_size
+              << ", corrupted_count: " << this->corrupted_count_;
+  }
+
+  DemuxReader<L, M>* reader_;
+  bool verify_;
+  uint64_t corrupted_count_{0};
+};
+
+}  // namespace lshl::demux::core
@@ -0,0 +1,194 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <unistd.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define LSHL_DEMUX_STREAMING_COPY 1
+#endif
+
+namespace lshl::demux::core {
+
+using std::size_t;
+using std::uint8_t;
+
+// Copy kernels of `MessageBuffer::write`, see doc/adr/ADR004.md
+
+/// @brief Messages up to this size with a compile-time size are copied with `copy_fixed<N>`.
+constexpr size_t FIXED_COPY_MAX = 256;
+
+/// @brief Width of one `copy_fixed` move, one AVX2 register or two SSE2 registers.
+constexpr size_t FIXED_COPY_CHUNK = 32;
+
+/// @brief Messages from this size are copied with non-temporal stores when streaming is enabled.
+constexpr size_t STREAMING_COPY_MIN = 4096;
+
+/// @brief Streaming is enabled when the circular buffer is at least this many times larger than the LLC.
+constexpr size_t STREAMING_RING_LLC_RATIO = 4;
+
+/// @brief Copies `N` bytes with fixed-width moves, no `memcpy` call. Every chunk is a `memcpy` of a constant size,
+/// which the compiler replaces with register moves. The last chunk overlaps the previous one instead of a tail of
+/// smaller moves.
+template <size_t N>
+  requires(0 < N && N <= FIXED_COPY_MAX)
+inline auto copy_fixed(uint8_t* dst, const uint8_t* src) noexcept -> void {
+  // NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  if constexpr (N <= FIXED_COPY_CHUNK) {
+    std::memcpy(dst, src, N);
+  } else {
+    [&]<size_t... I>(std::index_sequence<I...>) {
+      (std::memcpy(dst + (I * FIXED_COPY_CHUNK), src + (I * FIXED_COPY_CHUNK), FIXED_COPY_CHUNK), ...);
+    }(std::make_index_sequence<N / FIXED_COPY_CHUNK>{});
+    if constexpr (N % FIXED_COPY_CHUNK != 0) {
+      std::memcpy(dst + N - FIXED_COPY_CHUNK, src + N - FIXED_COPY_CHUNK, FIXED_COPY_CHUNK);
+    }
+  }
+  // NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+}
+
+/// @brief Streaming copy kernel, ordered by the store width.
+enum class StreamingCopy : std::uint8_t { None, Sse2, Avx2, Avx512 };
+
+inline auto operator<<(std::ostream& os, const StreamingCopy& x) -> std::ostream& {
+  switch (x) {
+    case StreamingCopy::None:
+      os << "None";
+      break;
+    case StreamingCopy::Sse2:
+      os << "Sse2";
+      break;
+    case StreamingCopy::Avx2:
+      os << "Avx2";
+      break;
+    case StreamingCopy::Avx512:
+      os << "Avx512";
+      break;
+  }
+  return os;
+}
+
+/// @brief Last level cache size in bytes, `0` if unknown. Detected once.
+[[nodiscard]] inline auto llc_size() noexcept -> size_t {
+  static const size_t result = [] {
+    const long x = sysconf(_SC_LEVEL3_CACHE_SIZE);  // NOLINT(google-runtime-int)
+    return x > 0 ? static_cast<size_t>(x) : 0;
+  }();
+  return result;
+}
+
+#if defined(LSHL_DEMUX_STREAMING_COPY)
+
+// NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic, cppcoreguidelines-pro-type-reinterpret-cast)
+
+/// @brief Copies the bytes up to the first `W`-aligned destination address with regular stores.
+/// @return number of copied bytes, `n` if the whole message fits into the head.
+template <size_t W>
+inline auto copy_unaligned_head(uint8_t* dst, const uint8_t* src, const size_t n) noexcept -> size_t {
+  const size_t head = std::min((W - (reinterpret_cast<std::uintptr_t>(dst) & (W - 1))) & (W - 1), n);
+  std::memcpy(dst, src, head);
+  return head;
+}
+
+// The streaming kernels: the unaligned head and the tail use regular stores, the body uses unaligned loads and
+// aligned non-temporal stores. `copy_streaming` issues the `sfence`.
+
+__attribute__((target("sse2"))) inline auto stream_copy_sse2(uint8_t* dst, const uint8_t* src, const size_t n) noexcept
+    -> void {
+  constexpr size_t W = sizeof(__m128i);
+  size_t i = copy_unaligned_head<W>(dst, src, n);
+  for (; i + W <= n; i += W) {
+    _mm_stream_si128(reinterpret_cast<__m128i*>(dst + i), _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+  }
+  std::memcpy(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2"))) inline auto stream_copy_avx2(uint8_t* dst, const uint8_t* src, const size_t n) noexcept
+    -> void {
+  constexpr size_t W = sizeof(__m256i);
+  size_t i = copy_unaligned_head<W>(dst, src, n);
+  for (; i + W <= n; i += W) {
+    const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + i), x);
+  }
+  std::memcpy(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx512f"))) inline auto
+stream_copy_avx512(uint8_t* dst, const uint8_t* src, const size_t n) noexcept -> void {
+  constexpr size_t W = sizeof(__m512i);
+  size_t i = copy_unaligned_head<W>(dst, src, n);
+  for (; i + W <= n; i += W) {
+    _mm512_stream_si512(reinterpret_cast<__m512i*>(dst + i), _mm512_loadu_si512(src + i));
+  }
+  std::memcpy(dst + i, src + i, n - i);
+}
+
+// NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic, cppcoreguidelines-pro-type-reinterpret-cast)
+
+#endif
+
+/// @brief The widest streaming copy the CPU supports. Detected once.
+[[nodiscard]] inline auto detect_streaming_copy() noexcept -> StreamingCopy {
+#if defined(LSHL_DEMUX_STREAMING_COPY)
+  static const StreamingCopy result = [] {
+    if (__builtin_cpu_supports("avx512f")) {
+      return StreamingCopy::Avx512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+      return StreamingCopy::Avx2;
+    }
+    return StreamingCopy::Sse2;  // baseline of x86-64
+  }();
+  return result;
+#else
+  return StreamingCopy::None;
+#endif
+}
+
+/// @brief Streaming copy for a circular buffer of `ring_size` bytes: `detect_streaming_copy()` if the buffer is at
+/// least `STREAMING_RING_LLC_RATIO` times larger than the LLC, `StreamingCopy::None` otherwise. In a smaller buffer
+/// the readers find the message in the LLC, bypassing the cache would make them read it from memory.
+[[nodiscard]] inline auto streaming_copy_for(const size_t ring_size) noexcept -> StreamingCopy {
+  const size_t llc = llc_size();
+  if (llc == 0 || ring_size / STREAMING_RING_LLC_RATIO < llc) {
+    return StreamingCopy::None;
+  }
+  return detect_streaming_copy();
+}
+
+/// @brief Copies `n` bytes with non-temporal stores of the `kernel` width and orders them with `sfence`, the stores
+/// are visible before a following release store publishes the message. `StreamingCopy::None` is a plain `memcpy`.
+/// The `kernel` must be supported by the CPU, see `detect_streaming_copy`.
+inline auto copy_streaming(const StreamingCopy kernel, uint8_t* dst, const uint8_t* src, const size_t n) noexcept
+    -> void {
+  switch (kernel) {
+#if defined(LSHL_DEMUX_STREAMING_COPY)
+    case StreamingCopy::Sse2:
+      stream_copy_sse2(dst, src, n);
+      _mm_sfence();
+      return;
+    case StreamingCopy::Avx2:
+      stream_copy_avx2(dst, src, n);
+      _mm_sfence();
+      return;
+    case StreamingCopy::Avx512:
+      stream_copy_avx512(dst, src, n);
+      _mm_sfence();
+      return;
+#endif
+    default:
+      std::memcpy(dst, src, n);
+      return;
+  }
+}
+
+}  // namespace lshl::demux::core
@@ -3,19 +3,27 @@
 
 #pragma once
 
+#include <unistd.h>
 #include <atomic>
+#include <bit>
 #include <cassert>
+#include <chrono>
 #include <concepts>
 #include <cstdint>
 #include <cstring>
 #include <optional>
 #include <span>
+#include <stdexcept>
+#include <string>
 #include <tuple>
 #include <utility>
 #include <vector>
 #include "../util/boost_log_util.h"
+#include "./demux_control.h"
+#include "./demux_stats.h"
 #include "./message_buffer.h"
 #include "./reader_id.h"
+#include "./reader_liveness.h"
 
 namespace lshl::demux::core {
 
@@ -44,20 +52,50 @@ template <size_t L, uint16_t M, bool B>
   requires(L >= M + 2 && M > 0)
 class DemuxWriter {
  public:
+  /// @param `stats` optional stats page, the writer updates `DemuxStats::writer`, not updated if `nullptr`.
+  /// @param `control` optional control block, lets a restarted writer continue with `recover`. A new writer starts
+  /// from the beginning of the buffer, increments the epoch and resets the rest of the control block.
   DemuxWriter(
       uint64_t all_readers_mask,
       span<uint8_t, L> buffer,
       atomic<uint64_t>* message_count_sync,
-      atomic<uint64_t>* wraparound_sync
+      atomic<uint64_t>* wraparound_sync,
+      DemuxStats* stats = nullptr,
+      DemuxControl* control = nullptr
   ) noexcept
       : all_readers_mask_(all_readers_mask),
         buffer_(buffer),
         message_count_sync_(message_count_sync),
-        wraparound_sync_(wraparound_sync) {
+        wraparound_sync_(wraparound_sync),
+        stats_(stats),
+        control_(control) {
     LOG_INFO << "[DemuxWriter::constructor] L: " << L << ", M: " << M << ", B: " << B
-             << ", all_readers_mask_: " << this->all_readers_mask_;
+             << ", all_readers_mask_: " << this->all_readers_mask_ << ", stats: " << (stats != nullptr)
+             << ", control: " << (control != nullptr);
+    if (this->control_ != nullptr) {
+      this->control_->epoch.fetch_add(1);
+      this->control_->publish_lap(DemuxLap{});
+    }
+    this->publish_all_readers_mask();
   }
 
+  /// @brief Continues after a writer that stopped or crashed, on the same shared memory. Restores the reader mask,
+  /// the message count, the position and a pending wraparound from the `control` block, `message_count_sync` and the
+  /// message lengths in the buffer, increments the epoch. A message that was written but not published is lost and
+  /// overwritten. The readers keep reading, they do not need to reconnect.
+  /// A pending wraparound stays pending: the non-blocking writer returns `WriteResult::Repeat` until the readers catch
+  /// up, the first write of the blocking writer waits for them. Both evict dead readers once `set_reader_timeout` is
+  /// set, so call it before the first write.
+  /// @throw `std::domain_error` if the buffer is inconsistent with the control block, e.g. it was not written by a
+  /// writer with the same control block, or with a different `L`.
+  [[nodiscard]] static auto recover(
+      span<uint8_t, L> buffer,
+      atomic<uint64_t>* message_count_sync,
+      atomic<uint64_t>* wraparound_sync,
+      DemuxControl* control,
+      DemuxStats* stats = nullptr
+  ) noexcept(false) -> DemuxWriter;
+
   ~DemuxWriter() = default;
   DemuxWriter(const DemuxWriter&) = delete;
   auto operator=(const DemuxWriter&) -> DemuxWriter& = delete;
@@ -112,7 +150,32 @@ class DemuxWriter {
   template <class A>
     requires(sizeof(A) <= M && sizeof(A) != 0)
   auto commit() noexcept -> void {
-    this->position_ += MessageBuffer<0>::required<A>();
+    this->advance(MessageBuffer<0>::required<A>());
+    this->increment_message_count();
+  }
+
+  /// @brief Reserves `n` bytes for a message directly in the circular buffer, so it can be serialized in place.
+  /// The message becomes visible to the readers after `commit(n)`. Nothing is published if `commit` is not called,
+  /// the next `allocate` or `write` reuses the reserved space.
+  /// @param `n` message length in bytes.
+  /// @return the reserved bytes or `std::nullopt`, the non-blocking writer returns `std::nullopt` when wraparound is
+  /// required, retry it the same way as `WriteResult::Repeat`.
+  [[nodiscard]] auto allocate(const uint16_t n) noexcept -> std::optional<span<uint8_t>> {
+    if (n == 0 || n > M) {
+      LOG_ERROR << "[DemuxWriter::allocate] invalid message length: " << n;
+      return std::nullopt;
+    }
+    if constexpr (B) {
+      return this->allocate_blocking(n, 1);
+    } else {
+      return this->allocate_non_blocking(n);
+    }
+  }
+
+  /// @brief Publishes the message reserved with `allocate(n)`.
+  /// @param `n` message length in bytes, must be equal to the allocated length.
+  auto commit(const uint16_t n) noexcept -> void {
+    this->advance(sizeof(message_length_t) + n);
     this->increment_message_count();
   }
 
@@ -130,20 +193,101 @@ class DemuxWriter {
     }
   }
 
+  /// @brief Writes/copies all `messages` into the buffer and publishes them to the readers with a single
+  /// `message_count_sync_` update instead of one update per message. The blocking writer waits for the readers
+  /// during a wraparound. The non-blocking writer stops at the first message that requires a wraparound.
+  /// @param `messages` messages that will be copied into the circular buffer, in order.
+  /// @return the number of written messages, the written messages are always a prefix of `messages`. Resend the
+  /// remaining ones when the result is less than `messages.size()`.
+  [[nodiscard]] auto write_batch(const span<const span<uint8_t>>& messages) noexcept -> size_t;
+
   [[nodiscard]] auto message_count() const noexcept -> uint64_t { return this->message_count_; }
 
+  /// @brief Software prefetch for writing: every write keeps the cache lines up to `lines` ahead of the position
+  /// prefetched, so the stores do not wait for the lines the readers last held in the shared state. `0` disables it,
+  /// the default. See `MessageBuffer::prefetch_ahead`, measure with `demux_harness --prefetch`.
+  auto set_prefetch_distance(const size_t lines) noexcept -> void { this->prefetch_distance_ = lines; }
+
+  [[nodiscard]] auto prefetch_distance() const noexcept -> size_t { return this->prefetch_distance_; }
+
   [[nodiscard]] auto is_registered_reader(const ReaderId& id) const noexcept -> bool {
     return this->all_readers_mask_ & id.mask();
   }
 
-  auto add_reader(const ReaderId& id) noexcept -> void { this->all_readers_mask_ |= id.mask(); }
+  auto add_reader(const ReaderId& id) noexcept -> void {
+    this->all_readers_mask_ |= id.mask();
+    this->publish_all_readers_mask();
+  }
 
-  auto remove_reader(const ReaderId& id) noexcept -> void { this->all_readers_mask_ &= ~id.mask(); }
+  auto remove_reader(const ReaderId& id) noexcept -> void {
+    this->all_readers_mask_ &= ~id.mask();
+    this->publish_all_readers_mask();
+  }
+
+  /// @brief Enables the eviction of dead readers: a reader that holds up a wraparound, made no progress for the
+  /// `timeout` and whose process is gone is removed with `remove_reader`, so one crashed reader does not stop the
+  /// writer. Requires the stats page, the readers publish their progress and PID there. `0` disables it, the default.
+  /// See `ReaderLiveness`.
+  auto set_reader_timeout(const std::chrono::nanoseconds timeout) noexcept -> void {
+    if (timeout.count() > 0 && this->stats_ == nullptr) {
+      LOG_WARNING << "[DemuxWriter::set_reader_timeout] no stats page, dead readers are not evicted";
+    }
+    this->liveness_.set_timeout_ns(timeout.count() > 0 ? static_cast<uint64_t>(timeout.count()) : 0);
+  }
+
+  [[nodiscard]] auto reader_timeout() const noexcept -> std::chrono::nanoseconds {
+    return std::chrono::nanoseconds(this->liveness_.timeout_ns());
+  }
+
+  /// @brief Removes the dead readers that hold up the pending wraparound, see `set_reader_timeout`. The writes call it
+  /// while they wait for the readers, call it from a loop that polls `wraparound_pending()` instead of writing.
+  /// @return mask of the evicted readers.
+  auto evict_dead_readers() noexcept -> uint64_t;
 
   /// @brief Returns lagging readers, based on `wraparound_sync_` and `all_readers_mask_`.
   /// iterates over 64bits.
   [[nodiscard]] auto lagging_readers() const noexcept -> std::vector<ReaderId>;
 
+  //
+  // Back-pressure queries. Cheap, they do not write to the buffer and do not initiate a wraparound, so the caller can
+  // decide whether to conflate, drop or spill a message before it decodes or serializes it.
+  //
+
+  /// @brief Bytes that can be written before the next wraparound, a message of `n` bytes takes `n + 2` bytes. Zero
+  /// while a wraparound is pending, `L` when all readers have caught up and the next write completes the wraparound.
+  [[nodiscard]] auto free_bytes() const noexcept -> size_t {
+    if (this->wraparound_) {
+      return this->all_readers_caught_up() ? L : 0;
+    }
+    return this->buffer_.remaining(this->position_);
+  }
+
+  /// @brief `true` if a message of `n` bytes can be written now without `WriteResult::Repeat`.
+  [[nodiscard]] auto can_write(const uint16_t n) const noexcept -> bool {
+    return sizeof(message_length_t) + n <= this->free_bytes();
+  }
+
+  /// @brief `true` if the writer initiated a wraparound and waits for one or more readers to catch up, all writes
+  /// return `WriteResult::Repeat` until then.
+  [[nodiscard]] auto wraparound_pending() const noexcept -> bool {
+    return this->wraparound_ && !this->all_readers_caught_up();
+  }
+
+  /// @brief Readers that hold up the pending wraparound, zero if no wraparound is pending. Does not allocate, unlike
+  /// `lagging_readers`.
+  [[nodiscard]] auto lagging_readers_mask() const noexcept -> uint64_t {
+    return this->wraparound_ ? ~this->wraparound_sync_->load() & this->all_readers_mask_ : 0;
+  }
+
+  /// @brief Estimated lag of the slowest registered reader, from the stats page. `std::nullopt` without the stats page
+  /// or registered readers. The pending wraparound completes after the slowest reader has read `bytes`.
+  [[nodiscard]] auto slowest_reader_lag() const noexcept -> std::optional<ReaderLag> {
+    if (this->stats_ == nullptr) {
+      return std::nullopt;
+    }
+    return this->stats_->slowest_reader(this->all_readers_mask_);
+  }
+
 #ifdef UNIT_TEST
 
   auto position() const noexcept -> size_t { return this->position_; }
@@ -154,15 +298,19 @@ class DemuxWriter {
 
  private:
   /// @brief Blocks/busy-spins while waiting for readers to catch up during a wraparound.
+  /// @tparam `E` the span extent, a compile-time message size selects the fixed-size copy of `MessageBuffer::write`.
   /// @param `source` message to write.
   /// @param recursion_level.
   /// @return WriteResult.
-  [[nodiscard]] auto write_blocking(const span<uint8_t>& source, uint8_t recursion_level) noexcept -> WriteResult;
+  template <size_t E>
+  [[nodiscard]] auto write_blocking(const span<uint8_t, E>& source, uint8_t recursion_level) noexcept -> WriteResult;
 
   /// @brief does not block while waiting for readers to catch up, returns `WriteResult::Repeat` instead.
+  /// @tparam `E` the span extent, see `write_blocking`.
   /// @param `source` message to write.
   /// @return `WriteResult`.
-  [[nodiscard]] auto write_non_blocking(const span<uint8_t>& source) noexcept -> WriteResult;
+  template <size_t E>
+  [[nodiscard]] auto write_non_blocking(const span<uint8_t, E>& source) noexcept -> WriteResult;
 
   /// @brief Blocks/busy-spins while waiting for readers to catch up during a wraparound.
   /// @param recursion_level.
@@ -177,17 +325,68 @@ class DemuxWriter {
     requires(std::default_initializable<A> && sizeof(A) != 0 && sizeof(A) <= M)
   [[nodiscard]] inline auto allocate_non_blocking() noexcept -> std::optional<A*>;
 
+  [[nodiscard]] auto allocate_blocking(uint16_t n, uint8_t recursion_level) noexcept -> std::optional<span<uint8_t>>;
+
+  [[nodiscard]] auto allocate_non_blocking(uint16_t n) noexcept -> std::optional<span<uint8_t>>;
+
   auto wait_for_readers_to_catch_up_and_wraparound() noexcept -> void;
 
+  // busy-waits for the readers, evicts dead readers, see `set_reader_timeout`
+  auto wait_for_readers_and_complete_wraparound() noexcept -> void;
+
+  // the blocking writer completes a wraparound within a call, only `recover` leaves one pending between the calls
+  auto complete_pending_wraparound() noexcept -> void {
+    if (this->wraparound_) [[unlikely]] {
+      this->wait_for_readers_and_complete_wraparound();
+    }
+  }
+
   inline auto initiate_wraparound() noexcept -> void;
 
   inline auto complete_wraparound() noexcept -> void;
 
-  [[nodiscard]] auto all_readers_caught_up() noexcept -> bool;
+  [[nodiscard]] auto all_readers_caught_up() const noexcept -> bool;
+
+  // the check of a stalled writer, evicts the dead readers when the live ones have caught up
+  [[nodiscard]] auto all_readers_caught_up_or_evict() noexcept -> bool {
+    return this->all_readers_caught_up() || (this->evict_dead_readers() != 0 && this->all_readers_caught_up());
+  }
 
   auto increment_message_count() noexcept -> void {
     this->message_count_ += 1;
+    this->publish_message_count();
+  }
+
+  auto publish_message_count() noexcept -> void {
     this->message_count_sync_->store(this->message_count_);
+    if (this->stats_ != nullptr) {
+      this->stats_->writer.message_count.store(this->message_count_, std::memory_order_relaxed);
+      this->stats_->writer.byte_count.store(this->wrapped_byte_count_ + this->position_, std::memory_order_relaxed);
+    }
+  }
+
+  auto publish_all_readers_mask() noexcept -> void {
+    if (this->stats_ != nullptr) {
+      this->stats_->writer.all_readers_mask.store(this->all_readers_mask_, std::memory_order_relaxed);
+    }
+    if (this->control_ != nullptr) {
+      this->control_->all_readers_mask.store(this->all_readers_mask_);
+    }
+  }
+
+  auto count_repeat() noexcept -> void {
+    if (this->stats_ != nullptr) {
+      increment(&this->stats_->writer.repeat_count);
+    }
+  }
+
+  // moves the position past a written message and prefetches the lines ahead of it
+  auto advance(const size_t n) noexcept -> void {
+    const size_t from = this->position_;
+    this->position_ += n;
+    if (this->prefetch_distance_ > 0) {
+      this->buffer_.template prefetch_ahead<true>(from, this->position_, this->prefetch_distance_);
+    }
   }
 
   uint64_t all_readers_mask_;
@@ -198,6 +397,12 @@ class DemuxWriter {
   bool wraparound_{false};
   atomic<uint64_t>* message_count_sync_;
   atomic<uint64_t>* wraparound_sync_;
+  DemuxStats* stats_;
+  DemuxControl* control_;
+  uint64_t wrapped_byte_count_{0};  // bytes written in all completed laps
+  uint64_t wraparound_start_ns_{0};
+  size_t prefetch_distance_{0};
+  ReaderLiveness liveness_{};
 };
 
 /// @brief Demultiplexer reader. Should be mapped into shared memory allocated by DemuxWriter.
@@ -207,18 +412,26 @@ template <size_t L, uint16_t M>
   requires(L >= M + 2 && M > 0)
 class DemuxReader {
  public:
+  /// @param `stats` optional reader counters, see `DemuxStats::reader`, not updated if `nullptr`.
   DemuxReader(
       const ReaderId& reader_id,
       const span<uint8_t, L> buffer,
       const atomic<uint64_t>* message_count_sync,
-      atomic<uint64_t>* wraparound_sync
+      atomic<uint64_t>* wraparound_sync,
+      ReaderStats* stats = nullptr
   ) noexcept
       : id_(reader_id),
         mask_(reader_id.mask()),
         buffer_(buffer),
         message_count_sync_(message_count_sync),
-        wraparound_sync_(wraparound_sync) {
-    LOG_INFO << "[DemuxReader::constructor] L: " << L << ", M: " << M << ", " << this->id_;
+        wraparound_sync_(wraparound_sync),
+        stats_(stats) {
+    LOG_INFO << "[DemuxReader::constructor] L: " << L << ", M: " << M << ", " << this->id_
+             << ", stats: " << (stats != nullptr);
+    if (this->stats_ != nullptr) {
+      // lets the writer tell a dead reader from a slow one, see `ReaderLiveness`
+      this->stats_->pid.store(static_cast<uint64_t>(::getpid()), std::memory_order_relaxed);
+    }
   }
 
   ~DemuxReader() = default;
@@ -260,6 +473,63 @@ class DemuxReader {
 
   [[nodiscard]] auto message_count() const noexcept -> uint64_t { return this->read_message_count_; }
 
+  /// @brief Messages published by the writer and not read yet, including the wraparound markers. One atomic load.
+  [[nodiscard]] auto lag() const noexcept -> uint64_t {
+    return this->message_count_sync_->load() - this->read_message_count_;
+  }
+
+  /// @brief Byte offset of the next message in the circular buffer.
+  [[nodiscard]] auto position() const noexcept -> size_t { return this->position_; }
+
+  /// @brief Bytes read in all laps, including the 2-byte message lengths, `ReaderStats::byte_count`.
+  [[nodiscard]] auto byte_count() const noexcept -> uint64_t { return this->wrapped_byte_count_ + this->position_; }
+
+  /// @brief Software prefetch of the messages ahead: `next()` keeps the cache lines up to `lines` past the next message
+  /// prefetched, see `MessageBuffer::prefetch_ahead`. `0` disables it, the default. 1..2 lines is usually enough for a
+  /// sequential reader, measure with `demux_harness --prefetch`.
+  auto set_prefetch_distance(const size_t lines) noexcept -> void { this->prefetch_distance_ = lines; }
+
+  [[nodiscard]] auto prefetch_distance() const noexcept -> size_t { return this->prefetch_distance_; }
+
+  /// @brief Continues reading from the `message_count`, `position` and `byte_count` of another reader, e.g. the
+  /// cursor published with a last-value cache snapshot. For a restarted or late-joining reader, it must be registered
+  /// with the writer before the call: the writer then cannot start a new lap before this reader reaches the wraparound
+  /// marker. Rejects a stale cursor, whose messages may have been overwritten: the cursor must be in the lap the writer
+  /// writes (`DemuxControl::lap()`), or right after the wraparound marker the writer waits at. Publishes the stats, the
+  /// lag is correct right away.
+  /// @param `control` the control block of the writer.
+  /// @return `false` if the cursor is stale, the reader is not changed, take a new snapshot and try again.
+  [[nodiscard]] auto resume_from(
+      const uint64_t message_count,
+      const size_t position,
+      const uint64_t byte_count,
+      const DemuxControl& control
+  ) noexcept -> bool {
+    assert(position <= L && position <= byte_count);
+    const DemuxLap lap = control.lap();
+    const uint64_t published = this->message_count_sync_->load();
+    const bool same_lap = byte_count - position == lap.wrapped_byte_count && lap.start_count <= message_count &&
+                          message_count <= published;
+    // the writer waits for this reader too, the marker is read on behalf of it
+    const bool after_marker = position == 0 && message_count == published && byte_count > lap.wrapped_byte_count;
+    if (!same_lap && !after_marker) {
+      LOG_WARNING << "[DemuxReader::resume_from] stale cursor, " << this->id_ << ", message_count: " << message_count
+                  << ", position: " << position << ", byte_count: " << byte_count << ", " << control;
+      return false;
+    }
+    this->read_message_count_ = message_count;
+    this->available_message_count_ = message_count;
+    this->position_ = position;
+    this->wrapped_byte_count_ = byte_count - position;
+    if (!same_lap) {
+      this->wraparound_sync_->fetch_or(this->mask_);
+    }
+    if (this->stats_ != nullptr) {
+      this->publish_stats();
+    }
+    return true;
+  }
+
  private:
   // NOLINTBEGIN(cppcoreguidelines-avoid-const-or-ref-data-members)
   const ReaderId id_;
@@ -272,17 +542,29 @@ class DemuxReader {
   const MessageBuffer<L> buffer_;  // read only buffer
   const atomic<uint64_t>* message_count_sync_;
   atomic<uint64_t>* wraparound_sync_;
+  ReaderStats* stats_;
+  uint64_t wrapped_byte_count_{0};  // bytes read in all completed laps
+  uint64_t wraparound_start_ns_{0};
+  size_t prefetch_distance_{0};
   // NOLINTEND(cppcoreguidelines-avoid-const-or-ref-data-members)
+
+  auto publish_stats() noexcept -> void {
+    this->stats_->message_count.store(this->read_message_count_, std::memory_order_relaxed);
+    this->stats_->byte_count.store(this->wrapped_byte_count_ + this->position_, std::memory_order_relaxed);
+    this->stats_->position.store(this->position_, std::memory_order_relaxed);
+  }
 };
 
 template <size_t L, uint16_t M, bool B>
   requires(L >= M + 2 && M > 0)
-auto DemuxWriter<L, M, B>::write_blocking(const span<uint8_t>& source, uint8_t recursion_level) noexcept
+template <size_t E>
+auto DemuxWriter<L, M, B>::write_blocking(const span<uint8_t, E>& source, uint8_t recursion_level) noexcept
     -> WriteResult {
+  this->complete_pending_wraparound();
   // it either writes the entire message or nothing
   const size_t written = this->buffer_.write(this->position_, source);
   if (written > 0) {
-    this->position_ += written;
+    this->advance(written);
     this->increment_message_count();
     return WriteResult::Success;
   } else {
@@ -298,7 +580,8 @@ auto DemuxWriter<L, M, B>::write_blocking(const span<uint8_t>& source, uint8_t r
 
 template <size_t L, uint16_t M, bool B>
   requires(L >= M + 2 && M > 0)
-auto DemuxWriter<L, M, B>::write_non_blocking(const span<uint8_t>& source) noexcept -> WriteResult {
+template <size_t E>
+auto DemuxWriter<L, M, B>::write_non_blocking(const span<uint8_t, E>& source) noexcept -> WriteResult {
   const size_t n = source.size();
 
   if (n == 0 || n > M) {
@@ -307,9 +590,10 @@ auto DemuxWriter<L, M, B>::write_non_blocking(const span<uint8_t>& source) noexc
   }
 
   if (this->wraparound_) {
-    if (this->all_readers_caught_up()) {
+    if (this->all_readers_caught_up_or_evict()) {
       this->complete_wraparound();
     } else {
+      this->count_repeat();
       return WriteResult::Repeat;
     }
   }
@@ -317,20 +601,74 @@ auto DemuxWriter<L, M, B>::write_non_blocking(const span<uint8_t>& source) noexc
   // writes the entire message or nothing
   const size_t written = this->buffer_.write(this->position_, source);
   if (written > 0) {
-    this->position_ += written;
+    this->advance(written);
     this->increment_message_count();
     return WriteResult::Success;
   } else {
     this->initiate_wraparound();
+    this->count_repeat();
     return WriteResult::Repeat;
   }
 }
+
+template <size_t L, uint16_t M, bool B>
+  requires(L >= M + 2 && M > 0)
+auto DemuxWriter<L, M, B>::write_batch(const span<const span<uint8_t>>& messages) noexcept -> size_t {
+  if constexpr (B) {
+    this->complete_pending_wraparound();
+  } else {
+    if (this->wraparound_) {
+      if (this->all_readers_caught_up_or_evict()) {
+        this->complete_wraparound();
+      } else {
+        this->count_repeat();
+        return 0;
+      }
+    }
+  }
+
+  size_t result = 0;
+  for (const span<uint8_t>& source : messages) {
+    const size_t n = source.size();
+    if (n == 0 || n > M) {
+      LOG_ERROR << "[DemuxWriter::write_batch] invalid message length: " << n;
+      break;
+    }
+
+    // writes the entire message or nothing, the message is not visible to the readers until it is published
+    size_t written = this->buffer_.write(this->position_, source);
+    if (written == 0) {
+      // initiate_wraparound publishes all messages written so far together with the end of buffer marker
+      if constexpr (B) {
+        this->wait_for_readers_to_catch_up_and_wraparound();
+        written = this->buffer_.write(this->position_, source);
+        if (written == 0) {
+          LOG_ERROR << "[DemuxWriter::write_batch] could not write after wraparound, message length: " << n;
+          break;
+        }
+      } else {
+        this->initiate_wraparound();
+        this->count_repeat();
+        break;
+      }
+    }
+
+    this->advance(written);
+    this->message_count_ += 1;
+    result += 1;
+  }
+
+  this->publish_message_count();
+  return result;
+}
+
 template <size_t L, uint16_t M, bool B>
   requires(L >= M + 2 && M > 0)
 template <class A>
   requires(std::default_initializable<A> && sizeof(A) != 0 && sizeof(A) <= M)
 [[nodiscard]] inline auto DemuxWriter<L, M, B>::allocate_blocking(uint8_t recursion_level) noexcept
     -> std::optional<A*> {
+  this->complete_pending_wraparound();
   std::optional<A*> result = this->buffer_.template allocate<A>(this->position_);
   if (result.has_value()) {
     return result;
@@ -351,9 +689,10 @@ template <class A>
   requires(std::default_initializable<A> && sizeof(A) != 0 && sizeof(A) <= M)
 [[nodiscard]] inline auto DemuxWriter<L, M, B>::allocate_non_blocking() noexcept -> std::optional<A*> {
   if (this->wraparound_) {
-    if (this->all_readers_caught_up()) {
+    if (this->all_readers_caught_up_or_evict()) {
       this->complete_wraparound();
     } else {
+      this->count_repeat();
       return std::nullopt;
     }
   }
@@ -361,7 +700,108 @@ template <class A>
   auto result = this->buffer_.template allocate<A>(this->position_);
   if (!result.has_value()) {
     this->initiate_wraparound();
+    this->count_repeat();
+  }
+  return result;
+}
+
+template <size_t L, uint16_t M, bool B>
+  requires(L >= M + 2 && M > 0)
+auto DemuxWriter<L, M, B>::allocate_blocking(const uint16_t n, uint8_t recursion_level) noexcept
+    -> std::optional<span<uint8_t>> {
+  this->complete_pending_wraparound();
+  std::optional<span<uint8_t>> result = this->buffer_.allocate(this->position_, n);
+  if (result.has_value()) {
+    return result;
+  } else {
+    if (recursion_level > 1) {
+      LOG_ERROR << "[DemuxWriter::allocate_blocking] recursion_level: " << recursion_level;
+      return std::nullopt;
+    } else {
+      this->wait_for_readers_to_catch_up_and_wraparound();
+      return this->allocate_blocking(n, recursion_level + 1);
+    }
+  }
+}
+
+template <size_t L, uint16_t M, bool B>
+  requires(L >= M + 2 && M > 0)
+auto DemuxWriter<L, M, B>::allocate_non_blocking(const uint16_t n) noexcept -> std::optional<span<uint8_t>> {
+  if (this->wraparound_) {
+    if (this->all_readers_caught_up_or_evict()) {
+      this->complete_wraparound();
+    } else {
+      this->count_repeat();
+      return std::nullopt;
+    }
+  }
+
+  std::optional<span<uint8_t>> result = this->buffer_.allocate(this->position_, n);
+  if (!result.has_value()) {
+    this->initiate_wraparound();
+    this->count_repeat();
+  }
+  return result;
+}
+
+template <size_t L, uint16_t M, bool B>
+  requires(L >= M + 2 && M > 0)
+auto DemuxWriter<L, M, B>::recover(
+    span<uint8_t, L> buffer,
+    atomic<uint64_t>* message_count_sync,
+    atomic<uint64_t>* wraparound_sync,
+    DemuxControl* control,
+    DemuxStats* stats
+) noexcept(false) -> DemuxWriter {
+  // read before the constructor resets the control block
+  const uint64_t message_count = message_count_sync->load();
+  const DemuxLap lap = control->lap();
+  const uint64_t lap_start_count = lap.start_count;
+  const uint64_t wrapped_byte_count = lap.wrapped_byte_count;
+  if (lap_start_count > message_count) {
+    throw std::domain_error(
+        "[DemuxWriter::recover] lap_start_count: " + std::to_string(lap_start_count) +
+        " is greater than message_count: " + std::to_string(message_count)
+    );
+  }
+
+  DemuxWriter result(control->all_readers_mask.load(), buffer, message_count_sync, wraparound_sync, stats, control);
+
+  // walk the messages published in the current lap, a wraparound marker can only be the last one
+  size_t position = 0;
+  bool wraparound = false;
+  for (uint64_t i = lap_start_count; i < message_count; ++i) {
+    if (wraparound) {
+      throw std::domain_error(
+          "[DemuxWriter::recover] message after the wraparound marker, message_count: " + std::to_string(i)
+      );
+    }
+    const span<uint8_t> x = result.buffer_.read(position);
+    if (x.empty()) {
+      wraparound = true;  // zero-length messages are never written, see `write`
+    } else if (x.size() > M || position + sizeof(message_length_t) + x.size() > L) {
+      throw std::domain_error(
+          "[DemuxWriter::recover] invalid message length: " + std::to_string(x.size()) +
+          ", position: " + std::to_string(position) + ", message_count: " + std::to_string(i)
+      );
+    } else {
+      position += sizeof(message_length_t) + x.size();
+    }
+  }
+
+  result.position_ = position;
+  result.message_count_ = message_count;
+  result.wraparound_ = wraparound;
+  result.wrapped_byte_count_ = wrapped_byte_count;
+  if (wraparound && stats != nullptr) {
+    // the wait of the crashed writer is lost, the wait is counted from here
+    result.wraparound_start_ns_ = stats_clock_ns();
   }
+  control->publish_lap(lap);
+  result.publish_message_count();
+  LOG_WARNING << "[DemuxWriter::recover] " << *control << ", message_count: " << message_count
+              << ", position: " << position << ", wraparound: " << wraparound
+              << ", wraparound_sync: " << wraparound_sync->load();
   return result;
 }
 
@@ -373,8 +813,14 @@ auto DemuxWriter<L, M, B>::wait_for_readers_to_catch_up_and_wraparound() noexcep
   LOG_DEBUG << "[DemuxWriter::wait_for_readers_to_catch_up_and_wraparound] message_count_: " << this->message_count_
             << ", position_: " << this->position_ << " ... waiting ...";
 
+  this->wait_for_readers_and_complete_wraparound();
+}
+
+template <size_t L, uint16_t M, bool B>
+  requires(L >= M + 2 && M > 0)
+auto DemuxWriter<L, M, B>::wait_for_readers_and_complete_wraparound() noexcept -> void {
   // busy-wait
-  while (!this->all_readers_caught_up()) {
+  while (!this->all_readers_caught_up_or_evict()) {
   }
 
   this->complete_wraparound();
@@ -388,27 +834,71 @@ inline auto DemuxWriter<L, M, B>::initiate_wraparound() noexcept -> void {
   this->wraparound_sync_->store(0);
   std::ignore = this->buffer_.write(this->position_, {});
   this->increment_message_count();
+  if (this->stats_ != nullptr) {
+    increment(&this->stats_->writer.wraparound_count);
+    this->wraparound_start_ns_ = stats_clock_ns();
+  }
 }
 
 template <size_t L, uint16_t M, bool B>
   requires(L >= M + 2 && M > 0)
 inline auto DemuxWriter<L, M, B>::complete_wraparound() noexcept -> void {
+  this->wrapped_byte_count_ += this->position_;
   this->position_ = 0;
   this->wraparound_ = false;
+  if (this->control_ != nullptr) {
+    // before the first message of the lap is published, `recover` walks the lap from here
+    this->control_->publish_lap(DemuxLap{this->message_count_, this->wrapped_byte_count_});
+  }
+  if (this->stats_ != nullptr) {
+    increment(&this->stats_->writer.wraparound_wait_ns, stats_clock_ns() - this->wraparound_start_ns_);
+  }
 }
 
 template <size_t L, uint16_t M, bool B>
   requires(L >= M + 2 && M > 0)
-inline auto DemuxWriter<L, M, B>::all_readers_caught_up() noexcept -> bool {
+inline auto DemuxWriter<L, M, B>::all_readers_caught_up() const noexcept -> bool {
+  // a reader removed during the wraparound can still set its bit
   const uint64_t x = this->wraparound_sync_->load();
-  return x == this->all_readers_mask_;
+  return (x & this->all_readers_mask_) == this->all_readers_mask_;
+}
+
+template <size_t L, uint16_t M, bool B>
+  requires(L >= M + 2 && M > 0)
+auto DemuxWriter<L, M, B>::evict_dead_readers() noexcept -> uint64_t {
+  if (this->stats_ == nullptr || this->liveness_.timeout_ns() == 0) {
+    return 0;
+  }
+  const uint64_t lagging = this->lagging_readers_mask();
+  if (lagging == 0) {
+    return 0;
+  }
+  const uint64_t now = stats_clock_ns();
+  const uint64_t dead = this->liveness_.dead_readers(*this->stats_, lagging, now);
+  if (dead == 0) {
+    return 0;
+  }
+  for (uint64_t mask = dead; mask != 0; mask &= mask - 1) {
+    const auto i = static_cast<uint8_t>(std::countr_zero(mask));
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-constant-array-index)
+    const ReaderStats& reader = this->stats_->readers[i];
+    LOG_WARNING << "[DemuxWriter::evict_dead_readers] evicting reader: " << (i + 1)
+                << ", pid: " << reader.pid.load(std::memory_order_relaxed)
+                << ", message_count: " << reader.message_count.load(std::memory_order_relaxed)
+                << ", writer message_count: " << this->message_count_
+                << ", idle_ns: " << this->liveness_.idle_ns(ReaderId{static_cast<uint8_t>(i + 1)}, now);
+  }
+  this->all_readers_mask_ &= ~dead;
+  this->publish_all_readers_mask();
+  increment(&this->stats_->writer.evicted_count, static_cast<uint64_t>(std::popcount(dead)));
+  return dead;
 }
 
 template <size_t L, uint16_t M, bool B>
   requires(L >= M + 2 && M > 0)
 [[nodiscard]] auto DemuxWriter<L, M, B>::lagging_readers() const noexcept -> std::vector<ReaderId> {
   const uint64_t reader_ids = this->wraparound_sync_->load();
-  const uint64_t lagging_reader_ids = reader_ids ^ this->all_readers_mask_;
+  const uint64_t lagging_reader_ids = ~reader_ids & this->all_readers_mask_;
   return mask_to_reader_ids(lagging_reader_ids);
 }
 
@@ -428,12 +918,23 @@ template <size_t L, uint16_t M>
   assert(msg_size <= M);
 
   if (msg_size > 0) {
+    const size_t from = this->position_;
     this->position_ += msg_size;
     this->position_ += sizeof(uint16_t);
+    if (this->prefetch_distance_ > 0) {
+      this->buffer_.template prefetch_ahead<false>(from, this->position_, this->prefetch_distance_);
+    }
     LOG_DEBUG << "[DemuxReader::next()] continue, " << this->id_
               << ", read_message_count_: " << this->read_message_count_
               << ", available_message_count_: " << this->available_message_count_ << ", position_: " << this->position_;
     assert(this->position_ <= L);
+    if (this->stats_ != nullptr) {
+      if (this->wraparound_start_ns_ != 0) {
+        increment(&this->stats_->wraparound_wait_ns, stats_clock_ns() - this->wraparound_start_ns_);
+        this->wraparound_start_ns_ = 0;
+      }
+      this->publish_stats();
+    }
     return result;
   } else {
     LOG_DEBUG << "[DemuxReader::next()] wrapping up, " << this->id_
@@ -441,8 +942,14 @@ template <size_t L, uint16_t M>
               << ", available_message_count_: " << this->available_message_count_ << ", position_: " << this->position_;
     // signal that it is ready to wraparound, see doc/adr/ADR003.md for more details
     assert(this->read_message_count_ == this->available_message_count_);
+    this->wrapped_byte_count_ += this->position_;
     this->position_ = 0;
     this->wraparound_sync_->fetch_or(this->mask_);
+    if (this->stats_ != nullptr) {
+      increment(&this->stats_->wraparound_count);
+      this->wraparound_start_ns_ = stats_clock_ns();
+      this->publish_stats();
+    }
     return {};
   }
 }
@@ -458,6 +965,9 @@ template <size_t L, uint16_t M>
       this->available_message_count_ = x;
       return true;
     } else {
+      if (this->stats_ != nullptr) {
+        increment(&this->stats_->heartbeat);
+      }
       return false;
     }
   }
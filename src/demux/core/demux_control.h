@@ -0,0 +1,66 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <new>
+
+namespace lshl::demux::core {
+
+using std::atomic;
+using std::uint64_t;
+
+// NOLINTBEGIN(misc-non-private-member-variables-in-classes)
+
+/// @brief Start of a lap, at position 0.
+struct DemuxLap {
+  uint64_t start_count{0};         // message count at the start of the lap
+  uint64_t wrapped_byte_count{0};  // bytes written in all completed laps
+};
+
+/// @brief Writer state that outlives the writer process, allocated in shared memory next to `wraparound_sync`. A
+/// restarted writer continues on the existing circular buffer with `DemuxWriter::recover`, the readers keep their
+/// mappings and positions. Together with `message_count_sync` and the message lengths in the buffer it is enough to
+/// restore the writer's position, so it is updated on a wraparound and on a reader mask change only, not per message.
+struct alignas(std::hardware_destructive_interference_size) DemuxControl {
+  atomic<uint64_t> epoch{0};             // incremented by every writer attached to the control block
+  atomic<uint64_t> all_readers_mask{0};  // registered readers
+  atomic<uint64_t> lap_seq{0};           // the current lap is `laps[lap_seq % 2]`
+  // two slots, see `publish_lap`
+  std::array<atomic<uint64_t>, 2> lap_start_counts{};
+  std::array<atomic<uint64_t>, 2> wrapped_byte_counts{};
+
+  /// @brief Publishes the start of a new lap, writer only. Fills the other slot and switches to it with one store: a
+  /// writer that crashes in between leaves the previous lap, both values of a lap are always from the same lap.
+  auto publish_lap(const DemuxLap& x) noexcept -> void {
+    const uint64_t next = this->lap_seq.load() + 1;
+    this->lap_start_counts.at(next % 2).store(x.start_count);
+    this->wrapped_byte_counts.at(next % 2).store(x.wrapped_byte_count);
+    this->lap_seq.store(next);
+  }
+
+  /// @brief The current lap, the last one published completely.
+  [[nodiscard]] auto lap() const noexcept -> DemuxLap {
+    const uint64_t i = this->lap_seq.load() % 2;
+    return DemuxLap{this->lap_start_counts.at(i).load(), this->wrapped_byte_counts.at(i).load()};
+  }
+};
+
+// NOLINTEND(misc-non-private-member-variables-in-classes)
+
+static_assert(atomic<uint64_t>::is_always_lock_free, "DemuxControl requires lock-free atomics in shared memory");
+static_assert(sizeof(DemuxControl) == std::hardware_destructive_interference_size, "one cache line");
+
+inline auto operator<<(std::ostream& os, const DemuxControl& x) -> std::ostream& {
+  const DemuxLap lap = x.lap();
+  os << "DemuxControl{epoch: " << x.epoch.load() << ", all_readers_mask: " << x.all_readers_mask.load()
+     << ", lap_seq: " << x.lap_seq.load() << ", lap_start_count: " << lap.start_count
+     << ", wrapped_byte_count: " << lap.wrapped_byte_count << "}";
+  return os;
+}
+
+}  // namespace lshl::demux::core
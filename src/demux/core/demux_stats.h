@@ -0,0 +1,127 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <new>
+#include <optional>
+#include "./reader_id.h"
+
+namespace lshl::demux::core {
+
+using std::atomic;
+using std::uint64_t;
+
+// NOLINTBEGIN(misc-non-private-member-variables-in-classes)
+
+/// @brief Writer counters. Written only by the writer with relaxed stores, so updating them costs a plain store.
+/// Readers of the stats (monitoring tools) can observe the counters slightly out of date and out of order.
+struct alignas(std::hardware_destructive_interference_size) WriterStats {
+  atomic<uint64_t> message_count{0};       // published messages, including the wraparound markers
+  atomic<uint64_t> byte_count{0};          // written bytes, including the 2-byte message lengths
+  atomic<uint64_t> repeat_count{0};        // non-blocking writes that returned `Repeat` or `std::nullopt`
+  atomic<uint64_t> wraparound_count{0};    // initiated wraparounds
+  atomic<uint64_t> wraparound_wait_ns{0};  // time spent waiting for the readers to catch up during wraparounds
+  atomic<uint64_t> all_readers_mask{0};    // registered readers
+  atomic<uint64_t> evicted_count{0};       // dead readers removed at wraparounds, see `ReaderLiveness`
+};
+
+/// @brief Reader counters, one cache line per reader. Written only by the owning reader with relaxed stores.
+struct alignas(std::hardware_destructive_interference_size) ReaderStats {
+  atomic<uint64_t> message_count{0};       // read messages, including the wraparound markers
+  atomic<uint64_t> byte_count{0};          // read bytes, including the 2-byte message lengths
+  atomic<uint64_t> position{0};            // current byte offset in the circular buffer
+  atomic<uint64_t> wraparound_count{0};    // wraparound markers read
+  atomic<uint64_t> wraparound_wait_ns{0};  // time between reading a wraparound marker and the next message
+  atomic<uint64_t> heartbeat{0};           // polls of an empty buffer, the reader is alive while it idles
+  atomic<uint64_t> pid{0};                 // reader process, `0` if unknown
+};
+
+/// @brief Lag of one reader behind the writer.
+struct ReaderLag {
+  uint8_t reader_id{0};
+  uint64_t messages{0};
+  uint64_t bytes{0};
+};
+
+// NOLINTEND(misc-non-private-member-variables-in-classes)
+
+inline auto operator<<(std::ostream& os, const ReaderLag& x) -> std::ostream& {
+  os << "ReaderLag{reader_id: " << static_cast<int>(x.reader_id) << ", messages: " << x.messages
+     << ", bytes: " << x.bytes << "}";
+  return os;
+}
+
+/// @brief Stats page, can be allocated in shared memory next to the circular buffer. The writer is given the whole
+/// page, it updates `writer` and reads the reader slots to estimate the reader lag. The readers are given pointers to
+/// their own slots. Passing `nullptr` disables the stats.
+struct DemuxStats {
+  WriterStats writer{};
+  std::array<ReaderStats, MAX_READER_NUM> readers{};
+
+  [[nodiscard]] auto reader(const ReaderId& id) noexcept -> ReaderStats& {
+    // ReaderId guarantees that value is within the bounds
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-constant-array-index)
+    return this->readers[id.value() - 1];
+  }
+
+  [[nodiscard]] auto reader(const ReaderId& id) const noexcept -> const ReaderStats& {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-constant-array-index)
+    return this->readers[id.value() - 1];
+  }
+
+  /// @brief Messages published by the writer and not yet read by the reader.
+  [[nodiscard]] auto lag_messages(const ReaderId& id) const noexcept -> uint64_t {
+    return lag(this->writer.message_count, this->reader(id).message_count);
+  }
+
+  /// @brief Bytes written by the writer and not yet read by the reader.
+  [[nodiscard]] auto lag_bytes(const ReaderId& id) const noexcept -> uint64_t {
+    return lag(this->writer.byte_count, this->reader(id).byte_count);
+  }
+
+  /// @brief The reader with the largest lag in bytes among `readers_mask`, `std::nullopt` if the mask is empty. An
+  /// estimate, the counters are loaded one by one with relaxed loads.
+  [[nodiscard]] auto slowest_reader(const uint64_t readers_mask) const noexcept -> std::optional<ReaderLag> {
+    std::optional<ReaderLag> result{};
+    for (uint64_t mask = readers_mask; mask != 0; mask &= mask - 1) {
+      const auto i = static_cast<uint8_t>(std::countr_zero(mask));
+      // NOLINTBEGIN(cppcoreguidelines-pro-bounds-constant-array-index)
+      const uint64_t bytes = lag(this->writer.byte_count, this->readers[i].byte_count);
+      if (!result.has_value() || bytes > result->bytes) {
+        const uint64_t messages = lag(this->writer.message_count, this->readers[i].message_count);
+        result = ReaderLag{static_cast<uint8_t>(i + 1), messages, bytes};
+      }
+      // NOLINTEND(cppcoreguidelines-pro-bounds-constant-array-index)
+    }
+    return result;
+  }
+
+ private:
+  static auto lag(const atomic<uint64_t>& written, const atomic<uint64_t>& read) noexcept -> uint64_t {
+    // the reader counter is loaded first, it can only grow, so the difference is never negative
+    const uint64_t r = read.load(std::memory_order_relaxed);
+    const uint64_t w = written.load(std::memory_order_relaxed);
+    return w > r ? w - r : 0;
+  }
+};
+
+/// @brief Single-writer increment, avoids the locked read-modify-write instruction of `fetch_add`.
+inline auto increment(atomic<uint64_t>* x, const uint64_t n = 1) noexcept -> void {
+  x->store(x->load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+/// @brief Clock for the stats, read once per wraparound.
+[[nodiscard]] inline auto stats_clock_ns() noexcept -> uint64_t {
+  return static_cast<uint64_t>(
+      std::chrono::nanoseconds(std::chrono::steady_clock::now().time_since_epoch()).count()
+  );
+}
+
+}  // namespace lshl::demux::core
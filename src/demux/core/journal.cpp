@@ -0,0 +1,297 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "./journal.h"
+#include <algorithm>
+#include <array>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <ios>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "../util/boost_log_util.h"
+
+namespace lshl::demux::core {
+
+namespace bipc = boost::interprocess;
+
+namespace {
+
+auto journal_file_path(
+    const std::filesystem::path& directory,
+    const std::string& name,
+    const uint32_t index,
+    const char* extension
+) -> std::filesystem::path {
+  constexpr int INDEX_WIDTH = 6;
+  std::stringstream file_name;
+  file_name << name << '.' << std::setw(INDEX_WIDTH) << std::setfill('0') << index << extension;
+  return directory / file_name.str();
+}
+
+template <class T>
+auto write_pod(std::ofstream& out, const T& x) noexcept(false) -> void {
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  out.write(reinterpret_cast<const char*>(&x), sizeof(T));
+}
+
+auto load_index(const std::filesystem::path& path) noexcept(false) -> std::vector<JournalIndexEntry> {
+  std::vector<JournalIndexEntry> result;
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    throw std::domain_error("could not open journal index: " + path.string());
+  }
+  JournalIndexEntry x{};
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  while (in.read(reinterpret_cast<char*>(&x), sizeof(JournalIndexEntry))) {
+    result.push_back(x);
+  }
+  return result;
+}
+
+}  // namespace
+
+auto journal_segment_path(const std::filesystem::path& directory, const std::string& name, const uint32_t index)
+    -> std::filesystem::path {
+  return journal_file_path(directory, name, index, ".journal");
+}
+
+auto journal_index_path(const std::filesystem::path& directory, const std::string& name, const uint32_t index)
+    -> std::filesystem::path {
+  return journal_file_path(directory, name, index, ".index");
+}
+
+JournalWriter::JournalWriter(
+    const std::filesystem::path& directory,
+    std::string name,
+    const size_t max_segment_size,
+    const uint64_t index_interval
+) noexcept(false)
+    : directory_(directory),
+      name_(std::move(name)),
+      max_segment_size_(max_segment_size),
+      index_interval_(std::max<uint64_t>(index_interval, 1)) {
+  if (std::filesystem::exists(journal_segment_path(this->directory_, this->name_, 0))) {
+    throw std::invalid_argument(
+        "journal already exists: " + journal_segment_path(this->directory_, this->name_, 0).string()
+    );
+  }
+  std::filesystem::create_directories(this->directory_);
+  this->open_segment(0);
+  LOG_INFO << "[JournalWriter::constructor] directory: " << this->directory_ << ", name: " << this->name_
+           << ", max_segment_size: " << this->max_segment_size_ << ", index_interval: " << this->index_interval_;
+}
+
+JournalWriter::~JournalWriter() {
+  this->segment_.flush();
+  this->index_.flush();
+}
+
+auto JournalWriter::append(const uint64_t timestamp, const span<const uint8_t>& message) noexcept(false) -> uint64_t {
+  if (message.empty() || message.size() > std::numeric_limits<uint32_t>::max()) {
+    throw std::invalid_argument("invalid message length: " + std::to_string(message.size()));
+  }
+
+  const size_t frame_size = journal_frame_size(message.size());
+  if (this->segment_message_count_ > 0 && this->segment_size_ + frame_size > this->max_segment_size_) {
+    this->open_segment(this->segment_index_ + 1);
+  }
+
+  this->sequence_ += 1;
+
+  if (this->segment_message_count_ % this->index_interval_ == 0) {
+    write_pod(this->index_, JournalIndexEntry{this->sequence_, timestamp, this->segment_size_});
+  }
+
+  const JournalFrameHeader header{this->sequence_, timestamp, static_cast<uint32_t>(message.size()), 0};
+  write_pod(this->segment_, header);
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  this->segment_.write(reinterpret_cast<const char*>(message.data()), static_cast<std::streamsize>(message.size()));
+
+  constexpr std::array<char, JOURNAL_FRAME_ALIGNMENT> PADDING{};
+  const size_t padding = frame_size - sizeof(JournalFrameHeader) - message.size();
+  this->segment_.write(PADDING.data(), static_cast<std::streamsize>(padding));
+
+  if (!this->segment_) {
+    throw std::domain_error("could not append to journal segment, sequence: " + std::to_string(this->sequence_));
+  }
+
+  this->segment_size_ += frame_size;
+  this->segment_message_count_ += 1;
+  return this->sequence_;
+}
+
+auto JournalWriter::flush() noexcept(false) -> void {
+  this->segment_.flush();
+  this->index_.flush();
+  if (!this->segment_ || !this->index_) {
+    throw std::domain_error("could not flush journal, sequence: " + std::to_string(this->sequence_));
+  }
+}
+
+auto JournalWriter::open_segment(const uint32_t index) noexcept(false) -> void {
+  if (this->segment_.is_open()) {
+    this->segment_.close();
+    this->index_.close();
+  }
+
+  const std::filesystem::path segment_path = journal_segment_path(this->directory_, this->name_, index);
+  this->segment_.open(segment_path, std::ios::binary | std::ios::trunc);
+  this->index_.open(journal_index_path(this->directory_, this->name_, index), std::ios::binary | std::ios::trunc);
+  if (!this->segment_ || !this->index_) {
+    throw std::domain_error("could not create journal segment: " + segment_path.string());
+  }
+
+  write_pod(this->segment_, JournalSegmentHeader{JOURNAL_MAGIC, JOURNAL_VERSION, index, this->sequence_ + 1});
+
+  this->segment_index_ = index;
+  this->segment_size_ = sizeof(JournalSegmentHeader);
+  this->segment_message_count_ = 0;
+  LOG_INFO << "[JournalWriter::open_segment] " << segment_path;
+}
+
+JournalReader::JournalReader(const std::filesystem::path& directory, const std::string& name) noexcept(false) {
+  for (uint32_t i = 0;; ++i) {
+    std::filesystem::path path = journal_segment_path(directory, name, i);
+    if (!std::filesystem::exists(path)) {
+      break;
+    }
+    this->segments_.push_back(Segment{std::move(path), load_index(journal_index_path(directory, name, i))});
+  }
+  if (this->segments_.empty()) {
+    throw std::invalid_argument("journal not found: " + journal_segment_path(directory, name, 0).string());
+  }
+  this->map_segment(0);
+  LOG_INFO << "[JournalReader::constructor] directory: " << directory << ", name: " << name
+           << ", segments: " << this->segments_.size();
+}
+
+auto JournalReader::next() noexcept(false) -> std::optional<JournalFrame> {
+  while (true) {
+    std::optional<JournalFrame> result = this->next_in_segment();
+    if (result.has_value() || !this->next_segment()) {
+      return result;
+    }
+  }
+}
+
+auto JournalReader::next_in_segment() noexcept -> std::optional<JournalFrame> {
+  std::optional<JournalFrame> result = this->read_frame(this->offset_);
+  if (result.has_value()) {
+    this->offset_ += journal_frame_size(result->message.size());
+  }
+  return result;
+}
+
+auto JournalReader::next_segment() noexcept(false) -> bool {
+  if (this->segment_ + 1 >= this->segments_.size()) {
+    return false;
+  }
+  this->map_segment(this->segment_ + 1);
+  return true;
+}
+
+auto JournalReader::seek_sequence(const uint64_t x) noexcept(false) -> bool {
+  return this->seek(x, [](const JournalFrame& f) { return f.sequence; });
+}
+
+auto JournalReader::seek_timestamp(const uint64_t x) noexcept(false) -> bool {
+  return this->seek(x, [](const JournalFrame& f) { return f.timestamp; });
+}
+
+template <class K>
+auto JournalReader::seek(const uint64_t x, K key) noexcept(false) -> bool {
+  // index entries and frames use the same fields for the key
+  const auto index_key = [&key](const JournalIndexEntry& e) {
+    return key(JournalFrame{e.sequence, e.timestamp, {}});
+  };
+
+  // the last segment that starts at or before x, every non-empty segment indexes its first frame
+  size_t segment = 0;
+  for (size_t i = 1; i < this->segments_.size(); ++i) {
+    const std::vector<JournalIndexEntry>& index = this->segments_[i].index;
+    if (index.empty() || index_key(index.front()) > x) {
+      break;
+    }
+    segment = i;
+  }
+
+  // the last indexed frame at or before x
+  const std::vector<JournalIndexEntry>& index = this->segments_[segment].index;
+  const auto it =
+      std::upper_bound(index.begin(), index.end(), x, [&index_key](const uint64_t v, const JournalIndexEntry& e) {
+        return v < index_key(e);
+      });
+
+  this->map_segment(segment);
+  if (it != index.begin()) {
+    this->offset_ = std::prev(it)->offset;
+  }
+
+  // scan forward, crossing into the following segments if needed
+  while (true) {
+    const size_t offset = this->offset_;
+    const std::optional<JournalFrame> frame = this->next_in_segment();
+    if (frame.has_value()) {
+      if (key(frame.value()) >= x) {
+        this->offset_ = offset;
+        return true;
+      }
+    } else if (!this->next_segment()) {
+      return false;
+    }
+  }
+}
+
+auto JournalReader::map_segment(const size_t index) noexcept(false) -> void {
+  const Segment& segment = this->segments_[index];
+
+  bipc::file_mapping file(segment.path.c_str(), bipc::read_only);
+  bipc::mapped_region region(file, bipc::read_only);
+  region.advise(bipc::mapped_region::advice_sequential);
+
+  if (region.get_size() < sizeof(JournalSegmentHeader)) {
+    throw std::domain_error("invalid journal segment, too small: " + segment.path.string());
+  }
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  const auto* header = reinterpret_cast<const JournalSegmentHeader*>(region.get_address());
+  if (header->magic != JOURNAL_MAGIC || header->version != JOURNAL_VERSION) {
+    throw std::domain_error("invalid journal segment, unexpected magic or version: " + segment.path.string());
+  }
+
+  this->file_ = std::move(file);
+  this->region_ = std::move(region);
+  this->data_ = span<uint8_t>{static_cast<uint8_t*>(this->region_.get_address()), this->region_.get_size()};
+  this->segment_ = index;
+  this->offset_ = sizeof(JournalSegmentHeader);
+  LOG_DEBUG << "[JournalReader::map_segment] " << segment.path << ", size: " << this->data_.size();
+}
+
+auto JournalReader::read_frame(const size_t offset) const noexcept -> std::optional<JournalFrame> {
+  if (offset + sizeof(JournalFrameHeader) > this->data_.size()) {
+    return std::nullopt;
+  }
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  const auto* header = reinterpret_cast<const JournalFrameHeader*>(this->data_.subspan(offset).data());
+  const size_t message_offset = offset + sizeof(JournalFrameHeader);
+  if (header->length == 0 || message_offset + header->length > this->data_.size()) {
+    // incomplete frame, the recording process did not finish writing it
+    LOG_WARNING << "[JournalReader::read_frame] truncated frame at offset: " << offset
+                << ", segment: " << this->segments_[this->segment_].path;
+    return std::nullopt;
+  }
+  return JournalFrame{header->sequence, header->timestamp, this->data_.subspan(message_offset, header->length)};
+}
+
+}  // namespace lshl::demux::core
@@ -0,0 +1,186 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace lshl::demux::core {
+
+using std::size_t;
+using std::span;
+using std::uint32_t;
+using std::uint64_t;
+using std::uint8_t;
+
+constexpr uint64_t JOURNAL_MAGIC = 0x314C4E524A584D44;  // "DMXJRNL1", little-endian
+constexpr uint32_t JOURNAL_VERSION = 1;
+
+constexpr size_t DEFAULT_JOURNAL_SEGMENT_SIZE = 256UL * 1024 * 1024;
+constexpr uint64_t DEFAULT_JOURNAL_INDEX_INTERVAL = 1024;
+
+// frames are padded, so every frame header in a mapped segment is naturally aligned
+constexpr size_t JOURNAL_FRAME_ALIGNMENT = alignof(uint64_t);
+
+// NOLINTBEGIN(misc-non-private-member-variables-in-classes)
+
+/// @brief The first bytes of every journal segment file.
+struct JournalSegmentHeader {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t segment_index;
+  uint64_t first_sequence;
+};
+
+/// @brief Precedes every recorded message in a segment file. The message bytes follow the header, the frame is
+/// padded to `JOURNAL_FRAME_ALIGNMENT`.
+struct JournalFrameHeader {
+  uint64_t sequence;   // 1-based, assigned by the JournalWriter
+  uint64_t timestamp;  // nanoseconds, provided by the recording process
+  uint32_t length;     // message length in bytes
+  uint32_t reserved;
+};
+
+/// @brief Sparse index entry, written every `index_interval` messages and for the first message of every segment.
+struct JournalIndexEntry {
+  uint64_t sequence;
+  uint64_t timestamp;
+  uint64_t offset;  // byte offset of the frame header in the segment file
+};
+
+/// @brief A recorded message. `message` points into the read-only mapping of the segment file, it is valid until the
+/// JournalReader moves to another segment.
+struct JournalFrame {
+  uint64_t sequence;
+  uint64_t timestamp;
+  span<uint8_t> message;
+};
+
+// NOLINTEND(misc-non-private-member-variables-in-classes)
+
+[[nodiscard]] constexpr auto journal_frame_size(const size_t message_length) noexcept -> size_t {
+  const size_t n = sizeof(JournalFrameHeader) + message_length;
+  return (n + JOURNAL_FRAME_ALIGNMENT - 1) / JOURNAL_FRAME_ALIGNMENT * JOURNAL_FRAME_ALIGNMENT;
+}
+
+[[nodiscard]] auto journal_segment_path(const std::filesystem::path& directory, const std::string& name, uint32_t index)
+    -> std::filesystem::path;
+
+[[nodiscard]] auto journal_index_path(const std::filesystem::path& directory, const std::string& name, uint32_t index)
+    -> std::filesystem::path;
+
+/// @brief Appends messages to a sequence of segment files `<directory>/<name>.<index>.journal` and builds a sparse
+/// `<name>.<index>.index` file for every segment, so a JournalReader can seek without scanning the whole recording.
+/// Starts a new segment when the current one would grow beyond `max_segment_size`.
+class JournalWriter {
+ public:
+  JournalWriter(
+      const std::filesystem::path& directory,
+      std::string name,
+      size_t max_segment_size = DEFAULT_JOURNAL_SEGMENT_SIZE,
+      uint64_t index_interval = DEFAULT_JOURNAL_INDEX_INTERVAL
+  ) noexcept(false);
+
+  ~JournalWriter();
+  JournalWriter(const JournalWriter&) = delete;
+  auto operator=(const JournalWriter&) -> JournalWriter& = delete;
+  JournalWriter(JournalWriter&&) = delete;
+  auto operator=(JournalWriter&&) -> JournalWriter& = delete;
+
+  /// @brief Appends a message to the current segment.
+  /// @param timestamp -- nanoseconds, must not decrease between calls, `JournalReader::seek_timestamp` relies on it.
+  /// @param message -- message bytes.
+  /// @return the sequence number assigned to the message.
+  auto append(uint64_t timestamp, const span<const uint8_t>& message) noexcept(false) -> uint64_t;
+
+  auto flush() noexcept(false) -> void;
+
+  /// @return the sequence number of the last appended message, `0` if nothing was appended.
+  [[nodiscard]] auto sequence() const noexcept -> uint64_t { return this->sequence_; }
+
+  [[nodiscard]] auto segment_count() const noexcept -> size_t { return this->segment_index_ + 1; }
+
+ private:
+  auto open_segment(uint32_t index) noexcept(false) -> void;
+
+  const std::filesystem::path directory_;
+  const std::string name_;
+  const size_t max_segment_size_;
+  const uint64_t index_interval_;
+
+  uint32_t segment_index_{0};
+  uint64_t sequence_{0};
+  size_t segment_size_{0};
+  uint64_t segment_message_count_{0};
+  std::ofstream segment_;
+  std::ofstream index_;
+};
+
+/// @brief Reads the segments written by JournalWriter. Maps one segment at a time read-only into memory, frames are
+/// returned without copying.
+class JournalReader {
+ public:
+  JournalReader(const std::filesystem::path& directory, const std::string& name) noexcept(false);
+
+  ~JournalReader() = default;
+  JournalReader(const JournalReader&) = delete;
+  auto operator=(const JournalReader&) -> JournalReader& = delete;
+  JournalReader(JournalReader&&) = default;
+  auto operator=(JournalReader&&) -> JournalReader& = delete;
+
+  /// @brief Returns the next frame, moves to the next segment when the current one is exhausted. Returned frames are
+  /// invalidated when the reader moves to another segment.
+  /// @return the next frame or `std::nullopt` at the end of the journal.
+  [[nodiscard]] auto next() noexcept(false) -> std::optional<JournalFrame>;
+
+  /// @brief Returns the next frame of the current segment. Does not move to the next segment, so all frames returned
+  /// so far stay valid.
+  /// @return the next frame or `std::nullopt` at the end of the current segment.
+  [[nodiscard]] auto next_in_segment() noexcept -> std::optional<JournalFrame>;
+
+  /// @brief Maps the next segment.
+  /// @return `false` when there are no more segments.
+  auto next_segment() noexcept(false) -> bool;
+
+  /// @brief Positions the reader so that `next` returns the first frame with `sequence >= x`. Uses the sparse index to
+  /// find the segment and the closest preceding frame, then scans forward.
+  /// @return `false` when all recorded sequence numbers are less than `x`.
+  auto seek_sequence(uint64_t x) noexcept(false) -> bool;
+
+  /// @brief Positions the reader so that `next` returns the first frame with `timestamp >= x`.
+  /// @return `false` when all recorded timestamps are less than `x`.
+  auto seek_timestamp(uint64_t x) noexcept(false) -> bool;
+
+  [[nodiscard]] auto segment_count() const noexcept -> size_t { return this->segments_.size(); }
+
+ private:
+  struct Segment {
+    std::filesystem::path path;
+    std::vector<JournalIndexEntry> index;
+  };
+
+  auto map_segment(size_t index) noexcept(false) -> void;
+
+  [[nodiscard]] auto read_frame(size_t offset) const noexcept -> std::optional<JournalFrame>;
+
+  template <class K>
+  auto seek(uint64_t x, K key) noexcept(false) -> bool;
+
+  std::vector<Segment> segments_;
+  size_t segment_{0};
+  boost::interprocess::file_mapping file_;
+  boost::interprocess::mapped_region region_;
+  span<uint8_t> data_;
+  size_t offset_{0};
+};
+
+}  // namespace lshl::demux::core
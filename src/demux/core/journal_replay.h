@@ -0,0 +1,139 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <span>
+#include "../util/boost_log_util.h"
+#include "./demultiplexer.h"
+#include "./journal.h"
+
+namespace lshl::demux::core {
+
+using std::size_t;
+using std::span;
+using std::uint64_t;
+using std::uint8_t;
+
+enum class ReplaySpeed : std::uint8_t {
+  Max,       // publish as fast as the writer and the readers allow
+  Recorded,  // preserve the recorded gaps between message timestamps
+};
+
+// max number of messages published with one `DemuxWriter::write_batch` call
+constexpr size_t REPLAY_BATCH_SIZE = 64;
+
+// NOLINTBEGIN(misc-non-private-member-variables-in-classes)
+struct ReplayResult {
+  uint64_t message_count{0};
+  uint64_t dropped_count{0};  // recorded messages that do not fit into the circular buffer `M`
+  std::chrono::nanoseconds elapsed{0};
+
+  [[nodiscard]] auto messages_per_second() const noexcept -> double {
+    constexpr double NS_IN_SECOND = 1'000'000'000.0;
+    if (this->elapsed.count() == 0) {
+      return 0.0;
+    }
+    return static_cast<double>(this->message_count) * NS_IN_SECOND / static_cast<double>(this->elapsed.count());
+  }
+};
+// NOLINTEND(misc-non-private-member-variables-in-classes)
+
+inline auto operator<<(std::ostream& os, const ReplayResult& x) -> std::ostream& {
+  os << "ReplayResult{message_count: " << x.message_count << ", dropped_count: " << x.dropped_count
+     << ", elapsed_ns: " << x.elapsed.count() << ", messages_per_second: " << x.messages_per_second() << "}";
+  return os;
+}
+
+/// @brief Republishes recorded messages from the current position of the `journal` into the `writer`. Messages are
+/// published in batches. A batch never spans journal segments, the batched messages point into the mapped segment.
+/// @tparam `L` The size of the circular buffer in bytes.
+/// @tparam `M` The maximum message size in bytes.
+/// @tparam `B` Blocking or non-blocking writer, the non-blocking writer is retried until the readers catch up.
+/// @param journal -- recorded messages, use `seek_sequence` or `seek_timestamp` to start from a later message.
+/// @param writer -- republishes the recorded messages.
+/// @param speed -- `ReplaySpeed::Recorded` waits (busy-spins) until the recorded gap between messages elapses.
+/// @param max_message_num -- stop after publishing this many messages.
+/// @return ReplayResult.
+template <size_t L, uint16_t M, bool B>
+auto replay(
+    JournalReader* journal,
+    DemuxWriter<L, M, B>* writer,
+    const ReplaySpeed speed,
+    const uint64_t max_message_num = std::numeric_limits<uint64_t>::max()
+) noexcept(false) -> ReplayResult {
+  using clock = std::chrono::steady_clock;
+
+  ReplayResult result{};
+  std::array<span<uint8_t>, REPLAY_BATCH_SIZE> batch{};
+  std::optional<JournalFrame> pending{};  // read from the journal, but not due yet
+
+  std::optional<uint64_t> first_timestamp{};
+  const clock::time_point start = clock::now();
+
+  const auto publish = [writer, &result](const span<const span<uint8_t>> xs) {
+    for (size_t sent = 0; sent < xs.size();) {
+      sent += writer->write_batch(xs.subspan(sent));
+    }
+    result.message_count += xs.size();
+  };
+
+  while (result.message_count < max_message_num) {
+    size_t n = 0;
+    const uint64_t limit = std::min<uint64_t>(REPLAY_BATCH_SIZE, max_message_num - result.message_count);
+
+    while (n < limit) {
+      std::optional<JournalFrame> frame = pending.has_value() ? pending : journal->next_in_segment();
+      pending.reset();
+      if (!frame.has_value()) {
+        break;
+      }
+      if (frame->message.size() > M) {
+        LOG_ERROR << "[replay] dropping message, sequence: " << frame->sequence
+                  << ", length: " << frame->message.size();
+        result.dropped_count += 1;
+        continue;
+      }
+      if (speed == ReplaySpeed::Recorded) {
+        if (!first_timestamp.has_value()) {
+          first_timestamp = frame->timestamp;
+        }
+        const uint64_t first = first_timestamp.value();
+        const uint64_t gap = frame->timestamp > first ? frame->timestamp - first : 0;
+        const clock::time_point due = start + std::chrono::nanoseconds(static_cast<int64_t>(gap));
+        if (clock::now() < due) {
+          if (n > 0) {
+            // publish what is due, come back for this one
+            pending = frame;
+            break;
+          }
+          // busy-wait
+          while (clock::now() < due) {
+          }
+        }
+      }
+      batch.at(n) = frame->message;
+      n += 1;
+    }
+
+    if (n > 0) {
+      publish(span{batch}.first(n));
+    } else if (!pending.has_value() && !journal->next_segment()) {
+      break;  // end of the journal
+    }
+  }
+
+  result.elapsed = clock::now() - start;
+  LOG_INFO << "[replay] " << result;
+  return result;
+}
+
+}  // namespace lshl::demux::core
@@ -0,0 +1,182 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "../util/boost_log_util.h"
+#include "./demultiplexer.h"
+
+namespace lshl::demux::core {
+
+using std::size_t;
+using std::span;
+using std::uint16_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::uint8_t;
+
+/// @brief Merges several `DemuxReader`s, e.g. one per venue feed, into one stream in timestamp order. Holds at most one
+/// message per input, the head, in the circular buffer of the input, and a min-heap of the heads keyed on the
+/// timestamps the `timestamp` function extracts. The timestamps of every input must not decrease.
+/// The smallest head is delivered when every input has a head, the order is global then. An input without messages
+/// holds the others back for at most `max_delay`: the smallest head is also delivered once `now` reaches its timestamp
+/// plus `max_delay`, and a message that arrives later with a smaller timestamp is delivered out of order, see
+/// `out_of_order_count`. `now` and `max_delay` are in the units of the timestamps, e.g. nanoseconds of `TscClock`.
+/// No allocations after the constructor.
+/// @tparam `F` `uint64_t(span<uint8_t>)`, the timestamp of a message.
+template <size_t L, uint16_t M, class F>
+  requires(std::is_invocable_r_v<uint64_t, F&, span<uint8_t>>)
+class MergingReader {
+ public:
+  /// @param `readers` must outlive the merging reader, one reader per input.
+  /// @throw `std::invalid_argument` if there are no readers.
+  MergingReader(const span<DemuxReader<L, M>* const> readers, F timestamp, const uint64_t max_delay) noexcept(false)
+      : readers_(readers.begin(), readers.end()),
+        timestamp_(std::move(timestamp)),
+        max_delay_(max_delay),
+        heads_(readers.size()) {
+    if (readers.empty()) {
+      throw std::invalid_argument("[MergingReader] no readers");
+    }
+    this->heap_.reserve(readers.size());
+    this->empty_inputs_.reserve(readers.size());
+    for (uint32_t i = 0; i < readers.size(); ++i) {
+      this->empty_inputs_.push_back(i);
+    }
+    LOG_INFO << "[MergingReader] L: " << L << ", M: " << M << ", inputs: " << readers.size()
+             << ", max_delay: " << max_delay;
+  }
+
+  /// @brief Does not block. Reads the inputs without a head, then delivers the smallest head if the order allows.
+  ///   The returned `span` points into the circular buffer of the input, it is valid until the next call.
+  /// @param `now` current time in the units of the timestamps.
+  /// @return message or empty span if nothing can be delivered yet.
+  [[nodiscard]] auto next(const uint64_t now) noexcept -> const span<uint8_t> {
+    if (this->top_delivered_) {
+      this->replace_top();
+    }
+    if (!this->empty_inputs_.empty()) {
+      this->read_empty_inputs();
+    }
+    if (this->heap_.empty()) {
+      return {};
+    }
+    const Head& top = this->heap_.front();
+    if (!this->empty_inputs_.empty() && (now < top.timestamp || now - top.timestamp < this->max_delay_)) {
+      return {};  // an input without messages can still have an older one
+    }
+    if (top.timestamp < this->last_timestamp_) {
+      this->out_of_order_count_ += 1;
+    } else {
+      this->last_timestamp_ = top.timestamp;
+    }
+    // stays in the heap until the next call, the input is read first then
+    this->top_delivered_ = true;
+    this->last_input_ = top.input;
+    this->delivered_count_ += 1;
+    return this->heads_[top.input];
+  }
+
+  /// @brief The input of the last delivered message, the index in `readers`.
+  [[nodiscard]] auto last_input() const noexcept -> uint32_t { return this->last_input_; }
+
+  /// @brief Messages held in the heads, read from the inputs and not delivered yet.
+  [[nodiscard]] auto pending_count() const noexcept -> size_t {
+    return this->heap_.size() - (this->top_delivered_ ? 1 : 0);
+  }
+
+  [[nodiscard]] auto delivered_count() const noexcept -> uint64_t { return this->delivered_count_; }
+
+  /// @brief Messages delivered after a message with a larger timestamp, they arrived later than `max_delay`.
+  [[nodiscard]] auto out_of_order_count() const noexcept -> uint64_t { return this->out_of_order_count_; }
+
+ private:
+  struct Head {
+    uint64_t timestamp;
+    uint32_t input;
+  };
+
+  // `std::ranges::push_heap` makes a max-heap, the smallest timestamp goes to the front, the input breaks ties
+  static auto later(const Head& a, const Head& b) noexcept -> bool {
+    return a.timestamp != b.timestamp ? a.timestamp > b.timestamp : a.input > b.input;
+  }
+
+  // the next message of the delivered input usually replaces it at the top, one sift down instead of a pop and a push
+  auto replace_top() noexcept -> void {
+    this->top_delivered_ = false;
+    const uint32_t input = this->heap_.front().input;
+    const span<uint8_t> x = read(this->readers_[input]);
+    if (x.empty()) {
+      std::ranges::pop_heap(this->heap_, later);
+      this->heap_.pop_back();
+      this->empty_inputs_.push_back(input);
+      return;
+    }
+    this->heads_[input] = x;
+    const Head head{this->timestamp_(x), input};
+    const size_t n = this->heap_.size();
+    size_t i = 0;
+    for (size_t child = 1; child < n; child = (2 * i) + 1) {
+      if (child + 1 < n && later(this->heap_[child], this->heap_[child + 1])) {
+        child += 1;
+      }
+      if (!later(head, this->heap_[child])) {
+        break;
+      }
+      this->heap_[i] = this->heap_[child];
+      i = child;
+    }
+    this->heap_[i] = head;
+  }
+
+  auto read_empty_inputs() noexcept -> void {
+    size_t i = 0;
+    while (i < this->empty_inputs_.size()) {
+      const uint32_t input = this->empty_inputs_[i];
+      const span<uint8_t> x = this->read(this->readers_[input]);
+      if (x.empty()) {
+        ++i;
+        continue;
+      }
+      this->heads_[input] = x;
+      this->heap_.push_back(Head{this->timestamp_(x), input});
+      std::ranges::push_heap(this->heap_, later);
+      // the order of the empty inputs does not matter
+      this->empty_inputs_[i] = this->empty_inputs_.back();
+      this->empty_inputs_.pop_back();
+    }
+  }
+
+  // skips the wraparound markers, `next` returns an empty span for them too
+  static auto read(DemuxReader<L, M>* reader) noexcept -> span<uint8_t> {
+    while (reader->has_next()) {
+      const span<uint8_t> x = reader->next();
+      if (!x.empty()) {
+        return x;
+      }
+    }
+    return {};
+  }
+
+  std::vector<DemuxReader<L, M>*> readers_;
+  F timestamp_;
+  uint64_t max_delay_;
+  std::vector<span<uint8_t>> heads_;  // per input, valid while the input is in the heap
+  std::vector<Head> heap_;
+  std::vector<uint32_t> empty_inputs_;  // the inputs without a head
+  bool top_delivered_{false};
+  uint64_t last_timestamp_{0};
+  uint32_t last_input_{0};
+  uint64_t delivered_count_{0};
+  uint64_t out_of_order_count_{0};
+};
+
+}  // namespace lshl::demux::core
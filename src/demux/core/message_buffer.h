@@ -9,8 +9,10 @@
 #include <cstdint>
 #include <iterator>
 #include <limits>
+#include <new>
 #include <optional>
 #include <span>
+#include "./copy_kernels.h"
 
 namespace lshl::demux::core {
 
@@ -30,7 +32,10 @@ using message_length_t = uint16_t;
 template <size_t L>
 struct MessageBuffer {
  public:
-  explicit MessageBuffer(span<uint8_t, L> buffer) : data_(buffer.data()) {}
+  /// @param streaming -- non-temporal stores for messages from `STREAMING_COPY_MIN` bytes, enabled by default when the
+  /// buffer is much larger than the LLC, see `streaming_copy_for`. Must be supported by the CPU.
+  explicit MessageBuffer(span<uint8_t, L> buffer, const StreamingCopy streaming = streaming_copy_for(L))
+      : data_(buffer.data()), streaming_(streaming) {}
 
   /// @brief Writes the entire passed message into the buffer or nothing.
   /// @param position -- the zero-based byte offset at which the message should be written.
@@ -43,6 +48,12 @@ struct MessageBuffer {
       const size_t length = message.size();
       write_length(position, length);
       uint8_t* data = std::next(this->data_, static_cast<int64_t>(position + sizeof(message_length_t)));
+      if constexpr (L >= STREAMING_COPY_MIN + sizeof(message_length_t)) {
+        if (length >= STREAMING_COPY_MIN && this->streaming_ != StreamingCopy::None) {
+          copy_streaming(this->streaming_, data, message.data(), length);
+          return required_space;
+        }
+      }
       std::copy_n(message.data(), length, data);  // write message bytes
       return required_space;
     } else {
@@ -50,6 +61,28 @@ struct MessageBuffer {
     }
   }
 
+  /// @brief Writes a message of a compile-time size, `DemuxWriter::write_safe` ends up here. Messages up to
+  /// `FIXED_COPY_MAX` bytes are copied with `copy_fixed<N>`, larger ones the same way as a message of a runtime size.
+  template <size_t N>
+    requires(N != std::dynamic_extent && N > 0)
+  [[nodiscard]] auto write(const size_t position, const span<uint8_t, N>& message) noexcept -> size_t {
+    if constexpr (N > FIXED_COPY_MAX) {
+      return this->write(position, span<uint8_t>{message});
+    } else {
+      constexpr size_t required_space = sizeof(message_length_t) + N;
+      if (this->remaining(position) >= required_space) {
+        write_length(position, N);
+        uint8_t* data = std::next(this->data_, static_cast<int64_t>(position + sizeof(message_length_t)));
+        copy_fixed<N>(data, message.data());
+        return required_space;
+      } else {
+        return 0;
+      }
+    }
+  }
+
+  [[nodiscard]] auto streaming_copy() const noexcept -> StreamingCopy { return this->streaming_; }
+
   /// @brief Returns required space in bytes for allocating an object of type A in the buffer.
   /// @tparam A -- type of the message.
   /// @return total space in the buffer required fo allocating an object of type A in the buffer.
@@ -83,6 +116,23 @@ struct MessageBuffer {
     }
   }
 
+  /// @brief Reserves `n` bytes for a message directly in the buffer, the message length is written immediately.
+  /// @param position -- the zero-based byte offset at which the message should be allocated in the buffer.
+  /// @param n -- message length in bytes.
+  /// @return std::optional<span<uint8_t>> none when message could not be allocated because there is not enough space.
+  [[nodiscard]] auto allocate(const size_t position, const message_length_t n) noexcept
+      -> std::optional<span<uint8_t>> {
+    const size_t required_space = sizeof(message_length_t) + n;
+
+    if (this->remaining(position) >= required_space) {
+      write_length(position, n);
+      uint8_t* data = std::next(this->data_, static_cast<int64_t>(position + sizeof(message_length_t)));
+      return span<uint8_t>{data, n};
+    } else {
+      return std::nullopt;
+    }
+  }
+
   /// @param position -- zero-based byte offset.
   /// @return the available number of byte at the provided position.
   [[nodiscard]] auto remaining(const size_t position) const noexcept -> size_t {
@@ -124,6 +174,21 @@ struct MessageBuffer {
     }
   }
 
+  /// @brief Keeps the cache lines up to `lines` ahead of the position prefetched while the position advances from
+  /// `from` to `to`: prefetches the lines that come into that window, one prefetch per line crossed, none while the
+  /// position stays within a line. Nothing past the end of the buffer is prefetched.
+  /// @tparam W -- prefetch for writing, `prefetchw` when the target has it (`-mprfchw`, `-march=broadwell` and later),
+  /// a read prefetch otherwise.
+  /// @param lines -- the prefetch distance in cache lines, must be greater than zero.
+  template <bool W>
+  auto prefetch_ahead(const size_t from, const size_t to, const size_t lines) const noexcept -> void {
+    constexpr size_t LINE = std::hardware_destructive_interference_size;
+    const size_t end = std::min(((to / LINE) + lines + 1) * LINE, L);
+    for (size_t p = ((from / LINE) + lines + 1) * LINE; p < end; p += LINE) {
+      __builtin_prefetch(std::next(this->data_, static_cast<int64_t>(p)), W ? 1 : 0, 3);
+    }
+  }
+
 #ifdef UNIT_TEST
   auto data() const noexcept -> span<uint8_t, L> { return span<uint8_t, L>{this->data_, L}; }
 #endif
@@ -145,6 +210,7 @@ struct MessageBuffer {
   }
 
   uint8_t* data_;
+  StreamingCopy streaming_;
 };
 
 }  // namespace lshl::demux::core
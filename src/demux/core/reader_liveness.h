@@ -0,0 +1,89 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <signal.h>
+#include <sys/types.h>
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <cstdint>
+#include "./demux_stats.h"
+#include "./reader_id.h"
+
+namespace lshl::demux::core {
+
+using std::uint64_t;
+using std::uint8_t;
+
+/// @brief `true` if the process exists, or if it cannot be signalled by this process.
+[[nodiscard]] inline auto process_alive(const uint64_t pid) noexcept -> bool {
+  return ::kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM;
+}
+
+/// @brief Decides which readers are dead, from the progress they publish in their `ReaderStats` slots. A reader makes
+/// progress by reading a message (`message_count`) or by polling an empty buffer (`heartbeat`). A reader that made no
+/// progress for the timeout is dead unless its process (`pid`) is still alive: a live reader that is stuck in its own
+/// processing is slow, not dead, and is left to the application. A reader that has not published a PID is decided by
+/// the timeout alone.
+/// Checked by the writer only while it waits for the readers at a wraparound, so a live reader is always ahead of or
+/// polling for the messages the writer waits on.
+class ReaderLiveness {
+ public:
+  /// @param `timeout_ns` `0` disables the check.
+  explicit ReaderLiveness(const uint64_t timeout_ns = 0) noexcept : timeout_ns_(timeout_ns) {}
+
+  [[nodiscard]] auto timeout_ns() const noexcept -> uint64_t { return this->timeout_ns_; }
+
+  auto set_timeout_ns(const uint64_t timeout_ns) noexcept -> void { this->timeout_ns_ = timeout_ns; }
+
+  /// @return the dead readers among `readers_mask`, zero if the check is disabled.
+  [[nodiscard]] auto dead_readers(const DemuxStats& stats, const uint64_t readers_mask, const uint64_t now_ns) noexcept
+      -> uint64_t {
+    if (this->timeout_ns_ == 0) {
+      return 0;
+    }
+    uint64_t result = 0;
+    for (uint64_t mask = readers_mask; mask != 0; mask &= mask - 1) {
+      const auto i = static_cast<uint8_t>(std::countr_zero(mask));
+      // NOLINTBEGIN(cppcoreguidelines-pro-bounds-constant-array-index)
+      const ReaderStats& reader = stats.readers[i];
+      Progress& last = this->readers_[i];
+      // NOLINTEND(cppcoreguidelines-pro-bounds-constant-array-index)
+      // both counters only grow, the sum changes if either of them does
+      const uint64_t progress = reader.message_count.load(std::memory_order_relaxed) +
+                                reader.heartbeat.load(std::memory_order_relaxed);
+      if (last.since_ns == 0 || progress != last.value) {
+        last = Progress{progress, now_ns};
+        continue;
+      }
+      if (now_ns - last.since_ns < this->timeout_ns_) {
+        continue;
+      }
+      const uint64_t pid = reader.pid.load(std::memory_order_relaxed);
+      if (pid == 0 || !process_alive(pid)) {
+        result |= uint64_t{1} << i;
+      }
+    }
+    return result;
+  }
+
+  /// @brief Time since the last progress of the reader, `0` if it was not tracked.
+  [[nodiscard]] auto idle_ns(const ReaderId& id, const uint64_t now_ns) const noexcept -> uint64_t {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-constant-array-index)
+    const Progress& last = this->readers_[id.value() - 1];
+    return last.since_ns == 0 ? 0 : now_ns - last.since_ns;
+  }
+
+ private:
+  struct Progress {
+    uint64_t value{0};
+    uint64_t since_ns{0};  // `0`: not tracked yet
+  };
+
+  uint64_t timeout_ns_;
+  std::array<Progress, MAX_READER_NUM> readers_{};
+};
+
+}  // namespace lshl::demux::core
@@ -0,0 +1,190 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "./columnar_batch.h"
+#include <cassert>
+#include <cstddef>
+#include <iostream>
+#include <span>
+#include <stdexcept>
+#include "../util/boost_log_util.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define LSHL_DEMUX_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace lshl::demux::example {
+
+using std::size_t;
+using std::span;
+
+auto operator<<(std::ostream& os, const SimdLevel& x) -> std::ostream& {
+  switch (x) {
+    case SimdLevel::Scalar:
+      os << "Scalar";
+      break;
+    case SimdLevel::Avx2:
+      os << "Avx2";
+      break;
+  }
+  return os;
+}
+
+auto detect_simd_level() noexcept -> SimdLevel {
+#if defined(LSHL_DEMUX_AVX2)
+  static const SimdLevel result = __builtin_cpu_supports("avx2") ? SimdLevel::Avx2 : SimdLevel::Scalar;
+  return result;
+#else
+  return SimdLevel::Scalar;
+#endif
+}
+
+MarketDataBatch::MarketDataBatch(const size_t capacity) noexcept(false)
+    : prices_(capacity), sizes_(capacity), instrument_ids_(capacity) {
+  if (capacity == 0) {
+    throw std::invalid_argument("MarketDataBatch capacity must be greater than 0");
+  }
+}
+
+namespace {
+
+auto multiply_scalar(span<const double> x, span<const double> y, span<double> output) noexcept -> void {
+  for (size_t i = 0; i < x.size(); ++i) {
+    output[i] = x[i] * y[i];
+  }
+}
+
+auto dot_scalar(span<const double> x, span<const double> y) noexcept -> double {
+  double result = 0;
+  for (size_t i = 0; i < x.size(); ++i) {
+    result += x[i] * y[i];
+  }
+  return result;
+}
+
+auto sum_scalar(span<const double> x) noexcept -> double {
+  double result = 0;
+  for (const double a : x) {
+    result += a;
+  }
+  return result;
+}
+
+#if defined(LSHL_DEMUX_AVX2)
+
+// 4 doubles per register, unaligned loads, the columns are `std::vector`s, the remainder is scalar
+constexpr size_t AVX2_WIDTH = 4;
+
+LSHL_DEMUX_AVX2 auto horizontal_sum(const __m256d x) noexcept -> double {
+  const __m128d a = _mm_add_pd(_mm256_castpd256_pd128(x), _mm256_extractf128_pd(x, 1));
+  return _mm_cvtsd_f64(_mm_add_sd(a, _mm_unpackhi_pd(a, a)));
+}
+
+LSHL_DEMUX_AVX2 auto multiply_avx2(span<const double> x, span<const double> y, span<double> output) noexcept -> void {
+  const size_t n = x.size() - (x.size() % AVX2_WIDTH);
+  for (size_t i = 0; i < n; i += AVX2_WIDTH) {
+    const __m256d a = _mm256_loadu_pd(&x[i]);
+    const __m256d b = _mm256_loadu_pd(&y[i]);
+    _mm256_storeu_pd(&output[i], _mm256_mul_pd(a, b));
+  }
+  multiply_scalar(x.subspan(n), y.subspan(n), output.subspan(n));
+}
+
+// two accumulators hide the latency of the dependent additions
+LSHL_DEMUX_AVX2 auto dot_avx2(span<const double> x, span<const double> y) noexcept -> double {
+  const size_t n = x.size() - (x.size() % (2 * AVX2_WIDTH));
+  __m256d acc0 = _mm256_setzero_pd();
+  __m256d acc1 = _mm256_setzero_pd();
+  for (size_t i = 0; i < n; i += 2 * AVX2_WIDTH) {
+    acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(_mm256_loadu_pd(&x[i]), _mm256_loadu_pd(&y[i])));
+    acc1 = _mm256_add_pd(
+        acc1, _mm256_mul_pd(_mm256_loadu_pd(&x[i + AVX2_WIDTH]), _mm256_loadu_pd(&y[i + AVX2_WIDTH]))
+    );
+  }
+  return horizontal_sum(_mm256_add_pd(acc0, acc1)) + dot_scalar(x.subspan(n), y.subspan(n));
+}
+
+LSHL_DEMUX_AVX2 auto sum_avx2(span<const double> x) noexcept -> double {
+  const size_t n = x.size() - (x.size() % (2 * AVX2_WIDTH));
+  __m256d acc0 = _mm256_setzero_pd();
+  __m256d acc1 = _mm256_setzero_pd();
+  for (size_t i = 0; i < n; i += 2 * AVX2_WIDTH) {
+    acc0 = _mm256_add_pd(acc0, _mm256_loadu_pd(&x[i]));
+    acc1 = _mm256_add_pd(acc1, _mm256_loadu_pd(&x[i + AVX2_WIDTH]));
+  }
+  return horizontal_sum(_mm256_add_pd(acc0, acc1)) + sum_scalar(x.subspan(n));
+}
+
+#endif
+
+// `SimdLevel::Avx2` is only used if the CPU supports it
+auto use_avx2(const SimdLevel simd) noexcept -> bool {
+  return simd == SimdLevel::Avx2 && detect_simd_level() == SimdLevel::Avx2;
+}
+
+}  // namespace
+
+auto multiply(const SimdLevel simd, span<const double> x, span<const double> y, span<double> output) noexcept
+    -> void {
+  assert(x.size() == y.size() && x.size() <= output.size());
+#if defined(LSHL_DEMUX_AVX2)
+  if (use_avx2(simd)) {
+    multiply_avx2(x, y, output);
+    return;
+  }
+#endif
+  multiply_scalar(x, y, output);
+}
+
+auto dot(const SimdLevel simd, span<const double> x, span<const double> y) noexcept -> double {
+  assert(x.size() == y.size());
+#if defined(LSHL_DEMUX_AVX2)
+  if (use_avx2(simd)) {
+    return dot_avx2(x, y);
+  }
+#endif
+  return dot_scalar(x, y);
+}
+
+auto sum(const SimdLevel simd, span<const double> x) noexcept -> double {
+#if defined(LSHL_DEMUX_AVX2)
+  if (use_avx2(simd)) {
+    return sum_avx2(x);
+  }
+#endif
+  return sum_scalar(x);
+}
+
+VwapAggregator::VwapAggregator(
+    const size_t max_instruments,
+    const size_t batch_capacity,
+    const SimdLevel simd
+) noexcept(false)
+    : simd_(use_avx2(simd) ? SimdLevel::Avx2 : SimdLevel::Scalar),
+      instruments_(max_instruments),
+      notional_(batch_capacity) {
+  if (simd != this->simd_) {
+    LOG_WARNING << "[VwapAggregator] " << simd << " is not supported, using " << this->simd_;
+  }
+}
+
+auto VwapAggregator::add(const MarketDataBatch& batch) noexcept -> size_t {
+  assert(batch.size() <= this->notional_.size());
+  const span<const double> sizes = batch.sizes();
+  const span<const uint32_t> ids = batch.instrument_ids();
+  multiply(this->simd_, batch.prices(), sizes, this->notional_);
+  size_t skipped = 0;
+  for (size_t i = 0; i < batch.size(); ++i) {
+    Vwap* x = this->instruments_.upsert(ids[i]);
+    if (x == nullptr) {
+      skipped += 1;
+      continue;
+    }
+    x->notional += this->notional_[i];
+    x->size += sizes[i];
+  }
+  return skipped;
+}
+
+}  // namespace lshl::demux::example
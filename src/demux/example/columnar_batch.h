@@ -0,0 +1,146 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <span>
+#include <vector>
+#include "../core/demultiplexer.h"
+#include "../util/flat_table.h"
+#include "./market_data.h"
+
+namespace lshl::demux::example {
+
+using std::size_t;
+using std::span;
+using std::uint16_t;
+using std::uint32_t;
+using std::uint64_t;
+
+enum class SimdLevel : std::uint8_t { Scalar, Avx2 };
+
+auto operator<<(std::ostream& os, const SimdLevel& x) -> std::ostream&;
+
+/// @brief The best kernels the CPU supports, detected once.
+[[nodiscard]] auto detect_simd_level() noexcept -> SimdLevel;
+
+/// @brief Columns of a run of `MarketDataUpdate`s, the transposed batch. Prices and sizes are converted to `double`
+/// once, so the aggregation kernels are plain vector multiplications and additions. Prices keep the fixed-point scale
+/// of `MarketDataUpdate::price`. The columns are allocated once in the constructor.
+class MarketDataBatch {
+ public:
+  explicit MarketDataBatch(size_t capacity) noexcept(false);
+
+  /// @return `false` if the batch is full.
+  auto append(const MarketDataUpdate& md) noexcept -> bool {
+    if (this->full()) {
+      return false;
+    }
+    this->prices_[this->size_] = static_cast<double>(md.price);
+    this->sizes_[this->size_] = static_cast<double>(md.size);
+    this->instrument_ids_[this->size_] = md.instrument_id;
+    this->size_ += 1;
+    return true;
+  }
+
+  /// @brief Reads the available updates until the batch is full, does not block.
+  /// @return number of appended updates.
+  template <size_t L, uint16_t M>
+  auto drain(lshl::demux::core::DemuxReader<L, M>* reader) noexcept -> size_t {
+    const size_t size = this->size_;
+    // the lag counts the wraparound markers too, it bounds the loop, the reader does not chase the writer
+    for (uint64_t n = reader->lag(); n > 0 && !this->full(); --n) {
+      const std::optional<const MarketDataUpdate*> x = reader->template next_unsafe<MarketDataUpdate>();
+      if (x.has_value()) {
+        this->append(*x.value());
+      }
+    }
+    return this->size_ - size;
+  }
+
+  auto clear() noexcept -> void { this->size_ = 0; }
+
+  [[nodiscard]] auto prices() const noexcept -> span<const double> { return {this->prices_.data(), this->size_}; }
+
+  [[nodiscard]] auto sizes() const noexcept -> span<const double> { return {this->sizes_.data(), this->size_}; }
+
+  [[nodiscard]] auto instrument_ids() const noexcept -> span<const uint32_t> {
+    return {this->instrument_ids_.data(), this->size_};
+  }
+
+  [[nodiscard]] auto size() const noexcept -> size_t { return this->size_; }
+
+  [[nodiscard]] auto capacity() const noexcept -> size_t { return this->prices_.size(); }
+
+  [[nodiscard]] auto empty() const noexcept -> bool { return this->size_ == 0; }
+
+  [[nodiscard]] auto full() const noexcept -> bool { return this->size_ == this->prices_.size(); }
+
+ private:
+  std::vector<double> prices_;
+  std::vector<double> sizes_;
+  std::vector<uint32_t> instrument_ids_;
+  size_t size_{0};
+};
+
+//
+// kernels, `x` and `y` of the same size, `SimdLevel::Avx2` falls back to scalar if the CPU does not support it
+//
+
+/// @brief `output[i] = x[i] * y[i]`.
+auto multiply(SimdLevel simd, span<const double> x, span<const double> y, span<double> output) noexcept -> void;
+
+/// @brief `sum(x[i] * y[i])`, the total notional of a batch.
+[[nodiscard]] auto dot(SimdLevel simd, span<const double> x, span<const double> y) noexcept -> double;
+
+[[nodiscard]] auto sum(SimdLevel simd, span<const double> x) noexcept -> double;
+
+// NOLINTBEGIN(misc-non-private-member-variables-in-classes)
+struct Vwap {
+  double notional{0};  // sum of `price * size`
+  double size{0};
+
+  [[nodiscard]] auto value() const noexcept -> double { return this->size == 0 ? 0 : this->notional / this->size; }
+};
+// NOLINTEND(misc-non-private-member-variables-in-classes)
+
+/// @brief Notional and VWAP per instrument, either one update at a time or one `MarketDataBatch` at a time. The batch
+/// path computes the notional column with the SIMD kernel, then accumulates it per instrument. Allocates in the
+/// constructor only, updates of new instruments are skipped when the instrument table is full.
+class VwapAggregator {
+ public:
+  /// @param `batch_capacity` max batch size, the capacity of the notional column.
+  VwapAggregator(size_t max_instruments, size_t batch_capacity, SimdLevel simd = detect_simd_level()) noexcept(false);
+
+  /// @return `false` if the instrument table is full.
+  auto add(const MarketDataUpdate& md) noexcept -> bool {
+    Vwap* x = this->instruments_.upsert(md.instrument_id);
+    if (x == nullptr) {
+      return false;
+    }
+    x->notional += static_cast<double>(md.price) * static_cast<double>(md.size);
+    x->size += static_cast<double>(md.size);
+    return true;
+  }
+
+  /// @return number of skipped updates, the instrument table is full.
+  auto add(const MarketDataBatch& batch) noexcept -> size_t;
+
+  /// @return `nullptr` if no updates of the instrument were added.
+  [[nodiscard]] auto find(const uint32_t instrument_id) const noexcept -> const Vwap* {
+    return this->instruments_.find(instrument_id);
+  }
+
+  [[nodiscard]] auto simd() const noexcept -> SimdLevel { return this->simd_; }
+
+ private:
+  SimdLevel simd_;
+  lshl::demux::util::FlatTable<uint32_t, Vwap> instruments_;
+  std::vector<double> notional_;  // notional column of the current batch
+};
+
+}  // namespace lshl::demux::example
@@ -0,0 +1,124 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include "../core/demultiplexer.h"
+#include "../util/flat_table.h"
+#include "./market_data.h"
+
+namespace lshl::demux::example {
+
+using lshl::demux::core::DemuxReader;
+using std::size_t;
+using std::uint16_t;
+using std::uint64_t;
+using std::uint8_t;
+
+/// @brief Conflation key, `(instrument_id, side, level)` packed into 64 bits.
+[[nodiscard]] inline auto conflation_key(const MarketDataUpdate& md) noexcept -> uint64_t {
+  constexpr unsigned INSTRUMENT_SHIFT = 16U;
+  constexpr unsigned SIDE_SHIFT = 8U;
+  return (static_cast<uint64_t>(md.instrument_id) << INSTRUMENT_SHIFT) |
+         (static_cast<uint64_t>(md.side) << SIDE_SHIFT) | static_cast<uint64_t>(md.level);
+}
+
+/// @brief Copy of a `MarketDataUpdate` in the conflation table, `MarketDataUpdate` itself is not copyable.
+struct alignas(MarketDataUpdate) ConflatedUpdate {
+  std::array<uint8_t, sizeof(MarketDataUpdate)> bytes{};  // NOLINT(misc-non-private-member-variables-in-classes)
+};
+
+/// @brief Market data consumer on top of `DemuxReader` that conflates updates when the reader falls behind. While the
+/// reader lag is within `lag_threshold` messages every update is delivered from the circular buffer. When the lag
+/// exceeds it, the reader drains the pending updates into a table keyed by `(instrument_id, side, level)` and delivers
+/// only the latest update per key, in the order the keys were first seen. A batch is bounded by the lag at its start
+/// and by `max_keys`, so the delivery lag is bounded by the number of distinct keys rather than by the message volume.
+/// No allocations after the constructor.
+template <size_t L, uint16_t M>
+class ConflatingReader {
+ public:
+  /// @param `reader` underlying reader, must outlive the conflating reader.
+  /// @param `lag_threshold` conflation starts when the reader lag exceeds this number of messages.
+  /// @param `max_keys` max distinct keys per conflation batch, the table capacity.
+  ConflatingReader(DemuxReader<L, M>* reader, const uint64_t lag_threshold, const size_t max_keys) noexcept(false)
+      : reader_(reader), lag_threshold_(lag_threshold), table_(max_keys) {}
+
+  /// @brief Does not block.
+  /// @return the next update or `std::nullopt` if no data available. The pointer is valid until the next call.
+  [[nodiscard]] auto next() noexcept -> std::optional<const MarketDataUpdate*> {
+    if (this->delivered_ < this->table_.size()) {
+      return this->deliver();
+    }
+    if (!this->table_.empty()) {
+      this->table_.clear();
+      this->delivered_ = 0;
+    }
+    if (this->reader_->lag() > this->lag_threshold_) {
+      this->fill();
+      if (!this->table_.empty()) {
+        return this->deliver();
+      }
+      return std::nullopt;  // wraparound markers only
+    }
+    const std::optional<const MarketDataUpdate*> x = this->reader_->template next_unsafe<MarketDataUpdate>();
+    if (x.has_value()) {
+      this->read_count_ += 1;
+    }
+    return x;
+  }
+
+  /// @brief Updates read from the circular buffer.
+  [[nodiscard]] auto read_count() const noexcept -> uint64_t { return this->read_count_; }
+
+  /// @brief Updates replaced by a later update with the same key, never delivered.
+  [[nodiscard]] auto conflated_count() const noexcept -> uint64_t { return this->conflated_count_; }
+
+  /// @brief Conflation batches, one per `fill`.
+  [[nodiscard]] auto batch_count() const noexcept -> uint64_t { return this->batch_count_; }
+
+  /// @brief `true` while delivering a conflation batch.
+  [[nodiscard]] auto is_conflating() const noexcept -> bool { return this->delivered_ < this->table_.size(); }
+
+ private:
+  auto fill() noexcept -> void {
+    // bounded by the lag at the start of the batch, does not chase the writer
+    const uint64_t n = this->reader_->lag();
+    // the table is checked before reading, a read update is never dropped
+    for (uint64_t i = 0; i < n && !this->table_.full(); ++i) {
+      const std::optional<const MarketDataUpdate*> x = this->reader_->template next_unsafe<MarketDataUpdate>();
+      if (!x.has_value()) {
+        continue;  // wraparound marker, the lag counts them
+      }
+      this->read_count_ += 1;
+      const size_t size = this->table_.size();
+      ConflatedUpdate* slot = this->table_.upsert(conflation_key(*x.value()));
+      if (this->table_.size() == size) {
+        this->conflated_count_ += 1;
+      }
+      std::memcpy(slot->bytes.data(), x.value(), sizeof(MarketDataUpdate));
+    }
+    this->batch_count_ += 1;
+  }
+
+  [[nodiscard]] auto deliver() noexcept -> std::optional<const MarketDataUpdate*> {
+    const ConflatedUpdate& x = this->table_.value(this->delivered_);
+    this->delivered_ += 1;
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    return reinterpret_cast<const MarketDataUpdate*>(x.bytes.data());
+  }
+
+  DemuxReader<L, M>* reader_;
+  uint64_t lag_threshold_;
+  lshl::demux::util::FlatTable<uint64_t, ConflatedUpdate> table_;
+  size_t delivered_{0};  // table entries delivered from the current batch
+  uint64_t read_count_{0};
+  uint64_t conflated_count_{0};
+  uint64_t batch_count_{0};
+};
+
+}  // namespace lshl::demux::example
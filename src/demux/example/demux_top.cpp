@@ -0,0 +1,290 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+// Live monitoring of a running `shm_demux` ring. Maps the control lines of the segment read-only and not the ring, so
+// it never takes part in the wraparound protocol and cannot slow down the writer or the readers.
+
+#include <array>
+#include <atomic>
+#include <boost/exception/diagnostic_information.hpp>
+#include <boost/exception/exception.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/log/expressions.hpp>  // NOLINT(misc-include-cleaner)
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../core/demultiplexer.h"
+#include "../core/demux_stats.h"
+#include "../core/reader_id.h"
+#include "../util/boost_log_util.h"
+#include "../util/shm_segment.h"
+#include "./shm_config.h"
+
+namespace {
+auto print_usage(const char* prog) -> void {
+  std::cerr << "Usage: " << prog << " [--interval=<milliseconds>] [--count=<number>] [--json]\n"
+            << "  where\n"
+            << "    --interval  refresh interval, default: 1000\n"
+            << "    --count     number of refreshes, runs until interrupted if omitted\n"
+            << "    --json      prints one JSON object per refresh\n";
+}
+}  // namespace
+
+namespace lshl::demux::example {
+
+using lshl::demux::core::DemuxStats;
+using lshl::demux::core::ReaderId;
+using lshl::demux::core::ReaderStats;
+using lshl::demux::core::WriterStats;
+using lshl::demux::util::FrameFormat;
+using lshl::demux::util::SegmentAccess;
+using std::array;
+using std::atomic;
+using std::size_t;
+using std::span;
+using std::uint64_t;
+using std::uint8_t;
+using std::vector;
+
+// NOLINTBEGIN(misc-non-private-member-variables-in-classes)
+struct TopConfig {
+  std::chrono::milliseconds interval{1000};
+  uint64_t count{0};  // zero - until interrupted
+  bool json{false};
+};
+
+/// @brief Plain copy of the counters taken at one point in time.
+struct Counters {
+  uint64_t message_count{0};
+  uint64_t byte_count{0};
+  uint64_t repeat_count{0};
+  uint64_t wraparound_count{0};
+  uint64_t wraparound_wait_ns{0};
+  uint64_t position{0};
+};
+
+struct Snapshot {
+  std::chrono::steady_clock::time_point time{};
+  uint64_t all_readers_mask{0};
+  uint64_t wraparound_sync{0};
+  uint64_t evicted_count{0};
+  Counters writer{};
+  array<Counters, lshl::demux::core::MAX_READER_NUM> readers{};
+};
+// NOLINTEND(misc-non-private-member-variables-in-classes)
+
+auto relaxed(const atomic<uint64_t>& x) noexcept -> uint64_t {
+  return x.load(std::memory_order_relaxed);
+}
+
+auto take_snapshot(const DemuxStats& stats, const atomic<uint64_t>& wraparound_sync) noexcept -> Snapshot {
+  Snapshot result{};
+  result.time = std::chrono::steady_clock::now();
+  const WriterStats& w = stats.writer;
+  result.all_readers_mask = relaxed(w.all_readers_mask);
+  result.wraparound_sync = wraparound_sync.load();
+  result.evicted_count = relaxed(w.evicted_count);
+  result.writer = Counters{
+      relaxed(w.message_count), relaxed(w.byte_count),         relaxed(w.repeat_count),
+      relaxed(w.wraparound_count), relaxed(w.wraparound_wait_ns), 0
+  };
+  for (const ReaderId& id : lshl::demux::core::mask_to_reader_ids(result.all_readers_mask)) {
+    const ReaderStats& r = stats.reader(id);
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-constant-array-index)
+    result.readers[id.value() - 1] = Counters{
+        relaxed(r.message_count),    relaxed(r.byte_count),         0,
+        relaxed(r.wraparound_count), relaxed(r.wraparound_wait_ns), relaxed(r.position)
+    };
+  }
+  return result;
+}
+
+/// @brief Rates per second between two snapshots.
+struct Row {
+  double msgs_per_sec{0.0};
+  double mb_per_sec{0.0};
+  double repeats_per_sec{0.0};
+  double wraparounds_per_sec{0.0};
+  double wraparound_wait_ms_per_sec{0.0};  // share of each second spent waiting at wraparounds
+  uint64_t position{0};
+};
+
+auto make_row(const Counters& x0, const Counters& x1, const double seconds) noexcept -> Row {
+  constexpr double BYTES_IN_MB = 1'000'000.0;
+  constexpr double NS_IN_MS = 1'000'000.0;
+  const auto rate = [seconds](const uint64_t a, const uint64_t b) {
+    return b > a ? static_cast<double>(b - a) / seconds : 0.0;
+  };
+  Row result{};
+  result.msgs_per_sec = rate(x0.message_count, x1.message_count);
+  result.mb_per_sec = rate(x0.byte_count, x1.byte_count) / BYTES_IN_MB;
+  result.repeats_per_sec = rate(x0.repeat_count, x1.repeat_count);
+  result.wraparounds_per_sec = rate(x0.wraparound_count, x1.wraparound_count);
+  result.wraparound_wait_ms_per_sec = rate(x0.wraparound_wait_ns, x1.wraparound_wait_ns) / NS_IN_MS;
+  result.position = x1.position;
+  return result;
+}
+
+auto lag(const uint64_t written, const uint64_t read) noexcept -> uint64_t {
+  return written > read ? written - read : 0;
+}
+
+/// @brief Readers that have not reached the wraparound marker yet, empty when no wraparound is pending.
+auto lagging_readers(const Snapshot& x) -> vector<ReaderId> {
+  if (x.writer.wraparound_count == 0) {
+    return {};  // `wraparound_sync` starts at zero, it has the reader bits after the first wraparound only
+  }
+  // an evicted reader can still set its bit
+  return lshl::demux::core::mask_to_reader_ids(~x.wraparound_sync & x.all_readers_mask);
+}
+
+auto print_table(const Snapshot& x0, const Snapshot& x1) -> void {
+  constexpr int WIDTH = 15;
+  const double seconds = std::chrono::duration<double>(x1.time - x0.time).count();
+  const Row w = make_row(x0.writer, x1.writer, seconds);
+
+  std::stringstream out;
+  out << std::fixed << std::setprecision(1);
+  out << "\n" << std::setw(WIDTH) << "" << std::setw(WIDTH) << "msgs/s" << std::setw(WIDTH) << "MB/s"
+      << std::setw(WIDTH) << "lag_msgs" << std::setw(WIDTH) << "lag_bytes" << std::setw(WIDTH) << "position"
+      << std::setw(WIDTH) << "repeats/s" << std::setw(WIDTH) << "wraps/s" << std::setw(WIDTH) << "wrap_wait_ms/s"
+      << '\n';
+  out << std::setw(WIDTH) << "writer" << std::setw(WIDTH) << w.msgs_per_sec << std::setw(WIDTH) << w.mb_per_sec
+      << std::setw(WIDTH) << "-" << std::setw(WIDTH) << "-" << std::setw(WIDTH) << "-" << std::setw(WIDTH)
+      << w.repeats_per_sec << std::setw(WIDTH) << w.wraparounds_per_sec << std::setw(WIDTH)
+      << w.wraparound_wait_ms_per_sec << '\n';
+  for (const ReaderId& id : lshl::demux::core::mask_to_reader_ids(x1.all_readers_mask)) {
+    const size_t i = id.value() - 1U;
+    const Counters& r1 = x1.readers.at(i);
+    const Row r = make_row(x0.readers.at(i), r1, seconds);
+    out << std::setw(WIDTH) << ("reader " + std::to_string(id.value())) << std::setw(WIDTH) << r.msgs_per_sec
+        << std::setw(WIDTH) << r.mb_per_sec << std::setw(WIDTH) << lag(x1.writer.message_count, r1.message_count)
+        << std::setw(WIDTH) << lag(x1.writer.byte_count, r1.byte_count) << std::setw(WIDTH) << r.position
+        << std::setw(WIDTH) << "-" << std::setw(WIDTH) << r.wraparounds_per_sec << std::setw(WIDTH)
+        << r.wraparound_wait_ms_per_sec << '\n';
+  }
+  out << "lagging readers: " << lagging_readers(x1) << ", evicted readers: " << x1.evicted_count << '\n';
+  std::cout << out.str() << std::flush;
+}
+
+auto print_json(const Snapshot& x0, const Snapshot& x1) -> void {
+  const double seconds = std::chrono::duration<double>(x1.time - x0.time).count();
+  const Row w = make_row(x0.writer, x1.writer, seconds);
+  const auto since_epoch = std::chrono::system_clock::now().time_since_epoch();
+
+  std::stringstream out;
+  out << std::fixed << std::setprecision(1);
+  out << R"({"timestamp_ms":)" << std::chrono::duration_cast<std::chrono::milliseconds>(since_epoch).count()
+      << R"(,"writer":{"message_count":)" << x1.writer.message_count << R"(,"msgs_per_sec":)" << w.msgs_per_sec
+      << R"(,"mb_per_sec":)" << w.mb_per_sec << R"(,"repeats_per_sec":)" << w.repeats_per_sec
+      << R"(,"wraparounds_per_sec":)" << w.wraparounds_per_sec << R"(,"wraparound_wait_ms_per_sec":)"
+      << w.wraparound_wait_ms_per_sec << R"(,"evicted_count":)" << x1.evicted_count << R"(},"readers":[)";
+  bool first = true;
+  for (const ReaderId& id : lshl::demux::core::mask_to_reader_ids(x1.all_readers_mask)) {
+    const size_t i = id.value() - 1U;
+    const Counters& r1 = x1.readers.at(i);
+    const Row r = make_row(x0.readers.at(i), r1, seconds);
+    out << (first ? "" : ",") << R"({"id":)" << static_cast<int>(id.value()) << R"(,"message_count":)"
+        << r1.message_count << R"(,"msgs_per_sec":)" << r.msgs_per_sec << R"(,"mb_per_sec":)" << r.mb_per_sec
+        << R"(,"lag_messages":)" << lag(x1.writer.message_count, r1.message_count) << R"(,"lag_bytes":)"
+        << lag(x1.writer.byte_count, r1.byte_count) << R"(,"position":)" << r.position
+        << R"(,"wraparounds_per_sec":)" << r.wraparounds_per_sec << R"(,"wraparound_wait_ms_per_sec":)"
+        << r.wraparound_wait_ms_per_sec << '}';
+    first = false;
+  }
+  out << R"(],"lagging_readers":[)";
+  first = true;
+  for (const ReaderId& id : lagging_readers(x1)) {
+    out << (first ? "" : ",") << static_cast<int>(id.value());
+    first = false;
+  }
+  out << "]}\n";
+  std::cout << out.str() << std::flush;
+}
+
+auto parse_args(const span<char*> args) noexcept(false) -> TopConfig {
+  TopConfig result{};
+  for (const char* arg : args.subspan(1)) {
+    const std::string x(arg);
+    const size_t eq = x.find('=');
+    const std::string key = x.substr(0, eq);
+    const std::string value = eq == std::string::npos ? std::string() : x.substr(eq + 1);
+    if (key == "--interval") {
+      result.interval = std::chrono::milliseconds(boost::lexical_cast<uint64_t>(value));
+    } else if (key == "--count") {
+      result.count = boost::lexical_cast<uint64_t>(value);
+    } else if (key == "--json") {
+      result.json = true;
+    } else {
+      throw std::invalid_argument("unexpected argument: " + x);
+    }
+  }
+  if (result.interval.count() == 0) {
+    throw std::invalid_argument("interval must be positive");
+  }
+  return result;
+}
+
+auto main_(const span<char*> args) noexcept(false) -> int {
+  constexpr int ERROR = 200;
+
+  // NOLINTNEXTLINE(misc-include-cleaner)
+  boost::log::core::get()->set_filter(boost::log::trivial::severity >= boost::log::trivial::warning);
+
+  TopConfig config{};
+  try {
+    config = parse_args(args);
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << '\n';
+    print_usage(args[0]);
+    return ERROR;
+  }
+
+  // the header is validated before the control lines are mapped, a segment of another build is rejected
+  const auto segment = ShmDemuxSegment<BUFFER_SIZE, MAX_MESSAGE_SIZE>::open(
+      SEGMENT_SHARED_MEM_NAME, FrameFormat::Plain, SegmentAccess::Monitor
+  );
+  const DemuxStats* stats = &segment.control()->stats;
+  const atomic<uint64_t>* wraparound_sync = &segment.control()->wraparound_sync;
+
+  Snapshot x0 = take_snapshot(*stats, *wraparound_sync);
+  for (uint64_t i = 0; config.count == 0 || i < config.count; ++i) {
+    std::this_thread::sleep_for(config.interval);  // NOLINT(misc-include-cleaner)
+    const Snapshot x1 = take_snapshot(*stats, *wraparound_sync);
+    if (config.json) {
+      print_json(x0, x1);
+    } else {
+      print_table(x0, x1);
+    }
+    x0 = x1;
+  }
+  return 0;
+}
+
+}  // namespace lshl::demux::example
+
+auto main(int argc, char* argv[]) noexcept -> int {
+  constexpr int ERROR = 100;
+  try {
+    const auto args = std::span<char*>(argv, static_cast<size_t>(argc));
+    return lshl::demux::example::main_(args);
+  } catch (const boost::exception& e) {
+    LOG_ERROR << "boost::exception: " << boost::diagnostic_information(e);
+    return ERROR;
+  } catch (const std::exception& e) {
+    LOG_ERROR << "std::exception: " << e.what();
+    return ERROR;
+  } catch (...) {
+    LOG_ERROR << "unexpected exception";
+    return ERROR;
+  }
+}
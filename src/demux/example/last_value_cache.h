@@ -0,0 +1,245 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include "../core/demux_stats.h"
+#include "./market_data.h"
+
+namespace lshl::demux::example {
+
+using std::atomic;
+using std::size_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::uint8_t;
+
+/// @brief Position in the circular buffer after the last applied update, `DemuxReader::resume_from` takes it.
+// NOLINTBEGIN(misc-non-private-member-variables-in-classes)
+struct RingCursor {
+  uint64_t message_count{0};  // messages read, including the wraparound markers, the sequence of the last message
+  size_t position{0};         // byte offset of the next message
+  uint64_t byte_count{0};     // bytes read in all laps, `DemuxReader::byte_count()`
+};
+
+struct LevelSnapshot {
+  uint64_t timestamp{0};
+  uint64_t price{0};
+  uint32_t size{0};
+};
+
+/// @brief Consistent copy of one instrument, `levels[side * LEVELS + level]`.
+template <size_t LEVELS>
+struct InstrumentSnapshot {
+  uint32_t instrument_id{0};
+  uint64_t message_count{0};  // ring sequence of the last update applied to the instrument
+  std::array<LevelSnapshot, 2 * LEVELS> levels{};
+};
+// NOLINTEND(misc-non-private-member-variables-in-classes)
+
+/// @brief Last-value cache of the market data stream, the last update per instrument, side and level. Flat and
+/// trivially destructible, so it can be constructed in shared memory next to the circular buffer. Maintained by a
+/// single process, the writer or a dedicated reader, late-joining and restarted readers copy it without locks.
+///
+/// Every instrument occupies its own cache-line-aligned entry published with a seqlock: the maintainer makes the
+/// sequence odd, updates the fields and makes it even again, a reader retries the copy if the sequence was odd or
+/// changed. The fields are relaxed atomics, so the racy copy is well defined. Instruments are placed with linear
+/// probing within `MAX_PROBE` entries and never removed, a miss on a full table costs `MAX_PROBE` loads, not `N`.
+/// Levels `>= LEVELS` are not cached.
+///
+/// Snapshot protocol: load the `cursor()`, copy the instruments, continue reading the ring from the cursor and skip
+/// the updates with a sequence `<=` the instrument's `message_count`, they are already in the copy.
+/// @tparam `N` max number of instruments.
+/// @tparam `LEVELS` cached levels per side.
+template <size_t N, size_t LEVELS>
+  requires(N > 0 && LEVELS > 0)
+class LastValueCache {
+ public:
+  /// @brief Applies the update, maintainer only.
+  /// @param `message_count` ring sequence of the update, `DemuxWriter::message_count()` after writing it or
+  /// `DemuxReader::message_count()` after reading it.
+  /// @return `false` if the level is not cached or the instrument's probe sequence is full.
+  auto apply(const MarketDataUpdate& md, const uint64_t message_count) noexcept -> bool {
+    if (md.level >= LEVELS) {
+      lshl::demux::core::increment(&this->skipped_count_);
+      return false;
+    }
+    Entry* entry = this->find_or_insert(md.instrument_id);
+    if (entry == nullptr) {
+      lshl::demux::core::increment(&this->skipped_count_);
+      return false;
+    }
+    Level& level = entry->levels[level_index(md)];
+    write_locked(&entry->seq, [&] {
+      entry->message_count.store(message_count, std::memory_order_relaxed);
+      level.timestamp.store(md.timestamp, std::memory_order_relaxed);
+      level.price.store(md.price, std::memory_order_relaxed);
+      level.size.store(md.size, std::memory_order_relaxed);
+    });
+    return true;
+  }
+
+  /// @brief Publishes the ring position after the last applied update, maintainer only.
+  auto publish_cursor(const RingCursor& x) noexcept -> void {
+    write_locked(&this->cursor_seq_, [&] {
+      this->cursor_message_count_.store(x.message_count, std::memory_order_relaxed);
+      this->cursor_position_.store(x.position, std::memory_order_relaxed);
+      this->cursor_byte_count_.store(x.byte_count, std::memory_order_relaxed);
+    });
+  }
+
+  [[nodiscard]] auto cursor() const noexcept -> RingCursor {
+    RingCursor result{};
+    read_locked(&this->cursor_seq_, [&] {
+      result.message_count = this->cursor_message_count_.load(std::memory_order_relaxed);
+      result.position = this->cursor_position_.load(std::memory_order_relaxed);
+      result.byte_count = this->cursor_byte_count_.load(std::memory_order_relaxed);
+    });
+    return result;
+  }
+
+  /// @brief Copies one instrument.
+  /// @return `false` if the instrument is not in the cache.
+  [[nodiscard]] auto read(const uint32_t instrument_id, InstrumentSnapshot<LEVELS>* output) const noexcept -> bool {
+    const Entry* entry = this->find(instrument_id);
+    if (entry == nullptr) {
+      return false;
+    }
+    copy(*entry, output);
+    return true;
+  }
+
+  /// @brief Copies all instruments, calls `f(const InstrumentSnapshot<LEVELS>&)` per instrument.
+  /// @return the cursor loaded before the copy, continue reading the ring from it.
+  template <class F>
+  auto snapshot(F&& f) const -> RingCursor {
+    const RingCursor result = this->cursor();
+    InstrumentSnapshot<LEVELS> x{};
+    for (const Entry& entry : this->entries_) {
+      if (entry.key.load(std::memory_order_acquire) != EMPTY) {
+        copy(entry, &x);
+        f(x);
+      }
+    }
+    return result;
+  }
+
+  /// @brief Updates that were not cached, the level is out of range or the probe sequence is full.
+  [[nodiscard]] auto skipped_count() const noexcept -> uint64_t {
+    return this->skipped_count_.load(std::memory_order_relaxed);
+  }
+
+  [[nodiscard]] static auto level_index(const MarketDataUpdate& md) noexcept -> size_t {
+    return (static_cast<size_t>(md.side) * LEVELS) + md.level;
+  }
+
+  static constexpr size_t MAX_PROBE = N < 16 ? N : 16;
+
+ private:
+  static constexpr uint64_t EMPTY = 0;  // keys are `instrument_id + 1`
+
+  struct Level {
+    atomic<uint64_t> timestamp{0};
+    atomic<uint64_t> price{0};
+    atomic<uint32_t> size{0};
+  };
+
+  struct alignas(std::hardware_destructive_interference_size) Entry {
+    atomic<uint64_t> seq{0};  // odd while the maintainer updates the entry
+    atomic<uint64_t> key{EMPTY};
+    atomic<uint64_t> message_count{0};
+    std::array<Level, 2 * LEVELS> levels{};
+  };
+
+  template <class W>
+  static auto write_locked(atomic<uint64_t>* seq, W&& write) noexcept -> void {
+    const uint64_t s = seq->load(std::memory_order_relaxed);
+    seq->store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);  // the odd sequence is visible before the fields change
+    write();
+    seq->store(s + 2, std::memory_order_release);
+  }
+
+  template <class R>
+  static auto read_locked(const atomic<uint64_t>* seq, R&& read) noexcept -> void {
+    while (true) {
+      const uint64_t s0 = seq->load(std::memory_order_acquire);
+      if ((s0 & 1U) != 0) {
+        continue;  // the maintainer is updating the entry
+      }
+      read();
+      std::atomic_thread_fence(std::memory_order_acquire);  // the fields are loaded before the sequence is re-checked
+      if (seq->load(std::memory_order_relaxed) == s0) {
+        return;
+      }
+    }
+  }
+
+  static auto copy(const Entry& entry, InstrumentSnapshot<LEVELS>* output) noexcept -> void {
+    read_locked(&entry.seq, [&] {
+      output->instrument_id = static_cast<uint32_t>(entry.key.load(std::memory_order_relaxed) - 1);
+      output->message_count = entry.message_count.load(std::memory_order_relaxed);
+      for (size_t i = 0; i < entry.levels.size(); ++i) {
+        const Level& level = entry.levels[i];
+        LevelSnapshot& x = output->levels[i];
+        x.timestamp = level.timestamp.load(std::memory_order_relaxed);
+        x.price = level.price.load(std::memory_order_relaxed);
+        x.size = level.size.load(std::memory_order_relaxed);
+      }
+    });
+  }
+
+  [[nodiscard]] static auto home(const uint32_t instrument_id) noexcept -> size_t {
+    constexpr uint64_t GOLDEN_RATIO = 0x9E3779B97F4A7C15ULL;
+    return static_cast<size_t>((instrument_id * GOLDEN_RATIO) >> 32U) % N;
+  }
+
+  [[nodiscard]] auto find(const uint32_t instrument_id) const noexcept -> const Entry* {
+    const uint64_t key = static_cast<uint64_t>(instrument_id) + 1;
+    size_t i = home(instrument_id);
+    for (size_t probe = 0; probe < MAX_PROBE; ++probe) {
+      const uint64_t x = this->entries_[i].key.load(std::memory_order_acquire);
+      if (x == key) {
+        return &this->entries_[i];
+      }
+      if (x == EMPTY) {
+        return nullptr;
+      }
+      i = i + 1 == N ? 0 : i + 1;
+    }
+    return nullptr;
+  }
+
+  [[nodiscard]] auto find_or_insert(const uint32_t instrument_id) noexcept -> Entry* {
+    const uint64_t key = static_cast<uint64_t>(instrument_id) + 1;
+    size_t i = home(instrument_id);
+    for (size_t probe = 0; probe < MAX_PROBE; ++probe) {
+      Entry& entry = this->entries_[i];
+      const uint64_t x = entry.key.load(std::memory_order_relaxed);
+      if (x == key) {
+        return &entry;
+      }
+      if (x == EMPTY) {
+        // the levels are zero, the release store publishes the key after them
+        entry.key.store(key, std::memory_order_release);
+        return &entry;
+      }
+      i = i + 1 == N ? 0 : i + 1;
+    }
+    return nullptr;
+  }
+
+  alignas(std::hardware_destructive_interference_size) atomic<uint64_t> cursor_seq_{0};
+  atomic<uint64_t> cursor_message_count_{0};
+  atomic<uint64_t> cursor_position_{0};
+  atomic<uint64_t> cursor_byte_count_{0};
+  atomic<uint64_t> skipped_count_{0};
+  std::array<Entry, N> entries_{};
+};
+
+}  // namespace lshl::demux::example
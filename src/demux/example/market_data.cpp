@@ -2,7 +2,6 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "./market_data.h"
-#include <chrono>
 #include <cstdint>
 #include <iostream>
 #include <limits>
@@ -33,10 +32,7 @@ auto operator<<(std::ostream& os, const MarketDataUpdate& md) -> std::ostream& {
 }
 
 auto MarketDataUpdateGenerator::generate_market_data_update(MarketDataUpdate* output) -> void {
-  const std::chrono::time_point<std::chrono::steady_clock, std::chrono::nanoseconds> now =
-      std::chrono::steady_clock::now();
-  const uint64_t x = static_cast<uint64_t>(now.time_since_epoch().count());
-  output->timestamp = x;
+  output->timestamp = this->clock_.now();
   output->instrument_id = this->distU32_(engine_);
   output->side = this->generate_side_();
   output->level = generate_level_();
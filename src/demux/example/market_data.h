@@ -6,6 +6,7 @@
 #include <cstdint>
 #include <iostream>
 #include <random>
+#include "../util/tsc_clock.h"
 
 namespace lshl::demux::example {
 
@@ -40,6 +41,11 @@ auto operator<<(std::ostream& os, const MarketDataUpdate& md) -> std::ostream&;
 
 class MarketDataUpdateGenerator {
  public:
+  MarketDataUpdateGenerator() = default;
+
+  /// @param clock -- timestamps the generated updates, `steady_clock` when TSC is not available.
+  explicit MarketDataUpdateGenerator(const lshl::demux::util::TscClock& clock) : clock_(clock) {}
+
   auto generate_market_data_update(MarketDataUpdate* output) -> void;
 
   static constexpr uint64_t PRICE_MULTIPLIER = 1000000000;
@@ -51,6 +57,7 @@ class MarketDataUpdateGenerator {
   auto generate_price_() -> uint64_t;
   auto generate_size_() -> uint32_t;
 
+  lshl::demux::util::TscClock clock_{};
   std::mt19937 engine_;
   std::uniform_int_distribution<uint32_t> distU32_;
   std::uniform_int_distribution<uint8_t> distU8_;
@@ -0,0 +1,99 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <flatbuffers/flatbuffers.h>
+#include <moldudp64-schema_generated.h>  // generated by flatc from src/demux/schema/moldudp64-schema.fbs
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include "../core/demultiplexer.h"
+#include "../util/boost_log_util.h"
+#include "../util/flatbuffers_util.h"
+
+namespace lshl::demux::example {
+
+using lshl::demux::core::DemuxWriter;
+using lshl::demux::core::WriteResult;
+using std::size_t;
+using std::span;
+using std::uint16_t;
+using std::uint64_t;
+using std::uint8_t;
+
+constexpr size_t MOLDUDP64_SESSION_LENGTH = 10;
+
+using MoldUdp64Session = std::array<uint8_t, MOLDUDP64_SESSION_LENGTH>;
+
+/// @brief Upper bound of the serialized `DownstreamPacket`/`UpstreamPacket` size: the root offset, the vtable, the
+/// table with the inlined `Header` struct, the vector length prefix and the alignment padding.
+constexpr size_t MOLDUDP64_PACKET_OVERHEAD = 128;
+
+/// @brief Space to reserve in the circular buffer for a packet carrying `message_length` bytes.
+[[nodiscard]] constexpr auto moldudp64_packet_capacity(const size_t message_length) noexcept -> size_t {
+  constexpr size_t A = lshl::demux::util::FLATBUFFERS_ALIGNMENT;
+  return (MOLDUDP64_PACKET_OVERHEAD + message_length + A - 1) / A * A;
+}
+
+/// @brief Builds `DownstreamPacket` or `UpstreamPacket` with the provided `FlatBufferBuilder`.
+/// @tparam `P` `ShmSequencer::DownstreamPacket` or `ShmSequencer::UpstreamPacket`.
+/// @param `session` MoldUDP64 session.
+/// @param `sequence_number` the sequence number of the message.
+/// @param `message` message data, can be empty.
+/// @return the packet offset, pass it to `FlatBufferBuilder::Finish`.
+template <class P>
+  requires(std::is_same_v<P, ShmSequencer::DownstreamPacket> || std::is_same_v<P, ShmSequencer::UpstreamPacket>)
+auto build_moldudp64_packet(
+    flatbuffers::FlatBufferBuilder& fbb,
+    const MoldUdp64Session& session,
+    const uint64_t sequence_number,
+    const span<const uint8_t>& message
+) noexcept(false) -> flatbuffers::Offset<P> {
+  ShmSequencer::Header header{};
+  for (size_t i = 0; i < MOLDUDP64_SESSION_LENGTH; ++i) {
+    header.mutable_sesion()->Mutate(static_cast<flatbuffers::uoffset_t>(i), session.at(i));
+  }
+  header.mutate_sequence_number(sequence_number);
+  header.mutate_message_count(message.empty() ? 0 : 1);
+
+  const auto length = static_cast<uint16_t>(message.size());
+  const flatbuffers::Offset<flatbuffers::Vector<uint8_t>> data = fbb.CreateVector(message.data(), message.size());
+  if constexpr (std::is_same_v<P, ShmSequencer::DownstreamPacket>) {
+    return ShmSequencer::CreateDownstreamPacket(fbb, &header, length, data);
+  } else {
+    return ShmSequencer::CreateUpstreamPacket(fbb, &header, length, data);
+  }
+}
+
+/// @brief Serializes `DownstreamPacket` or `UpstreamPacket` directly into the circular buffer.
+/// @tparam `P` `ShmSequencer::DownstreamPacket` or `ShmSequencer::UpstreamPacket`.
+/// @param `writer` the demultiplexer writer, `M` must fit `moldudp64_packet_capacity(message.size())`.
+/// @param `session` MoldUDP64 session.
+/// @param `sequence_number` the sequence number of the message.
+/// @param `message` message data, can be empty.
+/// @return the result of `lshl::demux::util::write_flatbuffer`.
+template <class P, size_t L, uint16_t M, bool B>
+[[nodiscard]] auto write_moldudp64_packet(
+    DemuxWriter<L, M, B>* writer,
+    const MoldUdp64Session& session,
+    const uint64_t sequence_number,
+    const span<const uint8_t>& message
+) noexcept(false) -> WriteResult {
+  const size_t capacity = moldudp64_packet_capacity(message.size());
+  if (capacity > M) {
+    LOG_ERROR << "[write_moldudp64_packet] message is too long: " << message.size() << ", M: " << M;
+    return WriteResult::Error;
+  }
+  return lshl::demux::util::write_flatbuffer<P>(
+      writer,
+      static_cast<uint16_t>(capacity),
+      [&session, sequence_number, &message](flatbuffers::FlatBufferBuilder& fbb) {
+        return build_moldudp64_packet<P>(fbb, session, sequence_number, message);
+      }
+  );
+}
+
+}  // namespace lshl::demux::example
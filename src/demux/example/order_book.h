@@ -0,0 +1,94 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "../util/flat_table.h"
+#include "./market_data.h"
+
+namespace lshl::demux::example {
+
+using std::size_t;
+using std::uint32_t;
+using std::uint64_t;
+
+/// @brief One side of the book, structure of arrays, level `0` is the best. A scan of the prices touches only the
+/// prices, `LEVELS` prices of a 10-level side fit in two cache lines.
+// NOLINTBEGIN(misc-non-private-member-variables-in-classes)
+template <size_t LEVELS>
+struct PriceLevels {
+  std::array<uint64_t, LEVELS> prices{};
+  std::array<uint32_t, LEVELS> sizes{};  // `0` is an empty level
+};
+
+template <size_t LEVELS>
+struct OrderBook {
+  uint64_t timestamp{0};  // of the last applied update
+  uint64_t update_count{0};
+  PriceLevels<LEVELS> bids{};
+  PriceLevels<LEVELS> asks{};
+
+  [[nodiscard]] auto side(const Side x) const noexcept -> const PriceLevels<LEVELS>& {
+    return x == Side::Bid ? this->bids : this->asks;
+  }
+
+  [[nodiscard]] auto side(const Side x) noexcept -> PriceLevels<LEVELS>& {
+    return x == Side::Bid ? this->bids : this->asks;
+  }
+};
+// NOLINTEND(misc-non-private-member-variables-in-classes)
+
+/// @brief Reference L2 order book consumer, applies `MarketDataUpdate`s of all instruments. Every update replaces the
+/// price and size of one level. Books are stored densely in an open-addressed `FlatTable` keyed by `instrument_id`,
+/// allocated once in the constructor, `apply` never allocates. Updates of levels `>= LEVELS` and of new instruments
+/// when the table is full are counted and skipped.
+/// @tparam `LEVELS` levels per side.
+template <size_t LEVELS>
+  requires(LEVELS > 0)
+class OrderBooks {
+ public:
+  /// @param `max_instruments` capacity of the instrument index.
+  explicit OrderBooks(const size_t max_instruments) noexcept(false) : books_(max_instruments) {}
+
+  /// @return `false` if the update was skipped.
+  auto apply(const MarketDataUpdate& md) noexcept -> bool {
+    if (md.level >= LEVELS) {
+      this->skipped_count_ += 1;
+      return false;
+    }
+    OrderBook<LEVELS>* book = this->books_.upsert(md.instrument_id);
+    if (book == nullptr) {
+      this->skipped_count_ += 1;
+      return false;
+    }
+    PriceLevels<LEVELS>& side = book->side(md.side);
+    side.prices[md.level] = md.price;
+    side.sizes[md.level] = md.size;
+    book->timestamp = md.timestamp;
+    book->update_count += 1;
+    return true;
+  }
+
+  /// @return `nullptr` if no updates of the instrument were applied.
+  [[nodiscard]] auto find(const uint32_t instrument_id) const noexcept -> const OrderBook<LEVELS>* {
+    return this->books_.find(instrument_id);
+  }
+
+  /// @brief Instrument of the book `i`, `i` within `[0, size())`, in the order the instruments were first seen.
+  [[nodiscard]] auto instrument_id(const size_t i) const noexcept -> uint32_t { return this->books_.key(i); }
+
+  [[nodiscard]] auto book(const size_t i) const noexcept -> const OrderBook<LEVELS>& { return this->books_.value(i); }
+
+  [[nodiscard]] auto size() const noexcept -> size_t { return this->books_.size(); }
+
+  [[nodiscard]] auto skipped_count() const noexcept -> uint64_t { return this->skipped_count_; }
+
+ private:
+  lshl::demux::util::FlatTable<uint32_t, OrderBook<LEVELS>> books_;
+  uint64_t skipped_count_{0};
+};
+
+}  // namespace lshl::demux::example
@@ -0,0 +1,69 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string>
+#include "../core/demux_control.h"
+#include "../core/demux_stats.h"
+#include "../util/shm_segment.h"
+#include "../util/shm_util.h"
+#include "../util/tsc_clock.h"
+#include "./last_value_cache.h"
+
+namespace lshl::demux::example {
+
+// shared memory segment names, shared by all example programs
+constexpr std::string SEGMENT_SHARED_MEM_NAME{"lshl_demux_seg"};  // up to 15 characters, constexpr std::string SSO
+constexpr std::string SYNC_SHARED_MEM_NAME{"lshl_demux_sync"};  // startup handshake, not removed on startup
+constexpr std::string ATTACH_SOCKET_NAME{"lshl_demux_att"};  // abstract Unix socket of `memfd-writer`
+
+constexpr int REPORT_PROGRESS = 1000000;
+
+// the startup handshake logs the processes it waits for at this interval
+constexpr std::chrono::seconds STARTUP_LOG_INTERVAL{1};
+
+// circular buffer size in bytes, the ring has its own pages in the segment
+constexpr std::size_t BUFFER_SIZE = 16 * lshl::demux::util::LINUX_PAGE_SIZE;
+
+// max message size that would be allowed
+constexpr std::uint16_t MAX_MESSAGE_SIZE = 256;
+
+// a reader that holds up a wraparound this long without progress is evicted if its process is gone
+constexpr std::chrono::milliseconds READER_TIMEOUT{1000};
+
+// the last-value cache in the control lines, maintained by `cache-reader`, see `MarketDataCache`
+constexpr std::size_t CACHE_INSTRUMENT_NUM = 1024;
+constexpr std::size_t CACHE_LEVELS = 10;
+
+// a late reader polls the writer's reader mask at this interval until the writer has added it
+constexpr std::chrono::milliseconds LATE_READER_POLL_INTERVAL{1};
+
+/// @brief Last update per instrument, side and level of the example stream, a late reader resumes from its snapshot.
+using MarketDataCache = LastValueCache<CACHE_INSTRUMENT_NUM, CACHE_LEVELS>;
+
+// NOLINTBEGIN(misc-non-private-member-variables-in-classes)
+
+/// @brief Control lines of the example segment, everything but the circular buffer. Read-write for the readers, they
+/// publish their wraparound flags and stats here, the ring itself is mapped read-only.
+struct ShmControl {
+  alignas(std::hardware_destructive_interference_size) std::atomic<std::uint64_t> message_count_sync{0};
+  alignas(std::hardware_destructive_interference_size) std::atomic<std::uint64_t> wraparound_sync{0};
+  lshl::demux::core::DemuxControl demux_control{};      // the writer state for `resume`, the readers watch the epoch
+  lshl::demux::util::TscCalibration tsc_calibration{};  // all processes convert TSC ticks with the same calibration
+  lshl::demux::core::DemuxStats stats{};                // every reader updates its own slot
+  MarketDataCache market_data_cache{};                  // maintained by one reader, copied by the late readers
+};
+
+// NOLINTEND(misc-non-private-member-variables-in-classes)
+
+/// @brief The segment shared by the example programs, see `lshl::demux::util::ShmSegment`.
+template <std::size_t L, std::uint16_t M>
+using ShmDemuxSegment = lshl::demux::util::ShmSegment<ShmControl, L, M>;
+
+}  // namespace lshl::demux::example
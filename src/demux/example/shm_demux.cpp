@@ -4,8 +4,6 @@
 #define XXH_INLINE_ALL  // <xxhash.h>
 
 #include "./shm_demux.h"
-#include <array>
-#include <atomic>
 #include <boost/exception/diagnostic_information.hpp>
 #include <boost/exception/exception.hpp>
 #include <boost/interprocess/managed_shared_memory.hpp>
@@ -23,24 +21,42 @@
 #include <string>
 #include <thread>
 #include "../core/demultiplexer.h"
+#include "../core/demux_control.h"
 #include "../core/reader_id.h"
 #include "../util/boost_log_util.h"
 #include "../util/hdr_histogram_util.h"
+#include "../util/segment_server.h"
 #include "../util/shm_remover.h"
+#include "../util/shm_segment.h"
 #include "../util/shm_util.h"
+#include "../util/startup_handshake.h"
+#include "../util/tsc_clock.h"
 #include "../util/xxhash_util.h"
+#include "./last_value_cache.h"
 #include "./market_data.h"
 
 namespace {
 auto print_usage(const char* prog) -> void {
   std::cerr << "Usage: " << prog << " [writer <number-of-readers> <number-of-messages> <zero-copy>]"
-            << " | [reader <unique-reader-number> <number-of-messages> <zero-copy>]\n"
+            << " | [resume <number-of-readers> <number-of-messages> <zero-copy>]"
+            << " | [reader <unique-reader-number> <number-of-messages> <zero-copy> [<latency-log>]]\n"
+            << " | [cache-reader <unique-reader-number> <number-of-messages> <zero-copy> [<latency-log>]]"
+            << " | [late-reader <unique-reader-number> <number-of-messages> <zero-copy> [<latency-log>]]\n"
+            << " | [memfd-writer <number-of-readers> <number-of-messages> <zero-copy>]"
+            << " | [memfd-reader <unique-reader-number> <number-of-messages> <zero-copy> [<latency-log>]]\n"
             << "  where\n"
             << "    <number-of-readers> and <unique-reader-number> are within the interval [1, "
             << static_cast<int>(lshl::demux::core::MAX_READER_NUM) << "]\n"
             << "    <number-of-messages> is within the interval [1, " << std::numeric_limits<uint64_t>::max()
             << "] (uint64_t)\n"
-            << "    <zero-copy> true/false\n";
+            << "    <zero-copy> true/false\n"
+            << "    <latency-log> per-second latency histograms (HdrHistogram log format), not written if omitted\n"
+            << "  resume restarts a crashed writer on the existing shared memory, the readers keep reading,"
+            << " <number-of-readers> is restored from the shared memory\n"
+            << "  cache-reader is one of the <number-of-readers>, it also maintains the last-value cache,"
+            << " late-reader is not, it joins a running writer and resumes from the cache snapshot\n"
+            << "  memfd-writer and memfd-reader pass an anonymous segment over a Unix socket,"
+            << " nothing is left in /dev/shm\n";
 }
 }  // namespace
 
@@ -63,40 +79,37 @@ auto main(int argc, char* argv[]) noexcept -> int {
 
 namespace lshl::demux::example {
 
-constexpr std::string BUFFER_SHARED_MEM_NAME{"lshl_demux_buf"};
-constexpr std::string UTIL_SHARED_MEM_NAME{"lshl_demux_util"};
-
-constexpr int REPORT_PROGRESS = 1000000;
-
-// circular buffer size in bytes
-constexpr std::size_t BUFFER_SIZE =
-    (16 * lshl::demux::util::LINUX_PAGE_SIZE) - lshl::demux::util::BOOST_IPC_INTERNAL_METADATA_SIZE;
-
-// max message size that would be allowed
-constexpr std::uint16_t MAX_MESSAGE_SIZE = 256;
-
 namespace bipc = boost::interprocess;
 
+using lshl::demux::core::DemuxControl;
 using lshl::demux::core::DemuxReader;
 using lshl::demux::core::DemuxWriter;
+using lshl::demux::core::mask_to_reader_ids;
 using lshl::demux::core::ReaderId;
+using lshl::demux::core::ReaderLag;
 using lshl::demux::core::WriteResult;
+using lshl::demux::util::FrameFormat;
 using lshl::demux::util::HDR_histogram_util;
+using lshl::demux::util::HDR_interval_log;
+using lshl::demux::util::NS_IN_SECOND;
+using lshl::demux::util::SegmentAccess;
+using lshl::demux::util::SegmentServer;
 using lshl::demux::util::ShmRemover;
+using lshl::demux::util::StartupHandshake;
+using lshl::demux::util::TscClock;
 using lshl::demux::util::XXH64_util;
-using std::array;
-using std::atomic;
 using std::size_t;
 using std::span;
 using std::uint16_t;
 
 auto main_(const span<char*> args) noexcept(false) -> int {
   constexpr int ERROR = 200;
-  constexpr size_t EXPECTED_ARG_NUM = 5;
+  constexpr size_t MIN_ARG_NUM = 5;
+  constexpr size_t MAX_ARG_NUM = 6;
 
   init_logging();
 
-  if (args.size() != EXPECTED_ARG_NUM) {
+  if (args.size() < MIN_ARG_NUM || args.size() > MAX_ARG_NUM) {
     print_usage(args[0]);
     return ERROR;
   }
@@ -113,8 +126,19 @@ auto main_(const span<char*> args) noexcept(false) -> int {
 
   if (command == "writer") {
     start_writer<BUFFER_SIZE, MAX_MESSAGE_SIZE>(num8, msg_num, zero_copy);
-  } else if (command == "reader") {
-    start_reader<BUFFER_SIZE, MAX_MESSAGE_SIZE>(num8, msg_num);
+  } else if (command == "resume") {
+    resume_writer<BUFFER_SIZE, MAX_MESSAGE_SIZE>(msg_num, zero_copy);
+  } else if (command == "reader" || command == "cache-reader" || command == "late-reader") {
+    const std::string latency_log = args.size() == MAX_ARG_NUM ? std::string(args[5]) : std::string();
+    const ReaderMode mode = command == "cache-reader"  ? ReaderMode::MaintainCache
+                            : command == "late-reader" ? ReaderMode::JoinLate
+                                                       : ReaderMode::Plain;
+    start_reader<BUFFER_SIZE, MAX_MESSAGE_SIZE>(num8, msg_num, latency_log, mode);
+  } else if (command == "memfd-writer") {
+    start_memfd_writer<BUFFER_SIZE, MAX_MESSAGE_SIZE>(num8, msg_num, zero_copy);
+  } else if (command == "memfd-reader") {
+    const std::string latency_log = args.size() == MAX_ARG_NUM ? std::string(args[5]) : std::string();
+    start_memfd_reader<BUFFER_SIZE, MAX_MESSAGE_SIZE>(num8, msg_num, latency_log);
   } else {
     print_usage(args[0]);
     return ERROR;
@@ -130,77 +154,165 @@ auto init_logging() noexcept -> void {
 
 template <size_t L, uint16_t M>
 auto start_writer(const uint8_t total_reader_num, const uint64_t msg_num, bool zero_copy) noexcept(false) -> void {
-  const size_t SHM_SIZE = lshl::demux::util::calculate_required_shared_mem_size(
-      L, lshl::demux::util::BOOST_IPC_INTERNAL_METADATA_SIZE, lshl::demux::util::LINUX_PAGE_SIZE
-  );
-
-  LOG_INFO << "start_writer " << BUFFER_SHARED_MEM_NAME << ", size: " << SHM_SIZE << ", L: " << L << ", M: " << M
+  LOG_INFO << "start_writer " << SEGMENT_SHARED_MEM_NAME << ", L: " << L << ", M: " << M
            << ", total_reader_num: " << static_cast<int>(total_reader_num) << ", zero_copy: " << zero_copy;
 
-  const ShmRemover remover1(BUFFER_SHARED_MEM_NAME.c_str());
-  const ShmRemover remover2(UTIL_SHARED_MEM_NAME.c_str());
+  // not removed on startup, the readers started before the writer wait in it
+  const ShmRemover remover0(SYNC_SHARED_MEM_NAME.c_str(), false);
+  // NOLINTNEXTLINE(misc-include-cleaner)
+  bipc::managed_shared_memory segment0(
+      bipc::open_or_create, SYNC_SHARED_MEM_NAME.c_str(), lshl::demux::util::LINUX_PAGE_SIZE
+  );
+  StartupHandshake* handshake = segment0.find_or_construct<StartupHandshake>("startup_handshake")();
+  handshake->reset();
 
-  const uint64_t all_readers_mask = ReaderId::all_readers_mask(total_reader_num);
+  ShmRemover remover(SEGMENT_SHARED_MEM_NAME.c_str());
 
-  // segment for the circular buffer and message counter, written by writer, read by readers
-  // NOLINTNEXTLINE(misc-include-cleaner)
-  bipc::managed_shared_memory segment1(bipc::create_only, BUFFER_SHARED_MEM_NAME.c_str(), SHM_SIZE);
-  LOG_INFO << "created shared_memory_object segment1: " << BUFFER_SHARED_MEM_NAME
-           << ", segment1.free_memory: " << segment1.get_free_memory();
+  const uint64_t all_readers_mask = ReaderId::all_readers_mask(total_reader_num);
 
-  array<uint8_t, L>* buffer = segment1.construct<array<uint8_t, L>>("buffer")();
-  LOG_INFO << "buffer allocated, segment1.free_memory: " << segment1.get_free_memory();
+  // the circular buffer and the control lines, the readers validate the header before they map the rest
+  const ShmDemuxSegment<L, M> segment = ShmDemuxSegment<L, M>::create(SEGMENT_SHARED_MEM_NAME, FrameFormat::Plain);
+  const TscClock clock = publish_tsc_calibration(segment);
+  DemuxWriter<L, M, false> writer = create_writer(segment, all_readers_mask);
 
-  atomic<uint64_t>* message_count_sync = segment1.construct<atomic<uint64_t>>("message_count_sync")(0);
-  LOG_INFO << "message_count_sync allocated, segment1.free_memory: " << segment1.get_free_memory();
+  handshake->publish_writer_ready();
+  LOG_INFO << "waiting for all readers ...";
+  while (!handshake->wait_for_readers(all_readers_mask, STARTUP_LOG_INTERVAL)) {
+    LOG_INFO << "waiting for readers: " << mask_to_reader_ids(all_readers_mask & ~handshake->readers_mask());
+  }
+  LOG_INFO << "all readers connected";
 
-  // segment for synchronization
-  bipc::managed_shared_memory segment2(
-      bipc::create_only, UTIL_SHARED_MEM_NAME.c_str(), lshl::demux::util::LINUX_PAGE_SIZE
-  );
-  LOG_INFO << "created shared_memory_object segment2: " << UTIL_SHARED_MEM_NAME
-           << ", segment2.free_memory: " << segment2.get_free_memory();
+  run_writer_loop_keep_on_failure(&writer, msg_num, zero_copy, clock, &remover, handshake);
+  LOG_INFO << "DemuxWriter completed";
+}
 
-  atomic<uint64_t>* wraparound_sync = segment2.construct<atomic<uint64_t>>("wraparound_sync")(0);
-  LOG_INFO << "wraparound_sync allocated, segment2.free_memory: " << segment2.get_free_memory();
+template <size_t L, uint16_t M>
+auto start_memfd_writer(const uint8_t total_reader_num, const uint64_t msg_num, bool zero_copy) noexcept(false)
+    -> void {
+  LOG_INFO << "start_memfd_writer " << ATTACH_SOCKET_NAME << ", L: " << L << ", M: " << M
+           << ", total_reader_num: " << static_cast<int>(total_reader_num) << ", zero_copy: " << zero_copy;
 
-  atomic<uint64_t>* startup_sync = segment2.construct<atomic<uint64_t>>("startup_sync")(0);
-  LOG_INFO << "startup_sync allocated, segment2.free_memory: " << segment2.get_free_memory();
+  const uint64_t all_readers_mask = ReaderId::all_readers_mask(total_reader_num);
 
-  DemuxWriter<L, M, false> writer(all_readers_mask, span{*buffer}, message_count_sync, wraparound_sync);
-  LOG_INFO << "DemuxWriter created, segment1.free_memory: " << segment1.get_free_memory()
-           << ", segment2.free_memory: " << segment2.get_free_memory();
+  // nothing to remove on startup or shutdown, the memory goes away with the last mapping
+  const ShmDemuxSegment<L, M> segment =
+      ShmDemuxSegment<L, M>::create_anonymous(SEGMENT_SHARED_MEM_NAME, FrameFormat::Plain);
+  const TscClock clock = publish_tsc_calibration(segment);
+  DemuxWriter<L, M, false> writer = create_writer(segment, all_readers_mask);
 
+  // the readers register by attaching, no startup handshake
+  SegmentServer<ShmControl, L, M> server(&segment, ATTACH_SOCKET_NAME);
   LOG_INFO << "waiting for all readers ...";
-  while (true) {
-    const uint64_t x = startup_sync->load();
-    if (x == all_readers_mask) {
-      break;
-    } else {
-      using namespace std::chrono_literals;
-      std::this_thread::sleep_for(1s);  // NOLINT(misc-include-cleaner)
-    }
+  while (!server.accept_readers(all_readers_mask, STARTUP_LOG_INTERVAL)) {
+    LOG_INFO << "waiting for readers: " << mask_to_reader_ids(all_readers_mask & ~server.readers_mask());
   }
   LOG_INFO << "all readers connected";
 
-  if (zero_copy) {
-    run_writer_loop_zero_copy(&writer, msg_num);
-  } else {
-    run_writer_loop(&writer, msg_num);
+  run_writer_loop_keep_on_failure(&writer, msg_num, zero_copy, clock, nullptr, nullptr);
+  LOG_INFO << "DemuxWriter completed";
+}
+
+template <size_t L, uint16_t M>
+auto publish_tsc_calibration(const ShmDemuxSegment<L, M>& segment) noexcept -> TscClock {
+  ShmControl* control = segment.control();
+  control->tsc_calibration = lshl::demux::util::calibrate_tsc();
+  LOG_INFO << "tsc_calibration: " << control->tsc_calibration;
+  const TscClock result{control->tsc_calibration};
+  if (!result.is_tsc()) {
+    LOG_WARNING << "invariant TSC is not available, falling back to steady_clock";
   }
-  LOG_INFO << "DemuxWriter completed, segment1.free_memory: " << segment1.get_free_memory()
-           << ", segment2.free_memory: " << segment2.get_free_memory();
+  return result;
 }
 
 template <size_t L, uint16_t M>
-auto run_writer_loop(DemuxWriter<L, M, false>* writer, const uint64_t msg_num) noexcept(false) -> void {
+auto create_writer(const ShmDemuxSegment<L, M>& segment, const uint64_t all_readers_mask) noexcept
+    -> DemuxWriter<L, M, false> {
+  ShmControl* control = segment.control();
+  DemuxWriter<L, M, false> result(
+      all_readers_mask,
+      segment.buffer(),
+      &control->message_count_sync,
+      &control->wraparound_sync,
+      &control->stats,
+      &control->demux_control
+  );
+  result.set_reader_timeout(READER_TIMEOUT);
+  LOG_INFO << "DemuxWriter created";
+  return result;
+}
+
+template <size_t L, uint16_t M>
+auto resume_writer(const uint64_t msg_num, bool zero_copy) noexcept(false) -> void {
+  LOG_INFO << "resume_writer " << SEGMENT_SHARED_MEM_NAME << ", L: " << L << ", M: " << M
+           << ", zero_copy: " << zero_copy;
+
+  // the segment is removed when the resumed writer completes
+  ShmRemover remover(SEGMENT_SHARED_MEM_NAME.c_str(), false);
+
+  const ShmDemuxSegment<L, M> segment =
+      ShmDemuxSegment<L, M>::open(SEGMENT_SHARED_MEM_NAME, FrameFormat::Plain, SegmentAccess::Writer);
+  ShmControl* control = segment.control();
+  const TscClock clock{control->tsc_calibration};
+
+  // the readers are connected already, no startup handshake
+  DemuxWriter<L, M, false> writer = DemuxWriter<L, M, false>::recover(
+      segment.buffer(),
+      &control->message_count_sync,
+      &control->wraparound_sync,
+      &control->demux_control,
+      &control->stats
+  );
+  writer.set_reader_timeout(READER_TIMEOUT);
+  LOG_INFO << "DemuxWriter resumed, " << control->demux_control
+           << ", readers: " << mask_to_reader_ids(control->demux_control.all_readers_mask.load());
+
+  // the late readers register with the handshake of the crashed writer, it is not opened
+  run_writer_loop_keep_on_failure(&writer, msg_num, zero_copy, clock, &remover, nullptr);
+  LOG_INFO << "DemuxWriter completed";
+}
+
+template <size_t L, uint16_t M>
+auto run_writer_loop_keep_on_failure(
+    DemuxWriter<L, M, false>* writer,
+    const uint64_t msg_num,
+    const bool zero_copy,
+    const TscClock& clock,
+    ShmRemover* remover,
+    const StartupHandshake* handshake
+) noexcept(false) -> void {
+  try {
+    if (zero_copy) {
+      run_writer_loop_zero_copy(writer, msg_num, clock, handshake);
+    } else {
+      run_writer_loop(writer, msg_num, clock, handshake);
+    }
+  } catch (...) {
+    // the readers keep their mappings, the writer can be restarted with `resume`
+    if (remover != nullptr) {
+      remover->keep();
+    }
+    throw;
+  }
+}
+
+template <size_t L, uint16_t M>
+auto run_writer_loop(
+    DemuxWriter<L, M, false>* writer,
+    const uint64_t msg_num,
+    const TscClock& clock,
+    const StartupHandshake* handshake
+) noexcept(false) -> void {
   LOG_INFO << "sending " << msg_num << " md updates ...";
 
   MarketDataUpdate md{};
-  MarketDataUpdateGenerator md_gen{};
+  MarketDataUpdateGenerator md_gen{clock};
   XXH64_util hash{};
+  uint64_t joined_mask = 0;
 
   for (uint64_t i = 1; i <= msg_num; ++i) {
+    if (handshake != nullptr) {
+      add_late_readers(writer, *handshake, &joined_mask);
+    }
     md_gen.generate_market_data_update(&md);
     LOG_DEBUG << md;
     const bool ok = write(writer, md);
@@ -220,8 +332,9 @@ auto run_writer_loop(DemuxWriter<L, M, false>* writer, const uint64_t msg_num) n
 
 template <class T, size_t L, uint16_t M>
 [[nodiscard]] inline auto write(DemuxWriter<L, M, false>* writer, const T& md) noexcept -> bool {
-  int attempt = 0;
+  // at most two attempts, the first one can initiate the wraparound
   while (true) {
+    wait_while_wraparound_pending(writer);
     const WriteResult result = writer->write_safe(md);
     switch (result) {
       case WriteResult::Success:
@@ -229,24 +342,64 @@ template <class T, size_t L, uint16_t M>
       case WriteResult::Error:
         return false;
       case WriteResult::Repeat:
-        attempt += 1;
-        if (attempt % REPORT_PROGRESS == 0) {
-          LOG_WARNING << "one or more readers are lagging, wraparound is blocked, write attempt: " << attempt
-                      << ", writer sequence: " << writer->message_count();
-        }
         continue;
     }
   }
 }
 
 template <size_t L, uint16_t M>
-auto run_writer_loop_zero_copy(DemuxWriter<L, M, false>* writer, const uint64_t msg_num) noexcept(false) -> void {
+inline auto wait_while_wraparound_pending(DemuxWriter<L, M, false>* writer) noexcept -> void {
+  // polls the readers' wraparound flags only, unlike `write` it does not retry the write and count the repeats
+  for (int i = 1; writer->wraparound_pending(); ++i) {
+    if (writer->evict_dead_readers() != 0) {
+      continue;
+    }
+    if (i % REPORT_PROGRESS == 0) {
+      const std::optional<ReaderLag> lag = writer->slowest_reader_lag();
+      LOG_WARNING << "one or more readers are lagging, wraparound is blocked, lagging readers: "
+                  << mask_to_reader_ids(writer->lagging_readers_mask()) << ", slowest reader: "
+                  << (lag.has_value() ? lag.value() : ReaderLag{}) << ", writer sequence: " << writer->message_count();
+    }
+  }
+}
+
+template <size_t L, uint16_t M>
+inline auto add_late_readers(
+    DemuxWriter<L, M, false>* writer,
+    const StartupHandshake& handshake,
+    uint64_t* joined_mask
+) noexcept -> void {
+  const uint64_t joined = handshake.readers_mask() & ~*joined_mask;
+  if (joined == 0) [[likely]] {
+    return;
+  }
+  *joined_mask |= joined;
+  // the startup readers and the evicted ones are seen once, only the new readers are added
+  for (const ReaderId& id : mask_to_reader_ids(joined)) {
+    if (!writer->is_registered_reader(id)) {
+      writer->add_reader(id);
+      LOG_INFO << "late reader joined: " << id << ", writer sequence: " << writer->message_count();
+    }
+  }
+}
+
+template <size_t L, uint16_t M>
+auto run_writer_loop_zero_copy(
+    DemuxWriter<L, M, false>* writer,
+    const uint64_t msg_num,
+    const TscClock& clock,
+    const StartupHandshake* handshake
+) noexcept(false) -> void {
   LOG_INFO << "sending " << msg_num << " md updates ...";
 
-  MarketDataUpdateGenerator md_gen{};
+  MarketDataUpdateGenerator md_gen{clock};
   XXH64_util hash{};
+  uint64_t joined_mask = 0;
 
   for (uint64_t i = 1; i <= msg_num; ++i) {
+    if (handshake != nullptr) {
+      add_late_readers(writer, *handshake, &joined_mask);
+    }
     const bool ok = write_zero_copy(writer, &md_gen, &hash);
     if (!ok) {
       LOG_ERROR << "dropped one message, could not write";
@@ -265,7 +418,9 @@ template <size_t L, uint16_t M>
 [[nodiscard]] inline auto
 write_zero_copy(DemuxWriter<L, M, false>* writer, MarketDataUpdateGenerator* md_gen, XXH64_util* hash) noexcept(false)
     -> bool {
-  for (int attempt = 0;; ++attempt) {
+  // at most two attempts, the first one can initiate the wraparound
+  while (true) {
+    wait_while_wraparound_pending(writer);
     const std::optional<MarketDataUpdate*> mo = writer->template allocate<MarketDataUpdate>();
     if (mo.has_value()) {
       MarketDataUpdate* md = mo.value();
@@ -274,74 +429,158 @@ write_zero_copy(DemuxWriter<L, M, false>* writer, MarketDataUpdateGenerator* md_
       writer->template commit<MarketDataUpdate>();
       hash->update(md, sizeof(MarketDataUpdate));
       return true;
-    } else {
-      attempt += 1;
-      if (attempt % REPORT_PROGRESS == 0) {
-        LOG_WARNING << "one or more readers are lagging, wraparound is blocked, write attempt: " << attempt
-                    << ", writer sequence: " << writer->message_count();
-      }
     }
   }
 }
 
 template <size_t L, uint16_t M>
-auto start_reader(const uint8_t reader_num, const uint64_t msg_num) noexcept(false) -> void {
-  using lshl::demux::example::BUFFER_SHARED_MEM_NAME;
-  using std::atomic;
-
-  LOG_INFO << "reader BUFFER_SHARED_MEM_NAME: " << BUFFER_SHARED_MEM_NAME << ", L: " << L << ", M: " << M
-           << ", reader_num: " << static_cast<int>(reader_num);
-
-  // read-only segment for the circular buffer and message counter
+auto start_reader(
+    const uint8_t reader_num,
+    const uint64_t msg_num,
+    const std::string& latency_log,
+    const ReaderMode mode
+) noexcept(false) -> void {
+  LOG_INFO << "reader " << SEGMENT_SHARED_MEM_NAME << ", L: " << L << ", M: " << M
+           << ", reader_num: " << static_cast<int>(reader_num) << ", mode: " << static_cast<int>(mode);
+
+  // created by the process that comes first, the reader can be started before the writer
   // NOLINTNEXTLINE(misc-include-cleaner)
-  bipc::managed_shared_memory segment1(bipc::open_read_only, BUFFER_SHARED_MEM_NAME.c_str());
-  LOG_INFO << "opened shared_memory_object segment1: " << BUFFER_SHARED_MEM_NAME
-           << ", segment1.free_memory: " << segment1.get_free_memory();
-
-  array<uint8_t, L>* buffer = segment1.find<array<uint8_t, L>>("buffer").first;
-  LOG_INFO << "buffer found, segment1.free_memory: " << segment1.get_free_memory();
+  bipc::managed_shared_memory segment0(
+      bipc::open_or_create, SYNC_SHARED_MEM_NAME.c_str(), lshl::demux::util::LINUX_PAGE_SIZE
+  );
+  StartupHandshake* handshake = segment0.find_or_construct<StartupHandshake>("startup_handshake")();
+  while (!handshake->wait_for_writer(STARTUP_LOG_INTERVAL)) {
+    LOG_INFO << "waiting for the writer ...";
+  }
 
-  atomic<uint64_t>* message_count_sync = segment1.find<atomic<uint64_t>>("message_count_sync").first;
-  LOG_INFO << "message_count_sync found, segment1.free_memory: " << segment1.get_free_memory();
+  // the ring is mapped read-only, the control lines read-write for the wraparound flag and the stats slot
+  const ShmDemuxSegment<L, M> segment =
+      ShmDemuxSegment<L, M>::open(SEGMENT_SHARED_MEM_NAME, FrameFormat::Plain, SegmentAccess::Reader);
+  run_reader(segment, reader_num, msg_num, latency_log, handshake, mode);
+}
 
-  // read-write segment for atomic variables
-  // NOLINTNEXTLINE(misc-include-cleaner)
-  bipc::managed_shared_memory segment2(bipc::open_only, UTIL_SHARED_MEM_NAME.c_str());
-  LOG_INFO << "opened shared_memory_object segment2: " << UTIL_SHARED_MEM_NAME
-           << ", segment2.free_memory: " << segment2.get_free_memory();
+template <size_t L, uint16_t M>
+auto start_memfd_reader(const uint8_t reader_num, const uint64_t msg_num, const std::string& latency_log)
+    noexcept(false) -> void {
+  LOG_INFO << "memfd reader " << ATTACH_SOCKET_NAME << ", L: " << L << ", M: " << M
+           << ", reader_num: " << static_cast<int>(reader_num);
 
-  atomic<uint64_t>* wraparound_sync = segment2.find<atomic<uint64_t>>("wraparound_sync").first;
-  LOG_INFO << "wraparound_sync found, segment2.free_memory: " << segment2.get_free_memory();
+  // attaching registers the reader, it can be started before the writer
+  std::optional<ShmDemuxSegment<L, M>> segment;
+  while (!segment.has_value()) {
+    segment = lshl::demux::util::attach_segment<ShmControl, L, M>(
+        ATTACH_SOCKET_NAME, reader_num, FrameFormat::Plain, STARTUP_LOG_INTERVAL
+    );
+    if (!segment.has_value()) {
+      LOG_INFO << "waiting for the writer ...";
+    }
+  }
+  run_reader(segment.value(), reader_num, msg_num, latency_log, nullptr, ReaderMode::Plain);
+}
 
-  atomic<uint64_t>* startup_sync = segment2.find<atomic<uint64_t>>("startup_sync").first;
-  LOG_INFO << "startup_sync found, segment2.free_memory: " << segment2.get_free_memory();
+template <size_t L, uint16_t M>
+auto run_reader(
+    const ShmDemuxSegment<L, M>& segment,
+    const uint8_t reader_num,
+    const uint64_t msg_num,
+    const std::string& latency_log,
+    StartupHandshake* handshake,
+    const ReaderMode mode
+) noexcept(false) -> void {
+  ShmControl* control = segment.control();
+  const TscClock clock{control->tsc_calibration};
+  LOG_INFO << "TSC clock: " << clock.is_tsc();
 
   const ReaderId id{reader_num};
 
-  DemuxReader<L, M> reader(id, span{*buffer}, message_count_sync, wraparound_sync);
-  LOG_INFO << "DemuxReader created, segment1.free_memory: " << segment2.get_free_memory()
-           << ", segment2.free_memory: " << segment2.get_free_memory();
+  DemuxReader<L, M> reader(
+      id, segment.buffer(), &control->message_count_sync, &control->wraparound_sync, &control->stats.reader(id)
+  );
+  LOG_INFO << "DemuxReader created";
+
+  if (handshake != nullptr) {
+    handshake->register_reader(id.mask());
+  }
+  if (mode == ReaderMode::JoinLate) {
+    join_late(&reader, control);
+  }
 
-  startup_sync->fetch_or(id.mask());
+  MarketDataCache* cache = mode == ReaderMode::MaintainCache ? &control->market_data_cache : nullptr;
+  if (latency_log.empty()) {
+    run_reader_loop(&reader, msg_num, clock, &control->demux_control, cache, nullptr);
+  } else {
+    HDR_interval_log log(latency_log, clock.now());
+    LOG_INFO << "writing latency interval log: " << latency_log;
+    run_reader_loop(&reader, msg_num, clock, &control->demux_control, cache, &log);
+  }
+  if (cache != nullptr) {
+    LOG_INFO << "last-value cache updated, skipped updates: " << cache->skipped_count();
+  }
+  LOG_INFO << "DemuxReader completed";
+}
 
-  run_reader_loop(&reader, msg_num);
-  LOG_INFO << "DemuxReader completed, segment1.free_memory: " << segment2.get_free_memory()
-           << ", segment2.free_memory: " << segment2.get_free_memory();
+template <size_t L, uint16_t M>
+auto join_late(DemuxReader<L, M>* reader, ShmControl* control) noexcept -> void {
+  // the writer adds the readers that registered after the startup between two writes
+  const uint64_t mask = reader->id().mask();
+  while ((control->demux_control.all_readers_mask.load() & mask) == 0) {
+    std::this_thread::sleep_for(LATE_READER_POLL_INTERVAL);
+  }
+  LOG_INFO << "added by the writer, " << reader->id();
+
+  for (uint64_t attempt = 1;; ++attempt) {
+    size_t instrument_num = 0;
+    const RingCursor cursor =
+        control->market_data_cache.snapshot([&instrument_num](const InstrumentSnapshot<CACHE_LEVELS>&) {
+          instrument_num += 1;
+        });
+    if (reader->resume_from(cursor.message_count, cursor.position, cursor.byte_count, control->demux_control)) {
+      LOG_INFO << "resumed from the last-value cache, instruments: " << instrument_num
+               << ", reader sequence number: " << reader->message_count() << ", attempts: " << attempt;
+      return;
+    }
+    std::this_thread::sleep_for(LATE_READER_POLL_INTERVAL);
+  }
 }
 
 template <size_t L, uint16_t M>
-auto run_reader_loop(DemuxReader<L, M>* reader, const uint64_t msg_num) noexcept(false) -> void {
+auto run_reader_loop(
+    DemuxReader<L, M>* reader,
+    const uint64_t msg_num,
+    const TscClock& clock,
+    const DemuxControl* control,
+    MarketDataCache* cache,
+    HDR_interval_log* log
+) noexcept(false) -> void {
   XXH64_util hash{};
+  uint64_t epoch = control == nullptr ? 0 : control->epoch.load();
+  uint64_t cached_count = reader->message_count();
   HDR_histogram_util histogram{};
+  HDR_histogram_util interval{};
+  uint64_t interval_start = clock.now();
 
   // consume the expected number of messages
   for (uint64_t i = 0; i < msg_num;) {
     const std::optional<const MarketDataUpdate*> read = reader->template next_unsafe<MarketDataUpdate>();
+    if (cache != nullptr && reader->message_count() != cached_count) {
+      update_cache(cache, *reader, read.value_or(nullptr));
+      cached_count = reader->message_count();
+    }
     if (read.has_value()) {
       i += 1;
       const MarketDataUpdate* md = read.value();
       // track the latency
-      histogram.record_value(calculate_latency(md->timestamp));
+      const int64_t latency = calculate_latency(md->timestamp, clock);
+      histogram.record_value(latency);
+      if (log != nullptr) {
+        interval.record_value(latency);
+        const uint64_t now = md->timestamp + static_cast<uint64_t>(latency);
+        if (now - interval_start >= NS_IN_SECOND) {
+          log->write(interval, interval_start, now);
+          interval.reset();
+          interval_start = now;
+        }
+      }
       LOG_DEBUG << *md;
       // report progress
       if (i % REPORT_PROGRESS == 0) {
@@ -349,9 +588,17 @@ auto run_reader_loop(DemuxReader<L, M>* reader, const uint64_t msg_num) noexcept
       }
       // calculate the hash
       hash.update(md, sizeof(MarketDataUpdate));
+    } else if (control != nullptr && control->epoch.load(std::memory_order_relaxed) != epoch) {
+      // checked when idle only, the restarted writer continues after the last published message
+      epoch = control->epoch.load();
+      LOG_WARNING << "writer restarted, epoch: " << epoch << ", reader sequence number: " << reader->message_count();
     }
   }
 
+  if (log != nullptr && interval.total_count() > 0) {
+    log->write(interval, interval_start, clock.now());
+  }
+
   LOG_INFO << "reader sequence number: " << reader->message_count()
            << ", XXH64_hash: " << XXH64_util::format(hash.digest());
 
@@ -359,10 +606,18 @@ auto run_reader_loop(DemuxReader<L, M>* reader, const uint64_t msg_num) noexcept
   histogram.print_report();
 }
 
-auto inline calculate_latency(const uint64_t x0) -> int64_t {
-  const std::chrono::time_point<std::chrono::steady_clock, std::chrono::nanoseconds> now =
-      std::chrono::steady_clock::now();
-  const uint64_t x1 = static_cast<uint64_t>(now.time_since_epoch().count());
+template <size_t L, uint16_t M>
+inline auto update_cache(MarketDataCache* cache, const DemuxReader<L, M>& reader, const MarketDataUpdate* md) noexcept
+    -> void {
+  if (md != nullptr) {
+    cache->apply(*md, reader.message_count());
+  }
+  // published after the entry, a snapshot never has an entry older than its cursor
+  cache->publish_cursor(RingCursor{reader.message_count(), reader.position(), reader.byte_count()});
+}
+
+auto inline calculate_latency(const uint64_t x0, const TscClock& clock) -> int64_t {
+  const uint64_t x1 = clock.now_serialized();
   return static_cast<int64_t>(x1 - x0);
 }
 
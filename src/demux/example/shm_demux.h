@@ -6,18 +6,35 @@
 #include <cstddef>
 #include <cstdint>
 #include <span>
+#include <string>
 #include "../core/demultiplexer.h"
+#include "../core/demux_control.h"
+#include "../util/hdr_histogram_util.h"
+#include "../util/shm_remover.h"
+#include "../util/startup_handshake.h"
+#include "../util/tsc_clock.h"
 #include "../util/xxhash_util.h"
+#include "./last_value_cache.h"
 #include "./market_data.h"
+#include "./shm_config.h"
 
 namespace lshl::demux::example {
 
+using lshl::demux::core::DemuxControl;
 using lshl::demux::core::DemuxReader;
 using lshl::demux::core::DemuxWriter;
+using lshl::demux::util::TscClock;
 
 using std::size_t;
 using std::uint16_t;
 
+/// @brief What a reader of the named segment does besides reading.
+enum class ReaderMode : std::uint8_t {
+  Plain,          // `reader`
+  MaintainCache,  // `cache-reader`, applies every update to `ShmControl::market_data_cache`
+  JoinLate        // `late-reader`, registers after the startup and resumes from the cache snapshot
+};
+
 auto init_logging() noexcept -> void;
 
 auto main_(std::span<char*> args) noexcept(false) -> int;
@@ -25,14 +42,68 @@ auto main_(std::span<char*> args) noexcept(false) -> int;
 template <size_t L, uint16_t M>
 auto start_writer(uint8_t total_reader_num, uint64_t msg_num, bool zero_copy) noexcept(false) -> void;
 
+/// @brief Same as `start_writer` on an anonymous segment, the readers attach over the `ATTACH_SOCKET_NAME` socket.
+template <size_t L, uint16_t M>
+auto start_memfd_writer(uint8_t total_reader_num, uint64_t msg_num, bool zero_copy) noexcept(false) -> void;
+
+/// @brief Calibrates the TSC and publishes the calibration in the control lines, before the readers connect.
+template <size_t L, uint16_t M>
+auto publish_tsc_calibration(const ShmDemuxSegment<L, M>& segment) noexcept -> TscClock;
+
+template <size_t L, uint16_t M>
+auto create_writer(const ShmDemuxSegment<L, M>& segment, uint64_t all_readers_mask) noexcept
+    -> DemuxWriter<L, M, false>;
+
+/// @brief Restarts a crashed writer on the existing shared memory with `DemuxWriter::recover`.
 template <size_t L, uint16_t M>
-auto run_writer_loop(DemuxWriter<L, M, false>* writer, uint64_t msg_num) noexcept(false) -> void;
+auto resume_writer(uint64_t msg_num, bool zero_copy) noexcept(false) -> void;
+
+/// @brief Runs the writer loop, keeps the shared memory if it fails, so the writer can be resumed.
+/// @param `remover` `nullptr` if there is nothing to keep, an anonymous segment.
+/// @param `handshake` `nullptr` if the readers cannot join after the startup.
+template <size_t L, uint16_t M>
+auto run_writer_loop_keep_on_failure(
+    DemuxWriter<L, M, false>* writer,
+    uint64_t msg_num,
+    bool zero_copy,
+    const TscClock& clock,
+    lshl::demux::util::ShmRemover* remover,
+    const lshl::demux::util::StartupHandshake* handshake
+) noexcept(false) -> void;
+
+template <size_t L, uint16_t M>
+auto run_writer_loop(
+    DemuxWriter<L, M, false>* writer,
+    uint64_t msg_num,
+    const TscClock& clock,
+    const lshl::demux::util::StartupHandshake* handshake
+) noexcept(false) -> void;
 
 template <class T, size_t L, uint16_t M>
 [[nodiscard]] inline auto write(DemuxWriter<L, M, false>* writer, const T& md) noexcept -> bool;
 
+/// @brief Busy-waits until all readers catch up with the pending wraparound, logs the lagging readers, evicts the dead
+/// ones.
 template <size_t L, uint16_t M>
-auto run_writer_loop_zero_copy(DemuxWriter<L, M, false>* writer, uint64_t msg_num) noexcept(false) -> void;
+inline auto wait_while_wraparound_pending(DemuxWriter<L, M, false>* writer) noexcept -> void;
+
+/// @brief Adds the readers that registered with the `handshake` after the startup, `late-reader`. One load if nobody
+/// joined.
+/// @param `joined_mask` the readers seen so far, updated.
+template <size_t L, uint16_t M>
+inline auto add_late_readers(
+    DemuxWriter<L, M, false>* writer,
+    const lshl::demux::util::StartupHandshake& handshake,
+    uint64_t* joined_mask
+) noexcept -> void;
+
+template <size_t L, uint16_t M>
+auto run_writer_loop_zero_copy(
+    DemuxWriter<L, M, false>* writer,
+    uint64_t msg_num,
+    const TscClock& clock,
+    const lshl::demux::util::StartupHandshake* handshake
+) noexcept(false) -> void;
 
 template <size_t L, uint16_t M>
 [[nodiscard]] inline auto write_zero_copy(
@@ -42,11 +113,46 @@ template <size_t L, uint16_t M>
 ) noexcept(false) -> bool;
 
 template <size_t L, uint16_t M>
-auto start_reader(uint8_t reader_num, uint64_t msg_num) noexcept(false) -> void;
+auto start_reader(uint8_t reader_num, uint64_t msg_num, const std::string& latency_log, ReaderMode mode) noexcept(false)
+    -> void;
 
 template <size_t L, uint16_t M>
-auto run_reader_loop(DemuxReader<L, M>* reader, uint64_t msg_num) noexcept(false) -> void;
+auto start_memfd_reader(uint8_t reader_num, uint64_t msg_num, const std::string& latency_log) noexcept(false) -> void;
+
+/// @param `handshake` `nullptr` if the reader registered when it attached.
+/// @param `mode` `ReaderMode::Plain` for an attached reader.
+template <size_t L, uint16_t M>
+auto run_reader(
+    const ShmDemuxSegment<L, M>& segment,
+    uint8_t reader_num,
+    uint64_t msg_num,
+    const std::string& latency_log,
+    lshl::demux::util::StartupHandshake* handshake,
+    ReaderMode mode
+) noexcept(false) -> void;
+
+/// @brief Waits until the writer has added the registered reader, copies the last-value cache and resumes from its
+/// cursor, takes a new snapshot if the cursor is stale. Needs a `cache-reader`: without it the cursor stays at the
+/// start of the first lap, and the writer waits for this reader at the next wraparound.
+template <size_t L, uint16_t M>
+auto join_late(DemuxReader<L, M>* reader, ShmControl* control) noexcept -> void;
+
+/// @param `cache` `nullptr` if the reader does not maintain the last-value cache.
+template <size_t L, uint16_t M>
+auto run_reader_loop(
+    DemuxReader<L, M>* reader,
+    uint64_t msg_num,
+    const TscClock& clock,
+    const DemuxControl* control,
+    MarketDataCache* cache,
+    lshl::demux::util::HDR_interval_log* log
+) noexcept(false) -> void;
+
+/// @brief Applies the update, if any, and publishes the reader's position after it, also after a wraparound marker.
+template <size_t L, uint16_t M>
+inline auto update_cache(MarketDataCache* cache, const DemuxReader<L, M>& reader, const MarketDataUpdate* md) noexcept
+    -> void;
 
-auto inline calculate_latency(uint64_t x0) -> int64_t;
+auto inline calculate_latency(uint64_t x0, const TscClock& clock) -> int64_t;
 
 }  // namespace lshl::demux::example
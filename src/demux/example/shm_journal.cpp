@@ -0,0 +1,231 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+#include <boost/exception/diagnostic_information.hpp>
+#include <boost/exception/exception.hpp>
+#include <boost/interprocess/managed_shared_memory.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/log/expressions.hpp>  // NOLINT(misc-include-cleaner)
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <span>
+#include <string>
+#include "../core/demultiplexer.h"
+#include "../core/journal.h"
+#include "../core/journal_replay.h"
+#include "../core/reader_id.h"
+#include "../util/boost_log_util.h"
+#include "../util/shm_remover.h"
+#include "../util/shm_segment.h"
+#include "../util/shm_util.h"
+#include "../util/startup_handshake.h"
+#include "./shm_config.h"
+
+namespace {
+auto print_usage(const char* prog) -> void {
+  std::cerr << "Usage: " << prog << " [record <unique-reader-number> <number-of-messages> <journal-dir>]"
+            << " | [replay <number-of-readers> <journal-dir> <speed> [<from>]]\n"
+            << "  where\n"
+            << "    <number-of-readers> and <unique-reader-number> are within the interval [1, "
+            << static_cast<int>(lshl::demux::core::MAX_READER_NUM) << "]\n"
+            << "    <number-of-messages> is within the interval [1, " << std::numeric_limits<uint64_t>::max()
+            << "] (uint64_t)\n"
+            << "    <speed> max/recorded\n"
+            << "    <from> seq:<sequence-number> or time:<timestamp-ns>, replays from the beginning if omitted\n";
+}
+}  // namespace
+
+namespace lshl::demux::example {
+
+constexpr std::string JOURNAL_NAME{"shm_demux"};
+
+namespace bipc = boost::interprocess;
+
+using lshl::demux::core::DemuxReader;
+using lshl::demux::core::DemuxWriter;
+using lshl::demux::core::JournalReader;
+using lshl::demux::core::JournalWriter;
+using lshl::demux::core::ReaderId;
+using lshl::demux::core::ReplayResult;
+using lshl::demux::core::ReplaySpeed;
+using lshl::demux::util::FrameFormat;
+using lshl::demux::util::SegmentAccess;
+using lshl::demux::util::ShmRemover;
+using lshl::demux::util::StartupHandshake;
+using std::size_t;
+using std::span;
+using std::uint16_t;
+
+auto init_logging() noexcept -> void;
+
+auto main_(span<char*> args) noexcept(false) -> int;
+
+template <size_t L, uint16_t M>
+auto start_recorder(const uint8_t reader_num, const uint64_t msg_num, const std::filesystem::path& dir) noexcept(false)
+    -> void {
+  LOG_INFO << "start_recorder L: " << L << ", M: " << M << ", reader_num: " << static_cast<int>(reader_num)
+           << ", msg_num: " << msg_num << ", dir: " << dir;
+
+  // NOLINTNEXTLINE(misc-include-cleaner)
+  bipc::managed_shared_memory segment0(
+      bipc::open_or_create, SYNC_SHARED_MEM_NAME.c_str(), lshl::demux::util::LINUX_PAGE_SIZE
+  );
+  StartupHandshake* handshake = segment0.find_or_construct<StartupHandshake>("startup_handshake")();
+  while (!handshake->wait_for_writer(STARTUP_LOG_INTERVAL)) {
+    LOG_INFO << "waiting for the writer ...";
+  }
+
+  const ShmDemuxSegment<L, M> segment =
+      ShmDemuxSegment<L, M>::open(SEGMENT_SHARED_MEM_NAME, FrameFormat::Plain, SegmentAccess::Reader);
+  ShmControl* control = segment.control();
+
+  const ReaderId id{reader_num};
+  // the stats slot publishes the recorder's progress, the writer does not evict it while it writes the journal
+  DemuxReader<L, M> reader(
+      id, segment.buffer(), &control->message_count_sync, &control->wraparound_sync, &control->stats.reader(id)
+  );
+  JournalWriter journal(dir, JOURNAL_NAME);
+
+  handshake->register_reader(id.mask());
+
+  for (uint64_t i = 0; i < msg_num;) {
+    const span<uint8_t> message = reader.next();
+    if (!message.empty()) {
+      const auto now = std::chrono::steady_clock::now().time_since_epoch();
+      journal.append(static_cast<uint64_t>(std::chrono::nanoseconds(now).count()), message);
+      i += 1;
+      if (i % REPORT_PROGRESS == 0) {
+        LOG_INFO << "number of messages recorded: " << i;
+      }
+    }
+  }
+  journal.flush();
+
+  LOG_INFO << "recorder completed, journal sequence number: " << journal.sequence()
+           << ", segments: " << journal.segment_count();
+}
+
+template <size_t L, uint16_t M>
+auto start_replay(
+    const uint8_t total_reader_num,
+    const std::filesystem::path& dir,
+    const ReplaySpeed speed,
+    const std::string& from
+) noexcept(false) -> void {
+  LOG_INFO << "start_replay L: " << L << ", M: " << M << ", total_reader_num: " << static_cast<int>(total_reader_num)
+           << ", dir: " << dir << ", from: " << from;
+
+  JournalReader journal(dir, JOURNAL_NAME);
+  if (from.starts_with("seq:")) {
+    if (!journal.seek_sequence(boost::lexical_cast<uint64_t>(from.substr(4)))) {
+      LOG_WARNING << "nothing to replay, sequence number not found: " << from;
+    }
+  } else if (from.starts_with("time:")) {
+    if (!journal.seek_timestamp(boost::lexical_cast<uint64_t>(from.substr(5)))) {
+      LOG_WARNING << "nothing to replay, timestamp not found: " << from;
+    }
+  }
+
+  // not removed on startup, the readers started before the writer wait in it
+  const ShmRemover remover0(SYNC_SHARED_MEM_NAME.c_str(), false);
+  // NOLINTNEXTLINE(misc-include-cleaner)
+  bipc::managed_shared_memory segment0(
+      bipc::open_or_create, SYNC_SHARED_MEM_NAME.c_str(), lshl::demux::util::LINUX_PAGE_SIZE
+  );
+  StartupHandshake* handshake = segment0.find_or_construct<StartupHandshake>("startup_handshake")();
+  handshake->reset();
+
+  const ShmRemover remover(SEGMENT_SHARED_MEM_NAME.c_str());
+
+  // replayed messages keep the recorded timestamps, the default `tsc_calibration` makes the readers compare them with
+  // `steady_clock`
+  ShmDemuxSegment<L, M> segment = ShmDemuxSegment<L, M>::create(SEGMENT_SHARED_MEM_NAME, FrameFormat::Plain);
+  ShmControl* control = segment.control();
+
+  const uint64_t all_readers_mask = ReaderId::all_readers_mask(total_reader_num);
+  DemuxWriter<L, M, false> writer(
+      all_readers_mask, segment.buffer(), &control->message_count_sync, &control->wraparound_sync, &control->stats
+  );
+
+  handshake->publish_writer_ready();
+  LOG_INFO << "waiting for all readers ...";
+  while (!handshake->wait_for_readers(all_readers_mask, STARTUP_LOG_INTERVAL)) {
+    LOG_INFO << "waiting for readers, registered readers mask: " << handshake->readers_mask();
+  }
+  LOG_INFO << "all readers connected";
+
+  const ReplayResult result = lshl::demux::core::replay(&journal, &writer, speed);
+  LOG_INFO << "replay completed, writer sequence number: " << writer.message_count()
+           << ", messages: " << result.message_count << ", dropped: " << result.dropped_count
+           << ", msgs/sec: " << static_cast<uint64_t>(result.messages_per_second());
+}
+
+auto main_(const span<char*> args) noexcept(false) -> int {
+  constexpr int ERROR = 200;
+  constexpr size_t MIN_ARG_NUM = 5;
+  constexpr size_t MAX_ARG_NUM = 6;
+
+  init_logging();
+
+  if (args.size() < MIN_ARG_NUM || args.size() > MAX_ARG_NUM) {
+    print_usage(args[0]);
+    return ERROR;
+  }
+
+  const std::string command(args[1]);
+  const auto num16 = boost::lexical_cast<uint16_t>(args[2]);
+  if (num16 < 1 || num16 > lshl::demux::core::MAX_READER_NUM) {
+    print_usage(args[0]);
+    return ERROR;
+  }
+  const auto num8 = static_cast<uint8_t>(num16);
+
+  if (command == "record" && args.size() == MIN_ARG_NUM) {
+    const auto msg_num = boost::lexical_cast<uint64_t>(args[3]);
+    start_recorder<BUFFER_SIZE, MAX_MESSAGE_SIZE>(num8, msg_num, std::filesystem::path(args[4]));
+  } else if (command == "replay") {
+    const std::string speed(args[4]);
+    if (speed != "max" && speed != "recorded") {
+      print_usage(args[0]);
+      return ERROR;
+    }
+    const std::string from = args.size() == MAX_ARG_NUM ? std::string(args[5]) : std::string();
+    start_replay<BUFFER_SIZE, MAX_MESSAGE_SIZE>(
+        num8, std::filesystem::path(args[3]), speed == "max" ? ReplaySpeed::Max : ReplaySpeed::Recorded, from
+    );
+  } else {
+    print_usage(args[0]);
+    return ERROR;
+  }
+
+  return 0;
+}
+
+auto init_logging() noexcept -> void {
+  // NOLINTNEXTLINE(misc-include-cleaner)
+  boost::log::core::get()->set_filter(boost::log::trivial::severity >= boost::log::trivial::info);
+}
+
+}  // namespace lshl::demux::example
+
+auto main(int argc, char* argv[]) noexcept -> int {
+  constexpr int ERROR = 100;
+  try {
+    const auto args = std::span<char*>(argv, static_cast<size_t>(argc));
+    return lshl::demux::example::main_(args);
+  } catch (const boost::exception& e) {
+    LOG_ERROR << "boost::exception: " << boost::diagnostic_information(e);
+    return ERROR;
+  } catch (const std::exception& e) {
+    LOG_ERROR << "std::exception: " << e.what();
+    return ERROR;
+  } catch (...) {
+    LOG_ERROR << "unexpected exception";
+    return ERROR;
+  }
+}
@@ -0,0 +1,232 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+// NOLINTBEGIN(readability-function-cognitive-complexity, misc-include-cleaner)
+
+#include "../util/channel_segment.h"
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "../core/demultiplexer.h"
+
+namespace lshl::demux::util {
+
+using std::size_t;
+using std::uint16_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::uint8_t;
+
+namespace {
+
+using namespace std::chrono_literals;
+
+struct TestControl {
+  std::atomic<uint64_t> message_count_sync{0};
+  std::atomic<uint64_t> wraparound_sync{0};
+};
+
+constexpr size_t L = 4 * LINUX_PAGE_SIZE;
+constexpr uint16_t M = 64;
+constexpr uint32_t N = 4;
+
+using TestSegment = ChannelSegment<TestControl, L, M, N>;
+using TestChannel = Channel<TestControl, L>;
+
+// removes the named segment when the test completes, unique per process, the tests can run in parallel
+class SegmentName {
+ public:
+  explicit SegmentName(const std::string& test) : value_("lshl_demux_test_" + test + "_" + std::to_string(::getpid())) {
+    TestSegment::remove(this->value_);
+  }
+  ~SegmentName() { TestSegment::remove(this->value_); }
+  SegmentName(const SegmentName&) = delete;
+  auto operator=(const SegmentName&) -> SegmentName& = delete;
+  SegmentName(SegmentName&&) = delete;
+  auto operator=(SegmentName&&) -> SegmentName& = delete;
+
+  [[nodiscard]] auto value() const noexcept -> const std::string& { return this->value_; }
+
+ private:
+  std::string value_;
+};
+
+}  // namespace
+
+TEST(ChannelSegmentTest, Layout) {
+  static_assert(TestSegment::CONTROL_OFFSET == LINUX_PAGE_SIZE);
+  static_assert(TestSegment::SLOT_SIZE % std::hardware_destructive_interference_size == 0);
+  static_assert(TestSegment::CONTROL_SIZE == 3 * LINUX_PAGE_SIZE);  // the doorbells of 64 readers, the control lines
+  static_assert(TestSegment::BUFFER_OFFSET % LINUX_PAGE_SIZE == 0);
+  static_assert(TestSegment::TOTAL_SIZE == TestSegment::BUFFER_OFFSET + (N * L));
+}
+
+TEST(ChannelSegmentTest, AddAndFindChannels) {
+  const SegmentName name("channels");
+  TestSegment writer = TestSegment::create(name.value());
+  ASSERT_EQ(writer.channel_count(), 0);
+  const TestChannel trades = writer.add_channel("trades", FrameFormat::Plain);
+  const TestChannel quotes = writer.add_channel("quotes", FrameFormat::Checksum32);
+  ASSERT_EQ(trades.index, 0);
+  ASSERT_EQ(quotes.index, 1);
+  ASSERT_EQ(writer.channel_count(), 2);
+
+  trades.buffer()[0] = 1;
+  quotes.buffer()[0] = 2;
+  quotes.buffer()[L - 1] = 3;
+  quotes.control->message_count_sync.store(4);
+
+  const TestSegment reader = TestSegment::open(name.value(), SegmentAccess::Reader);
+  ASSERT_EQ(reader.channel_count(), 2);
+  ASSERT_FALSE(reader.find_channel("depth", FrameFormat::Plain).has_value());
+  ASSERT_THROW((void)reader.find_channel("quotes", FrameFormat::Plain), std::domain_error);
+  const std::optional<TestChannel> x = reader.find_channel("quotes", FrameFormat::Checksum32);
+  ASSERT_TRUE(x.has_value());
+  ASSERT_EQ(x->index, 1);
+  ASSERT_EQ(x->name, "quotes");
+  ASSERT_EQ(x->buffer()[0], 2);
+  ASSERT_EQ(x->buffer()[L - 1], 3);
+  ASSERT_EQ(x->control->message_count_sync.load(), 4);
+  ASSERT_EQ(reader.find_channel("trades", FrameFormat::Plain)->buffer()[0], 1);
+
+  // a channel added later is found by the readers that are attached already
+  const TestChannel depth = writer.add_channel("depth", FrameFormat::Plain);
+  depth.control->wraparound_sync.store(5);
+  ASSERT_EQ(reader.find_channel("depth", FrameFormat::Plain)->control->wraparound_sync.load(), 5);
+
+  // the registry is per channel
+  x->registry->register_reader(0b1);
+  ASSERT_TRUE(quotes.registry->wait_for_readers(0b1, 1ms));
+  ASSERT_FALSE(trades.registry->wait_for_readers(0b1, 1ms));
+
+  const TestSegment monitor = TestSegment::open(name.value(), SegmentAccess::Monitor);
+  const std::optional<TestChannel> y = monitor.channel_at(2);
+  ASSERT_TRUE(y.has_value());
+  ASSERT_EQ(y->name, "depth");
+  ASSERT_EQ(y->ring, nullptr);
+  ASSERT_FALSE(monitor.channel_at(3).has_value());
+}
+
+TEST(ChannelSegmentTest, AddChannelRejectsInvalidNames) {
+  const SegmentName name("names");
+  TestSegment writer = TestSegment::create(name.value());
+  ASSERT_THROW((void)writer.add_channel("", FrameFormat::Plain), std::invalid_argument);
+  const std::string too_long(CHANNEL_NAME_MAX + 1, 'x');
+  ASSERT_THROW((void)writer.add_channel(too_long, FrameFormat::Plain), std::invalid_argument);
+  ASSERT_NO_THROW((void)writer.add_channel(std::string(CHANNEL_NAME_MAX, 'x'), FrameFormat::Plain));
+  ASSERT_NO_THROW((void)writer.add_channel("a", FrameFormat::Plain));
+  ASSERT_THROW((void)writer.add_channel("a", FrameFormat::Checksum32), std::invalid_argument);
+  ASSERT_EQ(writer.channel_count(), 2);
+}
+
+TEST(ChannelSegmentTest, DirectoryIsFull) {
+  const SegmentName name("full");
+  TestSegment writer = TestSegment::create(name.value());
+  for (uint32_t i = 0; i < N; ++i) {
+    ASSERT_NO_THROW((void)writer.add_channel("c" + std::to_string(i), FrameFormat::Plain));
+  }
+  ASSERT_THROW((void)writer.add_channel("extra", FrameFormat::Plain), std::domain_error);
+  ASSERT_EQ(writer.channel_count(), N);
+  ASSERT_TRUE(writer.find_channel("c3", FrameFormat::Plain).has_value());
+}
+
+TEST(ChannelSegmentTest, OpenRejectsIncompatibleSegment) {
+  const SegmentName name("incompatible");
+  ASSERT_THROW((void)TestSegment::open(name.value(), SegmentAccess::Reader), std::domain_error);
+  const TestSegment writer = TestSegment::create(name.value());
+  ASSERT_THROW((void)TestSegment::create(name.value()), std::domain_error);
+  ASSERT_THROW(
+      (void)(ChannelSegment<TestControl, L, M, N * 2>::open(name.value(), SegmentAccess::Reader)), std::domain_error
+  );
+  ASSERT_THROW(
+      (void)(ChannelSegment<TestControl, L / 2, M, N>::open(name.value(), SegmentAccess::Reader)), std::domain_error
+  );
+  ASSERT_THROW(
+      (void)(ChannelSegment<TestControl, L, M * 2, N>::open(name.value(), SegmentAccess::Reader)), std::domain_error
+  );
+  ASSERT_NO_THROW((void)TestSegment::open(name.value(), SegmentAccess::Writer));
+}
+
+TEST(ChannelSegmentTest, ReaderCannotWriteRingOrDirectory) {
+  const SegmentName name("readonly");
+  TestSegment writer = TestSegment::create(name.value());
+  const TestChannel channel = writer.add_channel("trades", FrameFormat::Plain);
+  const TestSegment reader = TestSegment::open(name.value(), SegmentAccess::Reader);
+  TestSegment other_reader = TestSegment::open(name.value(), SegmentAccess::Reader);
+  ASSERT_THROW((void)other_reader.add_channel("x", FrameFormat::Plain), std::domain_error);
+  const TestChannel x = reader.find_channel("trades", FrameFormat::Plain).value();
+  ASSERT_DEATH(x.buffer()[0] = 1, "");
+  ASSERT_DEATH(const_cast<ChannelSegmentHeader&>(reader.header()).channel_count.store(0), "");  // NOLINT
+  x.control->wraparound_sync.store(1);  // the control lines are shared both ways
+  ASSERT_EQ(channel.control->wraparound_sync.load(), 1);
+  ASSERT_EQ(channel.buffer()[0], 0);
+}
+
+TEST(ChannelSegmentTest, Doorbells) {
+  const SegmentName name("doorbells");
+  TestSegment writer = TestSegment::create(name.value());
+  const TestSegment reader = TestSegment::open(name.value(), SegmentAccess::Reader);
+  DoorbellPoller<N> poller1(reader.doorbell(1));
+  DoorbellPoller<N> poller2(reader.doorbell(2));
+  DoorbellPoller<N> poller64(reader.doorbell(64));
+  const TestChannel trades = writer.add_channel("trades", FrameFormat::Plain);
+  const TestChannel quotes = writer.add_channel("quotes", FrameFormat::Plain);
+
+  writer.ring_doorbells(quotes.index, 0b1 | (uint64_t{1} << 63));
+  writer.ring_doorbells(trades.index, 0b10);
+  std::vector<uint32_t> visited;
+  const auto visit = [&visited](const uint32_t channel) {
+    visited.push_back(channel);
+    return false;
+  };
+  ASSERT_EQ(poller1.poll(visit), 1);
+  ASSERT_EQ(poller2.poll(visit), 1);
+  ASSERT_EQ(poller64.poll(visit), 1);
+  ASSERT_EQ(visited, (std::vector<uint32_t>{quotes.index, trades.index, quotes.index}));
+  ASSERT_EQ(poller1.poll(visit), 0);
+}
+
+TEST(ChannelSegmentTest, IndependentChannels) {
+  const SegmentName name("demux");
+  TestSegment segment = TestSegment::create(name.value());
+  const TestSegment reader_segment = TestSegment::open(name.value(), SegmentAccess::Reader);
+  std::array<std::optional<core::DemuxWriter<L, M, false>>, 2> writers{};
+  std::array<std::optional<core::DemuxReader<L, M>>, 2> readers{};
+  for (size_t i = 0; i < 2; ++i) {
+    const TestChannel w = segment.add_channel("feed" + std::to_string(i), FrameFormat::Plain);
+    writers.at(i).emplace(0b1, w.buffer(), &w.control->message_count_sync, &w.control->wraparound_sync);
+    const TestChannel r = reader_segment.find_channel("feed" + std::to_string(i), FrameFormat::Plain).value();
+    readers.at(i).emplace(core::ReaderId{1}, r.buffer(), &r.control->message_count_sync, &r.control->wraparound_sync);
+  }
+
+  for (uint8_t n = 0; n < 10; ++n) {
+    std::array<uint8_t, 1> message{n};
+    ASSERT_EQ(writers[0]->write(message), core::WriteResult::Success);
+  }
+  std::array<uint8_t, 2> message{7, 8};
+  ASSERT_EQ(writers[1]->write(message), core::WriteResult::Success);
+
+  for (uint8_t n = 0; n < 10; ++n) {
+    const std::span<uint8_t> x = readers[0]->next();
+    ASSERT_EQ(x.size(), 1);
+    ASSERT_EQ(x[0], n);
+  }
+  ASSERT_TRUE(readers[0]->next().empty());
+  const std::span<uint8_t> x = readers[1]->next();
+  ASSERT_EQ(x.size(), 2);
+  ASSERT_EQ(x[1], 8);
+  ASSERT_TRUE(readers[1]->next().empty());
+}
+
+}  // namespace lshl::demux::util
+
+// NOLINTEND(readability-function-cognitive-complexity, misc-include-cleaner)
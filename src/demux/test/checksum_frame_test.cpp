@@ -0,0 +1,170 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+// NOLINTBEGIN(readability-function-cognitive-complexity, misc-include-cleaner)
+
+#define UNIT_TEST
+#undef NDEBUG  // for assert to work in release build
+
+#include "../core/checksum_frame.h"
+#include <gtest/gtest.h>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+#include "../core/demultiplexer.h"
+#include "./test_ring.h"
+
+using lshl::demux::core::ChecksumReader;
+using lshl::demux::core::ChecksumWriter;
+using lshl::demux::core::DemuxWriter;
+using lshl::demux::core::frame_checksum;
+using lshl::demux::core::TestRing;
+using lshl::demux::core::WriteResult;
+using std::array;
+using std::size_t;
+using std::span;
+using std::uint16_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::uint8_t;
+
+namespace {
+
+constexpr size_t L = 1024;
+constexpr uint16_t M = 64;
+
+using Ring = TestRing<L, M>;
+
+// NOLINTBEGIN(misc-non-private-member-variables-in-classes)
+struct Message {
+  uint64_t sequence;
+  array<uint8_t, 20> data;
+};
+// NOLINTEND(misc-non-private-member-variables-in-classes)
+
+}  // namespace
+
+template <class C>
+class ChecksumFrameTest : public ::testing::Test {};
+
+using ChecksumTypes = ::testing::Types<uint32_t, uint64_t>;
+TYPED_TEST_SUITE(ChecksumFrameTest, ChecksumTypes);
+
+TYPED_TEST(ChecksumFrameTest, RoundTrip) {
+  using C = TypeParam;
+  Ring ring{};
+  ChecksumWriter<C, L, M, false> writer(&ring.writer);
+  ChecksumReader<C, L, M> reader(&ring.reader, true);
+
+  for (uint64_t i = 0; i < 5; ++i) {
+    Message x{};
+    x.sequence = i;
+    x.data.fill(static_cast<uint8_t>(i));
+    ASSERT_EQ(WriteResult::Success, writer.write_safe(x));
+  }
+  // zero-copy
+  std::optional<span<uint8_t>> x = writer.allocate(3);
+  ASSERT_TRUE(x.has_value());
+  x.value()[0] = 'a';
+  x.value()[1] = 'b';
+  x.value()[2] = 'c';
+  writer.commit(3);
+
+  for (uint64_t i = 0; i < 5; ++i) {
+    const std::optional<const Message*> m = reader.template next_unsafe<Message>();
+    ASSERT_TRUE(m.has_value());
+    ASSERT_EQ(i, m.value()->sequence);
+    ASSERT_EQ(i, m.value()->data[19]);
+  }
+  const span<uint8_t> abc = reader.next();
+  ASSERT_EQ(3, abc.size());
+  ASSERT_EQ('c', abc[2]);
+  ASSERT_TRUE(reader.next().empty());
+  ASSERT_EQ(0, reader.corrupted_count());
+
+  // the payload is at the same offset as a plain message, followed by the trailer
+  C trailer{};
+  std::memcpy(&trailer, &ring.buffer[sizeof(uint16_t) + sizeof(Message)], sizeof(C));
+  Message first{};
+  first.sequence = 0;
+  first.data.fill(0);
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  ASSERT_EQ(frame_checksum<C>(span<const uint8_t>{reinterpret_cast<const uint8_t*>(&first), sizeof(Message)}), trailer);
+}
+
+TYPED_TEST(ChecksumFrameTest, DetectsCorruption) {
+  using C = TypeParam;
+  Ring ring{};
+  ChecksumWriter<C, L, M, false> writer(&ring.writer);
+  ChecksumReader<C, L, M> reader(&ring.reader, true);
+
+  const array<uint8_t, 8> payload{1, 2, 3, 4, 5, 6, 7, 8};
+  ASSERT_EQ(WriteResult::Success, writer.write(payload));
+  ASSERT_EQ(WriteResult::Success, writer.write(payload));
+  ring.buffer[sizeof(uint16_t) + 3] ^= 0x10U;  // a bit flip in the first payload
+
+  const span<uint8_t> x = reader.next();
+  ASSERT_EQ(8, x.size());  // delivered and counted
+  ASSERT_EQ(1, reader.corrupted_count());
+  ASSERT_EQ(8, reader.next().size());
+  ASSERT_EQ(1, reader.corrupted_count());
+}
+
+TYPED_TEST(ChecksumFrameTest, VerificationOff) {
+  using C = TypeParam;
+  Ring ring{};
+  ChecksumWriter<C, L, M, false> writer(&ring.writer);
+  ChecksumReader<C, L, M> reader(&ring.reader, false);
+
+  const array<uint8_t, 8> payload{1, 2, 3, 4, 5, 6, 7, 8};
+  ASSERT_EQ(WriteResult::Success, writer.write(payload));
+  ring.buffer[sizeof(uint16_t)] ^= 0x01U;
+  ASSERT_EQ(8, reader.next().size());
+  ASSERT_EQ(0, reader.corrupted_count());
+}
+
+TYPED_TEST(ChecksumFrameTest, InvalidFrames) {
+  using C = TypeParam;
+  Ring ring{};
+  ChecksumWriter<C, L, M, false> writer(&ring.writer);
+  ChecksumReader<C, L, M> reader(&ring.reader, true);
+
+  std::vector<uint8_t> payload(M, 1);
+  ASSERT_EQ(WriteResult::Error, writer.write(payload));  // no room for the checksum
+  ASSERT_EQ(WriteResult::Error, writer.write(span<const uint8_t>{}));
+  ASSERT_FALSE(writer.allocate(0).has_value());
+  payload.resize(ChecksumWriter<C, L, M, false>::MAX_PAYLOAD);
+  ASSERT_EQ(WriteResult::Success, writer.write(payload));
+
+  // a plain message, shorter than the checksum, is skipped
+  array<uint8_t, sizeof(C)> plain{};
+  ASSERT_EQ(WriteResult::Success, ring.writer.write(plain));
+
+  ASSERT_EQ(payload.size(), reader.next().size());
+  ASSERT_TRUE(reader.next().empty());
+  ASSERT_EQ(1, reader.corrupted_count());
+}
+
+TYPED_TEST(ChecksumFrameTest, BlockingWriter) {
+  using C = TypeParam;
+  Ring ring{};
+  DemuxWriter<L, M, true> blocking(
+      ring.id.mask(), span{ring.buffer}, &ring.message_count_sync, &ring.wraparound_sync
+  );
+  ChecksumWriter<C, L, M, true> writer(&blocking);
+  ChecksumReader<C, L, M> reader(&ring.reader, true);
+
+  // within the first lap, the blocking writer waits for the reader at a wraparound
+  const array<uint8_t, ChecksumWriter<C, L, M, true>::MAX_PAYLOAD> payload{1, 2, 3};
+  for (size_t i = 0; i < L / (2 * M); ++i) {
+    ASSERT_EQ(WriteResult::Success, writer.write(payload));
+    ASSERT_EQ(payload.size(), reader.next().size());
+  }
+  ASSERT_EQ(WriteResult::Error, writer.write(span<const uint8_t>{}));
+  ASSERT_EQ(0, reader.corrupted_count());
+}
+
+// NOLINTEND(readability-function-cognitive-complexity, misc-include-cleaner)
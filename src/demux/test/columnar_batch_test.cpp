@@ -0,0 +1,166 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+// NOLINTBEGIN(readability-function-cognitive-complexity, misc-include-cleaner)
+
+#define UNIT_TEST
+#undef NDEBUG  // for assert to work in release build
+
+#include "../example/columnar_batch.h"
+#include <gtest/gtest.h>
+#include <rapidcheck.h>  // NOLINT(misc-include-cleaner)
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <vector>
+#include "../core/demultiplexer.h"
+#include "../core/message_buffer.h"
+#include "../core/reader_id.h"
+#include "../example/market_data.h"
+
+using lshl::demux::core::DemuxReader;
+using lshl::demux::core::DemuxWriter;
+using lshl::demux::core::MessageBuffer;
+using lshl::demux::core::ReaderId;
+using lshl::demux::core::WriteResult;
+using lshl::demux::example::detect_simd_level;
+using lshl::demux::example::MarketDataBatch;
+using lshl::demux::example::MarketDataUpdate;
+using lshl::demux::example::SimdLevel;
+using lshl::demux::example::Vwap;
+using lshl::demux::example::VwapAggregator;
+using std::size_t;
+using std::span;
+using std::uint16_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::uint8_t;
+using std::vector;
+
+namespace {
+
+constexpr std::array<SimdLevel, 2> SIMD_LEVELS{SimdLevel::Scalar, SimdLevel::Avx2};
+
+auto set(MarketDataUpdate* md, const uint32_t instrument_id, const uint64_t price, const uint32_t size) -> void {
+  md->timestamp = 0;
+  md->instrument_id = instrument_id;
+  md->price = price;
+  md->size = size;
+}
+
+}  // namespace
+
+TEST(ColumnarBatchTest, Append) {
+  ASSERT_THROW(MarketDataBatch(0), std::invalid_argument);
+
+  MarketDataBatch batch(2);
+  MarketDataUpdate md{};
+  ASSERT_TRUE(batch.empty());
+  set(&md, 7, 100, 1);
+  ASSERT_TRUE(batch.append(md));
+  set(&md, 8, 200, 2);
+  ASSERT_TRUE(batch.append(md));
+  ASSERT_TRUE(batch.full());
+  ASSERT_FALSE(batch.append(md));
+
+  ASSERT_EQ(2, batch.size());
+  ASSERT_EQ(100.0, batch.prices()[0]);
+  ASSERT_EQ(2.0, batch.sizes()[1]);
+  ASSERT_EQ(8, batch.instrument_ids()[1]);
+
+  batch.clear();
+  ASSERT_TRUE(batch.empty());
+  ASSERT_EQ(0, batch.prices().size());
+}
+
+TEST(ColumnarBatchTest, Drain) {
+  constexpr uint16_t M = sizeof(MarketDataUpdate);
+  constexpr size_t L = 8 * MessageBuffer<0>::required<MarketDataUpdate>();
+  std::array<uint8_t, L> buffer{};
+  std::atomic<uint64_t> message_count_sync{0};
+  std::atomic<uint64_t> wraparound_sync{0};
+  const ReaderId id{1};
+  DemuxWriter<L, M, false> writer(id.mask(), span{buffer}, &message_count_sync, &wraparound_sync);
+  DemuxReader<L, M> reader(id, span{buffer}, &message_count_sync, &wraparound_sync);
+  MarketDataBatch batch(5);
+  MarketDataUpdate md{};
+
+  ASSERT_EQ(0, batch.drain(&reader));
+  for (uint32_t i = 0; i < 8; ++i) {
+    set(&md, i, i, 1);
+    ASSERT_EQ(WriteResult::Success, writer.write_safe(md));
+  }
+  ASSERT_EQ(5, batch.drain(&reader));  // bounded by the capacity
+  ASSERT_EQ(4, batch.instrument_ids()[4]);
+  batch.clear();
+  ASSERT_EQ(3, batch.drain(&reader));
+  ASSERT_EQ(7, batch.instrument_ids()[2]);
+  ASSERT_EQ(0, reader.lag());
+}
+
+// integer values, the sums are exact in any order
+TEST(ColumnarBatchTest, KernelsSameAsScalar) {
+  rc::check([](const vector<uint32_t>& xs) {
+    vector<double> x{};
+    vector<double> y{};
+    double expected_dot = 0;
+    double expected_sum = 0;
+    for (const uint32_t a : xs) {
+      x.push_back(static_cast<double>(a % 100000));
+      y.push_back(static_cast<double>(a >> 16U));
+      expected_dot += x.back() * y.back();
+      expected_sum += x.back();
+    }
+    for (const SimdLevel simd : SIMD_LEVELS) {
+      vector<double> output(x.size());
+      lshl::demux::example::multiply(simd, x, y, output);
+      for (size_t i = 0; i < x.size(); ++i) {
+        RC_ASSERT(output[i] == x[i] * y[i]);
+      }
+      RC_ASSERT(lshl::demux::example::dot(simd, x, y) == expected_dot);
+      RC_ASSERT(lshl::demux::example::sum(simd, x) == expected_sum);
+    }
+  });
+}
+
+TEST(ColumnarBatchTest, BatchSameAsPerMessage) {
+  constexpr size_t MAX_INSTRUMENTS = 4;
+  constexpr size_t N = 37;  // not a multiple of the vector width
+  for (const SimdLevel simd : SIMD_LEVELS) {
+    VwapAggregator per_message(MAX_INSTRUMENTS, N, SimdLevel::Scalar);
+    VwapAggregator batched(MAX_INSTRUMENTS, N, simd);
+    MarketDataBatch batch(N);
+    MarketDataUpdate md{};
+    size_t skipped = 0;
+    for (uint32_t i = 0; i < N; ++i) {
+      set(&md, i % (MAX_INSTRUMENTS + 1), 1000 + i, i + 1);
+      skipped += per_message.add(md) ? 0U : 1U;
+      ASSERT_TRUE(batch.append(md));
+    }
+    ASSERT_EQ(skipped, batched.add(batch));
+    ASSERT_EQ(7, skipped);  // instrument 4, the table is full
+
+    for (uint32_t i = 0; i < MAX_INSTRUMENTS; ++i) {
+      const Vwap* expected = per_message.find(i);
+      const Vwap* actual = batched.find(i);
+      ASSERT_NE(nullptr, actual);
+      ASSERT_EQ(expected->notional, actual->notional);
+      ASSERT_EQ(expected->size, actual->size);
+      ASSERT_EQ(expected->value(), actual->value());
+    }
+    ASSERT_EQ(nullptr, batched.find(MAX_INSTRUMENTS));
+  }
+}
+
+TEST(ColumnarBatchTest, SimdFallback) {
+  const VwapAggregator x(1, 1, SimdLevel::Avx2);
+  ASSERT_EQ(detect_simd_level(), x.simd());
+  const VwapAggregator y(1, 1, SimdLevel::Scalar);
+  ASSERT_EQ(SimdLevel::Scalar, y.simd());
+}
+
+// NOLINTEND(readability-function-cognitive-complexity, misc-include-cleaner)
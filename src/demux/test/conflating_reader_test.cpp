@@ -0,0 +1,145 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+// NOLINTBEGIN(readability-function-cognitive-complexity, misc-include-cleaner)
+
+#define UNIT_TEST
+#undef NDEBUG  // for assert to work in release build
+
+#include "../example/conflating_reader.h"
+#include <gtest/gtest.h>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include "../core/demultiplexer.h"
+#include "../core/message_buffer.h"
+#include "../example/market_data.h"
+#include "./test_ring.h"
+
+using lshl::demux::core::MessageBuffer;
+using lshl::demux::core::TestRing;
+using lshl::demux::core::WriteResult;
+using lshl::demux::example::ConflatingReader;
+using lshl::demux::example::MarketDataUpdate;
+using lshl::demux::example::Side;
+using std::optional;
+using std::size_t;
+using std::uint16_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::uint8_t;
+
+namespace {
+
+constexpr uint16_t M = sizeof(MarketDataUpdate);
+constexpr size_t MESSAGE_NUM = 16;  // messages that fit into the buffer
+constexpr size_t L = MESSAGE_NUM * MessageBuffer<0>::required<MarketDataUpdate>();
+
+using Ring = TestRing<L, M>;
+
+// price carries the sequence number of the update
+auto write(Ring* ring, const uint32_t instrument_id, const Side side, const uint8_t level, const uint64_t price)
+    -> void {
+  MarketDataUpdate md{};
+  md.timestamp = price;
+  md.instrument_id = instrument_id;
+  md.side = side;
+  md.level = level;
+  md.price = price;
+  md.size = 1;
+  ASSERT_EQ(WriteResult::Success, ring->writer.write_safe(md));
+}
+
+auto read_all(ConflatingReader<L, M>* reader) -> std::vector<uint64_t> {
+  std::vector<uint64_t> prices{};
+  for (optional<const MarketDataUpdate*> x = reader->next(); x.has_value(); x = reader->next()) {
+    prices.push_back(x.value()->price);
+  }
+  return prices;
+}
+
+}  // namespace
+
+TEST(ConflatingReaderTest, DeliversEveryUpdateWithinLagThreshold) {
+  Ring ring{};
+  ConflatingReader<L, M> reader(&ring.reader, 4, 8);
+  for (uint64_t i = 1; i <= 4; ++i) {
+    write(&ring, 1, Side::Bid, 0, i);
+  }
+  ASSERT_EQ((std::vector<uint64_t>{1, 2, 3, 4}), read_all(&reader));
+  ASSERT_EQ(4, reader.read_count());
+  ASSERT_EQ(0, reader.conflated_count());
+  ASSERT_EQ(0, reader.batch_count());
+}
+
+TEST(ConflatingReaderTest, DeliversLatestUpdatePerKeyWhenLagging) {
+  Ring ring{};
+  ConflatingReader<L, M> reader(&ring.reader, 2, 8);
+  // keys: (1, Bid, 0), (1, Ask, 0), (2, Bid, 0), (1, Bid, 1)
+  write(&ring, 1, Side::Bid, 0, 1);
+  write(&ring, 1, Side::Ask, 0, 2);
+  write(&ring, 1, Side::Bid, 0, 3);
+  write(&ring, 2, Side::Bid, 0, 4);
+  write(&ring, 1, Side::Bid, 1, 5);
+  write(&ring, 1, Side::Ask, 0, 6);
+  write(&ring, 1, Side::Bid, 0, 7);
+
+  // first-seen order of the keys, latest update per key
+  ASSERT_EQ((std::vector<uint64_t>{7, 6, 4, 5}), read_all(&reader));
+  ASSERT_EQ(7, reader.read_count());
+  ASSERT_EQ(3, reader.conflated_count());
+  ASSERT_EQ(1, reader.batch_count());
+  ASSERT_FALSE(reader.is_conflating());
+
+  // caught up, back to delivering every update
+  write(&ring, 1, Side::Bid, 0, 8);
+  ASSERT_EQ((std::vector<uint64_t>{8}), read_all(&reader));
+}
+
+TEST(ConflatingReaderTest, BatchIsBoundedByMaxKeys) {
+  Ring ring{};
+  ConflatingReader<L, M> reader(&ring.reader, 1, 2);
+  write(&ring, 1, Side::Bid, 0, 1);
+  write(&ring, 1, Side::Bid, 0, 2);
+  write(&ring, 2, Side::Bid, 0, 3);
+  write(&ring, 1, Side::Bid, 0, 4);
+  write(&ring, 3, Side::Bid, 0, 5);
+  write(&ring, 3, Side::Bid, 0, 6);
+
+  // the batch stops when the table is full, the next update is not read even if its key is in the table
+  ASSERT_EQ(2, reader.next().value()->price);
+  ASSERT_TRUE(reader.is_conflating());
+  ASSERT_EQ(3, reader.next().value()->price);
+  // the second batch
+  ASSERT_EQ(4, reader.next().value()->price);
+  ASSERT_EQ(5, reader.next().value()->price);
+  ASSERT_EQ(2, reader.batch_count());
+  // within the lag threshold
+  ASSERT_EQ(6, reader.next().value()->price);
+  ASSERT_FALSE(reader.next().has_value());
+  ASSERT_EQ(1, reader.conflated_count());
+  ASSERT_EQ(6, reader.read_count());
+}
+
+TEST(ConflatingReaderTest, ConflatesAcrossWraparound) {
+  Ring ring{};
+  ConflatingReader<L, M> reader(&ring.reader, 0, 4);
+  for (uint64_t i = 1; i <= MESSAGE_NUM; ++i) {
+    write(&ring, static_cast<uint32_t>(i % 2), Side::Bid, 0, i);
+  }
+  // initiates the wraparound, completed after the reader reads the marker
+  MarketDataUpdate md{};
+  ASSERT_EQ(WriteResult::Repeat, ring.writer.write_safe(md));
+
+  ASSERT_EQ((std::vector<uint64_t>{MESSAGE_NUM - 1, MESSAGE_NUM}), read_all(&reader));
+  ASSERT_FALSE(ring.writer.wraparound_pending());
+
+  write(&ring, 1, Side::Bid, 0, 100);
+  write(&ring, 1, Side::Bid, 0, 101);
+  ASSERT_EQ((std::vector<uint64_t>{101}), read_all(&reader));
+  ASSERT_EQ(MESSAGE_NUM + 2, reader.read_count());
+  ASSERT_EQ(MESSAGE_NUM - 1, reader.conflated_count());
+}
+
+// NOLINTEND(readability-function-cognitive-complexity, misc-include-cleaner)
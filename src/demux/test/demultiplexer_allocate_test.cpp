@@ -10,6 +10,7 @@
 
 #include <gtest/gtest.h>
 #include <rapidcheck.h>  // NOLINT(misc-include-cleaner)
+#include <algorithm>
 #include <array>
 #include <atomic>
 #include <boost/log/core.hpp>         // NOLINT(misc-include-cleaner)
@@ -269,6 +270,46 @@ TEST(NonBlockingDemuxWriterWithAllocateTest, SlowReader) {
   rc::check(slow_reader_test);
 }
 
+TEST(NonBlockingDemuxWriterWithAllocateTest, AllocateBytesAndCommit) {
+  array<uint8_t, L> buffer{};
+  atomic<uint64_t> msg_counter_sync{0};
+  atomic<uint64_t> wraparound_sync{0};
+  const ReaderId reader_id{1};
+
+  DemuxWriter<L, M, false> writer(reader_id.mask(), span{buffer}, &msg_counter_sync, &wraparound_sync);
+  DemuxReader<L, M> reader(reader_id, span{buffer}, &msg_counter_sync, &wraparound_sync);
+
+  ASSERT_FALSE(writer.allocate(0).has_value());
+  ASSERT_FALSE(writer.allocate(M + 1).has_value());
+
+  // not visible to the reader until commit
+  const optional<span<uint8_t>> m1 = writer.allocate(3);
+  ASSERT_TRUE(m1.has_value());
+  ASSERT_EQ(3, m1->size());
+  std::fill(m1->begin(), m1->end(), 7);
+  ASSERT_TRUE(reader.next().empty());
+  writer.commit(3);
+
+  const span<uint8_t> r1 = reader.next();
+  ASSERT_EQ(vector<uint8_t>(3, 7), vector<uint8_t>(r1.begin(), r1.end()));
+
+  // fill up the buffer, the non-blocking writer has to wait for the reader before wraparound
+  size_t written = 0;
+  while (writer.allocate(M).has_value()) {
+    writer.commit(M);
+    written += 1;
+  }
+  ASSERT_GT(written, 0);
+  ASSERT_FALSE(writer.allocate(M).has_value());
+
+  for (size_t i = 0; i < written; ++i) {
+    ASSERT_EQ(M, reader.next().size());
+  }
+  ASSERT_TRUE(reader.next().empty());  // wraparound marker
+
+  ASSERT_TRUE(writer.allocate(M).has_value());
+}
+
 auto main(int argc, char** argv) -> int {
   namespace logging = boost::log;
   logging::core::get()->set_filter(logging::trivial::severity >= logging::trivial::warning);
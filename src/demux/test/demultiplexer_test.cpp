@@ -21,10 +21,15 @@
 #include <cstdint>
 #include <future>
 #include <limits>
+#include <optional>
 #include <set>
 #include <span>
+#include <stdexcept>
+#include <tuple>
 #include <vector>
 #include "../core/demultiplexer.h"
+#include "../core/demux_control.h"
+#include "../core/demux_stats.h"
 #include "../core/message_buffer.h"
 #include "../core/reader_id.h"
 #include "./reader_id_gen.h"
@@ -42,7 +47,10 @@ BOOST_STRONG_TYPEDEF(std::vector<uint8_t>, TestMessage);
 }  // namespace lshl::demux::core
 
 using lshl::demux::core::DEFAULT_WAIT;
+using lshl::demux::core::DemuxControl;
+using lshl::demux::core::DemuxLap;
 using lshl::demux::core::DemuxReader;
+using lshl::demux::core::DemuxStats;
 using lshl::demux::core::DemuxWriter;
 using lshl::demux::core::mask_to_reader_ids;
 using lshl::demux::core::ReaderId;
@@ -308,6 +316,55 @@ TEST(NonBlockingDemuxWriterTest, WriteWhenBufferIfFullAndGetWriteRepeatResult) {
   ASSERT_EQ(0, read2.size());
 }
 
+TEST(NonBlockingDemuxWriterTest, BackPressureQueries) {
+  array<uint8_t, L> buffer{};
+  atomic<uint64_t> msg_counter_sync{0};
+  atomic<uint64_t> wraparound_sync{0};
+  const uint8_t all_readers_mask = 0b11;
+  const ReaderId subId1(1);
+  const ReaderId subId2(2);
+
+  DemuxWriter<L, M, false> writer(all_readers_mask, span{buffer}, &msg_counter_sync, &wraparound_sync);
+  DemuxReader<L, M> reader1(subId1, span{buffer}, &msg_counter_sync, &wraparound_sync);
+  DemuxReader<L, M> reader2(subId2, span{buffer}, &msg_counter_sync, &wraparound_sync);
+
+  ASSERT_EQ(L, writer.free_bytes());
+  ASSERT_TRUE(writer.can_write(M - 2));
+  ASSERT_FALSE(writer.wraparound_pending());
+  ASSERT_EQ(0, writer.lagging_readers_mask());
+  ASSERT_FALSE(writer.slowest_reader_lag().has_value());  // no stats page
+
+  array<uint8_t, M> m1{1};
+  ASSERT_EQ(WriteResult::Success, writer.write(m1));
+  ASSERT_EQ(L - M - 2, writer.free_bytes());
+  ASSERT_TRUE(writer.can_write(M - 4));
+  ASSERT_FALSE(writer.can_write(M - 3));
+  ASSERT_FALSE(writer.wraparound_pending());
+
+  // initiates the wraparound
+  ASSERT_EQ(WriteResult::Repeat, writer.write(m1));
+  ASSERT_TRUE(writer.wraparound_pending());
+  ASSERT_EQ(0, writer.free_bytes());
+  ASSERT_FALSE(writer.can_write(1));
+  ASSERT_EQ(0b11, writer.lagging_readers_mask());
+
+  ASSERT_EQ(M, reader1.next().size());
+  ASSERT_TRUE(reader1.next().empty());  // wraparound marker
+  ASSERT_TRUE(writer.wraparound_pending());
+  ASSERT_EQ(0b10, writer.lagging_readers_mask());
+
+  ASSERT_EQ(M, reader2.next().size());
+  ASSERT_TRUE(reader2.next().empty());
+  ASSERT_FALSE(writer.wraparound_pending());
+  ASSERT_EQ(0, writer.lagging_readers_mask());
+  // the next write completes the wraparound
+  ASSERT_EQ(L, writer.free_bytes());
+  ASSERT_TRUE(writer.can_write(M));
+
+  ASSERT_EQ(WriteResult::Success, writer.write(m1));
+  ASSERT_EQ(L - M - 2, writer.free_bytes());
+}
+
 namespace {
 template <bool Blocking>
 auto write_and_read_1(TestMessage message) {
@@ -344,7 +401,8 @@ TEST(NonBlockingDemuxWriterTest, WriteRead1) {
 }
 
 namespace {
-template <bool Blocking>
+// `P` prefetch distance of the writer and the reader, must not change the result
+template <bool Blocking, size_t P = 0>
 auto one_reader_read_x(const vector<TestMessage>& valid_messages) {
   if (valid_messages.empty()) {
     return;
@@ -360,6 +418,8 @@ auto one_reader_read_x(const vector<TestMessage>& valid_messages) {
 
   DemuxWriter<L, M, Blocking> writer(all_readers_mask, span{buffer}, &msg_counter_sync, &wraparound_sync);
   DemuxReader<L, M> reader(subId, span{buffer}, &msg_counter_sync, &wraparound_sync);
+  writer.set_prefetch_distance(P);
+  reader.set_prefetch_distance(P);
 
   std::future<size_t> sent_count_future =
       std::async(std::launch::async, [&valid_messages, &writer] { return write_all(valid_messages, writer); });
@@ -389,6 +449,16 @@ TEST(NonBlockingDemuxWriterTest, OneReaderReadX) {
   rc::check(one_reader_read_x<false>);
 }
 
+TEST(BlockingDemuxWriterTest, OneReaderReadXWithPrefetch) {
+  rc::check(one_reader_read_x<true, 1>);
+  rc::check(one_reader_read_x<true, 4>);
+}
+
+TEST(NonBlockingDemuxWriterTest, OneReaderReadXWithPrefetch) {
+  rc::check(one_reader_read_x<false, 2>);
+  rc::check(one_reader_read_x<false, 64>);  // beyond the end of the buffer
+}
+
 namespace {
 template <bool Blocking>
 auto multiple_readers_read_x(const vector<TestMessage>& valid_messages) -> void {
@@ -623,6 +693,275 @@ TEST(NonBlockingDemuxWriterTest, SlowReader) {
   rc::check(slow_reader_test);
 }
 
+TEST(NonBlockingDemuxWriterTest, WriteBatch) {
+  array<uint8_t, L> buffer{};
+  atomic<uint64_t> msg_counter_sync{0};
+  atomic<uint64_t> wraparound_sync{0};
+  const ReaderId reader_id{1};
+
+  DemuxWriter<L, M, false> writer(reader_id.mask(), span{buffer}, &msg_counter_sync, &wraparound_sync);
+  DemuxReader<L, M> reader(reader_id, span{buffer}, &msg_counter_sync, &wraparound_sync);
+
+  constexpr size_t N = (L / 4) - sizeof(uint16_t);  // 4 messages fill up the entire buffer
+  array<uint8_t, N> m{1};
+  const array<span<uint8_t>, 6> batch{m, m, m, m, m, m};
+
+  ASSERT_EQ(4, writer.write_batch(batch));
+  ASSERT_EQ(5, writer.message_count());  // the end of buffer marker counts
+  ASSERT_EQ(5, msg_counter_sync.load());
+
+  // wraparound is pending, the reader has not caught up yet
+  ASSERT_EQ(0, writer.write_batch(batch));
+
+  for (size_t i = 0; i < 4; ++i) {
+    assert_eq(m, reader.next());
+  }
+  ASSERT_TRUE(reader.next().empty());
+
+  // the reader caught up, the wraparound completes and the rest of the batch is written
+  ASSERT_EQ(2, writer.write_batch(span{batch}.subspan(4)));
+  assert_eq(m, reader.next());
+  assert_eq(m, reader.next());
+  ASSERT_FALSE(reader.has_next());
+}
+
+TEST(BlockingDemuxWriterTest, WriteBatchInvalidMessage) {
+  array<uint8_t, L> buffer{};
+  atomic<uint64_t> msg_counter_sync{0};
+  atomic<uint64_t> wraparound_sync{0};
+
+  DemuxWriter<L, M, true> writer(ReaderId{1}.mask(), span{buffer}, &msg_counter_sync, &wraparound_sync);
+
+  array<uint8_t, 1> m{1};
+  const array<span<uint8_t>, 3> batch{m, {}, m};
+
+  // stops at the first invalid message, publishes everything before it
+  ASSERT_EQ(1, writer.write_batch(batch));
+  ASSERT_EQ(1, msg_counter_sync.load());
+}
+
+namespace {
+// reads until the reader has nothing left or reached the wraparound marker
+template <size_t L, uint16_t M>
+auto drain(DemuxReader<L, M>* reader, vector<TestMessage>* output) -> void {
+  for (span<uint8_t> m = reader->next(); !m.empty(); m = reader->next()) {
+    output->emplace_back(TestMessage(vector<uint8_t>{m.begin(), m.end()}));
+  }
+}
+}  // namespace
+
+TEST(NonBlockingDemuxWriterTest, Recover) {
+  // the writer "crashes" every `period` messages and when a wraparound is pending, the reader keeps reading
+  rc::check([](const vector<TestMessage>& messages, const uint8_t x) {
+    const size_t period = 1 + (x % 8);
+
+    array<uint8_t, L> buffer{};
+    atomic<uint64_t> msg_counter_sync{0};
+    atomic<uint64_t> wraparound_sync{0};
+    DemuxControl control{};
+    const ReaderId id{1};
+
+    std::optional<DemuxWriter<L, M, false>> writer{};
+    writer.emplace(id.mask(), span{buffer}, &msg_counter_sync, &wraparound_sync, nullptr, &control);
+    DemuxReader<L, M> reader(id, span{buffer}, &msg_counter_sync, &wraparound_sync);
+    uint64_t epoch = 1;
+    const auto crash_and_recover = [&] {
+      writer.reset();
+      writer.emplace(DemuxWriter<L, M, false>::recover(span{buffer}, &msg_counter_sync, &wraparound_sync, &control));
+      epoch += 1;
+    };
+
+    vector<TestMessage> received{};
+    for (size_t i = 0; i < messages.size();) {
+      TestMessage m = messages[i];
+      if (writer->write(m.t) == WriteResult::Repeat) {
+        crash_and_recover();
+        RC_ASSERT(writer->wraparound_pending());
+        drain(&reader, &received);
+        continue;
+      }
+      i += 1;
+      if (i % period == 0) {
+        crash_and_recover();
+        RC_ASSERT(writer->message_count() == msg_counter_sync.load());
+      }
+      drain(&reader, &received);
+    }
+
+    RC_ASSERT(control.epoch.load() == epoch);
+    RC_ASSERT(control.all_readers_mask.load() == id.mask());
+    assert_eq(messages, received);
+    return !::testing::Test::HasFailure();
+  });
+}
+
+TEST(BlockingDemuxWriterTest, RecoverPendingWraparoundCompletesOnFirstWrite) {
+  array<uint8_t, L> buffer{};
+  atomic<uint64_t> msg_counter_sync{0};
+  atomic<uint64_t> wraparound_sync{0};
+  DemuxControl control{};
+  const ReaderId id{1};
+  DemuxReader<L, M> reader(id, span{buffer}, &msg_counter_sync, &wraparound_sync);
+
+  array<uint8_t, M> m1{1};
+  {
+    // the non-blocking writer leaves the wraparound pending
+    DemuxWriter<L, M, false> writer(id.mask(), span{buffer}, &msg_counter_sync, &wraparound_sync, nullptr, &control);
+    ASSERT_EQ(WriteResult::Success, writer.write(m1));
+    ASSERT_EQ(WriteResult::Repeat, writer.write(m1));
+    ASSERT_TRUE(writer.wraparound_pending());
+  }
+  assert_eq(m1, reader.next());
+  ASSERT_TRUE(reader.next().empty());  // the marker, the reader is ready for the wraparound
+
+  DemuxWriter<L, M, true> writer =
+      DemuxWriter<L, M, true>::recover(span{buffer}, &msg_counter_sync, &wraparound_sync, &control);
+  ASSERT_EQ(2, control.epoch.load());
+  ASSERT_EQ(2, writer.message_count());
+  ASSERT_FALSE(writer.wraparound_pending());
+  ASSERT_EQ(L, writer.free_bytes());  // the reader has caught up, the next write completes the wraparound
+
+  array<uint8_t, M> m2{2};
+  ASSERT_EQ(WriteResult::Success, writer.write(m2));
+  ASSERT_EQ(L - sizeof(uint16_t) - M, writer.free_bytes());  // back at position 0
+  assert_eq(m2, reader.next());
+}
+
+TEST(NonBlockingDemuxWriterTest, RecoverPendingWraparoundWithStats) {
+  array<uint8_t, L> buffer{};
+  atomic<uint64_t> msg_counter_sync{0};
+  atomic<uint64_t> wraparound_sync{0};
+  DemuxControl control{};
+  DemuxStats stats{};
+  const ReaderId id{1};
+  DemuxReader<L, M> reader(id, span{buffer}, &msg_counter_sync, &wraparound_sync);
+
+  array<uint8_t, M> m1{1};
+  {
+    DemuxWriter<L, M, false> writer(id.mask(), span{buffer}, &msg_counter_sync, &wraparound_sync, &stats, &control);
+    ASSERT_EQ(WriteResult::Success, writer.write(m1));
+    ASSERT_EQ(WriteResult::Repeat, writer.write(m1));
+  }
+
+  DemuxWriter<L, M, false> writer =
+      DemuxWriter<L, M, false>::recover(span{buffer}, &msg_counter_sync, &wraparound_sync, &control, &stats);
+  ASSERT_TRUE(writer.wraparound_pending());
+  assert_eq(m1, reader.next());
+  ASSERT_TRUE(reader.next().empty());
+
+  array<uint8_t, M> m2{2};
+  ASSERT_EQ(WriteResult::Success, writer.write(m2));
+  assert_eq(m2, reader.next());
+  ASSERT_EQ(1, stats.writer.wraparound_count.load());
+  // the wait is counted from `recover`, not from the epoch of the clock
+  const auto wait = std::chrono::nanoseconds(stats.writer.wraparound_wait_ns.load());
+  ASSERT_LT(wait, std::chrono::seconds(1));
+}
+
+TEST(NonBlockingDemuxWriterTest, RecoverAfterCrashInCompleteWraparound) {
+  array<uint8_t, L> buffer{};
+  atomic<uint64_t> msg_counter_sync{0};
+  atomic<uint64_t> wraparound_sync{0};
+  DemuxControl control{};
+  DemuxStats stats{};
+  const ReaderId id{1};
+  DemuxReader<L, M> reader(id, span{buffer}, &msg_counter_sync, &wraparound_sync);
+
+  array<uint8_t, M> m1{1};
+  {
+    DemuxWriter<L, M, false> writer(id.mask(), span{buffer}, &msg_counter_sync, &wraparound_sync, &stats, &control);
+    while (writer.write(m1) == WriteResult::Success) {
+    }
+    vector<TestMessage> received{};
+    drain(&reader, &received);
+    // `complete_wraparound` crashes after it filled the slot of the next lap, before it switched to it
+    const uint64_t seq = control.lap_seq.load();
+    control.lap_start_counts.at((seq + 1) % 2).store(writer.message_count());
+    control.wrapped_byte_counts.at((seq + 1) % 2).store(stats.writer.byte_count.load());
+  }
+  ASSERT_EQ(0, control.lap().wrapped_byte_count);
+
+  DemuxWriter<L, M, false> writer =
+      DemuxWriter<L, M, false>::recover(span{buffer}, &msg_counter_sync, &wraparound_sync, &control, &stats);
+  ASSERT_EQ(L, writer.free_bytes());  // the wraparound is still pending, the reader has caught up
+  array<uint8_t, M> m2{2};
+  ASSERT_EQ(WriteResult::Success, writer.write(m2));
+  assert_eq(m2, reader.next());
+  // the bytes of the first lap are counted once
+  ASSERT_EQ(reader.byte_count(), stats.writer.byte_count.load());
+  ASSERT_EQ(reader.byte_count() - reader.position(), control.lap().wrapped_byte_count);
+}
+
+TEST(NonBlockingDemuxWriterTest, ResumeFromRejectsStaleCursor) {
+  array<uint8_t, L> buffer{};
+  atomic<uint64_t> msg_counter_sync{0};
+  atomic<uint64_t> wraparound_sync{0};
+  DemuxControl control{};
+  const ReaderId id1{1};
+  const ReaderId id2{2};
+  DemuxWriter<L, M, false> writer(id1.mask(), span{buffer}, &msg_counter_sync, &wraparound_sync, nullptr, &control);
+  DemuxReader<L, M> reader1(id1, span{buffer}, &msg_counter_sync, &wraparound_sync);
+  DemuxReader<L, M> reader2(id2, span{buffer}, &msg_counter_sync, &wraparound_sync);
+  struct Cursor {
+    uint64_t message_count;
+    size_t position;
+    uint64_t byte_count;
+  };
+  const auto cursor = [&reader1] { return Cursor{reader1.message_count(), reader1.position(), reader1.byte_count()}; };
+  const auto resume = [&reader2, &control](const Cursor& x) {
+    return reader2.resume_from(x.message_count, x.position, x.byte_count, control);
+  };
+
+  array<uint8_t, 8> m{};
+  const auto fill_up = [&] {
+    while (writer.write(m) == WriteResult::Success) {
+      m[0] += 1;
+    }
+  };
+  fill_up();
+  std::ignore = reader1.next();
+  const Cursor first_lap = cursor();
+  vector<TestMessage> received{};
+  drain(&reader1, &received);
+  const Cursor after_marker = cursor();  // the writer waits at the marker
+
+  // reader 2 joins, the writer waits for it at the marker
+  writer.add_reader(id2);
+  ASSERT_TRUE(resume(after_marker));
+  ASSERT_EQ(WriteResult::Success, writer.write(m));
+  assert_eq(m, reader2.next());
+  assert_eq(m, reader1.next());
+
+  // the writer is in the second lap, the messages after the first lap cursor are overwritten
+  ASSERT_FALSE(resume(first_lap));
+  ASSERT_EQ(1, reader2.message_count() - after_marker.message_count);  // not changed
+
+  m[0] += 1;
+  ASSERT_EQ(WriteResult::Success, writer.write(m));
+  ASSERT_TRUE(resume(cursor()));
+  assert_eq(m, reader2.next());
+}
+
+TEST(NonBlockingDemuxWriterTest, RecoverInconsistentState) {
+  array<uint8_t, L> buffer{};
+  atomic<uint64_t> msg_counter_sync{0};
+  atomic<uint64_t> wraparound_sync{0};
+  DemuxControl control{};
+  const auto recover = [&] {
+    std::ignore = DemuxWriter<L, M, false>::recover(span{buffer}, &msg_counter_sync, &wraparound_sync, &control);
+  };
+
+  // the control block is ahead of the message count
+  msg_counter_sync.store(1);
+  control.publish_lap(DemuxLap{2, 0});
+  ASSERT_THROW(recover(), std::domain_error);
+
+  // a message length greater than `M`, the buffer was written with a different layout
+  control.publish_lap(DemuxLap{});
+  buffer[0] = M + 1;
+  ASSERT_THROW(recover(), std::domain_error);
+}
+
 auto main(int argc, char** argv) -> int {
   namespace logging = boost::log;
   logging::core::get()->set_filter(logging::trivial::severity >= logging::trivial::warning);
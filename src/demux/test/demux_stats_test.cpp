@@ -0,0 +1,452 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+// NOLINTBEGIN(readability-function-cognitive-complexity, misc-include-cleaner)
+
+#define UNIT_TEST
+#undef NDEBUG  // for assert to work in release build
+
+#include "../core/demux_stats.h"
+#include <gtest/gtest.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <array>
+#include <atomic>
+#include <boost/log/core.hpp>         // NOLINT(misc-include-cleaner)
+#include <boost/log/expressions.hpp>  // NOLINT(misc-include-cleaner)
+#include <cstddef>
+#include <chrono>
+#include <cstdint>
+#include <new>
+#include <optional>
+#include <span>
+#include <thread>
+#include <tuple>
+#include "../core/demultiplexer.h"
+#include "../core/demux_control.h"
+#include "../core/reader_id.h"
+#include "../core/reader_liveness.h"
+
+using lshl::demux::core::DemuxControl;
+using lshl::demux::core::DemuxReader;
+using lshl::demux::core::DemuxStats;
+using lshl::demux::core::DemuxWriter;
+using lshl::demux::core::ReaderId;
+using lshl::demux::core::ReaderLag;
+using lshl::demux::core::ReaderLiveness;
+using lshl::demux::core::ReaderStats;
+using lshl::demux::core::WriterStats;
+using lshl::demux::core::WriteResult;
+using std::array;
+using std::atomic;
+using std::size_t;
+using std::span;
+using std::uint64_t;
+using std::uint8_t;
+
+static_assert(sizeof(WriterStats) == std::hardware_destructive_interference_size);
+static_assert(sizeof(ReaderStats) == std::hardware_destructive_interference_size);
+static_assert(alignof(DemuxStats) == std::hardware_destructive_interference_size);
+
+namespace {
+
+constexpr size_t L = 64;
+constexpr uint16_t M = 8;
+constexpr uint64_t MESSAGE_BYTES = sizeof(uint16_t) + M;
+
+auto relaxed(const atomic<uint64_t>& x) -> uint64_t {
+  return x.load(std::memory_order_relaxed);
+}
+
+// PID of a process that has exited
+auto dead_pid() -> uint64_t {
+  const pid_t pid = ::fork();
+  if (pid == 0) {
+    ::_exit(0);
+  }
+  ::waitpid(pid, nullptr, 0);
+  return static_cast<uint64_t>(pid);
+}
+
+constexpr std::chrono::milliseconds READER_TIMEOUT{1};
+
+auto wait_for_reader_timeout() -> void {
+  std::this_thread::sleep_for(2 * READER_TIMEOUT);
+}
+
+}  // namespace
+
+TEST(DemuxStatsTest, WriterAndReaderCountersWithoutWraparound) {
+  array<uint8_t, L> buffer{};
+  atomic<uint64_t> message_count_sync{0};
+  atomic<uint64_t> wraparound_sync{0};
+  DemuxStats stats{};
+
+  const ReaderId id1{1};
+  const ReaderId id2{2};
+  DemuxWriter<L, M, false> writer(
+      ReaderId::all_readers_mask(2), span{buffer}, &message_count_sync, &wraparound_sync, &stats
+  );
+  DemuxReader<L, M> reader1(id1, span{buffer}, &message_count_sync, &wraparound_sync, &stats.reader(id1));
+
+  ASSERT_EQ(3, relaxed(stats.writer.all_readers_mask));
+
+  array<uint8_t, M> message{};
+  for (size_t i = 0; i < 3; ++i) {
+    ASSERT_EQ(WriteResult::Success, writer.write(message));
+  }
+  ASSERT_EQ(3, relaxed(stats.writer.message_count));
+  ASSERT_EQ(3 * MESSAGE_BYTES, relaxed(stats.writer.byte_count));
+  ASSERT_EQ(0, relaxed(stats.writer.repeat_count));
+
+  ASSERT_EQ(M, reader1.next().size());
+  ASSERT_EQ(1, relaxed(stats.reader(id1).message_count));
+  ASSERT_EQ(MESSAGE_BYTES, relaxed(stats.reader(id1).byte_count));
+  ASSERT_EQ(MESSAGE_BYTES, relaxed(stats.reader(id1).position));
+
+  ASSERT_EQ(2, stats.lag_messages(id1));
+  ASSERT_EQ(2 * MESSAGE_BYTES, stats.lag_bytes(id1));
+  // reader 2 has not read anything
+  ASSERT_EQ(3, stats.lag_messages(id2));
+  ASSERT_EQ(3 * MESSAGE_BYTES, stats.lag_bytes(id2));
+
+  writer.remove_reader(id2);
+  ASSERT_EQ(1, relaxed(stats.writer.all_readers_mask));
+}
+
+TEST(DemuxStatsTest, WraparoundAndRepeatCounters) {
+  array<uint8_t, L> buffer{};
+  atomic<uint64_t> message_count_sync{0};
+  atomic<uint64_t> wraparound_sync{0};
+  DemuxStats stats{};
+
+  const ReaderId id{1};
+  DemuxWriter<L, M, false> writer(
+      ReaderId::all_readers_mask(1), span{buffer}, &message_count_sync, &wraparound_sync, &stats
+  );
+  DemuxReader<L, M> reader(id, span{buffer}, &message_count_sync, &wraparound_sync, &stats.reader(id));
+
+  // L / (2 + M) messages fit into the buffer
+  constexpr uint64_t N = L / MESSAGE_BYTES;
+  array<uint8_t, M> message{};
+  for (uint64_t i = 0; i < N; ++i) {
+    ASSERT_EQ(WriteResult::Success, writer.write(message));
+  }
+
+  // initiates the wraparound, then waits for the reader
+  ASSERT_EQ(WriteResult::Repeat, writer.write(message));
+  ASSERT_EQ(WriteResult::Repeat, writer.write(message));
+  ASSERT_EQ(2, relaxed(stats.writer.repeat_count));
+  ASSERT_EQ(1, relaxed(stats.writer.wraparound_count));
+  ASSERT_EQ(N + 1, relaxed(stats.writer.message_count));  // including the wraparound marker
+  ASSERT_EQ(1, stats.lag_messages(id) - N);
+
+  for (uint64_t i = 0; i < N; ++i) {
+    ASSERT_EQ(M, reader.next().size());
+  }
+  ASSERT_TRUE(reader.next().empty());  // wraparound marker
+  ASSERT_EQ(1, relaxed(stats.reader(id).wraparound_count));
+  ASSERT_EQ(0, relaxed(stats.reader(id).position));
+  ASSERT_EQ(0, stats.lag_messages(id));
+  ASSERT_EQ(0, stats.lag_bytes(id));
+
+  ASSERT_EQ(WriteResult::Success, writer.write(message));
+  ASSERT_EQ((N + 1) * MESSAGE_BYTES, relaxed(stats.writer.byte_count));
+
+  ASSERT_EQ(M, reader.next().size());
+  ASSERT_EQ(N + 2, relaxed(stats.reader(id).message_count));
+  ASSERT_EQ((N + 1) * MESSAGE_BYTES, relaxed(stats.reader(id).byte_count));
+  ASSERT_EQ(MESSAGE_BYTES, relaxed(stats.reader(id).position));
+  ASSERT_EQ(0, stats.lag_bytes(id));
+}
+
+TEST(DemuxStatsTest, SlowestReaderLag) {
+  array<uint8_t, L> buffer{};
+  atomic<uint64_t> message_count_sync{0};
+  atomic<uint64_t> wraparound_sync{0};
+  DemuxStats stats{};
+
+  const ReaderId id1{1};
+  const ReaderId id2{2};
+  DemuxWriter<L, M, false> writer(
+      ReaderId::all_readers_mask(2), span{buffer}, &message_count_sync, &wraparound_sync, &stats
+  );
+  DemuxReader<L, M> reader1(id1, span{buffer}, &message_count_sync, &wraparound_sync, &stats.reader(id1));
+  DemuxReader<L, M> reader2(id2, span{buffer}, &message_count_sync, &wraparound_sync, &stats.reader(id2));
+
+  ASSERT_FALSE(stats.slowest_reader(0).has_value());
+
+  array<uint8_t, M> message{};
+  for (size_t i = 0; i < 3; ++i) {
+    ASSERT_EQ(WriteResult::Success, writer.write(message));
+  }
+  ASSERT_EQ(M, reader1.next().size());
+  ASSERT_EQ(M, reader1.next().size());
+  ASSERT_EQ(M, reader2.next().size());
+
+  const std::optional<ReaderLag> x = writer.slowest_reader_lag();
+  ASSERT_TRUE(x.has_value());
+  ASSERT_EQ(2, x->reader_id);
+  ASSERT_EQ(2, x->messages);
+  ASSERT_EQ(2 * MESSAGE_BYTES, x->bytes);
+
+  // only the registered readers are considered
+  writer.remove_reader(id2);
+  ASSERT_EQ(1, writer.slowest_reader_lag()->reader_id);
+  ASSERT_EQ(MESSAGE_BYTES, writer.slowest_reader_lag()->bytes);
+}
+
+TEST(DemuxStatsTest, ResumeFromPublishesReaderCounters) {
+  array<uint8_t, L> buffer{};
+  atomic<uint64_t> message_count_sync{0};
+  atomic<uint64_t> wraparound_sync{0};
+  DemuxStats stats{};
+
+  const ReaderId id1{1};
+  const ReaderId id2{2};
+  DemuxControl control{};
+  DemuxWriter<L, M, false> writer(id1.mask(), span{buffer}, &message_count_sync, &wraparound_sync, &stats, &control);
+  DemuxReader<L, M> reader1(id1, span{buffer}, &message_count_sync, &wraparound_sync);
+
+  // reader 1 is in the second lap
+  array<uint8_t, M> message{};
+  while (writer.write(message) == WriteResult::Success) {
+  }
+  while (reader1.has_next()) {
+    std::ignore = reader1.next();
+  }
+  ASSERT_EQ(WriteResult::Success, writer.write(message));
+  ASSERT_EQ(WriteResult::Success, writer.write(message));
+  ASSERT_EQ(M, reader1.next().size());
+  const uint64_t byte_count = reader1.byte_count();
+  ASSERT_GT(byte_count, reader1.position());
+
+  DemuxReader<L, M> reader2(id2, span{buffer}, &message_count_sync, &wraparound_sync, &stats.reader(id2));
+  ASSERT_TRUE(reader2.resume_from(reader1.message_count(), reader1.position(), byte_count, control));
+  ASSERT_EQ(byte_count, reader2.byte_count());
+  ASSERT_EQ(reader1.message_count(), relaxed(stats.reader(id2).message_count));
+  ASSERT_EQ(byte_count, relaxed(stats.reader(id2).byte_count));
+  ASSERT_EQ(MESSAGE_BYTES, relaxed(stats.reader(id2).position));
+  ASSERT_EQ(1, stats.lag_messages(id2));
+  ASSERT_EQ(MESSAGE_BYTES, stats.lag_bytes(id2));
+
+  ASSERT_EQ(M, reader2.next().size());
+  ASSERT_EQ(relaxed(stats.writer.byte_count), relaxed(stats.reader(id2).byte_count));
+}
+
+TEST(DemuxStatsTest, ReaderPublishesPidAndHeartbeat) {
+  array<uint8_t, L> buffer{};
+  atomic<uint64_t> message_count_sync{0};
+  atomic<uint64_t> wraparound_sync{0};
+  DemuxStats stats{};
+
+  const ReaderId id{1};
+  DemuxReader<L, M> reader(id, span{buffer}, &message_count_sync, &wraparound_sync, &stats.reader(id));
+  ASSERT_EQ(static_cast<uint64_t>(::getpid()), relaxed(stats.reader(id).pid));
+  ASSERT_EQ(0, relaxed(stats.reader(id).heartbeat));
+
+  ASSERT_TRUE(reader.next().empty());
+  ASSERT_TRUE(reader.next().empty());
+  ASSERT_EQ(2, relaxed(stats.reader(id).heartbeat));
+}
+
+TEST(DemuxStatsTest, EvictDeadReader) {
+  array<uint8_t, L> buffer{};
+  atomic<uint64_t> message_count_sync{0};
+  atomic<uint64_t> wraparound_sync{0};
+  DemuxStats stats{};
+
+  const ReaderId id1{1};
+  const ReaderId id2{2};
+  DemuxWriter<L, M, false> writer(
+      ReaderId::all_readers_mask(2), span{buffer}, &message_count_sync, &wraparound_sync, &stats
+  );
+  DemuxReader<L, M> reader1(id1, span{buffer}, &message_count_sync, &wraparound_sync, &stats.reader(id1));
+  DemuxReader<L, M> reader2(id2, span{buffer}, &message_count_sync, &wraparound_sync, &stats.reader(id2));
+  stats.reader(id2).pid.store(dead_pid());
+  writer.set_reader_timeout(READER_TIMEOUT);
+
+  constexpr uint64_t N = L / MESSAGE_BYTES;
+  array<uint8_t, M> message{};
+  for (uint64_t i = 0; i < N; ++i) {
+    ASSERT_EQ(WriteResult::Success, writer.write(message));
+  }
+  ASSERT_EQ(WriteResult::Repeat, writer.write(message));  // initiates the wraparound
+  for (uint64_t i = 0; i < N; ++i) {
+    ASSERT_EQ(M, reader1.next().size());
+  }
+  ASSERT_TRUE(reader1.next().empty());  // wraparound marker
+
+  // reader 2 holds up the wraparound, it is evicted after the timeout
+  ASSERT_EQ(WriteResult::Repeat, writer.write(message));
+  ASSERT_EQ(id2.mask(), writer.lagging_readers_mask());
+  wait_for_reader_timeout();
+  ASSERT_EQ(id2.mask(), writer.evict_dead_readers());
+  ASSERT_EQ(id1.mask(), writer.all_readers_mask());
+  ASSERT_EQ(id1.mask(), relaxed(stats.writer.all_readers_mask));
+  ASSERT_EQ(1, relaxed(stats.writer.evicted_count));
+
+  // an evicted reader that was not dead sets its wraparound bit, the writer ignores it
+  for (uint64_t i = 0; i < N; ++i) {
+    ASSERT_EQ(M, reader2.next().size());
+  }
+  ASSERT_TRUE(reader2.next().empty());
+  ASSERT_EQ(id1.mask() | id2.mask(), wraparound_sync.load());
+  ASSERT_EQ(WriteResult::Success, writer.write(message));
+}
+
+TEST(DemuxStatsTest, EvictDeadReaderOnWrite) {
+  array<uint8_t, L> buffer{};
+  atomic<uint64_t> message_count_sync{0};
+  atomic<uint64_t> wraparound_sync{0};
+  DemuxStats stats{};
+
+  const ReaderId id1{1};
+  const ReaderId id2{2};
+  DemuxWriter<L, M, false> writer(
+      ReaderId::all_readers_mask(2), span{buffer}, &message_count_sync, &wraparound_sync, &stats
+  );
+  DemuxReader<L, M> reader1(id1, span{buffer}, &message_count_sync, &wraparound_sync, &stats.reader(id1));
+  stats.reader(id2).pid.store(dead_pid());
+  writer.set_reader_timeout(READER_TIMEOUT);
+
+  constexpr uint64_t N = L / MESSAGE_BYTES;
+  array<uint8_t, M> message{};
+  for (uint64_t i = 0; i < N; ++i) {
+    ASSERT_EQ(WriteResult::Success, writer.write(message));
+  }
+  ASSERT_EQ(WriteResult::Repeat, writer.write(message));
+  for (uint64_t i = 0; i <= N; ++i) {
+    std::ignore = reader1.next();
+  }
+
+  ASSERT_EQ(WriteResult::Repeat, writer.write(message));
+  wait_for_reader_timeout();
+  ASSERT_EQ(WriteResult::Success, writer.write(message));
+  ASSERT_EQ(id1.mask(), writer.all_readers_mask());
+  ASSERT_EQ(1, relaxed(stats.writer.evicted_count));
+}
+
+TEST(DemuxStatsTest, LiveReaderIsNotEvicted) {
+  array<uint8_t, L> buffer{};
+  atomic<uint64_t> message_count_sync{0};
+  atomic<uint64_t> wraparound_sync{0};
+  DemuxStats stats{};
+
+  const ReaderId id1{1};
+  const ReaderId id2{2};
+  DemuxWriter<L, M, false> writer(
+      ReaderId::all_readers_mask(2), span{buffer}, &message_count_sync, &wraparound_sync, &stats
+  );
+  DemuxReader<L, M> reader1(id1, span{buffer}, &message_count_sync, &wraparound_sync, &stats.reader(id1));
+  // reader 2 publishes the PID of this process and makes no progress
+  const DemuxReader<L, M> reader2(id2, span{buffer}, &message_count_sync, &wraparound_sync, &stats.reader(id2));
+  writer.set_reader_timeout(READER_TIMEOUT);
+
+  constexpr uint64_t N = L / MESSAGE_BYTES;
+  array<uint8_t, M> message{};
+  for (uint64_t i = 0; i < N; ++i) {
+    ASSERT_EQ(WriteResult::Success, writer.write(message));
+  }
+  ASSERT_EQ(WriteResult::Repeat, writer.write(message));
+  for (uint64_t i = 0; i <= N; ++i) {
+    std::ignore = reader1.next();
+  }
+
+  ASSERT_EQ(WriteResult::Repeat, writer.write(message));
+  wait_for_reader_timeout();
+  ASSERT_EQ(WriteResult::Repeat, writer.write(message));
+  ASSERT_EQ(0, writer.evict_dead_readers());
+  ASSERT_EQ(ReaderId::all_readers_mask(2), writer.all_readers_mask());
+  ASSERT_EQ(0, relaxed(stats.writer.evicted_count));
+}
+
+TEST(DemuxStatsTest, BlockingWriterEvictsDeadReader) {
+  array<uint8_t, L> buffer{};
+  atomic<uint64_t> message_count_sync{0};
+  atomic<uint64_t> wraparound_sync{0};
+  DemuxStats stats{};
+
+  const ReaderId id{1};
+  DemuxWriter<L, M, true> writer(id.mask(), span{buffer}, &message_count_sync, &wraparound_sync, &stats);
+  stats.reader(id).pid.store(dead_pid());  // the reader crashed before reading anything
+  writer.set_reader_timeout(READER_TIMEOUT);
+
+  constexpr uint64_t N = L / MESSAGE_BYTES;
+  array<uint8_t, M> message{};
+  for (uint64_t i = 0; i <= N; ++i) {  // the last write waits for the timeout
+    ASSERT_EQ(WriteResult::Success, writer.write(message));
+  }
+  ASSERT_EQ(0, writer.all_readers_mask());
+  ASSERT_EQ(1, relaxed(stats.writer.evicted_count));
+}
+
+TEST(DemuxStatsTest, BlockingWriterEvictsDeadReaderAfterRecover) {
+  array<uint8_t, L> buffer{};
+  atomic<uint64_t> message_count_sync{0};
+  atomic<uint64_t> wraparound_sync{0};
+  DemuxControl control{};
+  DemuxStats stats{};
+
+  const ReaderId id{1};
+  array<uint8_t, M> message{};
+  {
+    // the writer crashes with a wraparound pending
+    DemuxWriter<L, M, false> writer(
+        id.mask(), span{buffer}, &message_count_sync, &wraparound_sync, &stats, &control
+    );
+    while (writer.write(message) == WriteResult::Success) {
+    }
+    ASSERT_TRUE(writer.wraparound_pending());
+  }
+  stats.reader(id).pid.store(dead_pid());
+
+  // `recover` does not wait for the dead reader, the first write evicts it
+  DemuxWriter<L, M, true> writer =
+      DemuxWriter<L, M, true>::recover(span{buffer}, &message_count_sync, &wraparound_sync, &control, &stats);
+  writer.set_reader_timeout(READER_TIMEOUT);
+  ASSERT_EQ(WriteResult::Success, writer.write(message));
+  ASSERT_FALSE(writer.wraparound_pending());
+  ASSERT_EQ(0, writer.all_readers_mask());
+  ASSERT_EQ(1, relaxed(stats.writer.evicted_count));
+}
+
+TEST(DemuxStatsTest, ReaderLivenessWithoutPid) {
+  DemuxStats stats{};
+  const ReaderId id{1};
+  ReaderLiveness liveness{10};
+
+  ASSERT_EQ(0, liveness.dead_readers(stats, id.mask(), 100));  // starts tracking
+  ASSERT_EQ(0, liveness.dead_readers(stats, id.mask(), 105));
+  ASSERT_EQ(5, liveness.idle_ns(id, 105));
+  stats.reader(id).heartbeat.store(1);
+  ASSERT_EQ(0, liveness.dead_readers(stats, id.mask(), 120));  // progress, the timeout starts again
+  ASSERT_EQ(0, liveness.dead_readers(stats, id.mask(), 129));
+  ASSERT_EQ(id.mask(), liveness.dead_readers(stats, id.mask(), 130));  // no PID, the timeout decides
+
+  liveness.set_timeout_ns(0);
+  ASSERT_EQ(0, liveness.dead_readers(stats, id.mask(), 1000));
+}
+
+TEST(DemuxStatsTest, NoStats) {
+  array<uint8_t, L> buffer{};
+  atomic<uint64_t> message_count_sync{0};
+  atomic<uint64_t> wraparound_sync{0};
+
+  DemuxWriter<L, M, true> writer(ReaderId::all_readers_mask(1), span{buffer}, &message_count_sync, &wraparound_sync);
+  DemuxReader<L, M> reader(ReaderId{1}, span{buffer}, &message_count_sync, &wraparound_sync);
+
+  array<uint8_t, M> message{};
+  ASSERT_EQ(WriteResult::Success, writer.write(message));
+  ASSERT_EQ(M, reader.next().size());
+}
+
+auto main(int argc, char** argv) -> int {
+  namespace logging = boost::log;
+  logging::core::get()->set_filter(logging::trivial::severity >= logging::trivial::warning);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+// NOLINTEND(readability-function-cognitive-complexity, misc-include-cleaner)
@@ -0,0 +1,143 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+// NOLINTBEGIN(readability-function-cognitive-complexity, misc-include-cleaner)
+
+#include "../util/doorbell.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace lshl::demux::util {
+
+using std::uint32_t;
+using std::uint64_t;
+
+namespace {
+
+// collects the visited channels, `not_drained` are reported as not drained once
+class Visitor {
+ public:
+  explicit Visitor(std::vector<uint32_t> not_drained = {}) : not_drained_(std::move(not_drained)) {}
+
+  auto operator()(const uint32_t channel) -> bool {
+    this->visited_.push_back(channel);
+    const auto it = std::find(this->not_drained_.begin(), this->not_drained_.end(), channel);
+    if (it == this->not_drained_.end()) {
+      return false;
+    }
+    this->not_drained_.erase(it);
+    return true;
+  }
+
+  [[nodiscard]] auto take() -> std::vector<uint32_t> { return std::exchange(this->visited_, {}); }
+
+ private:
+  std::vector<uint32_t> not_drained_;
+  std::vector<uint32_t> visited_;
+};
+
+}  // namespace
+
+TEST(DoorbellTest, Layout) {
+  static_assert(Doorbell<1>::WORD_NUM == 1);
+  static_assert(Doorbell<64>::WORD_NUM == 1);
+  static_assert(Doorbell<65>::WORD_NUM == 2);
+  static_assert(Doorbell<DOORBELL_MAX_CHANNELS>::WORD_NUM == 64);
+  static_assert(sizeof(Doorbell<64>) == 2 * std::hardware_destructive_interference_size);
+  static_assert(std::is_trivially_destructible_v<Doorbell<DOORBELL_MAX_CHANNELS>>);
+}
+
+TEST(DoorbellTest, VisitsRungChannels) {
+  const auto doorbell = std::make_unique<Doorbell<DOORBELL_MAX_CHANNELS>>();
+  DoorbellPoller<DOORBELL_MAX_CHANNELS> poller(doorbell.get());
+  Visitor visitor;
+  ASSERT_EQ(poller.poll(std::ref(visitor)), 0);
+
+  doorbell->ring(4095);
+  doorbell->ring(70);
+  doorbell->ring(3);
+  doorbell->ring(70);  // rung twice, visited once
+  doorbell->ring(0);
+  ASSERT_EQ(poller.poll(std::ref(visitor)), 4);
+  ASSERT_EQ(visitor.take(), (std::vector<uint32_t>{0, 3, 70, 4095}));
+  ASSERT_EQ(doorbell->summary.load(), 0);
+  ASSERT_EQ(poller.poll(std::ref(visitor)), 0);
+
+  doorbell->ring(70);
+  ASSERT_EQ(poller.poll(std::ref(visitor)), 1);
+  ASSERT_EQ(visitor.take(), (std::vector<uint32_t>{70}));
+}
+
+TEST(DoorbellTest, VisitsNotDrainedChannelsAgain) {
+  Doorbell<128> doorbell;
+  DoorbellPoller<128> poller(&doorbell);
+  Visitor visitor({5, 127});
+  doorbell.ring(5);
+  doorbell.ring(6);
+  doorbell.ring(127);
+  ASSERT_EQ(poller.poll(std::ref(visitor)), 3);
+  ASSERT_TRUE(poller.has_pending());
+  // without ringing again, the writers do not see it
+  ASSERT_EQ(doorbell.summary.load(), 0);
+  doorbell.ring(6);
+  ASSERT_EQ(poller.poll(std::ref(visitor)), 3);
+  ASSERT_FALSE(poller.has_pending());
+  ASSERT_EQ(visitor.take(), (std::vector<uint32_t>{5, 6, 127, 5, 6, 127}));
+  ASSERT_EQ(poller.poll(std::ref(visitor)), 0);
+}
+
+// every channel has one writer thread that counts and rings, the poller must see the last count of every channel
+TEST(DoorbellTest, NoLostRings) {
+  constexpr uint32_t N = 256;
+  constexpr uint32_t WRITER_NUM = 4;
+  constexpr uint64_t RING_NUM = 20000;
+  const auto doorbell = std::make_unique<Doorbell<N>>();
+  std::array<std::atomic<uint64_t>, N> published{};
+  std::array<uint64_t, N> seen{};
+  DoorbellPoller<N> poller(doorbell.get());
+  const auto visit = [&](const uint32_t channel) {
+    seen.at(channel) = published.at(channel).load(std::memory_order_relaxed);
+    return false;
+  };
+
+  std::atomic<uint32_t> running{WRITER_NUM};
+  std::vector<std::thread> writers;
+  for (uint32_t t = 0; t < WRITER_NUM; ++t) {
+    writers.emplace_back([&, t] {
+      for (uint64_t n = 0; n < RING_NUM; ++n) {
+        const auto channel = static_cast<uint32_t>(((n * 37) + t) % (N / WRITER_NUM) * WRITER_NUM + t);
+        published.at(channel).fetch_add(1, std::memory_order_relaxed);
+        doorbell->ring(channel);
+      }
+      running.fetch_sub(1);
+    });
+  }
+  while (running.load() != 0) {
+    (void)poller.poll(visit);
+  }
+  for (std::thread& x : writers) {
+    x.join();
+  }
+  (void)poller.poll(visit);
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < N; ++i) {
+    ASSERT_EQ(seen.at(i), published.at(i).load()) << "channel: " << i;
+    total += seen.at(i);
+  }
+  ASSERT_EQ(total, WRITER_NUM * RING_NUM);
+  ASSERT_EQ(poller.poll(visit), 0);
+}
+
+}  // namespace lshl::demux::util
+
+// NOLINTEND(readability-function-cognitive-complexity, misc-include-cleaner)
@@ -0,0 +1,84 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+// NOLINTBEGIN(readability-function-cognitive-complexity, misc-include-cleaner)
+
+#define UNIT_TEST
+#undef NDEBUG  // for assert to work in release build
+
+#include "../util/flat_table.h"
+#include <gtest/gtest.h>
+#include <rapidcheck.h>  // NOLINT(misc-include-cleaner)
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+using lshl::demux::util::FlatTable;
+using std::size_t;
+using std::uint64_t;
+
+using Table = FlatTable<uint64_t, uint64_t>;
+
+TEST(FlatTableTest, InvalidCapacity) {
+  ASSERT_THROW(Table(0), std::invalid_argument);
+}
+
+TEST(FlatTableTest, UpsertFindClear) {
+  Table table(3);
+  ASSERT_EQ(3, table.capacity());
+  ASSERT_TRUE(table.empty());
+  ASSERT_EQ(nullptr, table.find(1));
+
+  *table.upsert(10) = 100;
+  *table.upsert(20) = 200;
+  *table.upsert(10) = 101;  // overwrites
+  ASSERT_EQ(2, table.size());
+  ASSERT_EQ(101, *table.find(10));
+  ASSERT_EQ(200, *table.find(20));
+
+  // insertion order
+  ASSERT_EQ(10, table.key(0));
+  ASSERT_EQ(101, table.value(0));
+  ASSERT_EQ(20, table.key(1));
+
+  *table.upsert(30) = 300;
+  ASSERT_TRUE(table.full());
+  ASSERT_EQ(nullptr, table.upsert(40));
+  ASSERT_NE(nullptr, table.upsert(30));  // existing key, still found when full
+
+  table.clear();
+  ASSERT_TRUE(table.empty());
+  ASSERT_EQ(nullptr, table.find(10));
+  ASSERT_EQ(0, *table.upsert(20));  // value is reset on insert
+}
+
+TEST(FlatTableTest, SameAsMap) {
+  rc::check([](const std::vector<uint64_t>& keys) {
+    constexpr size_t CAPACITY = 8;
+    Table table(CAPACITY);
+    std::map<uint64_t, uint64_t> model{};
+    for (size_t i = 0; i < keys.size(); ++i) {
+      // few distinct keys, so the table fills up and the keys repeat
+      const uint64_t key = keys[i] % (2 * CAPACITY);
+      uint64_t* value = table.upsert(key);
+      if (model.size() == CAPACITY && !model.contains(key)) {
+        RC_ASSERT(value == nullptr);
+        continue;
+      }
+      RC_ASSERT(value != nullptr);
+      *value = i;
+      model[key] = i;
+    }
+    RC_ASSERT(table.size() == model.size());
+    for (size_t i = 0; i < table.size(); ++i) {
+      RC_ASSERT(model.at(table.key(i)) == table.value(i));
+    }
+    for (const auto& [key, value] : model) {
+      RC_ASSERT(table.find(key) != nullptr && *table.find(key) == value);
+    }
+  });
+}
+
+// NOLINTEND(readability-function-cognitive-complexity, misc-include-cleaner)
@@ -0,0 +1,187 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+// NOLINTBEGIN(readability-function-cognitive-complexity, misc-include-cleaner)
+
+#include <rapidcheck/gen/Container.h>
+#define UNIT_TEST
+#undef NDEBUG  // for assert to work in release build
+
+#include "../util/flatbuffers_util.h"
+#include <flatbuffers/flatbuffers.h>
+#include <gtest/gtest.h>
+#include <moldudp64-schema_generated.h>
+#include <rapidcheck.h>  // NOLINT(misc-include-cleaner)
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <boost/log/core.hpp>         // NOLINT(misc-include-cleaner)
+#include <boost/log/expressions.hpp>  // NOLINT(misc-include-cleaner)
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <span>
+#include <vector>
+#include "../core/demultiplexer.h"
+#include "../core/reader_id.h"
+#include "../example/moldudp64.h"
+
+using lshl::demux::core::DemuxReader;
+using lshl::demux::core::DemuxWriter;
+using lshl::demux::core::ReaderId;
+using lshl::demux::core::WriteResult;
+using lshl::demux::example::moldudp64_packet_capacity;
+using lshl::demux::example::MoldUdp64Session;
+using lshl::demux::example::write_moldudp64_packet;
+using lshl::demux::util::read_flatbuffer;
+using ShmSequencer::DownstreamPacket;
+using ShmSequencer::UpstreamPacket;
+using std::array;
+using std::atomic;
+using std::span;
+using std::uint16_t;
+using std::uint64_t;
+using std::uint8_t;
+using std::vector;
+
+constexpr std::chrono::seconds DEFAULT_WAIT(5);
+constexpr size_t MAX_MESSAGE_LENGTH = 64;
+constexpr auto M = static_cast<uint16_t>(moldudp64_packet_capacity(MAX_MESSAGE_LENGTH));
+constexpr size_t L = 4 * (M + 2);
+
+constexpr MoldUdp64Session SESSION{'S', 'E', 'S', 'S', 'I', 'O', 'N', '0', '0', '1'};
+
+namespace {
+
+template <class P>
+auto expect_packet(const P* packet, const uint64_t sequence_number, const vector<uint8_t>& message) -> bool {
+  EXPECT_NE(nullptr, packet);
+  if (packet == nullptr) {
+    return false;
+  }
+  EXPECT_TRUE(std::equal(SESSION.begin(), SESSION.end(), packet->header()->sesion()->begin()));
+  EXPECT_EQ(sequence_number, packet->header()->sequence_number());
+  EXPECT_EQ(message.empty() ? 0 : 1, packet->header()->message_count());
+  EXPECT_EQ(message.size(), packet->message_length());
+  EXPECT_EQ(message, vector<uint8_t>(packet->message_data()->begin(), packet->message_data()->end()));
+  return !::testing::Test::HasFailure();
+}
+
+template <class P, bool B>
+auto write_read_packets(const vector<vector<uint8_t>>& messages) -> bool {
+  array<uint8_t, L> buffer{};
+  atomic<uint64_t> msg_counter_sync{0};
+  atomic<uint64_t> wraparound_sync{0};
+  const ReaderId reader_id{1};
+
+  DemuxWriter<L, M, B> writer(reader_id.mask(), span{buffer}, &msg_counter_sync, &wraparound_sync);
+  DemuxReader<L, M> reader(reader_id, span{buffer}, &msg_counter_sync, &wraparound_sync);
+
+  std::future<bool> written = std::async(std::launch::async, [&messages, &writer] {
+    for (uint64_t i = 0; i < messages.size();) {
+      const WriteResult result = write_moldudp64_packet<P>(&writer, SESSION, i + 1, messages[i]);
+      EXPECT_NE(WriteResult::Error, result);
+      if (result == WriteResult::Success) {
+        i += 1;
+      }
+    }
+    return !::testing::Test::HasFailure();
+  });
+
+  std::future<bool> received = std::async(std::launch::async, [&messages, &reader] {
+    for (uint64_t i = 0; i < messages.size();) {
+      const span<uint8_t> m = reader.next();
+      if (!m.empty()) {
+        // every packet occupies the whole reserved capacity
+        EXPECT_EQ(moldudp64_packet_capacity(messages[i].size()), m.size());
+        if (!expect_packet(read_flatbuffer<P>(m), i + 1, messages[i])) {
+          return false;
+        }
+        i += 1;
+      }
+    }
+    return !::testing::Test::HasFailure();
+  });
+
+  EXPECT_EQ(std::future_status::ready, written.wait_for(DEFAULT_WAIT));
+  EXPECT_TRUE(written.get());
+  EXPECT_EQ(std::future_status::ready, received.wait_for(DEFAULT_WAIT));
+  EXPECT_TRUE(received.get());
+  return !::testing::Test::HasFailure();
+}
+
+auto generate_messages() -> rc::Gen<vector<vector<uint8_t>>> {
+  return rc::gen::container<vector<vector<uint8_t>>>(
+      rc::gen::resize(MAX_MESSAGE_LENGTH, rc::gen::arbitrary<vector<uint8_t>>())
+  );
+}
+
+}  // namespace
+
+TEST(FlatBuffersTest, BlockingWriterDownstreamPacket) {
+  rc::check([] { RC_ASSERT((write_read_packets<DownstreamPacket, true>(*generate_messages()))); });
+}
+
+TEST(FlatBuffersTest, NonBlockingWriterUpstreamPacket) {
+  rc::check([] { RC_ASSERT((write_read_packets<UpstreamPacket, false>(*generate_messages()))); });
+}
+
+TEST(FlatBuffersTest, MessageDoesNotFitIntoCapacity) {
+  array<uint8_t, L> buffer{};
+  atomic<uint64_t> msg_counter_sync{0};
+  atomic<uint64_t> wraparound_sync{0};
+  const ReaderId reader_id{1};
+
+  DemuxWriter<L, M, false> writer(reader_id.mask(), span{buffer}, &msg_counter_sync, &wraparound_sync);
+  DemuxReader<L, M> reader(reader_id, span{buffer}, &msg_counter_sync, &wraparound_sync);
+
+  constexpr uint16_t TOO_SMALL = 32;
+  const vector<uint8_t> message(MAX_MESSAGE_LENGTH, 1);
+  const WriteResult result =
+      lshl::demux::util::write_flatbuffer<DownstreamPacket>(&writer, TOO_SMALL, [&message](auto& fbb) {
+        const auto data = fbb.CreateVector(message.data(), message.size());
+        const ShmSequencer::Header header{};
+        return ShmSequencer::CreateDownstreamPacket(fbb, &header, 0, data);
+      });
+  ASSERT_EQ(WriteResult::Error, result);
+
+  // nothing is published
+  ASSERT_EQ(0, writer.message_count());
+  ASSERT_TRUE(reader.next().empty());
+
+  // the reserved space is reused
+  ASSERT_EQ(WriteResult::Success, write_moldudp64_packet<DownstreamPacket>(&writer, SESSION, 1, message));
+  ASSERT_TRUE(expect_packet(read_flatbuffer<DownstreamPacket>(reader.next()), 1, message));
+}
+
+TEST(FlatBuffersTest, CorruptedPacketIsRejected) {
+  const vector<uint8_t> message(MAX_MESSAGE_LENGTH, 1);
+  array<uint8_t, L> buffer{};
+  atomic<uint64_t> msg_counter_sync{0};
+  atomic<uint64_t> wraparound_sync{0};
+  const ReaderId reader_id{1};
+
+  DemuxWriter<L, M, false> writer(reader_id.mask(), span{buffer}, &msg_counter_sync, &wraparound_sync);
+  DemuxReader<L, M> reader(reader_id, span{buffer}, &msg_counter_sync, &wraparound_sync);
+
+  ASSERT_EQ(WriteResult::Success, write_moldudp64_packet<DownstreamPacket>(&writer, SESSION, 1, message));
+  const span<uint8_t> m = reader.next();
+  ASSERT_NE(nullptr, read_flatbuffer<DownstreamPacket>(m));
+
+  // the root offset points outside the buffer
+  flatbuffers::WriteScalar<flatbuffers::uoffset_t>(m.data(), static_cast<flatbuffers::uoffset_t>(m.size()));
+  ASSERT_EQ(nullptr, read_flatbuffer<DownstreamPacket>(m));
+
+  // truncated
+  ASSERT_EQ(nullptr, read_flatbuffer<DownstreamPacket>(m.first(sizeof(flatbuffers::uoffset_t))));
+}
+
+auto main(int argc, char** argv) -> int {
+  namespace logging = boost::log;
+  logging::core::get()->set_filter(logging::trivial::severity >= logging::trivial::warning);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+// NOLINTEND(readability-function-cognitive-complexity, misc-include-cleaner)
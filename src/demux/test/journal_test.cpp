@@ -0,0 +1,242 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+// NOLINTBEGIN(readability-function-cognitive-complexity, misc-include-cleaner)
+
+#define UNIT_TEST
+#undef NDEBUG  // for assert to work in release build
+
+#include "../core/journal.h"
+#include <gtest/gtest.h>
+#include <rapidcheck.h>  // NOLINT(misc-include-cleaner)
+#include <array>
+#include <atomic>
+#include <boost/log/core.hpp>         // NOLINT(misc-include-cleaner)
+#include <boost/log/expressions.hpp>  // NOLINT(misc-include-cleaner)
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <future>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+#include "../core/demultiplexer.h"
+#include "../core/journal_replay.h"
+#include "../core/reader_id.h"
+
+using lshl::demux::core::DemuxReader;
+using lshl::demux::core::DemuxWriter;
+using lshl::demux::core::JournalFrame;
+using lshl::demux::core::JournalReader;
+using lshl::demux::core::JournalWriter;
+using lshl::demux::core::ReaderId;
+using lshl::demux::core::ReplayResult;
+using lshl::demux::core::ReplaySpeed;
+using std::array;
+using std::atomic;
+using std::optional;
+using std::span;
+using std::uint64_t;
+using std::uint8_t;
+using std::vector;
+
+constexpr std::chrono::seconds DEFAULT_WAIT(5);
+constexpr size_t L = 256;
+constexpr uint16_t M = 64;
+
+namespace {
+
+// removes the temporary journal directory at the end of a test
+struct TempDirectory {
+  explicit TempDirectory(const std::string& name)
+      : path_(std::filesystem::temp_directory_path() / ("lshl_demux_" + name)) {
+    std::filesystem::remove_all(this->path_);
+  }
+  ~TempDirectory() { std::filesystem::remove_all(this->path_); }
+  TempDirectory(const TempDirectory&) = delete;
+  auto operator=(const TempDirectory&) -> TempDirectory& = delete;
+  TempDirectory(TempDirectory&&) = delete;
+  auto operator=(TempDirectory&&) -> TempDirectory& = delete;
+
+  [[nodiscard]] auto path() const -> const std::filesystem::path& { return this->path_; }
+
+ private:
+  std::filesystem::path path_;
+};
+
+// message `i` is `i % M + 1` bytes long and filled with `i`
+auto create_message(const uint64_t i) -> vector<uint8_t> {
+  return vector<uint8_t>(i % M + 1, static_cast<uint8_t>(i));
+}
+
+// timestamp of the message `i`
+constexpr uint64_t TIMESTAMP_STEP = 10;
+constexpr uint64_t TIMESTAMP_BASE = 1000;
+
+auto record(const std::filesystem::path& dir, const uint64_t message_num, const size_t segment_size) -> size_t {
+  constexpr uint64_t INDEX_INTERVAL = 8;
+  JournalWriter journal(dir, "test", segment_size, INDEX_INTERVAL);
+  for (uint64_t i = 1; i <= message_num; ++i) {
+    const vector<uint8_t> m = create_message(i);
+    EXPECT_EQ(i, journal.append(TIMESTAMP_BASE + (i * TIMESTAMP_STEP), m));
+  }
+  journal.flush();
+  return journal.segment_count();
+}
+
+auto expect_frame(const optional<JournalFrame>& frame, const uint64_t i) -> bool {
+  EXPECT_TRUE(frame.has_value());
+  if (!frame.has_value()) {
+    return false;
+  }
+  EXPECT_EQ(i, frame->sequence);
+  EXPECT_EQ(TIMESTAMP_BASE + (i * TIMESTAMP_STEP), frame->timestamp);
+  const vector<uint8_t> expected = create_message(i);
+  EXPECT_EQ(expected, vector<uint8_t>(frame->message.begin(), frame->message.end()));
+  return !::testing::Test::HasFailure();
+}
+
+}  // namespace
+
+TEST(JournalTest, FrameSize) {
+  ASSERT_EQ(24, sizeof(lshl::demux::core::JournalFrameHeader));
+  ASSERT_EQ(24, lshl::demux::core::journal_frame_size(0));
+  ASSERT_EQ(32, lshl::demux::core::journal_frame_size(1));
+  ASSERT_EQ(32, lshl::demux::core::journal_frame_size(8));
+  ASSERT_EQ(40, lshl::demux::core::journal_frame_size(9));
+}
+
+TEST(JournalTest, WriteReadMultipleSegments) {
+  constexpr uint64_t MESSAGE_NUM = 1000;
+  constexpr size_t SEGMENT_SIZE = 4096;
+  const TempDirectory dir("journal_write_read");
+
+  const size_t segment_num = record(dir.path(), MESSAGE_NUM, SEGMENT_SIZE);
+  ASSERT_GT(segment_num, 1);
+
+  JournalReader journal(dir.path(), "test");
+  ASSERT_EQ(segment_num, journal.segment_count());
+
+  for (uint64_t i = 1; i <= MESSAGE_NUM; ++i) {
+    ASSERT_TRUE(expect_frame(journal.next(), i));
+  }
+  ASSERT_FALSE(journal.next().has_value());
+}
+
+TEST(JournalTest, WriterDoesNotOverwriteExistingJournal) {
+  const TempDirectory dir("journal_exists");
+  record(dir.path(), 1, lshl::demux::core::DEFAULT_JOURNAL_SEGMENT_SIZE);
+  ASSERT_THROW(JournalWriter(dir.path(), "test"), std::invalid_argument);
+}
+
+TEST(JournalTest, EmptyMessageIsRejected) {
+  const TempDirectory dir("journal_empty_message");
+  JournalWriter journal(dir.path(), "test");
+  ASSERT_THROW(journal.append(0, {}), std::invalid_argument);
+  ASSERT_EQ(0, journal.sequence());
+}
+
+TEST(JournalTest, SeekSequence) {
+  constexpr uint64_t MESSAGE_NUM = 500;
+  constexpr size_t SEGMENT_SIZE = 2048;
+  const TempDirectory dir("journal_seek_sequence");
+  record(dir.path(), MESSAGE_NUM, SEGMENT_SIZE);
+
+  JournalReader journal(dir.path(), "test");
+  rc::check([&journal](const uint16_t x) {
+    const uint64_t sequence = (x % MESSAGE_NUM) + 1;
+    RC_ASSERT(journal.seek_sequence(sequence));
+    RC_ASSERT(expect_frame(journal.next(), sequence));
+  });
+
+  ASSERT_TRUE(journal.seek_sequence(0));
+  ASSERT_TRUE(expect_frame(journal.next(), 1));
+  ASSERT_FALSE(journal.seek_sequence(MESSAGE_NUM + 1));
+}
+
+TEST(JournalTest, SeekTimestamp) {
+  constexpr uint64_t MESSAGE_NUM = 500;
+  constexpr size_t SEGMENT_SIZE = 2048;
+  const TempDirectory dir("journal_seek_timestamp");
+  record(dir.path(), MESSAGE_NUM, SEGMENT_SIZE);
+
+  JournalReader journal(dir.path(), "test");
+
+  // exact timestamp
+  ASSERT_TRUE(journal.seek_timestamp(TIMESTAMP_BASE + (123 * TIMESTAMP_STEP)));
+  ASSERT_TRUE(expect_frame(journal.next(), 123));
+
+  // between two timestamps, the next message is returned
+  ASSERT_TRUE(journal.seek_timestamp(TIMESTAMP_BASE + (321 * TIMESTAMP_STEP) - 1));
+  ASSERT_TRUE(expect_frame(journal.next(), 321));
+
+  ASSERT_FALSE(journal.seek_timestamp(TIMESTAMP_BASE + ((MESSAGE_NUM + 1) * TIMESTAMP_STEP)));
+}
+
+namespace {
+template <bool B>
+auto replay_into_reader(const ReplaySpeed speed) -> void {
+  constexpr uint64_t MESSAGE_NUM = 300;
+  constexpr size_t SEGMENT_SIZE = 2048;
+  const TempDirectory dir("journal_replay");
+  record(dir.path(), MESSAGE_NUM, SEGMENT_SIZE);
+
+  JournalReader journal(dir.path(), "test");
+  constexpr uint64_t FIRST = 17;
+  ASSERT_TRUE(journal.seek_sequence(FIRST));
+
+  array<uint8_t, L> buffer{};
+  atomic<uint64_t> msg_counter_sync{0};
+  atomic<uint64_t> wraparound_sync{0};
+  const ReaderId reader_id{1};
+
+  DemuxWriter<L, M, B> writer(reader_id.mask(), span{buffer}, &msg_counter_sync, &wraparound_sync);
+  DemuxReader<L, M> reader(reader_id, span{buffer}, &msg_counter_sync, &wraparound_sync);
+
+  std::future<ReplayResult> replayed = std::async(std::launch::async, [&journal, &writer, speed] {
+    return lshl::demux::core::replay(&journal, &writer, speed);
+  });
+
+  std::future<bool> received = std::async(std::launch::async, [&reader] {
+    for (uint64_t i = FIRST; i <= MESSAGE_NUM;) {
+      const span<uint8_t> m = reader.next();
+      if (!m.empty()) {
+        EXPECT_EQ(create_message(i), vector<uint8_t>(m.begin(), m.end())) << "sequence: " << i;
+        i += 1;
+      }
+    }
+    return !::testing::Test::HasFailure();
+  });
+
+  ASSERT_EQ(std::future_status::ready, replayed.wait_for(DEFAULT_WAIT));
+  const ReplayResult result = replayed.get();
+  ASSERT_EQ(MESSAGE_NUM - FIRST + 1, result.message_count);
+  ASSERT_EQ(0, result.dropped_count);
+
+  ASSERT_EQ(std::future_status::ready, received.wait_for(DEFAULT_WAIT));
+  ASSERT_TRUE(received.get());
+}
+}  // namespace
+
+TEST(JournalReplayTest, BlockingMaxSpeed) {
+  replay_into_reader<true>(ReplaySpeed::Max);
+}
+
+TEST(JournalReplayTest, NonBlockingMaxSpeed) {
+  replay_into_reader<false>(ReplaySpeed::Max);
+}
+
+TEST(JournalReplayTest, NonBlockingRecordedSpeed) {
+  replay_into_reader<false>(ReplaySpeed::Recorded);
+}
+
+auto main(int argc, char** argv) -> int {
+  namespace logging = boost::log;
+  logging::core::get()->set_filter(logging::trivial::severity >= logging::trivial::warning);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+// NOLINTEND(readability-function-cognitive-complexity, misc-include-cleaner)
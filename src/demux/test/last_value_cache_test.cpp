@@ -0,0 +1,210 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+// NOLINTBEGIN(readability-function-cognitive-complexity, misc-include-cleaner)
+
+#define UNIT_TEST
+#undef NDEBUG  // for assert to work in release build
+
+#include "../example/last_value_cache.h"
+#include <gtest/gtest.h>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <span>
+#include <thread>
+#include <type_traits>
+#include "../core/demultiplexer.h"
+#include "../core/demux_control.h"
+#include "../core/message_buffer.h"
+#include "../core/reader_id.h"
+#include "../example/market_data.h"
+
+using lshl::demux::core::DemuxControl;
+using lshl::demux::core::DemuxReader;
+using lshl::demux::core::DemuxWriter;
+using lshl::demux::core::MessageBuffer;
+using lshl::demux::core::ReaderId;
+using lshl::demux::core::WriteResult;
+using lshl::demux::example::InstrumentSnapshot;
+using lshl::demux::example::LastValueCache;
+using lshl::demux::example::MarketDataUpdate;
+using lshl::demux::example::RingCursor;
+using lshl::demux::example::Side;
+using std::array;
+using std::atomic;
+using std::optional;
+using std::size_t;
+using std::span;
+using std::uint16_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::uint8_t;
+
+namespace {
+
+constexpr size_t LEVELS = 4;
+using Cache = LastValueCache<8, LEVELS>;
+using Snapshot = InstrumentSnapshot<LEVELS>;
+
+static_assert(std::is_trivially_destructible_v<Cache>, "lives in shared memory");
+
+auto update(const uint32_t instrument_id, const Side side, const uint8_t level, const uint64_t price)
+    -> std::unique_ptr<MarketDataUpdate> {
+  auto md = std::make_unique<MarketDataUpdate>();
+  md->timestamp = price;
+  md->instrument_id = instrument_id;
+  md->side = side;
+  md->level = level;
+  md->price = price;
+  md->size = static_cast<uint32_t>(price);
+  return md;
+}
+
+auto index(const Side side, const uint8_t level) -> size_t {
+  return (static_cast<size_t>(side) * LEVELS) + level;
+}
+
+}  // namespace
+
+TEST(LastValueCacheTest, ApplyAndRead) {
+  const auto cache = std::make_unique<Cache>();
+  Snapshot x{};
+  ASSERT_FALSE(cache->read(7, &x));
+
+  ASSERT_TRUE(cache->apply(*update(7, Side::Bid, 0, 100), 1));
+  ASSERT_TRUE(cache->apply(*update(7, Side::Ask, 3, 200), 2));
+  ASSERT_TRUE(cache->apply(*update(7, Side::Bid, 0, 101), 3));
+  ASSERT_TRUE(cache->apply(*update(0, Side::Bid, 1, 300), 4));
+
+  ASSERT_TRUE(cache->read(7, &x));
+  ASSERT_EQ(7, x.instrument_id);
+  ASSERT_EQ(3, x.message_count);
+  ASSERT_EQ(101, x.levels[index(Side::Bid, 0)].price);
+  ASSERT_EQ(101, x.levels[index(Side::Bid, 0)].size);
+  ASSERT_EQ(200, x.levels[index(Side::Ask, 3)].price);
+  ASSERT_EQ(0, x.levels[index(Side::Bid, 1)].price);
+
+  ASSERT_TRUE(cache->read(0, &x));
+  ASSERT_EQ(0, x.instrument_id);
+  ASSERT_EQ(300, x.levels[index(Side::Bid, 1)].price);
+}
+
+TEST(LastValueCacheTest, SkipsLevelsOutOfRangeAndInstrumentsWhenFull) {
+  const auto cache = std::make_unique<Cache>();
+  ASSERT_FALSE(cache->apply(*update(1, Side::Bid, LEVELS, 1), 1));
+  for (uint32_t i = 0; i < 8; ++i) {
+    ASSERT_TRUE(cache->apply(*update(i * 1000, Side::Bid, 0, 1), i));
+  }
+  ASSERT_FALSE(cache->apply(*update(1, Side::Bid, 0, 1), 9));
+  ASSERT_TRUE(cache->apply(*update(7000, Side::Ask, 1, 2), 10));  // existing instrument
+  ASSERT_EQ(2, cache->skipped_count());
+
+  size_t n = 0;
+  cache->snapshot([&n](const Snapshot&) { n += 1; });
+  ASSERT_EQ(8, n);
+}
+
+// a late-joining reader copies the snapshot and continues from the ring, it ends up with the maintainer's state
+TEST(LastValueCacheTest, SnapshotThenContinueFromRing) {
+  constexpr uint16_t M = sizeof(MarketDataUpdate);
+  constexpr size_t L = 64 * MessageBuffer<0>::required<MarketDataUpdate>();
+  array<uint8_t, L> buffer{};
+  atomic<uint64_t> message_count_sync{0};
+  atomic<uint64_t> wraparound_sync{0};
+  DemuxControl control{};
+  const ReaderId maintainer_id{1};
+  const ReaderId late_id{2};
+  DemuxWriter<L, M, false> writer(
+      maintainer_id.mask() | late_id.mask(), span{buffer}, &message_count_sync, &wraparound_sync, nullptr, &control
+  );
+  DemuxReader<L, M> maintainer(maintainer_id, span{buffer}, &message_count_sync, &wraparound_sync);
+  const auto cache = std::make_unique<Cache>();
+
+  const auto write = [&writer](const uint64_t i) {
+    const auto md = update(static_cast<uint32_t>(i % 3), i % 2 == 0 ? Side::Bid : Side::Ask, i % LEVELS, i);
+    ASSERT_EQ(WriteResult::Success, writer.write_safe(*md));
+  };
+  const auto maintain = [&maintainer, &cache] {
+    for (optional<const MarketDataUpdate*> x = maintainer.next_unsafe<MarketDataUpdate>(); x.has_value();
+         x = maintainer.next_unsafe<MarketDataUpdate>()) {
+      cache->apply(*x.value(), maintainer.message_count());
+      cache->publish_cursor(RingCursor{maintainer.message_count(), maintainer.position(), maintainer.byte_count()});
+    }
+  };
+
+  for (uint64_t i = 1; i <= 20; ++i) {
+    write(i);
+  }
+  maintain();
+  for (uint64_t i = 21; i <= 30; ++i) {
+    write(i);
+  }
+
+  // the late reader copies the snapshot, the maintainer applies more updates after the cursor was loaded
+  std::map<uint32_t, Snapshot> state{};
+  const RingCursor cursor = cache->snapshot([&state](const Snapshot& x) { state[x.instrument_id] = x; });
+  ASSERT_EQ(20, cursor.message_count);
+  maintain();
+
+  DemuxReader<L, M> late(late_id, span{buffer}, &message_count_sync, &wraparound_sync);
+  ASSERT_TRUE(late.resume_from(cursor.message_count, cursor.position, cursor.byte_count, control));
+  for (optional<const MarketDataUpdate*> x = late.next_unsafe<MarketDataUpdate>(); x.has_value();
+       x = late.next_unsafe<MarketDataUpdate>()) {
+    const MarketDataUpdate& md = *x.value();
+    Snapshot& s = state[md.instrument_id];
+    if (late.message_count() <= s.message_count) {
+      continue;  // already in the snapshot
+    }
+    s.message_count = late.message_count();
+    s.levels[Cache::level_index(md)].price = md.price;
+  }
+  ASSERT_EQ(30, late.message_count());
+
+  ASSERT_EQ(3, state.size());
+  for (const auto& [instrument_id, s] : state) {
+    Snapshot expected{};
+    ASSERT_TRUE(cache->read(instrument_id, &expected));
+    ASSERT_EQ(expected.message_count, s.message_count);
+    for (size_t i = 0; i < expected.levels.size(); ++i) {
+      ASSERT_EQ(expected.levels[i].price, s.levels[i].price);
+    }
+  }
+}
+
+// the copy is never torn: every level is written with price == size == timestamp
+TEST(LastValueCacheTest, ConcurrentReadIsConsistent) {
+  const auto cache = std::make_unique<Cache>();
+  constexpr uint64_t N = 200'000;
+  atomic<bool> done{false};
+
+  std::thread maintainer([&cache, &done] {
+    for (uint64_t i = 1; i <= N; ++i) {
+      cache->apply(*update(1, Side::Bid, static_cast<uint8_t>(i % LEVELS), i), i);
+    }
+    done.store(true);
+  });
+
+  uint64_t reads = 0;
+  Snapshot x{};
+  while (!done.load() || reads == 0) {
+    if (cache->read(1, &x)) {
+      reads += 1;
+      for (const auto& level : x.levels) {
+        ASSERT_EQ(level.price, level.size);
+        ASSERT_EQ(level.price, level.timestamp);
+        ASSERT_LE(level.price, x.message_count);
+      }
+    }
+  }
+  maintainer.join();
+
+  ASSERT_TRUE(cache->read(1, &x));
+  ASSERT_EQ(N, x.message_count);
+}
+
+// NOLINTEND(readability-function-cognitive-complexity, misc-include-cleaner)
@@ -0,0 +1,170 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+// NOLINTBEGIN(readability-function-cognitive-complexity, misc-include-cleaner)
+
+#include "../core/merging_reader.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <vector>
+#include "../core/demultiplexer.h"
+#include "../core/message_buffer.h"
+#include "./test_ring.h"
+
+using lshl::demux::core::DemuxReader;
+using lshl::demux::core::MergingReader;
+using lshl::demux::core::MessageBuffer;
+using lshl::demux::core::TestRing;
+using lshl::demux::core::WriteResult;
+using std::array;
+using std::size_t;
+using std::span;
+using std::uint16_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::uint8_t;
+
+namespace {
+
+struct Message {
+  uint64_t timestamp;
+  uint64_t value;
+};
+
+constexpr uint16_t M = sizeof(Message);
+constexpr size_t MESSAGE_NUM = 8;  // messages that fit into the buffer
+constexpr size_t L = MESSAGE_NUM * MessageBuffer<0>::required<Message>();
+
+using Ring = TestRing<L, M>;
+
+auto write(Ring* ring, const uint64_t timestamp, const uint64_t value) -> WriteResult {
+  return ring->writer.write_safe(Message{timestamp, value});
+}
+
+auto timestamp(const span<uint8_t> x) noexcept -> uint64_t {
+  uint64_t result = 0;
+  std::memcpy(&result, x.data(), sizeof(result));
+  return result;
+}
+
+using TimestampFn = decltype(&timestamp);
+using Merger = MergingReader<L, M, TimestampFn>;
+
+auto make_rings(const size_t n) -> std::vector<std::unique_ptr<Ring>> {
+  std::vector<std::unique_ptr<Ring>> result;
+  for (size_t i = 0; i < n; ++i) {
+    result.push_back(std::make_unique<Ring>());
+  }
+  return result;
+}
+
+auto make_merger(const std::vector<std::unique_ptr<Ring>>& rings, const uint64_t max_delay) -> Merger {
+  std::vector<DemuxReader<L, M>*> readers;
+  for (const std::unique_ptr<Ring>& x : rings) {
+    readers.push_back(&x->reader);
+  }
+  return Merger{readers, &timestamp, max_delay};
+}
+
+// the values of the messages delivered at `now`
+auto read_all(Merger* merger, const uint64_t now) -> std::vector<uint64_t> {
+  std::vector<uint64_t> result;
+  for (span<uint8_t> x = merger->next(now); !x.empty(); x = merger->next(now)) {
+    Message m{};
+    std::memcpy(&m, x.data(), sizeof(m));
+    result.push_back(m.value);
+  }
+  return result;
+}
+
+}  // namespace
+
+TEST(MergingReaderTest, RequiresReaders) {
+  ASSERT_THROW((Merger{std::vector<DemuxReader<L, M>*>{}, &timestamp, 0}), std::invalid_argument);
+}
+
+TEST(MergingReaderTest, DeliversInTimestampOrder) {
+  const std::vector<std::unique_ptr<Ring>> rings = make_rings(3);
+  Merger merger = make_merger(rings, 1000);
+  ASSERT_EQ(write(rings[0].get(), 10, 1), WriteResult::Success);
+  ASSERT_EQ(write(rings[0].get(), 40, 4), WriteResult::Success);
+  ASSERT_EQ(write(rings[1].get(), 20, 2), WriteResult::Success);
+  ASSERT_EQ(write(rings[1].get(), 50, 5), WriteResult::Success);
+  ASSERT_EQ(write(rings[2].get(), 30, 3), WriteResult::Success);
+  // ring 2 runs dry after 30, 40 and 50 wait for it
+  ASSERT_EQ(read_all(&merger, 60), (std::vector<uint64_t>{1, 2, 3}));
+  ASSERT_EQ(merger.pending_count(), 2);
+
+  // then ring 0 runs dry after 40
+  ASSERT_EQ(write(rings[2].get(), 45, 6), WriteResult::Success);
+  ASSERT_EQ(read_all(&merger, 60), (std::vector<uint64_t>{4}));
+  ASSERT_EQ(merger.last_input(), 0);
+  ASSERT_EQ(write(rings[0].get(), 70, 7), WriteResult::Success);
+  ASSERT_EQ(read_all(&merger, 60), (std::vector<uint64_t>{6}));
+  ASSERT_EQ(merger.last_input(), 2);
+  ASSERT_EQ(merger.delivered_count(), 5);
+  ASSERT_EQ(merger.out_of_order_count(), 0);
+}
+
+TEST(MergingReaderTest, EqualTimestampsInInputOrder) {
+  const std::vector<std::unique_ptr<Ring>> rings = make_rings(2);
+  Merger merger = make_merger(rings, 0);
+  ASSERT_EQ(write(rings[1].get(), 10, 2), WriteResult::Success);
+  ASSERT_EQ(write(rings[0].get(), 10, 1), WriteResult::Success);
+  ASSERT_EQ(read_all(&merger, 10), (std::vector<uint64_t>{1, 2}));
+}
+
+TEST(MergingReaderTest, SilentInputHoldsForMaxDelay) {
+  const std::vector<std::unique_ptr<Ring>> rings = make_rings(2);
+  Merger merger = make_merger(rings, 100);
+  ASSERT_EQ(write(rings[0].get(), 10, 1), WriteResult::Success);
+  ASSERT_EQ(write(rings[0].get(), 20, 2), WriteResult::Success);
+  ASSERT_TRUE(read_all(&merger, 109).empty());
+  ASSERT_EQ(read_all(&merger, 110), (std::vector<uint64_t>{1}));
+  ASSERT_TRUE(read_all(&merger, 119).empty());
+  ASSERT_TRUE(read_all(&merger, 5).empty());  // the clock is behind the timestamps
+  ASSERT_EQ(read_all(&merger, 120), (std::vector<uint64_t>{2}));
+
+  // later than `max_delay`, delivered out of order
+  ASSERT_EQ(write(rings[1].get(), 15, 3), WriteResult::Success);
+  ASSERT_EQ(read_all(&merger, 120), (std::vector<uint64_t>{3}));
+  ASSERT_EQ(merger.out_of_order_count(), 1);
+}
+
+TEST(MergingReaderTest, MergesAcrossWraparounds) {
+  constexpr size_t N = 3;
+  constexpr uint64_t MESSAGES_PER_INPUT = 10 * MESSAGE_NUM;
+  const std::vector<std::unique_ptr<Ring>> rings = make_rings(N);
+  Merger merger = make_merger(rings, 1'000'000);
+  array<uint64_t, N> written{};
+  std::vector<uint64_t> values;
+  // input `i` has timestamps `i, i + N, i + 2N...`, the merged values count up
+  while (values.size() < N * MESSAGES_PER_INPUT) {
+    for (size_t i = 0; i < N; ++i) {
+      const uint64_t x = (written.at(i) * N) + i;
+      if (written.at(i) < MESSAGES_PER_INPUT && write(rings[i].get(), x, x) == WriteResult::Success) {
+        written.at(i) += 1;
+      }
+    }
+    const std::vector<uint64_t> xs = read_all(&merger, 0);
+    values.insert(values.end(), xs.begin(), xs.end());
+    if (xs.empty() && std::ranges::all_of(written, [](const uint64_t n) { return n == MESSAGES_PER_INPUT; })) {
+      // the last messages, the inputs that finished first hold them back
+      const std::vector<uint64_t> rest = read_all(&merger, N * MESSAGES_PER_INPUT + 1'000'000);
+      values.insert(values.end(), rest.begin(), rest.end());
+    }
+  }
+  for (size_t i = 0; i < values.size(); ++i) {
+    ASSERT_EQ(values[i], i);
+  }
+  ASSERT_EQ(merger.out_of_order_count(), 0);
+}
+
+// NOLINTEND(readability-function-cognitive-complexity, misc-include-cleaner)
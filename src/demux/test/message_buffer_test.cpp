@@ -8,6 +8,7 @@
 #include "../core/message_buffer.h"
 #include <gtest/gtest.h>
 #include <rapidcheck.h>  // NOLINT(misc-include-cleaner)
+#include <algorithm>
 #include <array>
 #include <cstddef>
 #include <cstdint>
@@ -19,7 +20,9 @@
 #include "../util/shm_util.h"
 #include "../util/tuple_util.h"
 
+using lshl::demux::core::detect_streaming_copy;
 using lshl::demux::core::MessageBuffer;
+using lshl::demux::core::StreamingCopy;
 using std::array;
 using std::span;
 using std::uint8_t;
@@ -38,6 +41,33 @@ auto create_test_array(const size_t size) -> vector<uint8_t> {
   }
   return result;
 }
+
+// writes a message of a compile-time size at every position, bytes outside the message must stay zero
+template <size_t N>
+auto test_write_fixed() -> void {
+  constexpr size_t BUF_SIZE = 512;
+  vector<uint8_t> src = create_test_array(N);
+  const span<uint8_t, N> message{src.data(), N};
+  for (size_t position = 0; position < BUF_SIZE; position++) {
+    std::array<uint8_t, BUF_SIZE> data{};
+    MessageBuffer<BUF_SIZE> buf(data);
+    const size_t remaining = buf.remaining(position);
+    const size_t written = buf.write(position, message);
+    if (remaining < N + sizeof(uint16_t)) {
+      ASSERT_EQ(written, 0) << "N: " << N << ", position: " << position;
+      continue;
+    }
+    ASSERT_EQ(written, N + sizeof(uint16_t)) << "N: " << N << ", position: " << position;
+    const span<uint8_t> read = buf.read(position);
+    ASSERT_EQ(read.size(), N);
+    ASSERT_TRUE(std::equal(read.begin(), read.end(), src.begin())) << "N: " << N << ", position: " << position;
+    for (size_t i = 0; i < BUF_SIZE; i++) {
+      if (i < position || i >= position + written) {
+        ASSERT_EQ(data[i], 0) << "N: " << N << ", position: " << position << ", i: " << i;
+      }
+    }
+  }
+}
 }  // namespace
 
 TEST(MessageBufferTest, MessageBufferRemaining0) {
@@ -263,4 +293,59 @@ TEST(MessageBufferTest, MessageBufferAllocateAndRead) {
   });
 }
 
+TEST(MessageBufferTest, MessageBufferWriteFixed) {
+  test_write_fixed<1>();
+  test_write_fixed<7>();
+  test_write_fixed<16>();
+  test_write_fixed<31>();
+  test_write_fixed<32>();
+  test_write_fixed<33>();
+  test_write_fixed<100>();
+  test_write_fixed<128>();
+  test_write_fixed<255>();
+  test_write_fixed<256>();
+  test_write_fixed<257>();  // larger than `FIXED_COPY_MAX`, copied as a message of a runtime size
+}
+
+TEST(MessageBufferTest, MessageBufferWriteStreaming) {
+  std::vector<StreamingCopy> kernels{StreamingCopy::None};
+  for (const StreamingCopy x : {StreamingCopy::Sse2, StreamingCopy::Avx2, StreamingCopy::Avx512}) {
+    if (x <= detect_streaming_copy()) {
+      kernels.push_back(x);
+    }
+  }
+
+  for (const StreamingCopy kernel : kernels) {
+    std::cout << "kernel: " << kernel << '\n';
+    rc::check([kernel](const uint16_t position, const uint16_t src_size) {
+      constexpr size_t BUF_SIZE = 4 * lshl::demux::core::STREAMING_COPY_MIN;
+
+      const size_t p = position % BUF_SIZE;
+      const size_t n = src_size % (BUF_SIZE / 2);
+      vector<uint8_t> data(BUF_SIZE + 1, 0);  // the last byte must never be written
+      MessageBuffer<BUF_SIZE> buf(span<uint8_t, BUF_SIZE>{data.data(), BUF_SIZE}, kernel);
+      EXPECT_EQ(buf.streaming_copy(), kernel);
+
+      const size_t remaining = buf.remaining(p);
+      vector<uint8_t> src = create_test_array(n);
+      const size_t written = buf.write(p, src);
+      if (remaining >= n + sizeof(uint16_t)) {
+        EXPECT_EQ(written, n + sizeof(uint16_t));
+        const span<uint8_t> read = buf.read(p);
+        EXPECT_EQ(read.size(), n);
+        EXPECT_TRUE(std::equal(read.begin(), read.end(), src.begin()));
+      } else {
+        EXPECT_EQ(written, 0);
+      }
+      for (size_t i = 0; i < data.size(); i++) {
+        if (i < p || i >= p + written) {
+          EXPECT_EQ(data[i], 0) << "i: " << i;
+        }
+      }
+
+      return !::testing::Test::HasFailure();
+    });
+  }
+}
+
 // NOLINTEND(readability-function-cognitive-complexity, misc-include-cleaner)
\ No newline at end of file
@@ -0,0 +1,125 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+// NOLINTBEGIN(readability-function-cognitive-complexity, misc-include-cleaner)
+
+#define UNIT_TEST
+#undef NDEBUG  // for assert to work in release build
+
+#include "../example/order_book.h"
+#include <gtest/gtest.h>
+#include <rapidcheck.h>  // NOLINT(misc-include-cleaner)
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "../example/market_data.h"
+
+using lshl::demux::example::MarketDataUpdate;
+using lshl::demux::example::OrderBook;
+using lshl::demux::example::OrderBooks;
+using lshl::demux::example::Side;
+using std::size_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::uint8_t;
+
+namespace {
+
+constexpr size_t LEVELS = 4;
+
+auto set(MarketDataUpdate* md, const uint32_t instrument_id, const Side side, const uint8_t level, const uint64_t price)
+    -> void {
+  md->timestamp = price;
+  md->instrument_id = instrument_id;
+  md->side = side;
+  md->level = level;
+  md->price = price;
+  md->size = static_cast<uint32_t>(price + 1);
+}
+
+}  // namespace
+
+TEST(OrderBookTest, InvalidCapacity) {
+  ASSERT_THROW(OrderBooks<LEVELS>(0), std::invalid_argument);
+}
+
+TEST(OrderBookTest, Apply) {
+  OrderBooks<LEVELS> books(2);
+  MarketDataUpdate md{};
+  ASSERT_EQ(nullptr, books.find(7));
+
+  set(&md, 7, Side::Bid, 0, 100);
+  ASSERT_TRUE(books.apply(md));
+  set(&md, 7, Side::Ask, 3, 200);
+  ASSERT_TRUE(books.apply(md));
+  set(&md, 7, Side::Bid, 0, 101);  // replaces the level
+  ASSERT_TRUE(books.apply(md));
+  set(&md, 7, Side::Bid, LEVELS, 1);  // not in the book
+  ASSERT_FALSE(books.apply(md));
+
+  const OrderBook<LEVELS>* book = books.find(7);
+  ASSERT_NE(nullptr, book);
+  ASSERT_EQ(3, book->update_count);
+  ASSERT_EQ(101, book->timestamp);
+  ASSERT_EQ(101, book->bids.prices[0]);
+  ASSERT_EQ(102, book->bids.sizes[0]);
+  ASSERT_EQ(0, book->bids.sizes[1]);
+  ASSERT_EQ(200, book->side(Side::Ask).prices[3]);
+  ASSERT_EQ(0, book->asks.prices[0]);
+
+  set(&md, 8, Side::Ask, 0, 300);
+  ASSERT_TRUE(books.apply(md));
+  set(&md, 9, Side::Ask, 0, 400);  // the index is full
+  ASSERT_FALSE(books.apply(md));
+  ASSERT_EQ(2, books.skipped_count());
+
+  ASSERT_EQ(2, books.size());
+  ASSERT_EQ(7, books.instrument_id(0));
+  ASSERT_EQ(8, books.instrument_id(1));
+  ASSERT_EQ(300, books.book(1).asks.prices[0]);
+}
+
+TEST(OrderBookTest, SameAsMap) {
+  rc::check([](const std::vector<uint64_t>& xs) {
+    constexpr size_t MAX_INSTRUMENTS = 8;
+    OrderBooks<LEVELS> books(MAX_INSTRUMENTS);
+    // (instrument_id, side, level) -> (price, size)
+    std::map<std::tuple<uint32_t, Side, uint8_t>, std::pair<uint64_t, uint32_t>> model{};
+    std::map<uint32_t, uint64_t> update_counts{};
+    MarketDataUpdate md{};
+    for (const uint64_t x : xs) {
+      // few distinct instruments and levels, so the index fills up and the levels are replaced
+      const auto instrument_id = static_cast<uint32_t>(x % (2 * MAX_INSTRUMENTS));
+      const Side side = (x >> 8U) % 2 == 0 ? Side::Bid : Side::Ask;
+      const auto level = static_cast<uint8_t>((x >> 16U) % (LEVELS + 1));
+      set(&md, instrument_id, side, level, x >> 24U);
+      const bool expected = level < LEVELS && (update_counts.size() < MAX_INSTRUMENTS ||
+                                               update_counts.contains(instrument_id));
+      RC_ASSERT(books.apply(md) == expected);
+      if (expected) {
+        model[{instrument_id, side, level}] = {md.price, md.size};
+        update_counts[instrument_id] += 1;
+      }
+    }
+    RC_ASSERT(books.size() == update_counts.size());
+    for (const auto& [instrument_id, n] : update_counts) {
+      const OrderBook<LEVELS>* book = books.find(instrument_id);
+      RC_ASSERT(book != nullptr);
+      RC_ASSERT(book->update_count == n);
+      for (const Side side : {Side::Bid, Side::Ask}) {
+        for (uint8_t level = 0; level < LEVELS; ++level) {
+          const auto it = model.find({instrument_id, side, level});
+          const std::pair<uint64_t, uint32_t> expected = it == model.end() ? std::pair{0UL, 0U} : it->second;
+          RC_ASSERT(book->side(side).prices[level] == expected.first);
+          RC_ASSERT(book->side(side).sizes[level] == expected.second);
+        }
+      }
+    }
+  });
+}
+
+// NOLINTEND(readability-function-cognitive-complexity, misc-include-cleaner)
@@ -0,0 +1,84 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+// NOLINTBEGIN(readability-function-cognitive-complexity, misc-include-cleaner)
+
+#include "../util/perf_counters.h"
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <optional>
+#include <sstream>
+#include <string>
+
+#define UNIT_TEST
+
+namespace lshl::demux::util {
+
+using std::uint64_t;
+
+// hardware counters are not available in most containers and VMs, the tests check both cases
+TEST(PerfCountersTest, CountsOrDegradesToNoCounters) {
+  PerfCounters perf{};
+  perf.start();
+  volatile uint64_t x = 0;
+  for (uint64_t i = 0; i < 1'000'000; ++i) {
+    x = x + i;
+  }
+  perf.stop();
+  const PerfCounterValues values = perf.read();
+
+  if (!perf.available()) {
+    for (const std::optional<uint64_t>& v : values.values) {
+      ASSERT_FALSE(v.has_value());
+    }
+    GTEST_SKIP() << "perf events are not available";
+  }
+
+  // the leader is always open when the counters are available
+  ASSERT_TRUE(values[PerfEvent::Cycles].has_value());
+  ASSERT_GT(values[PerfEvent::Cycles].value(), 1'000'000);
+  if (values[PerfEvent::Instructions].has_value()) {
+    ASSERT_GT(values[PerfEvent::Instructions].value(), 1'000'000);
+  }
+}
+
+TEST(PerfCountersTest, StoppedCountersDoNotCount) {
+  PerfCounters perf{};
+  if (!perf.available()) {
+    GTEST_SKIP() << "perf events are not available";
+  }
+  perf.start();
+  perf.stop();
+  const PerfCounterValues a = perf.read();
+  volatile uint64_t x = 0;
+  for (uint64_t i = 0; i < 1'000'000; ++i) {
+    x = x + i;
+  }
+  const PerfCounterValues b = perf.read();
+  ASSERT_EQ(a[PerfEvent::Instructions], b[PerfEvent::Instructions]);
+}
+
+TEST(PerfCountersTest, Sum) {
+  PerfCounterValues a{};
+  a.values[0] = 10;
+  PerfCounterValues b{};
+  b.values[0] = 5;
+  b.values[1] = 7;
+  a += b;
+  ASSERT_EQ(a[PerfEvent::Cycles], 15);
+  ASSERT_EQ(a[PerfEvent::Instructions], 7);
+  ASSERT_FALSE(a[PerfEvent::L1dMisses].has_value());
+}
+
+TEST(PerfCountersTest, PrintPer) {
+  PerfCounterValues a{};
+  a.values[0] = 30;
+  a.values[1] = 10;
+  std::stringstream ss;
+  print_per(ss, a, 10);
+  ASSERT_EQ(ss.str(), "cycles: 3, instr: 1, L1d_miss: n/a, LLC_miss: n/a, br_miss: n/a");
+}
+
+}  // namespace lshl::demux::util
+
+// NOLINTEND(readability-function-cognitive-complexity, misc-include-cleaner)
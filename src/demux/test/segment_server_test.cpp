@@ -0,0 +1,237 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+// NOLINTBEGIN(readability-function-cognitive-complexity, misc-include-cleaner)
+
+#include "../util/segment_server.h"
+#include <gtest/gtest.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace lshl::demux::util {
+
+using std::size_t;
+using std::uint16_t;
+using std::uint64_t;
+using std::uint8_t;
+
+namespace {
+
+using namespace std::chrono_literals;
+
+struct TestControl {
+  std::atomic<uint64_t> message_count_sync{0};
+  std::atomic<uint64_t> wraparound_sync{0};
+};
+
+constexpr size_t L = 4 * LINUX_PAGE_SIZE;
+constexpr uint16_t M = 64;
+
+using TestSegment = ShmSegment<TestControl, L, M>;
+using TestServer = SegmentServer<TestControl, L, M>;
+
+// much longer than an attach, a test that waits this long failed
+constexpr std::chrono::seconds LONG_TIMEOUT{10};
+
+// unique per process, the tests can run in parallel
+auto socket_name(const std::string& test) -> std::string {
+  return "lshl_demux_test_" + test + "_" + std::to_string(::getpid());
+}
+
+auto attach(const std::string& name, const uint8_t reader_num) -> std::optional<TestSegment> {
+  return attach_segment<TestControl, L, M>(name, reader_num, FrameFormat::Plain, LONG_TIMEOUT);
+}
+
+}  // namespace
+
+TEST(SegmentServerTest, AttachReaders) {
+  const std::string name = socket_name("attach");
+  const TestSegment writer = TestSegment::create_anonymous(name, FrameFormat::Plain);
+  writer.buffer()[0] = 7;
+  TestServer server(&writer, name);
+
+  std::optional<TestSegment> reader1;
+  std::optional<TestSegment> reader2;
+  // the readers connect before the writer accepts
+  std::thread t1([&] { reader1 = attach(name, 1); });
+  std::thread t2([&] { reader2 = attach(name, 2); });
+  ASSERT_TRUE(server.accept_readers(0b11, LONG_TIMEOUT));
+  t1.join();
+  t2.join();
+  ASSERT_EQ(server.readers_mask(), 0b11);
+
+  ASSERT_TRUE(reader1.has_value());
+  ASSERT_TRUE(reader2.has_value());
+  ASSERT_EQ(reader1->buffer()[0], 7);
+  ASSERT_EQ(reader2->buffer()[0], 7);
+  writer.buffer()[1] = 8;
+  ASSERT_EQ(reader1->buffer()[1], 8);
+  reader2->control()->wraparound_sync.store(0b10);
+  ASSERT_EQ(writer.control()->wraparound_sync.load(), 0b10);
+}
+
+TEST(SegmentServerTest, ReaderStartedBeforeWriter) {
+  const std::string name = socket_name("early");
+  std::optional<TestSegment> reader;
+  std::thread t([&] { reader = attach(name, 1); });
+  std::this_thread::sleep_for(50ms);  // the reader retries to connect
+
+  const TestSegment writer = TestSegment::create_anonymous(name, FrameFormat::Plain);
+  writer.control()->message_count_sync.store(3);
+  TestServer server(&writer, name);
+  ASSERT_TRUE(server.accept_readers(0b1, LONG_TIMEOUT));
+  t.join();
+  ASSERT_TRUE(reader.has_value());
+  ASSERT_EQ(reader->control()->message_count_sync.load(), 3);
+}
+
+TEST(SegmentServerTest, RejectsUnexpectedAndDuplicateReaders) {
+  const std::string name = socket_name("reject");
+  const TestSegment writer = TestSegment::create_anonymous(name, FrameFormat::Plain);
+  TestServer server(&writer, name);
+
+  std::thread t([&] {
+    ASSERT_THROW((void)attach(name, 3), std::domain_error);  // not expected
+    ASSERT_TRUE(attach(name, 1).has_value());
+    ASSERT_THROW((void)attach(name, 1), std::domain_error);  // attached already
+  });
+  ASSERT_TRUE(server.accept_readers(0b1, LONG_TIMEOUT));
+  ASSERT_FALSE(server.accept_readers(0b11, 1s));  // rejects the duplicate, reader 2 never comes
+  t.join();
+  ASSERT_EQ(server.readers_mask(), 0b1);
+}
+
+TEST(SegmentServerTest, OversizedRequest) {
+  const std::string name = socket_name("oversized");
+  const TestSegment writer = TestSegment::create_anonymous(name, FrameFormat::Plain);
+  TestServer server(&writer, name);
+
+  std::optional<UnixSocket> client = UnixSocket::connect(name);
+  ASSERT_TRUE(client.has_value());
+  const std::array<uint8_t, 2 * sizeof(AttachRequest)> request{};
+  client->send(request);
+
+  std::optional<TestSegment> reader;
+  std::thread t([&] { reader = attach(name, 1); });
+  ASSERT_TRUE(server.accept_readers(0b1, LONG_TIMEOUT));  // the writer keeps accepting after the bad request
+  t.join();
+  ASSERT_TRUE(reader.has_value());
+
+  AttachReply reply{};
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  const std::span<uint8_t> bytes{reinterpret_cast<uint8_t*>(&reply), sizeof(reply)};
+  const std::optional<UnixSocket::Received> received = client->receive(bytes, {}, LONG_TIMEOUT);
+  ASSERT_TRUE(received.has_value());
+  ASSERT_EQ(received->size, sizeof(AttachReply));
+  ASSERT_EQ(received->fd_count, 0);
+  ASSERT_EQ(reply.status, AttachStatus::InvalidRequest);
+}
+
+TEST(SegmentServerTest, ReaderClosesBeforeReply) {
+  const std::string name = socket_name("closed");
+  const TestSegment writer = TestSegment::create_anonymous(name, FrameFormat::Plain);
+  TestServer server(&writer, name);
+
+  {
+    // sends a valid request and goes away, the reply fails with `EPIPE`
+    std::optional<UnixSocket> client = UnixSocket::connect(name);
+    ASSERT_TRUE(client.has_value());
+    const AttachRequest request{SEGMENT_MAGIC, SEGMENT_VERSION, 1};
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    client->send(std::span<const uint8_t>{reinterpret_cast<const uint8_t*>(&request), sizeof(request)});
+  }
+  ASSERT_FALSE(server.accept_readers(0b1, 100ms));
+  ASSERT_EQ(server.readers_mask(), 0);  // the reader number is still free
+
+  std::optional<TestSegment> reader;
+  std::thread t([&] { reader = attach(name, 1); });
+  ASSERT_TRUE(server.accept_readers(0b1, LONG_TIMEOUT));
+  t.join();
+  ASSERT_TRUE(reader.has_value());
+}
+
+TEST(SegmentServerTest, RejectsOtherUser) {
+  if (::geteuid() != 0) {
+    GTEST_SKIP() << "switching the user of the reader needs root";
+  }
+  const std::string name = socket_name("user");
+  const TestSegment writer = TestSegment::create_anonymous(name, FrameFormat::Plain);
+  TestServer server(&writer, name);
+
+  const pid_t pid = ::fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0) {
+    constexpr uid_t NOBODY = 65534;
+    if (::setuid(NOBODY) != 0) {
+      ::_exit(2);
+    }
+    try {
+      (void)attach(name, 1);
+    } catch (const std::domain_error&) {
+      ::_exit(0);  // rejected
+    }
+    ::_exit(1);
+  }
+  ASSERT_FALSE(server.accept_readers(0b1, 500ms));
+  int status = 0;
+  ASSERT_EQ(::waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFEXITED(status));
+  ASSERT_EQ(WEXITSTATUS(status), 0);
+  ASSERT_EQ(server.readers_mask(), 0);
+}
+
+TEST(SegmentServerTest, Timeouts) {
+  const std::string name = socket_name("timeout");
+  // nobody listens
+  ASSERT_FALSE((attach_segment<TestControl, L, M>(name, 1, FrameFormat::Plain, 30ms).has_value()));
+
+  const TestSegment writer = TestSegment::create_anonymous(name, FrameFormat::Plain);
+  TestServer server(&writer, name);
+  ASSERT_FALSE(server.accept_readers(0b1, 1ms));
+  ASSERT_TRUE(server.accept_readers(0, 1ms));  // no readers expected
+  // one writer per socket name
+  ASSERT_THROW(TestServer(&writer, name), std::domain_error);
+}
+
+TEST(SegmentServerTest, CrossProcess) {
+  const std::string name = socket_name("fork");
+  const TestSegment writer = TestSegment::create_anonymous(name, FrameFormat::Plain);
+  TestServer server(&writer, name);
+
+  const pid_t pid = ::fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0) {
+    // the child reads the ring through the passed file descriptors and acknowledges in the control lines
+    std::optional<TestSegment> reader = attach(name, 1);
+    if (!reader.has_value()) {
+      ::_exit(1);
+    }
+    while (reader->control()->message_count_sync.load() == 0) {
+    }
+    reader->control()->wraparound_sync.store(reader->buffer()[L - 1]);
+    ::_exit(0);
+  }
+  ASSERT_TRUE(server.accept_readers(0b1, LONG_TIMEOUT));
+  writer.buffer()[L - 1] = 9;
+  writer.control()->message_count_sync.store(1);
+  int status = 0;
+  ASSERT_EQ(::waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFEXITED(status));
+  ASSERT_EQ(WEXITSTATUS(status), 0);
+  ASSERT_EQ(writer.control()->wraparound_sync.load(), 9);
+}
+
+}  // namespace lshl::demux::util
+
+// NOLINTEND(readability-function-cognitive-complexity, misc-include-cleaner)
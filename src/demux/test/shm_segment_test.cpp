@@ -0,0 +1,206 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+// NOLINTBEGIN(readability-function-cognitive-complexity, misc-include-cleaner)
+
+#include "../util/shm_segment.h"
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+
+namespace lshl::demux::util {
+
+using std::size_t;
+using std::uint16_t;
+using std::uint64_t;
+using std::uint8_t;
+
+namespace {
+
+struct TestControl {
+  std::atomic<uint64_t> message_count_sync{0};
+  std::atomic<uint64_t> wraparound_sync{0};
+};
+
+struct OtherControl {
+  std::atomic<uint64_t> message_count_sync{0};
+};
+
+constexpr size_t L = 4 * LINUX_PAGE_SIZE;
+constexpr uint16_t M = 64;
+
+using TestSegment = ShmSegment<TestControl, L, M>;
+
+// unique per process, the tests can run in parallel
+auto segment_name(const std::string& test) -> std::string {
+  return "lshl_demux_test_" + test + "_" + std::to_string(::getpid());
+}
+
+// removes the named segment when the test completes
+class SegmentName {
+ public:
+  explicit SegmentName(const std::string& test) : value_(segment_name(test)) { TestSegment::remove(this->value_); }
+  ~SegmentName() { TestSegment::remove(this->value_); }
+  SegmentName(const SegmentName&) = delete;
+  auto operator=(const SegmentName&) -> SegmentName& = delete;
+  SegmentName(SegmentName&&) = delete;
+  auto operator=(SegmentName&&) -> SegmentName& = delete;
+
+  [[nodiscard]] auto value() const noexcept -> const std::string& { return this->value_; }
+
+ private:
+  std::string value_;
+};
+
+}  // namespace
+
+TEST(ShmSegmentTest, Layout) {
+  static_assert(TestSegment::CONTROL_OFFSET == LINUX_PAGE_SIZE);
+  static_assert(TestSegment::BUFFER_OFFSET % LINUX_PAGE_SIZE == 0);
+  static_assert(TestSegment::TOTAL_SIZE == TestSegment::BUFFER_OFFSET + L);
+  ASSERT_EQ(page_align(0), 0);
+  ASSERT_EQ(page_align(1), LINUX_PAGE_SIZE);
+  ASSERT_EQ(page_align(LINUX_PAGE_SIZE), LINUX_PAGE_SIZE);
+}
+
+TEST(ShmSegmentTest, CreateAndOpen) {
+  const SegmentName name("create");
+  const TestSegment writer = TestSegment::create(name.value(), FrameFormat::Checksum32);
+  const SegmentHeader& h = writer.header();
+  ASSERT_EQ(h.magic.load(), SEGMENT_MAGIC);
+  ASSERT_EQ(h.version, SEGMENT_VERSION);
+  ASSERT_EQ(h.frame_format, FrameFormat::Checksum32);
+  ASSERT_EQ(h.buffer_size, L);
+  ASSERT_EQ(h.max_message_size, M);
+  ASSERT_EQ(h.control_type_size, sizeof(TestControl));
+  ASSERT_EQ(h.total_size, TestSegment::TOTAL_SIZE);
+
+  writer.buffer()[0] = 1;
+  writer.buffer()[L - 1] = 2;
+  writer.control()->message_count_sync.store(3);
+
+  const TestSegment reader = TestSegment::open(name.value(), FrameFormat::Checksum32, SegmentAccess::Reader);
+  ASSERT_EQ(reader.access(), SegmentAccess::Reader);
+  ASSERT_EQ(reader.buffer()[0], 1);
+  ASSERT_EQ(reader.buffer()[L - 1], 2);
+  ASSERT_EQ(reader.control()->message_count_sync.load(), 3);
+
+  // the control lines are shared both ways
+  reader.control()->wraparound_sync.store(4);
+  ASSERT_EQ(writer.control()->wraparound_sync.load(), 4);
+
+  const TestSegment monitor = TestSegment::open(name.value(), FrameFormat::Checksum32, SegmentAccess::Monitor);
+  ASSERT_EQ(monitor.control()->wraparound_sync.load(), 4);
+}
+
+TEST(ShmSegmentTest, CreateFailsIfExists) {
+  const SegmentName name("exists");
+  const TestSegment x = TestSegment::create(name.value(), FrameFormat::Plain);
+  ASSERT_THROW((void)TestSegment::create(name.value(), FrameFormat::Plain), std::domain_error);
+}
+
+TEST(ShmSegmentTest, OpenRejectsIncompatibleSegment) {
+  const SegmentName name("incompatible");
+  ASSERT_THROW((void)TestSegment::open(name.value(), FrameFormat::Plain, SegmentAccess::Reader), std::domain_error);
+
+  const TestSegment x = TestSegment::create(name.value(), FrameFormat::Plain);
+  ASSERT_THROW(
+      (void)TestSegment::open(name.value(), FrameFormat::Checksum64, SegmentAccess::Reader), std::domain_error
+  );
+  ASSERT_THROW(
+      (void)(ShmSegment<TestControl, L / 2, M>::open(name.value(), FrameFormat::Plain, SegmentAccess::Reader)),
+      std::domain_error
+  );
+  ASSERT_THROW(
+      (void)(ShmSegment<TestControl, L, M * 2>::open(name.value(), FrameFormat::Plain, SegmentAccess::Reader)),
+      std::domain_error
+  );
+  ASSERT_THROW(
+      (void)(ShmSegment<OtherControl, L, M>::open(name.value(), FrameFormat::Plain, SegmentAccess::Reader)),
+      std::domain_error
+  );
+  // larger than the segment
+  ASSERT_THROW(
+      (void)(ShmSegment<TestControl, L * 2, M>::open(name.value(), FrameFormat::Plain, SegmentAccess::Reader)),
+      std::domain_error
+  );
+  ASSERT_NO_THROW((void)TestSegment::open(name.value(), FrameFormat::Plain, SegmentAccess::Reader));
+}
+
+TEST(ShmSegmentTest, OpenRejectsUninitializedSegment) {
+  const SegmentName name("uninitialized");
+  // the size is right, the header is not written yet
+  const int fd = ::shm_open(("/" + name.value()).c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(::ftruncate(fd, static_cast<off_t>(TestSegment::TOTAL_SIZE)), 0);
+  ::close(fd);
+  ASSERT_THROW((void)TestSegment::open(name.value(), FrameFormat::Plain, SegmentAccess::Reader), std::domain_error);
+}
+
+TEST(ShmSegmentTest, ReaderCannotWriteRing) {
+  const SegmentName name("readonly");
+  const TestSegment writer = TestSegment::create(name.value(), FrameFormat::Plain);
+  const TestSegment reader = TestSegment::open(name.value(), FrameFormat::Plain, SegmentAccess::Reader);
+  const TestSegment monitor = TestSegment::open(name.value(), FrameFormat::Plain, SegmentAccess::Monitor);
+  ASSERT_DEATH(reader.buffer()[0] = 1, "");
+  ASSERT_DEATH(monitor.control()->wraparound_sync.store(1), "");
+  ASSERT_EQ(writer.buffer()[0], 0);
+  ASSERT_EQ(writer.control()->wraparound_sync.load(), 0);
+}
+
+TEST(ShmSegmentTest, AnonymousSegment) {
+  const TestSegment writer = TestSegment::create_anonymous("lshl_demux_test", FrameFormat::Plain);
+  ASSERT_EQ(writer.header().buffer_offset, 0);
+  writer.buffer()[1] = 5;
+  const TestSegment reader =
+      TestSegment::open_fds(::dup(writer.fd()), ::dup(writer.ring_fd()), FrameFormat::Plain, SegmentAccess::Reader);
+  ASSERT_EQ(reader.buffer()[1], 5);
+  writer.control()->message_count_sync.store(6);
+  ASSERT_EQ(reader.control()->message_count_sync.load(), 6);
+  const TestSegment monitor = TestSegment::open_fds(::dup(writer.fd()), -1, FrameFormat::Plain, SegmentAccess::Monitor);
+  ASSERT_EQ(monitor.control()->message_count_sync.load(), 6);
+}
+
+TEST(ShmSegmentTest, AnonymousRingIsSealed) {
+  const TestSegment writer = TestSegment::create_anonymous("lshl_demux_test", FrameFormat::Plain);
+  ASSERT_EQ(::fcntl(writer.ring_fd(), F_GET_SEALS) & TestSegment::RING_SEALS, TestSegment::RING_SEALS);
+  // the writer keeps its mapping, nobody gets a new writable one
+  writer.buffer()[0] = 1;
+  ASSERT_EQ(::mmap(nullptr, L, PROT_READ | PROT_WRITE, MAP_SHARED, writer.ring_fd(), 0), MAP_FAILED);
+  const uint8_t x = 2;
+  ASSERT_LT(::pwrite(writer.ring_fd(), &x, 1, 0), 0);
+  ASSERT_NE(::ftruncate(writer.fd(), 0), 0);
+
+  const TestSegment reader =
+      TestSegment::open_fds(::dup(writer.fd()), ::dup(writer.ring_fd()), FrameFormat::Plain, SegmentAccess::Reader);
+  ASSERT_NE(::mprotect(reader.buffer().data(), L, PROT_READ | PROT_WRITE), 0);
+  ASSERT_DEATH(reader.buffer()[0] = 1, "");
+  ASSERT_EQ(writer.buffer()[0], 1);
+}
+
+TEST(ShmSegmentTest, OpenFdsRejectsUnsealedRing) {
+  const TestSegment writer = TestSegment::create_anonymous("lshl_demux_test", FrameFormat::Plain);
+  const int ring = ::memfd_create("lshl_demux_test.unsealed", MFD_CLOEXEC);
+  ASSERT_GE(ring, 0);
+  ASSERT_EQ(::ftruncate(ring, static_cast<off_t>(L)), 0);
+  ASSERT_THROW(
+      (void)TestSegment::open_fds(::dup(writer.fd()), ring, FrameFormat::Plain, SegmentAccess::Reader),
+      std::domain_error
+  );
+  const int fd = ::dup(writer.fd());
+  const int ring_fd = ::dup(writer.ring_fd());
+  ASSERT_THROW(
+      (void)TestSegment::open_fds(fd, ring_fd, FrameFormat::Plain, SegmentAccess::Writer), std::invalid_argument
+  );
+}
+
+}  // namespace lshl::demux::util
+
+// NOLINTEND(readability-function-cognitive-complexity, misc-include-cleaner)
@@ -0,0 +1,110 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+// NOLINTBEGIN(readability-function-cognitive-complexity, misc-include-cleaner)
+
+#include "../util/startup_handshake.h"
+#include <gtest/gtest.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdint>
+#include <new>
+#include <thread>
+
+namespace lshl::demux::util {
+
+using std::uint64_t;
+
+namespace {
+
+using namespace std::chrono_literals;
+
+// much longer than a wakeup, a test that waits this long was not woken
+constexpr std::chrono::seconds LONG_TIMEOUT{10};
+
+auto elapsed_since(const std::chrono::steady_clock::time_point start) -> std::chrono::nanoseconds {
+  return std::chrono::steady_clock::now() - start;
+}
+
+}  // namespace
+
+TEST(StartupHandshakeTest, Timeouts) {
+  StartupHandshake x{};
+  ASSERT_FALSE(x.writer_ready());
+  ASSERT_FALSE(x.wait_for_writer(1ms));
+  ASSERT_FALSE(x.wait_for_readers(0b1, 1ms));
+  ASSERT_TRUE(x.wait_for_readers(0, 1ms));  // no readers expected
+}
+
+TEST(StartupHandshakeTest, WriterReadyWakesReaders) {
+  StartupHandshake x{};
+  const auto start = std::chrono::steady_clock::now();
+  bool ok1 = false;
+  bool ok2 = false;
+  std::thread reader1([&] { ok1 = x.wait_for_writer(LONG_TIMEOUT); });
+  std::thread reader2([&] { ok2 = x.wait_for_writer(LONG_TIMEOUT); });
+  std::this_thread::sleep_for(10ms);  // let the readers fall asleep
+  x.publish_writer_ready();
+  reader1.join();
+  reader2.join();
+  ASSERT_TRUE(ok1);
+  ASSERT_TRUE(ok2);
+  ASSERT_LT(elapsed_since(start), LONG_TIMEOUT / 2);
+  ASSERT_TRUE(x.wait_for_writer(0ns));  // does not sleep once the writer is ready
+}
+
+TEST(StartupHandshakeTest, LastReaderWakesWriter) {
+  StartupHandshake x{};
+  const auto start = std::chrono::steady_clock::now();
+  bool ok = false;
+  std::thread writer([&] { ok = x.wait_for_readers(0b101, LONG_TIMEOUT); });
+  x.register_reader(0b001);
+  std::this_thread::sleep_for(10ms);
+  x.register_reader(0b010);  // not expected
+  x.register_reader(0b100);
+  writer.join();
+  ASSERT_TRUE(ok);
+  ASSERT_LT(elapsed_since(start), LONG_TIMEOUT / 2);
+  ASSERT_EQ(0b111, x.readers_mask());
+}
+
+TEST(StartupHandshakeTest, ResetForgetsPreviousRun) {
+  StartupHandshake x{};
+  x.publish_writer_ready();
+  x.register_reader(0b1);
+  x.reset();
+  ASSERT_FALSE(x.writer_ready());
+  ASSERT_EQ(0, x.readers_mask());
+  ASSERT_FALSE(x.wait_for_readers(0b1, 1ms));
+}
+
+TEST(StartupHandshakeTest, AcrossProcesses) {
+  // shared mapping, the child process gets the same physical page
+  void* page = ::mmap(nullptr, sizeof(StartupHandshake), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  ASSERT_NE(MAP_FAILED, page);
+  auto* x = new (page) StartupHandshake{};
+
+  const pid_t pid = ::fork();
+  if (pid == 0) {  // reader
+    const bool ok = x->wait_for_writer(LONG_TIMEOUT);
+    x->register_reader(0b1);
+    ::_exit(ok ? 0 : 1);
+  }
+  ASSERT_GT(pid, 0);
+
+  const auto start = std::chrono::steady_clock::now();
+  x->publish_writer_ready();
+  ASSERT_TRUE(x->wait_for_readers(0b1, LONG_TIMEOUT));
+  ASSERT_LT(elapsed_since(start), LONG_TIMEOUT / 2);
+  int status = 0;
+  ASSERT_EQ(pid, ::waitpid(pid, &status, 0));
+  ASSERT_TRUE(WIFEXITED(status));
+  ASSERT_EQ(0, WEXITSTATUS(status));
+  ::munmap(page, sizeof(StartupHandshake));
+}
+
+}  // namespace lshl::demux::util
+
+// NOLINTEND(readability-function-cognitive-complexity, misc-include-cleaner)
@@ -0,0 +1,32 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include "../core/demultiplexer.h"
+#include "../core/reader_id.h"
+
+namespace lshl::demux::core {
+
+// NOLINTBEGIN(misc-non-private-member-variables-in-classes)
+
+/// @brief A circular buffer with a non-blocking writer and one reader in one thread, the fixture of the tests of the
+/// layers over `DemuxWriter` and `DemuxReader`.
+template <std::size_t L, std::uint16_t M>
+struct TestRing {
+  std::array<std::uint8_t, L> buffer{};
+  std::atomic<std::uint64_t> message_count_sync{0};
+  std::atomic<std::uint64_t> wraparound_sync{0};
+  const ReaderId id{1};
+  DemuxWriter<L, M, false> writer{id.mask(), std::span{buffer}, &message_count_sync, &wraparound_sync};
+  DemuxReader<L, M> reader{id, std::span{buffer}, &message_count_sync, &wraparound_sync};
+};
+
+// NOLINTEND(misc-non-private-member-variables-in-classes)
+
+}  // namespace lshl::demux::core
@@ -0,0 +1,84 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+// NOLINTBEGIN(readability-function-cognitive-complexity, misc-include-cleaner)
+
+#include "../util/tsc_clock.h"
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdlib>
+#include <cstdint>
+#include <thread>
+#include <type_traits>
+
+#define UNIT_TEST
+
+namespace lshl::demux::util {
+
+using std::int64_t;
+using std::uint64_t;
+
+static_assert(std::is_trivially_copyable_v<TscCalibration>, "TscCalibration lives in shared memory");
+
+TEST(TscClockTest, DefaultClockIsSteadyClock) {
+  const TscClock clock{};
+  ASSERT_FALSE(clock.is_tsc());
+  const uint64_t before = steady_clock_ns();
+  const uint64_t now = clock.now();
+  const uint64_t after = steady_clock_ns();
+  ASSERT_LE(before, now);
+  ASSERT_LE(now, after);
+}
+
+TEST(TscClockTest, FallbackCalibrationIsSteadyClock) {
+  const TscClock clock{TscCalibration{}};
+  ASSERT_FALSE(clock.is_tsc());
+}
+
+TEST(TscClockTest, CalibrationMatchesCpuid) {
+  const TscCalibration calibration = calibrate_tsc(std::chrono::milliseconds{10});
+  ASSERT_EQ(has_invariant_tsc(), calibration.invariant_tsc);
+  if (calibration.invariant_tsc) {
+    ASSERT_GT(calibration.ns_per_tick, 0.0);
+    ASSERT_GT(calibration.tsc_base, 0);
+    ASSERT_GT(calibration.ns_base, 0);
+  } else {
+    ASSERT_EQ(0.0, calibration.ns_per_tick);
+  }
+}
+
+TEST(TscClockTest, ToNsIsLinear) {
+  // 2.5 GHz TSC
+  const TscCalibration calibration{1000, 5000, 0.4, true};
+  const TscClock clock{calibration};
+  ASSERT_TRUE(clock.is_tsc());
+  ASSERT_EQ(5000, clock.to_ns(1000));
+  ASSERT_EQ(5400, clock.to_ns(2000));
+  ASSERT_EQ(4600, clock.to_ns(0));  // ticks read slightly before the calibration
+}
+
+TEST(TscClockTest, TscClockTracksSteadyClock) {
+  const TscCalibration calibration = calibrate_tsc(std::chrono::milliseconds{20});
+  if (!calibration.invariant_tsc) {
+    GTEST_SKIP() << "invariant TSC is not available";
+  }
+  const TscClock clock{calibration};
+  ASSERT_TRUE(clock.is_tsc());
+
+  // the two clocks should agree within a millisecond after a few milliseconds of drift
+  constexpr int64_t TOLERANCE_NS = 1'000'000;
+  for (int i = 0; i < 5; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds{2});
+    const auto tsc_ns = static_cast<int64_t>(clock.now_serialized());
+    const auto steady_ns = static_cast<int64_t>(steady_clock_ns());
+    ASSERT_LT(std::abs(steady_ns - tsc_ns), TOLERANCE_NS);
+  }
+
+  const uint64_t x0 = clock.now();
+  const uint64_t x1 = clock.now_serialized();
+  ASSERT_LE(x0, x1);
+}
+
+}  // namespace lshl::demux::util
+
+// NOLINTEND(readability-function-cognitive-complexity, misc-include-cleaner)
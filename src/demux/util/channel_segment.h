@@ -0,0 +1,396 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include "./boost_log_util.h"
+#include "./doorbell.h"
+#include "./shm_segment.h"
+#include "./shm_util.h"
+#include "./startup_handshake.h"
+
+namespace lshl::demux::util {
+
+using std::size_t;
+using std::uint16_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::uint8_t;
+
+constexpr uint64_t CHANNEL_SEGMENT_MAGIC = 0x314E414843584D44;  // "DMXCHAN1", little-endian
+constexpr uint32_t CHANNEL_SEGMENT_VERSION = 1;
+
+/// @brief Max channel name length in bytes, without the terminating zero.
+constexpr size_t CHANNEL_NAME_MAX = 31;
+
+enum class ChannelState : uint32_t {
+  Free = 0,
+  Active = 1,  // stored last by `add_channel`, a reader that sees it sees the initialized channel
+};
+
+// NOLINTBEGIN(misc-non-private-member-variables-in-classes)
+
+/// @brief Directory entry of one channel, written once by the writer that adds the channel.
+struct ChannelEntry {
+  std::atomic<ChannelState> state;
+  FrameFormat frame_format;
+  std::array<char, CHANNEL_NAME_MAX + 1> name;  // zero-terminated
+};
+
+/// @brief The first page of a channel segment, followed by the directory of `channel_capacity` entries.
+struct ChannelSegmentHeader {
+  std::atomic<uint64_t> magic;  // `CHANNEL_SEGMENT_MAGIC`, stored last
+  uint32_t version;
+  uint32_t channel_capacity;   // `N`
+  uint64_t buffer_size;        // `L`
+  uint32_t max_message_size;   // `M`
+  uint32_t control_type_size;  // `sizeof` of the control lines type
+  uint64_t directory_offset;
+  uint64_t control_offset;  // the doorbells of the readers, then the control lines of all channels, `slot_size` each
+  uint64_t doorbell_size;
+  uint64_t slot_size;
+  uint64_t buffer_offset;  // the rings of all channels, `ring_size` each
+  uint64_t ring_size;
+  uint64_t total_size;
+  std::atomic<uint32_t> channel_count;  // claimed directory entries
+};
+
+/// @brief The control lines of one channel and its reader registry. The readers of a channel register with
+/// `registry.register_reader(mask)`, its writer waits for them with `registry.wait_for_readers`.
+template <class C>
+struct alignas(std::hardware_destructive_interference_size) ChannelSlot {
+  StartupHandshake registry{};
+  C control{};
+};
+
+/// @brief One channel of a `ChannelSegment`, points into the mappings of the segment.
+template <class C, size_t L>
+struct Channel {
+  uint32_t index;
+  std::string_view name;
+  FrameFormat frame_format;
+  StartupHandshake* registry;
+  C* control;
+  uint8_t* ring;  // `nullptr` for `SegmentAccess::Monitor`
+
+  /// @brief The circular buffer, read-only for `SegmentAccess::Reader`.
+  [[nodiscard]] auto buffer() const noexcept -> std::span<uint8_t, L> {
+    assert(this->ring != nullptr);
+    return std::span<uint8_t, L>{this->ring, L};
+  }
+};
+
+// NOLINTEND(misc-non-private-member-variables-in-classes)
+
+/// @brief Shared memory segment of up to `N` named channels, every channel with its own ring of `L` bytes, control
+/// lines `C` and reader registry. Dozens of feeds in one segment: a reader attaches to any number of channels by name
+/// with three mappings, the directory, the control lines of all channels and the rings of all channels, instead of a
+/// segment per feed. The control lines are packed, a cache line aligned slot per channel, so the hot counters of all
+/// channels share a few pages and TLB entries. A channel is added to a running segment with `add_channel`, up to `N`.
+/// Unlike `ShmSegment` the regions are not per channel: the readers map all rings read-only and all control lines
+/// read-write. Every reader number has a `Doorbell` of all channels: a reader of many channels polls its doorbell with
+/// a `DoorbellPoller` and visits the rung channels only, the writers ring after they publish, see `ring_doorbells`.
+/// @tparam `C` control lines of one channel, constructed by `add_channel` with `C{}`, must be trivially destructible.
+template <class C, size_t L, uint16_t M, uint32_t N>
+  requires(std::is_default_constructible_v<C> && std::is_trivially_destructible_v<C> && L >= M + 2 && M > 0 && N > 0 &&
+           N <= DOORBELL_MAX_CHANNELS)
+class ChannelSegment {
+ public:
+  static constexpr size_t DIRECTORY_OFFSET =
+      (sizeof(ChannelSegmentHeader) + alignof(ChannelEntry) - 1) / alignof(ChannelEntry) * alignof(ChannelEntry);
+  static constexpr size_t CONTROL_OFFSET = page_align(DIRECTORY_OFFSET + (N * sizeof(ChannelEntry)));
+  static constexpr size_t DOORBELL_NUM = 64;  // one per reader number
+  static constexpr size_t DOORBELLS_SIZE = DOORBELL_NUM * sizeof(Doorbell<N>);
+  static constexpr size_t SLOT_SIZE = sizeof(ChannelSlot<C>);
+  static constexpr size_t CONTROL_SIZE = page_align(DOORBELLS_SIZE + (N * SLOT_SIZE));
+  static constexpr size_t BUFFER_OFFSET = CONTROL_OFFSET + CONTROL_SIZE;
+  static constexpr size_t RING_SIZE = page_align(L);
+  static constexpr size_t TOTAL_SIZE = BUFFER_OFFSET + (N * RING_SIZE);
+
+  static_assert(alignof(ChannelSlot<C>) <= LINUX_PAGE_SIZE);
+
+  /// @brief Creates the named segment with an empty directory, fails if it exists.
+  /// @throw `std::domain_error` if the segment cannot be created.
+  [[nodiscard]] static auto create(const std::string& name) noexcept(false) -> ChannelSegment {
+    ShmFd fd{::shm_open(shm_name(name).c_str(), O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR)};
+    if (fd.get() < 0) {
+      throw_shm_error("could not create channel segment", name);
+    }
+    if (::ftruncate(fd.get(), static_cast<off_t>(TOTAL_SIZE)) != 0) {
+      throw_shm_error("could not resize channel segment", name);
+    }
+    ChannelSegment result(std::move(fd), name, SegmentAccess::Writer);
+    result.mappings_[0] = ShmMapping(result.fd_.get(), 0, TOTAL_SIZE, PROT_READ | PROT_WRITE, name);
+    uint8_t* base = result.mappings_[0].data();
+    // NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    result.header_ = new (base) ChannelSegmentHeader{};
+    result.control_ = base + CONTROL_OFFSET;
+    result.rings_ = base + BUFFER_OFFSET;
+    // NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    for (uint8_t reader_num = 1; reader_num <= DOORBELL_NUM; ++reader_num) {
+      new (result.doorbell(reader_num)) Doorbell<N>{};
+    }
+    ChannelSegmentHeader* h = result.header_;
+    h->version = CHANNEL_SEGMENT_VERSION;
+    h->channel_capacity = N;
+    h->buffer_size = L;
+    h->max_message_size = M;
+    h->control_type_size = sizeof(C);
+    h->directory_offset = DIRECTORY_OFFSET;
+    h->control_offset = CONTROL_OFFSET;
+    h->doorbell_size = sizeof(Doorbell<N>);
+    h->slot_size = SLOT_SIZE;
+    h->buffer_offset = BUFFER_OFFSET;
+    h->ring_size = RING_SIZE;
+    h->total_size = TOTAL_SIZE;
+    h->magic.store(CHANNEL_SEGMENT_MAGIC, std::memory_order_release);
+    LOG_INFO << "[ChannelSegment::create] " << name << ", N: " << N << ", L: " << L << ", M: " << M
+             << ", slot_size: " << SLOT_SIZE << ", total_size: " << TOTAL_SIZE;
+    return result;
+  }
+
+  /// @brief Opens an existing named segment, validates the header against `N`, `L`, `M` and `C`. A `Writer` can add
+  /// channels, a `Reader` maps the directory and the rings read-only and the control lines read-write, a `Monitor`
+  /// maps the directory and the control lines read-only.
+  /// @throw `std::domain_error` if the segment does not exist or is not compatible.
+  [[nodiscard]] static auto open(const std::string& name, const SegmentAccess access) noexcept(false)
+      -> ChannelSegment {
+    const bool monitor = access == SegmentAccess::Monitor;
+    const bool writer = access == SegmentAccess::Writer;
+    ShmFd fd{::shm_open(shm_name(name).c_str(), monitor ? O_RDONLY : O_RDWR, 0)};
+    if (fd.get() < 0) {
+      throw_shm_error("could not open channel segment", name);
+    }
+    fd.check_size(TOTAL_SIZE, name);
+
+    ChannelSegment result(std::move(fd), name, access);
+    const int descriptor = result.fd_.get();
+    if (writer) {
+      result.mappings_[0] = ShmMapping(descriptor, 0, TOTAL_SIZE, PROT_READ | PROT_WRITE, name);
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+      result.header_ = reinterpret_cast<ChannelSegmentHeader*>(result.mappings_[0].data());
+      validate(*result.header_, name);
+      // NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+      result.control_ = result.mappings_[0].data() + CONTROL_OFFSET;
+      result.rings_ = result.mappings_[0].data() + BUFFER_OFFSET;
+      // NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    } else {
+      result.mappings_[0] = ShmMapping(descriptor, 0, CONTROL_OFFSET, PROT_READ, name);
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+      result.header_ = reinterpret_cast<ChannelSegmentHeader*>(result.mappings_[0].data());
+      validate(*result.header_, name);
+      const int control_protection = monitor ? PROT_READ : PROT_READ | PROT_WRITE;
+      result.mappings_[1] = ShmMapping(descriptor, CONTROL_OFFSET, CONTROL_SIZE, control_protection, name);
+      result.control_ = result.mappings_[1].data();
+      if (!monitor) {
+        result.mappings_[2] = ShmMapping(descriptor, BUFFER_OFFSET, N * RING_SIZE, PROT_READ, name);
+        result.rings_ = result.mappings_[2].data();
+      }
+    }
+    LOG_INFO << "[ChannelSegment::open] " << name << ", N: " << N << ", L: " << L << ", M: " << M
+             << ", access: " << access << ", channel_count: " << result.channel_count();
+    return result;
+  }
+
+  /// @brief Removes the named segment, the processes that mapped it keep their mappings.
+  static auto remove(const std::string& name) noexcept -> bool { return ::shm_unlink(shm_name(name).c_str()) == 0; }
+
+  ~ChannelSegment() = default;
+  ChannelSegment(const ChannelSegment&) = delete;
+  auto operator=(const ChannelSegment&) -> ChannelSegment& = delete;
+  ChannelSegment(ChannelSegment&&) noexcept = default;
+  auto operator=(ChannelSegment&&) noexcept -> ChannelSegment& = default;
+
+  /// @brief Adds a channel to the directory and constructs its control lines, the readers find it once this returns.
+  /// Channels are never removed.
+  /// @throw `std::invalid_argument` if the name is empty, too long or taken, `std::domain_error` if the directory is
+  /// full or the segment is not open for writing.
+  auto add_channel(const std::string_view name, const FrameFormat format) noexcept(false) -> Channel<C, L> {
+    if (this->access_ != SegmentAccess::Writer) {
+      throw std::domain_error("[ChannelSegment::add_channel] segment is not open for writing: " + this->name_);
+    }
+    if (name.empty() || name.size() > CHANNEL_NAME_MAX) {
+      throw std::invalid_argument("[ChannelSegment::add_channel] invalid channel name: " + std::string(name));
+    }
+    if (this->find_entry(name).has_value()) {
+      throw std::invalid_argument("[ChannelSegment::add_channel] channel exists: " + std::string(name));
+    }
+    // claimed, not counted, so the writers of a segment in different processes get different entries
+    uint32_t index = this->header_->channel_count.load();
+    do {
+      if (index >= N) {
+        throw std::domain_error("[ChannelSegment::add_channel] directory is full, N: " + std::to_string(N));
+      }
+    } while (!this->header_->channel_count.compare_exchange_weak(index, index + 1));
+
+    new (this->slot(index)) ChannelSlot<C>{};
+    ChannelEntry& entry = this->entry(index);
+    entry.frame_format = format;
+    std::copy(name.begin(), name.end(), entry.name.begin());
+    entry.state.store(ChannelState::Active, std::memory_order_release);
+    LOG_INFO << "[ChannelSegment::add_channel] " << this->name_ << ", channel: " << name << ", index: " << index
+             << ", format: " << format;
+    return this->channel(index);
+  }
+
+  /// @return `std::nullopt` if there is no channel with the `name` yet.
+  /// @throw `std::domain_error` if the channel has another frame format.
+  [[nodiscard]] auto find_channel(const std::string_view name, const FrameFormat format) const noexcept(false)
+      -> std::optional<Channel<C, L>> {
+    const std::optional<uint32_t> index = this->find_entry(name);
+    if (!index.has_value()) {
+      return std::nullopt;
+    }
+    const Channel<C, L> result = this->channel(index.value());
+    if (result.frame_format != format) {
+      throw std::domain_error(
+          "[ChannelSegment::find_channel] incompatible channel: " + std::string(name) +
+          ", frame_format: " + std::to_string(static_cast<uint32_t>(result.frame_format)) +
+          ", expected: " + std::to_string(static_cast<uint32_t>(format))
+      );
+    }
+    return result;
+  }
+
+  /// @brief Number of directory entries in use, some of them can still be in `add_channel`.
+  [[nodiscard]] auto channel_count() const noexcept -> uint32_t {
+    return std::min(this->header_->channel_count.load(std::memory_order_acquire), N);
+  }
+
+  /// @return `std::nullopt` if the entry is not active (yet).
+  [[nodiscard]] auto channel_at(const uint32_t index) const noexcept -> std::optional<Channel<C, L>> {
+    if (index >= N || this->entry(index).state.load(std::memory_order_acquire) != ChannelState::Active) {
+      return std::nullopt;
+    }
+    return this->channel(index);
+  }
+
+  /// @brief The doorbell of the reader `reader_num`, `[1, 64]`, the reader polls it with a `DoorbellPoller`.
+  [[nodiscard]] auto doorbell(const uint8_t reader_num) const noexcept -> Doorbell<N>* {
+    assert(reader_num >= 1 && reader_num <= DOORBELL_NUM);
+    // NOLINTBEGIN(cppcoreguidelines-pro-type-reinterpret-cast, cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    return reinterpret_cast<Doorbell<N>*>(this->control_ + ((reader_num - 1U) * sizeof(Doorbell<N>)));
+    // NOLINTEND(cppcoreguidelines-pro-type-reinterpret-cast, cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  }
+
+  /// @brief Rings the `channel` in the doorbells of the `readers_mask`, `ReaderId::mask()` bits. Called by the writer
+  /// of the channel after it published, one atomic per reader, two the first time the reader's word is rung.
+  auto ring_doorbells(const uint32_t channel, const uint64_t readers_mask) const noexcept -> void {
+    for (uint64_t mask = readers_mask; mask != 0; mask &= mask - 1) {
+      this->doorbell(static_cast<uint8_t>(std::countr_zero(mask) + 1))->ring(channel);
+    }
+  }
+
+  [[nodiscard]] auto header() const noexcept -> const ChannelSegmentHeader& { return *this->header_; }
+
+  [[nodiscard]] auto access() const noexcept -> SegmentAccess { return this->access_; }
+
+  [[nodiscard]] auto name() const noexcept -> const std::string& { return this->name_; }
+
+ private:
+  ChannelSegment(ShmFd fd, std::string name, const SegmentAccess access) noexcept
+      : fd_(std::move(fd)), name_(std::move(name)), access_(access) {}
+
+  // POSIX requires a leading slash for portable names
+  static auto shm_name(const std::string& name) -> std::string { return name.starts_with('/') ? name : '/' + name; }
+
+  static auto validate(const ChannelSegmentHeader& x, const std::string& name) noexcept(false) -> void {
+    const auto fail = [&name](const std::string& what, const uint64_t actual, const uint64_t expected) {
+      throw std::domain_error(
+          "[ChannelSegment] incompatible segment: " + name + ", " + what + ": " + std::to_string(actual) +
+          ", expected: " + std::to_string(expected)
+      );
+    };
+    const uint64_t magic = x.magic.load(std::memory_order_acquire);
+    if (magic != CHANNEL_SEGMENT_MAGIC) {
+      fail("magic, not a channel segment or not initialized yet", magic, CHANNEL_SEGMENT_MAGIC);
+    }
+    if (x.version != CHANNEL_SEGMENT_VERSION) {
+      fail("version", x.version, CHANNEL_SEGMENT_VERSION);
+    }
+    if (x.channel_capacity != N) {
+      fail("channel_capacity (N)", x.channel_capacity, N);
+    }
+    if (x.buffer_size != L) {
+      fail("buffer_size (L)", x.buffer_size, L);
+    }
+    if (x.max_message_size != M) {
+      fail("max_message_size (M)", x.max_message_size, M);
+    }
+    if (x.control_type_size != sizeof(C)) {
+      fail("control_type_size", x.control_type_size, sizeof(C));
+    }
+    if (x.directory_offset != DIRECTORY_OFFSET || x.control_offset != CONTROL_OFFSET ||
+        x.doorbell_size != sizeof(Doorbell<N>) || x.slot_size != SLOT_SIZE ||
+        x.buffer_offset != BUFFER_OFFSET || x.ring_size != RING_SIZE || x.total_size != TOTAL_SIZE) {
+      fail("layout, total_size", x.total_size, TOTAL_SIZE);
+    }
+  }
+
+  [[nodiscard]] auto find_entry(const std::string_view name) const noexcept -> std::optional<uint32_t> {
+    const uint32_t n = this->channel_count();
+    for (uint32_t i = 0; i < n; ++i) {
+      const ChannelEntry& x = this->entry(i);
+      if (x.state.load(std::memory_order_acquire) == ChannelState::Active && entry_name(x) == name) {
+        return i;
+      }
+    }
+    return std::nullopt;
+  }
+
+  [[nodiscard]] auto entry(const uint32_t index) const noexcept -> ChannelEntry& {
+    // NOLINTBEGIN(cppcoreguidelines-pro-type-reinterpret-cast, cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    auto* directory = reinterpret_cast<ChannelEntry*>(reinterpret_cast<uint8_t*>(this->header_) + DIRECTORY_OFFSET);
+    return directory[index];
+    // NOLINTEND(cppcoreguidelines-pro-type-reinterpret-cast, cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  }
+
+  [[nodiscard]] auto slot(const uint32_t index) const noexcept -> ChannelSlot<C>* {
+    // NOLINTBEGIN(cppcoreguidelines-pro-type-reinterpret-cast, cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    return reinterpret_cast<ChannelSlot<C>*>(this->control_ + DOORBELLS_SIZE + (index * SLOT_SIZE));
+    // NOLINTEND(cppcoreguidelines-pro-type-reinterpret-cast, cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  }
+
+  // bounded, the directory is written by another process
+  static auto entry_name(const ChannelEntry& x) noexcept -> std::string_view {
+    return {x.name.data(), ::strnlen(x.name.data(), x.name.size())};
+  }
+
+  [[nodiscard]] auto channel(const uint32_t index) const noexcept -> Channel<C, L> {
+    const ChannelEntry& x = this->entry(index);
+    ChannelSlot<C>* s = this->slot(index);
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    uint8_t* ring = this->rings_ == nullptr ? nullptr : this->rings_ + (index * RING_SIZE);
+    return Channel<C, L>{index, entry_name(x), x.frame_format, &s->registry, &s->control, ring};
+  }
+
+  ShmFd fd_;
+  std::string name_;
+  SegmentAccess access_;
+  std::array<ShmMapping, 3> mappings_{};  // the writer maps the whole segment with the first one
+  ChannelSegmentHeader* header_{nullptr};
+  uint8_t* control_{nullptr};
+  uint8_t* rings_{nullptr};
+};
+
+}  // namespace lshl::demux::util
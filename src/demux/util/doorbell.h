@@ -0,0 +1,114 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <new>
+
+namespace lshl::demux::util {
+
+using std::uint32_t;
+using std::uint64_t;
+
+/// @brief Max channels of a `Doorbell`, one summary word of 64 words of 64 bits.
+constexpr uint32_t DOORBELL_MAX_CHANNELS = 64 * 64;
+
+// NOLINTBEGIN(misc-non-private-member-variables-in-classes)
+
+/// @brief Bitmap of the channels with new messages, shared by the writers of the channels and one poller, see
+/// `DoorbellPoller`. A writer rings the channel after it published a message. Two levels: bit `i` of `words[w]` is
+/// channel `w * 64 + i`, bit `w` of `summary` is set when `words[w]` becomes non-zero. An idle poller loads the summary
+/// only, whatever the number of channels. Trivially destructible, lives in shared memory.
+template <uint32_t N>
+  requires(N > 0 && N <= DOORBELL_MAX_CHANNELS)
+struct Doorbell {
+  static constexpr uint32_t WORD_NUM = (N + 63) / 64;
+
+  alignas(std::hardware_destructive_interference_size) std::atomic<uint64_t> summary{0};
+  alignas(std::hardware_destructive_interference_size) std::array<std::atomic<uint64_t>, WORD_NUM> words{};
+
+  /// @brief Called by the writer of the `channel` after it published, e.g. after `DemuxWriter::write`. Sets the
+  /// channel bit, and the summary bit if the word was empty: the summary bit of a non-empty word is set already, or
+  /// about to be set by the writer that made it non-empty.
+  auto ring(const uint32_t channel) noexcept -> void {
+    assert(channel < N);
+    const uint64_t bit = uint64_t{1} << (channel % 64);
+    // acquire: a word the poller has taken is published in a summary the poller has taken too
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-constant-array-index)
+    if (this->words[channel / 64].fetch_or(bit, std::memory_order_acq_rel) == 0) {
+      this->summary.fetch_or(uint64_t{1} << (channel / 64), std::memory_order_release);
+    }
+  }
+};
+
+// NOLINTEND(misc-non-private-member-variables-in-classes)
+
+/// @brief Visits the channels of a `Doorbell` that were rung, instead of calling `has_next` on every channel: takes
+/// the rung words with one `exchange` each and walks their bits with `countr_zero` (`tzcnt`). A channel the visitor did
+/// not drain is kept in the poller's own pending bitmap and visited again by the next `poll`, the writers never see
+/// it. One poller per `Doorbell`, taking a word clears it.
+template <uint32_t N>
+class DoorbellPoller {
+ public:
+  explicit DoorbellPoller(Doorbell<N>* doorbell) noexcept : doorbell_(doorbell) {}
+
+  /// @brief Does not block. Calls `visit(channel)` for every channel rung since the previous `poll` and for every
+  /// channel `visit` returned `true` for. The visitor returns `true` if the channel may still have messages, e.g. it
+  /// stopped after a batch.
+  /// @return number of `visit` calls, `0` when there was nothing to do.
+  template <class F>
+  auto poll(F&& visit) noexcept(noexcept(visit(uint32_t{0}))) -> uint32_t {
+    if (this->doorbell_->summary.load(std::memory_order_relaxed) != 0) {
+      this->take_rung_words();
+    }
+    uint32_t result = 0;
+    for (uint64_t summary = this->pending_summary_; summary != 0; summary &= summary - 1) {
+      const auto w = static_cast<uint32_t>(std::countr_zero(summary));
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-constant-array-index)
+      uint64_t& pending = this->pending_[w];
+      uint64_t not_drained = 0;
+      for (uint64_t bits = pending; bits != 0; bits &= bits - 1) {
+        const auto i = static_cast<uint32_t>(std::countr_zero(bits));
+        ++result;
+        if (visit((w * 64) + i)) {
+          not_drained |= uint64_t{1} << i;
+        }
+      }
+      pending = not_drained;
+      if (not_drained == 0) {
+        this->pending_summary_ &= ~(uint64_t{1} << w);
+      }
+    }
+    return result;
+  }
+
+  /// @brief `true` if the next `poll` visits channels the visitor did not drain.
+  [[nodiscard]] auto has_pending() const noexcept -> bool { return this->pending_summary_ != 0; }
+
+ private:
+  // the words are taken after the summary, a writer that sets a word bit after that sets the summary bit again
+  auto take_rung_words() noexcept -> void {
+    for (uint64_t summary = this->doorbell_->summary.exchange(0, std::memory_order_acq_rel); summary != 0;
+         summary &= summary - 1) {
+      const auto w = static_cast<uint32_t>(std::countr_zero(summary));
+      // NOLINTBEGIN(cppcoreguidelines-pro-bounds-constant-array-index)
+      const uint64_t bits = this->doorbell_->words[w].exchange(0, std::memory_order_acq_rel);
+      if (bits != 0) {
+        this->pending_[w] |= bits;
+        this->pending_summary_ |= uint64_t{1} << w;
+      }
+      // NOLINTEND(cppcoreguidelines-pro-bounds-constant-array-index)
+    }
+  }
+
+  Doorbell<N>* doorbell_;
+  uint64_t pending_summary_{0};
+  std::array<uint64_t, Doorbell<N>::WORD_NUM> pending_{};
+};
+
+}  // namespace lshl::demux::util
@@ -0,0 +1,132 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace lshl::demux::util {
+
+using std::size_t;
+using std::uint32_t;
+using std::uint64_t;
+
+/// @brief Open-addressed hash table with linear probing and a fixed capacity, allocated once in the constructor,
+/// `upsert` and `clear` never allocate. Entries are stored densely in insertion order, iterate them with `key(i)` and
+/// `value(i)`, `i` within `[0, size())`. No single-entry erase, `clear` resets the table in `O(size())`.
+/// @tparam `K` key, equality comparable.
+/// @tparam `V` value, default constructible and copy assignable, `upsert` returns a pointer to it.
+/// @tparam `H` hash, the result is mixed before it is masked, so `std::hash` of an integer works fine.
+template <class K, class V, class H = std::hash<K>>
+class FlatTable {
+ public:
+  /// @param `capacity` max number of entries, the slot array is at least twice as large, load factor <= 0.5.
+  explicit FlatTable(const size_t capacity) noexcept(false)
+      : slots_(std::bit_ceil(2 * validate_capacity(capacity)), EMPTY),
+        mask_(slots_.size() - 1),
+        shift_(64U - static_cast<unsigned>(std::countr_zero(slots_.size()))),
+        keys_(capacity),
+        values_(capacity),
+        entry_slots_(capacity) {}
+
+  ~FlatTable() = default;
+  FlatTable(const FlatTable&) = delete;                          // copy constructor
+  auto operator=(const FlatTable&) -> FlatTable& = delete;       // copy assignment
+  FlatTable(FlatTable&&) noexcept = default;                     // move constructor
+  auto operator=(FlatTable&&) noexcept -> FlatTable& = default;  // move assignment
+
+  /// @brief Finds the entry for `key` or inserts a default-constructed one.
+  /// @return pointer to the value, overwrite it to keep the latest value, `nullptr` if the key is new and the table
+  /// is full.
+  [[nodiscard]] auto upsert(const K& key) noexcept -> V* {
+    size_t slot = this->home_slot(key);
+    while (true) {
+      const uint32_t index = this->slots_[slot];
+      if (index == EMPTY) {
+        if (this->size_ == this->keys_.size()) {
+          return nullptr;
+        }
+        const size_t i = this->size_;
+        this->slots_[slot] = static_cast<uint32_t>(i);
+        this->keys_[i] = key;
+        this->values_[i] = V{};
+        this->entry_slots_[i] = slot;
+        this->size_ += 1;
+        return &this->values_[i];
+      }
+      if (this->keys_[index] == key) {
+        return &this->values_[index];
+      }
+      slot = (slot + 1) & this->mask_;
+    }
+  }
+
+  [[nodiscard]] auto find(const K& key) const noexcept -> const V* {
+    size_t slot = this->home_slot(key);
+    while (true) {
+      const uint32_t index = this->slots_[slot];
+      if (index == EMPTY) {
+        return nullptr;
+      }
+      if (this->keys_[index] == key) {
+        return &this->values_[index];
+      }
+      slot = (slot + 1) & this->mask_;
+    }
+  }
+
+  /// @brief Removes all entries, touches only the used slots.
+  auto clear() noexcept -> void {
+    for (size_t i = 0; i < this->size_; ++i) {
+      this->slots_[this->entry_slots_[i]] = EMPTY;
+    }
+    this->size_ = 0;
+  }
+
+  [[nodiscard]] auto key(const size_t i) const noexcept -> const K& { return this->keys_[i]; }
+
+  [[nodiscard]] auto value(const size_t i) const noexcept -> const V& { return this->values_[i]; }
+
+  [[nodiscard]] auto size() const noexcept -> size_t { return this->size_; }
+
+  [[nodiscard]] auto empty() const noexcept -> bool { return this->size_ == 0; }
+
+  [[nodiscard]] auto full() const noexcept -> bool { return this->size_ == this->keys_.size(); }
+
+  [[nodiscard]] auto capacity() const noexcept -> size_t { return this->keys_.size(); }
+
+ private:
+  static constexpr uint32_t EMPTY = UINT32_MAX;
+
+  static auto validate_capacity(const size_t capacity) noexcept(false) -> size_t {
+    if (capacity == 0 || capacity >= EMPTY / 2) {
+      throw std::invalid_argument(
+          "FlatTable capacity must be within the interval: [1, " + std::to_string(EMPTY / 2) + ")"
+      );
+    }
+    return capacity;
+  }
+
+  [[nodiscard]] auto home_slot(const K& key) const noexcept -> size_t {
+    // Fibonacci hashing, spreads sequential keys and identity hashes over the slots, high bits are the best mixed
+    constexpr uint64_t GOLDEN_RATIO = 0x9E3779B97F4A7C15ULL;
+    const uint64_t h = static_cast<uint64_t>(H{}(key)) * GOLDEN_RATIO;
+    return static_cast<size_t>(h >> this->shift_);
+  }
+
+  std::vector<uint32_t> slots_;  // entry index or `EMPTY`
+  size_t mask_;
+  unsigned shift_;  // keeps the top log2(slots_.size()) bits of the hash
+  std::vector<K> keys_;
+  std::vector<V> values_;
+  std::vector<size_t> entry_slots_;  // slot of every entry, for `clear`
+  size_t size_{0};
+};
+
+}  // namespace lshl::demux::util
@@ -0,0 +1,138 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <flatbuffers/flatbuffers.h>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include "../core/demultiplexer.h"
+#include "./boost_log_util.h"
+
+namespace lshl::demux::util {
+
+using lshl::demux::core::DemuxWriter;
+using lshl::demux::core::WriteResult;
+using std::size_t;
+using std::span;
+using std::uint16_t;
+using std::uint8_t;
+
+// FlatBufferBuilder never aligns anything to more than the largest scalar
+constexpr size_t FLATBUFFERS_ALIGNMENT = alignof(flatbuffers::largest_scalar_t);
+
+/// @brief FlatBuffers allocator that hands out a fixed region reserved in the circular buffer. FlatBufferBuilder
+/// builds the buffer back to front, the finished buffer ends at the end of the region. The region cannot grow,
+/// `reallocate_downward` throws `std::length_error`, reserve enough space for the largest possible message.
+class RingAllocator : public flatbuffers::Allocator {
+ public:
+  explicit RingAllocator(const span<uint8_t> region) noexcept : region_(region) {}
+
+  ~RingAllocator() override = default;
+  RingAllocator(const RingAllocator&) = delete;
+  auto operator=(const RingAllocator&) -> RingAllocator& = delete;
+  RingAllocator(RingAllocator&&) = delete;
+  auto operator=(RingAllocator&&) -> RingAllocator& = delete;
+
+  auto allocate(const size_t size) -> uint8_t* override {
+    if (size > this->region_.size()) {
+      throw std::length_error(
+          "[RingAllocator::allocate] requested: " + std::to_string(size) + ", reserved: " +
+          std::to_string(this->region_.size())
+      );
+    }
+    return this->region_.data();
+  }
+
+  auto deallocate(uint8_t* /*unused*/, size_t /*unused*/) -> void override {
+    // the region belongs to the circular buffer
+  }
+
+  auto reallocate_downward(uint8_t* /*unused*/, size_t old_size, size_t new_size, size_t, size_t) -> uint8_t* override {
+    throw std::length_error(
+        "[RingAllocator::reallocate_downward] old_size: " + std::to_string(old_size) + ", new_size: " +
+        std::to_string(new_size)
+    );
+  }
+
+ private:
+  span<uint8_t> region_;
+};
+
+/// @brief Builds a FlatBuffers table of type `T` directly in the circular buffer, there is no intermediate heap buffer
+/// and no copy. Reserves `capacity` bytes in the ring, the finished buffer is placed at the end of the reserved space
+/// and the root offset at the start of the reserved space is patched to point at it, so the message returned by
+/// `DemuxReader::next()` is a valid FlatBuffer. The readers receive all `capacity` bytes, the unused bytes in between
+/// are skipped by the root offset.
+/// @tparam `T` FlatBuffers table type, the root type of the message.
+/// @param `writer` the demultiplexer writer.
+/// @param `capacity` the reserved space in bytes, upper bound of the finished buffer size. Rounded down to
+/// `FLATBUFFERS_ALIGNMENT`.
+/// @param `build` `flatbuffers::Offset<T>(flatbuffers::FlatBufferBuilder&)`, builds the message.
+/// @return `WriteResult::Repeat` when the non-blocking writer needs to wraparound, `WriteResult::Error` when the
+/// message does not fit into `capacity` bytes.
+template <class T, size_t L, uint16_t M, bool B, class F>
+[[nodiscard]] auto write_flatbuffer(DemuxWriter<L, M, B>* writer, const uint16_t capacity, F build) noexcept(false)
+    -> WriteResult {
+  const auto n = static_cast<uint16_t>(capacity / FLATBUFFERS_ALIGNMENT * FLATBUFFERS_ALIGNMENT);
+  const std::optional<span<uint8_t>> region = writer->allocate(n);
+  if (!region.has_value()) {
+    return B ? WriteResult::Error : WriteResult::Repeat;
+  }
+
+  try {
+    RingAllocator allocator(region.value());
+    flatbuffers::FlatBufferBuilder builder(n, &allocator, false, FLATBUFFERS_ALIGNMENT);
+    const flatbuffers::Offset<T> root = build(builder);
+    builder.Finish(root);
+
+    const size_t size = builder.GetSize();
+    const size_t gap = n - size;
+    assert(builder.GetBufferPointer() == region->data() + gap);
+    if (gap > 0) {
+      // the finished size is a multiple of `uoffset_t`, so is the gap, there is always room for the root offset
+      const auto root_offset = static_cast<flatbuffers::uoffset_t>(
+          gap + flatbuffers::ReadScalar<flatbuffers::uoffset_t>(builder.GetBufferPointer())
+      );
+      flatbuffers::WriteScalar<flatbuffers::uoffset_t>(region->data(), root_offset);
+    }
+  } catch (const std::length_error& e) {
+    // nothing is published without commit, the reserved space will be reused
+    LOG_ERROR << "[write_flatbuffer] message does not fit into capacity: " << n << ", " << e.what();
+    return WriteResult::Error;
+  }
+
+  writer->commit(n);
+  return WriteResult::Success;
+}
+
+/// @brief Verifies the FlatBuffer received from `DemuxReader::next()` and returns a zero-copy pointer to the root
+/// table. The messages in the circular buffer are only 2-byte aligned, the alignment check is disabled, the unaligned
+/// scalar access is fine on x86-64.
+/// @tparam `T` FlatBuffers table type, the root type of the message.
+/// @param `message` the message returned by `DemuxReader::next()`.
+/// @return the root table or `nullptr` when the verification failed.
+template <class T>
+[[nodiscard]] auto read_flatbuffer(const span<uint8_t>& message) noexcept -> const T* {
+  flatbuffers::Verifier::Options options{};
+  options.check_alignment = false;
+  flatbuffers::Verifier verifier(message.data(), message.size(), options);
+  if (!verifier.VerifyBuffer<T>(nullptr)) {
+    return nullptr;
+  }
+  return flatbuffers::GetRoot<T>(message.data());
+}
+
+/// @brief Returns a pointer to the root table without verification, use for messages that were verified before.
+template <class T>
+[[nodiscard]] auto read_flatbuffer_unverified(const span<uint8_t>& message) noexcept -> const T* {
+  return flatbuffers::GetRoot<T>(message.data());
+}
+
+}  // namespace lshl::demux::util
@@ -0,0 +1,44 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <ctime>
+
+namespace lshl::demux::util {
+
+using std::uint32_t;
+
+// Process-shared futex on an `atomic<uint32_t>` in shared memory, not `FUTEX_PRIVATE_FLAG`: the waiter and the waker
+// are different processes with different mappings of the word.
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) && std::atomic<uint32_t>::is_always_lock_free);
+
+/// @brief Sleeps while `*word == expected`, at most `timeout`. Returns when woken, on timeout, on a signal or at once
+/// if the value differs, the caller re-checks its condition in a loop.
+inline auto
+futex_wait(std::atomic<uint32_t>* word, const uint32_t expected, const std::chrono::nanoseconds timeout) noexcept
+    -> void {
+  using std::chrono::duration_cast;
+  using std::chrono::nanoseconds;
+  using std::chrono::seconds;
+  const seconds s = duration_cast<seconds>(timeout);
+  const timespec ts{.tv_sec = static_cast<time_t>(s.count()), .tv_nsec = (timeout - nanoseconds(s)).count()};
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg, cppcoreguidelines-pro-type-reinterpret-cast)
+  ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, &ts, nullptr, 0);
+}
+
+/// @brief Wakes all processes sleeping in `futex_wait` on the `word`.
+inline auto futex_wake_all(std::atomic<uint32_t>* word) noexcept -> void {
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg, cppcoreguidelines-pro-type-reinterpret-cast)
+  ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+}  // namespace lshl::demux::util
@@ -4,6 +4,9 @@
 #pragma once
 
 #include <hdr/hdr_histogram.h>
+#include <hdr/hdr_histogram_log.h>
+#include <hdr/hdr_time.h>
+#include <cerrno>
 #include <cstdint>
 #include <cstdio>
 #include <stdexcept>
@@ -11,9 +14,22 @@
 
 namespace lshl::demux::util {
 
+using std::int64_t;
+using std::uint64_t;
+
+constexpr uint64_t NS_IN_SECOND = 1'000'000'000;
+
+inline auto to_hdr_timespec(const uint64_t ns) noexcept -> hdr_timespec {
+  hdr_timespec result{};
+  result.tv_sec = static_cast<decltype(result.tv_sec)>(ns / NS_IN_SECOND);
+  result.tv_nsec = static_cast<decltype(result.tv_nsec)>(ns % NS_IN_SECOND);
+  return result;
+}
+
+class HDR_interval_log;
+
 struct HDR_histogram_util {
   explicit HDR_histogram_util() noexcept(false) {
-    using std::int64_t;
     // initialize hdr_histogram
     const int64_t lowest_discernible_value = 1L;              // Minimum value that can be tracked
     const int64_t highest_trackable_value = 10'000'000'000L;  // Maximum value to be tracked
@@ -37,10 +53,106 @@ struct HDR_histogram_util {
     }
   }
 
+  /// @brief Merges all intervals of the HdrHistogram log written by `HDR_interval_log`, possibly by another process,
+  /// into this histogram.
+  /// @return the number of merged intervals.
+  auto add_log(const std::string& path) noexcept(false) -> uint64_t {
+    FILE* file = std::fopen(path.c_str(), "r");  // NOLINT(cppcoreguidelines-owning-memory)
+    if (file == nullptr) {
+      throw std::invalid_argument("could not open HdrHistogram log: " + path);
+    }
+    hdr_log_reader reader{};
+    hdr_log_reader_init(&reader);
+    int rc = hdr_log_read_header(&reader, file);
+    uint64_t intervals = 0;
+    while (rc == 0) {
+      hdr_histogram* interval = nullptr;
+      rc = hdr_log_read(&reader, file, &interval, nullptr, nullptr);
+      if (rc == 0) {
+        const int64_t dropped = hdr_add(this->histogram_, interval);
+        hdr_close(interval);
+        if (dropped != 0) {
+          rc = EINVAL;
+        }
+        intervals += 1;
+      }
+    }
+    std::fclose(file);  // NOLINT(cppcoreguidelines-owning-memory)
+    if (rc != EOF) {
+      throw std::domain_error("could not read HdrHistogram log: " + path + ", error: " + hdr_strerror(rc));
+    }
+    return intervals;
+  }
+
+  /// @brief Merges the values recorded in the `other` histogram into this one.
+  auto add(const HDR_histogram_util& other) noexcept(false) -> void {
+    const int64_t dropped = hdr_add(this->histogram_, other.histogram_);
+    if (dropped != 0) {
+      throw std::domain_error(std::string("hdr_add dropped values: ") + std::to_string(dropped));
+    }
+  }
+
+  [[nodiscard]] auto value_at_percentile(const double percentile) const noexcept -> int64_t {
+    return hdr_value_at_percentile(this->histogram_, percentile);
+  }
+
+  [[nodiscard]] auto max() const noexcept -> int64_t { return hdr_max(this->histogram_); }
+
+  [[nodiscard]] auto mean() const noexcept -> double { return hdr_mean(this->histogram_); }
+
+  [[nodiscard]] auto total_count() const noexcept -> int64_t { return this->histogram_->total_count; }
+
+  auto reset() noexcept -> void { hdr_reset(this->histogram_); }
+
   auto print_report() { hdr_percentiles_print(this->histogram_, stdout, 2, 1.0, format_type::CLASSIC); }
 
  private:
+  friend class HDR_interval_log;
+
   hdr_histogram* histogram_{nullptr};
 };
 
+/// @brief Writes interval histograms in the HdrHistogram log format, see
+/// <https://github.com/HdrHistogram/HdrHistogram/blob/master/src/main/java/org/HdrHistogram/HistogramLogWriter.java>.
+/// The logs can be plotted with HistogramLogAnalyzer and merged with `HDR_histogram_util::add_log`.
+class HDR_interval_log {
+ public:
+  /// @param start_ns -- log start time, nanoseconds, the same clock as the interval timestamps.
+  HDR_interval_log(const std::string& path, const uint64_t start_ns) noexcept(false)
+      : file_(std::fopen(path.c_str(), "w")) {  // NOLINT(cppcoreguidelines-owning-memory)
+    if (this->file_ == nullptr) {
+      throw std::invalid_argument("could not create HdrHistogram log: " + path);
+    }
+    hdr_log_writer_init(&this->writer_);
+    hdr_timespec start = to_hdr_timespec(start_ns);
+    const int rc = hdr_log_write_header(&this->writer_, this->file_, "demux", &start);
+    if (rc != 0) {
+      std::fclose(this->file_);  // NOLINT(cppcoreguidelines-owning-memory)
+      throw std::domain_error("hdr_log_write_header failed: " + path + ", error: " + hdr_strerror(rc));
+    }
+  }
+
+  ~HDR_interval_log() { std::fclose(this->file_); }  // NOLINT(cppcoreguidelines-owning-memory)
+
+  HDR_interval_log(const HDR_interval_log&) = delete;                         // copy constructor
+  auto operator=(const HDR_interval_log&) -> HDR_interval_log& = delete;      // copy assignment
+  HDR_interval_log(HDR_interval_log&&) noexcept = delete;                     // move constructor
+  auto operator=(HDR_interval_log&&) noexcept -> HDR_interval_log& = delete;  // move assignment
+
+  /// @brief Appends the values recorded in the `interval` histogram between `start_ns` and `end_ns`.
+  auto write(const HDR_histogram_util& interval, const uint64_t start_ns, const uint64_t end_ns) noexcept(false)
+      -> void {
+    const hdr_timespec start = to_hdr_timespec(start_ns);
+    const hdr_timespec end = to_hdr_timespec(end_ns);
+    const int rc = hdr_log_write(&this->writer_, this->file_, &start, &end, interval.histogram_);
+    if (rc != 0) {
+      throw std::domain_error(std::string("hdr_log_write failed, error: ") + hdr_strerror(rc));
+    }
+  }
+
+ private:
+  FILE* file_;
+  hdr_log_writer writer_{};
+};
+
 }  // namespace lshl::demux::util
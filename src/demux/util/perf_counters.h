@@ -0,0 +1,214 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include "./boost_log_util.h"
+
+namespace lshl::demux::util {
+
+using std::size_t;
+using std::uint64_t;
+using std::uint8_t;
+
+enum class PerfEvent : uint8_t { Cycles, Instructions, L1dMisses, LlcMisses, BranchMisses };
+
+constexpr size_t PERF_EVENT_NUM = 5;
+
+constexpr std::array<const char*, PERF_EVENT_NUM> PERF_EVENT_NAMES{
+    "cycles", "instr", "L1d_miss", "LLC_miss", "br_miss"
+};
+
+/// @brief Counter values, `std::nullopt` for the events that could not be opened.
+struct PerfCounterValues {
+  std::array<std::optional<uint64_t>, PERF_EVENT_NUM> values{};
+
+  [[nodiscard]] auto operator[](const PerfEvent e) const noexcept -> std::optional<uint64_t> {
+    return this->values.at(static_cast<size_t>(e));
+  }
+
+  /// @brief Sums the counters of several threads, an event is missing only if it is missing in both.
+  auto operator+=(const PerfCounterValues& x) noexcept -> PerfCounterValues& {
+    for (size_t i = 0; i < PERF_EVENT_NUM; ++i) {
+      const std::optional<uint64_t>& v = x.values.at(i);
+      if (v.has_value()) {
+        this->values.at(i) = this->values.at(i).value_or(0) + v.value();
+      }
+    }
+    return *this;
+  }
+};
+
+/// @brief Hardware performance counters of the calling thread, user space only, via `perf_event_open(2)`. All events
+/// are opened as one group, so they are scheduled on the PMU together and cover the same instructions. Degrades to no
+/// counters (`available() == false`) when perf events are not permitted (`/proc/sys/kernel/perf_event_paranoid`) or not
+/// supported, e.g. in a VM without a virtual PMU. Events that the CPU does not support are skipped individually.
+/// Open, start and stop outside the measured loop, reading the counters is a system call.
+class PerfCounters {
+ public:
+  PerfCounters() noexcept {
+    for (size_t i = 0; i < PERF_EVENT_NUM; ++i) {
+      const int fd = open_event(static_cast<PerfEvent>(i), this->leader_fd());
+      if (fd < 0) {
+        // every thread opens its own counters, warn once per process and event
+        static std::array<std::once_flag, PERF_EVENT_NUM> warned{};
+        const int error = errno;
+        std::call_once(warned.at(i), [i, error] {
+          LOG_WARNING << "[PerfCounters] " << (i == 0 ? "no hardware counters" : "event is not supported: ")
+                      << (i == 0 ? "" : PERF_EVENT_NAMES.at(i)) << ", perf_event_open error: " << std::strerror(error);
+        });
+        if (i == 0) {
+          return;
+        }
+        continue;
+      }
+      this->fds_.at(i) = fd;
+      this->group_index_.at(i) = this->group_size_;
+      this->group_size_ += 1;
+    }
+  }
+
+  ~PerfCounters() {
+    for (const int fd : this->fds_) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+  }
+
+  PerfCounters(const PerfCounters&) = delete;                         // copy constructor
+  auto operator=(const PerfCounters&) -> PerfCounters& = delete;      // copy assignment
+  PerfCounters(PerfCounters&&) noexcept = delete;                     // move constructor
+  auto operator=(PerfCounters&&) noexcept -> PerfCounters& = delete;  // move assignment
+
+  [[nodiscard]] auto available() const noexcept -> bool { return this->leader_fd() >= 0; }
+
+  /// @brief Resets and enables all counters of the group.
+  auto start() noexcept -> void {
+    if (this->available()) {
+      // NOLINTBEGIN(cppcoreguidelines-pro-type-vararg)
+      ioctl(this->leader_fd(), PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+      ioctl(this->leader_fd(), PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+      // NOLINTEND(cppcoreguidelines-pro-type-vararg)
+    }
+  }
+
+  /// @brief Enables the counters without resetting them, e.g. after excluding a part of the loop with `stop()`.
+  auto resume() noexcept -> void {
+    if (this->available()) {
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+      ioctl(this->leader_fd(), PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+  }
+
+  auto stop() noexcept -> void {
+    if (this->available()) {
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+      ioctl(this->leader_fd(), PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    }
+  }
+
+  /// @brief Reads the counters, the values are scaled up if the group was multiplexed with other events.
+  [[nodiscard]] auto read() const noexcept -> PerfCounterValues {
+    PerfCounterValues result{};
+    if (!this->available()) {
+      return result;
+    }
+
+    // PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING layout:
+    // nr, time_enabled, time_running, value[nr]
+    constexpr size_t HEADER_SIZE = 3;
+    std::array<uint64_t, HEADER_SIZE + PERF_EVENT_NUM> data{};
+    const ssize_t n = ::read(this->leader_fd(), data.data(), sizeof(data));
+    if (n < static_cast<ssize_t>(HEADER_SIZE * sizeof(uint64_t)) || data[0] != this->group_size_) {
+      LOG_WARNING << "[PerfCounters] could not read counters, error: " << std::strerror(errno);
+      return result;
+    }
+    const uint64_t time_enabled = data[1];
+    const uint64_t time_running = data[2];
+    const double scale =
+        time_running == 0 ? 0.0 : static_cast<double>(time_enabled) / static_cast<double>(time_running);
+
+    for (size_t i = 0; i < PERF_EVENT_NUM; ++i) {
+      if (this->fds_.at(i) >= 0) {
+        const uint64_t raw = data.at(HEADER_SIZE + this->group_index_.at(i));
+        result.values.at(i) = static_cast<uint64_t>(static_cast<double>(raw) * scale);
+      }
+    }
+    return result;
+  }
+
+ private:
+  [[nodiscard]] auto leader_fd() const noexcept -> int { return this->fds_[0]; }
+
+  static auto open_event(const PerfEvent event, const int group_fd) noexcept -> int {
+    perf_event_attr attr{};
+    attr.size = sizeof(perf_event_attr);
+    switch (event) {
+      case PerfEvent::Cycles:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+      case PerfEvent::Instructions:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+      case PerfEvent::L1dMisses:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8U) |
+                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16U);  // NOLINT(hicpp-signed-bitwise)
+        break;
+      case PerfEvent::LlcMisses:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        break;
+      case PerfEvent::BranchMisses:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+    }
+    if (group_fd < 0) {
+      attr.disabled = 1;  // the leader enables and disables the whole group
+    }
+    attr.exclude_kernel = 1U;
+    attr.exclude_hv = 1U;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // calling thread, any CPU
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0UL));
+  }
+
+  std::array<int, PERF_EVENT_NUM> fds_{-1, -1, -1, -1, -1};
+  std::array<size_t, PERF_EVENT_NUM> group_index_{};
+  uint64_t group_size_{0};
+};
+
+/// @brief Prints the counters divided by `n`, e.g. per message: `cycles: 12.3, instr: 45.6, ...`.
+inline auto print_per(std::ostream& os, const PerfCounterValues& x, const uint64_t n) -> std::ostream& {
+  bool first = true;
+  for (size_t i = 0; i < PERF_EVENT_NUM; ++i) {
+    os << (first ? "" : ", ") << PERF_EVENT_NAMES.at(i) << ": ";
+    first = false;
+    const std::optional<uint64_t>& v = x.values.at(i);
+    if (v.has_value() && n > 0) {
+      os << static_cast<double>(v.value()) / static_cast<double>(n);
+    } else {
+      os << "n/a";
+    }
+  }
+  return os;
+}
+
+}  // namespace lshl::demux::util
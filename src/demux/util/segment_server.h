@@ -0,0 +1,263 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include "./boost_log_util.h"
+#include "./shm_segment.h"
+#include "./unix_socket.h"
+
+namespace lshl::demux::util {
+
+using std::uint32_t;
+using std::uint64_t;
+using std::uint8_t;
+
+/// @brief Result of an attach request.
+enum class AttachStatus : uint32_t {
+  Attached = 0,
+  UnexpectedReader = 1,  // the reader number is not in the writer's readers mask
+  DuplicateReader = 2,   // another reader attached with the same number
+  InvalidRequest = 3,
+  PermissionDenied = 4,  // the reader runs as a different user than the writer
+};
+
+inline auto operator<<(std::ostream& os, const AttachStatus& x) -> std::ostream& {
+  switch (x) {
+    case AttachStatus::Attached:
+      os << "Attached";
+      break;
+    case AttachStatus::UnexpectedReader:
+      os << "UnexpectedReader";
+      break;
+    case AttachStatus::DuplicateReader:
+      os << "DuplicateReader";
+      break;
+    case AttachStatus::InvalidRequest:
+      os << "InvalidRequest";
+      break;
+    case AttachStatus::PermissionDenied:
+      os << "PermissionDenied";
+      break;
+    default:
+      os << "AttachStatus{" << static_cast<uint32_t>(x) << "}";
+      break;
+  }
+  return os;
+}
+
+// NOLINTBEGIN(misc-non-private-member-variables-in-classes)
+
+/// @brief First message of a reader on the attach socket.
+struct AttachRequest {
+  uint64_t magic;  // `SEGMENT_MAGIC`
+  uint32_t version;
+  uint32_t reader_num;  // `[1, 64]`, `ReaderId::value()`
+};
+
+/// @brief Reply of the writer, carries `ShmSegment::fd()` and `ShmSegment::ring_fd()` if the reader is attached.
+struct AttachReply {
+  uint64_t magic;  // `SEGMENT_MAGIC`
+  uint32_t version;
+  AttachStatus status;
+};
+
+// NOLINTEND(misc-non-private-member-variables-in-classes)
+
+/// @brief Hands an anonymous segment (`ShmSegment::create_anonymous`) to the readers. Listens on an abstract Unix
+/// domain socket, which is also the registration channel of the readers: a reader connects, sends its number and gets
+/// the sealed file descriptors back with `SCM_RIGHTS`. Unlike a named segment nothing needs cleaning up, the memory is
+/// released with the last mapping and the socket name with the writer. Replaces `StartupHandshake` for the anonymous
+/// segments, see `attach_segment` for the reader side.
+/// An abstract socket has no file permissions, any local user can connect. Only a reader with the effective user ID of
+/// the writer (`SO_PEERCRED`) gets the file descriptors, the control lines are writable.
+template <class C, size_t L, uint16_t M>
+class SegmentServer {
+ public:
+  /// @param `segment` created with `create_anonymous`, must outlive the server.
+  /// @throw `std::domain_error` if the socket name is taken, e.g. by another writer.
+  SegmentServer(const ShmSegment<C, L, M>* segment, const std::string& socket_name) noexcept(false)
+      : segment_(segment), socket_(UnixSocket::listen(socket_name)) {
+    if (segment->ring_fd() < 0) {
+      throw std::invalid_argument("[SegmentServer] a named segment is opened by name, not passed: " + segment->name());
+    }
+    LOG_INFO << "[SegmentServer] listening on: " << socket_name;
+  }
+
+  /// @brief Attaches the readers that connect within the `timeout`, until all readers of `all_readers_mask` are
+  /// attached. A reader that connects but does not send its request within the remaining time is dropped, so is a
+  /// reader that sends an invalid request or closes the connection before the reply, the others are still accepted.
+  /// @return `false` on timeout.
+  [[nodiscard]] auto accept_readers(const uint64_t all_readers_mask, const std::chrono::nanoseconds timeout)
+      noexcept(false) -> bool {
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while ((this->readers_mask_ & all_readers_mask) != all_readers_mask) {
+      const auto remaining = deadline - std::chrono::steady_clock::now();
+      if (remaining <= std::chrono::nanoseconds::zero()) {
+        return false;
+      }
+      std::optional<UnixSocket> connection = this->socket_.accept(remaining);
+      if (connection.has_value()) {
+        this->attach(&connection.value(), all_readers_mask, deadline - std::chrono::steady_clock::now());
+      }
+    }
+    return true;
+  }
+
+  /// @brief The attached readers.
+  [[nodiscard]] auto readers_mask() const noexcept -> uint64_t { return this->readers_mask_; }
+
+ private:
+  // the errors of one connection do not reach the writer, the connection is dropped
+  auto attach(UnixSocket* connection, const uint64_t all_readers_mask, const std::chrono::nanoseconds timeout) noexcept
+      -> void {
+    AttachRequest request{};
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    const std::span<uint8_t> bytes{reinterpret_cast<uint8_t*>(&request), sizeof(request)};
+    std::optional<UnixSocket::Received> received;
+    try {
+      received = connection->receive(bytes, {}, timeout);
+    } catch (const std::exception& e) {
+      // e.g. a request longer than `AttachRequest`, it is discarded
+      LOG_ERROR << "[SegmentServer::attach] could not receive the request: " << e.what();
+      reply(connection, AttachStatus::InvalidRequest, {});
+      return;
+    }
+    if (!received.has_value() || received.value().size == 0) {
+      LOG_WARNING << "[SegmentServer::attach] reader did not send the request";
+      return;
+    }
+    const AttachStatus status = same_user(*connection) ? this->check(request, received.value().size, all_readers_mask)
+                                                        : AttachStatus::PermissionDenied;
+    if (status != AttachStatus::Attached) {
+      LOG_ERROR << "[SegmentServer::attach] rejected reader_num: " << request.reader_num << ", status: " << status;
+      reply(connection, status, {});
+      return;
+    }
+    const std::array<int, 2> fds{this->segment_->fd(), this->segment_->ring_fd()};
+    if (!reply(connection, status, fds)) {
+      return;  // the reader number stays free for the next attempt
+    }
+    this->readers_mask_ |= reader_mask(request.reader_num);
+    LOG_INFO << "[SegmentServer::attach] attached reader_num: " << request.reader_num
+             << ", readers_mask: " << this->readers_mask_;
+  }
+
+  static auto same_user(const UnixSocket& connection) noexcept -> bool {
+    try {
+      const uid_t uid = connection.peer_uid();
+      if (uid != ::geteuid()) {
+        LOG_ERROR << "[SegmentServer::attach] reader uid: " << uid << ", writer uid: " << ::geteuid();
+        return false;
+      }
+      return true;
+    } catch (const std::exception& e) {
+      LOG_ERROR << "[SegmentServer::attach] " << e.what();
+      return false;
+    }
+  }
+
+  // @return `false` if the reader has gone away, e.g. closed the connection without waiting for the reply
+  static auto reply(UnixSocket* connection, const AttachStatus status, const std::span<const int> fds) noexcept
+      -> bool {
+    const AttachReply reply{SEGMENT_MAGIC, SEGMENT_VERSION, status};
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    const std::span<const uint8_t> bytes{reinterpret_cast<const uint8_t*>(&reply), sizeof(reply)};
+    try {
+      connection->send(bytes, fds);
+      return true;
+    } catch (const std::exception& e) {
+      LOG_WARNING << "[SegmentServer::attach] could not reply, status: " << status << ", " << e.what();
+      return false;
+    }
+  }
+
+  [[nodiscard]] auto check(const AttachRequest& request, const size_t size, const uint64_t all_readers_mask) const
+      noexcept -> AttachStatus {
+    if (size != sizeof(AttachRequest) || request.magic != SEGMENT_MAGIC || request.version != SEGMENT_VERSION ||
+        request.reader_num == 0 || request.reader_num > 64) {
+      return AttachStatus::InvalidRequest;
+    }
+    const uint64_t mask = reader_mask(request.reader_num);
+    if ((mask & all_readers_mask) == 0) {
+      return AttachStatus::UnexpectedReader;
+    }
+    if ((mask & this->readers_mask_) != 0) {
+      return AttachStatus::DuplicateReader;
+    }
+    return AttachStatus::Attached;
+  }
+
+  static auto reader_mask(const uint32_t reader_num) noexcept -> uint64_t { return uint64_t{1} << (reader_num - 1); }
+
+  const ShmSegment<C, L, M>* segment_;
+  UnixSocket socket_;
+  uint64_t readers_mask_{0};
+};
+
+/// @brief Connect retry interval of `attach_segment` while the writer is not listening yet.
+constexpr std::chrono::milliseconds ATTACH_RETRY_INTERVAL{10};
+
+/// @brief The reader side of `SegmentServer`: connects to the writer's socket, registers the `reader_num` and maps the
+/// segment it gets back, the ring read-only. The reader can be started before the writer, it retries to connect
+/// until the `timeout`.
+/// @return `std::nullopt` if the writer did not listen within the `timeout`.
+/// @throw `std::domain_error` if the writer rejected the reader or the segment is not compatible.
+template <class C, size_t L, uint16_t M>
+[[nodiscard]] auto attach_segment(
+    const std::string& socket_name,
+    const uint8_t reader_num,
+    const FrameFormat format,
+    const std::chrono::nanoseconds timeout
+) noexcept(false) -> std::optional<ShmSegment<C, L, M>> {
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  std::optional<UnixSocket> connection = UnixSocket::connect(socket_name);
+  while (!connection.has_value()) {
+    if (std::chrono::steady_clock::now() >= deadline) {
+      return std::nullopt;
+    }
+    std::this_thread::sleep_for(ATTACH_RETRY_INTERVAL);
+    connection = UnixSocket::connect(socket_name);
+  }
+
+  const AttachRequest request{SEGMENT_MAGIC, SEGMENT_VERSION, reader_num};
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  connection->send(std::span<const uint8_t>{reinterpret_cast<const uint8_t*>(&request), sizeof(request)});
+
+  AttachReply reply{};
+  std::array<int, 2> fds{-1, -1};
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  const std::span<uint8_t> bytes{reinterpret_cast<uint8_t*>(&reply), sizeof(reply)};
+  const auto remaining = std::max(deadline - std::chrono::steady_clock::now(), std::chrono::nanoseconds{0});
+  const std::optional<UnixSocket::Received> received = connection->receive(bytes, fds, remaining);
+  if (!received.has_value()) {
+    return std::nullopt;
+  }
+  const bool valid = received.value().size == sizeof(AttachReply) && reply.magic == SEGMENT_MAGIC &&
+                     reply.version == SEGMENT_VERSION && received.value().fd_count == fds.size();
+  if (!valid || reply.status != AttachStatus::Attached) {
+    UnixSocket::close_all(std::span{fds}.first(received.value().fd_count));
+    std::ostringstream message;
+    message << "[attach_segment] writer rejected reader_num: " << static_cast<int>(reader_num)
+            << ", status: " << reply.status << ", fd_count: " << received.value().fd_count;
+    throw std::domain_error(message.str());
+  }
+  return ShmSegment<C, L, M>::open_fds(fds[0], fds[1], format, SegmentAccess::Reader);
+}
+
+}  // namespace lshl::demux::util
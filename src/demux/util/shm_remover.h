@@ -9,8 +9,12 @@
 namespace lshl::demux::util {
 
 struct ShmRemover {
-  explicit ShmRemover(const char* name) : name_(name) {
+  /// @param `remove_on_startup` `false` keeps the existing object, e.g. the segments of a writer that is restarted.
+  explicit ShmRemover(const char* name, const bool remove_on_startup = true) : name_(name) {
     namespace bipc = boost::interprocess;
+    if (!remove_on_startup) {
+      return;
+    }
     const bool ok = bipc::shared_memory_object::remove(this->name_);
     if (ok) {
       LOG_WARNING << "[startup] removed shared_memory_object: " << this->name_;
@@ -21,6 +25,10 @@ struct ShmRemover {
 
   ~ShmRemover() {
     namespace bipc = boost::interprocess;
+    if (this->keep_) {
+      LOG_WARNING << "[shutdown] keeping shared_memory_object: " << this->name_;
+      return;
+    }
     const bool ok = bipc::shared_memory_object::remove(this->name_);
     if (ok) {
       LOG_INFO << "[shutdown] removed shared_memory_object: " << this->name_;
@@ -34,8 +42,12 @@ struct ShmRemover {
   ShmRemover(ShmRemover&&) noexcept = delete;                     // move constructor
   auto operator=(ShmRemover&&) noexcept -> ShmRemover& = delete;  // move assignment
 
+  /// @brief Does not remove the object on shutdown, so the writer can be restarted on it.
+  auto keep() noexcept -> void { this->keep_ = true; }
+
  private:
   const char* name_;
+  bool keep_{false};
 };
 
 }  // namespace lshl::demux::util
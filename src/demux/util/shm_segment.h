@@ -0,0 +1,445 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include "./boost_log_util.h"
+#include "./shm_util.h"
+
+namespace lshl::demux::util {
+
+using std::size_t;
+using std::uint16_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::uint8_t;
+
+constexpr uint64_t SEGMENT_MAGIC = 0x3130474553584D44;  // "DMXSEG01", little-endian
+constexpr uint32_t SEGMENT_VERSION = 1;
+
+/// @brief How the messages in the ring are framed, readers must use the same format as the writer.
+enum class FrameFormat : uint32_t {
+  Plain = 0,       // `DemuxWriter`
+  Checksum32 = 1,  // `ChecksumWriter<uint32_t, ...>`
+  Checksum64 = 2,  // `ChecksumWriter<uint64_t, ...>`
+};
+
+inline auto operator<<(std::ostream& os, const FrameFormat& x) -> std::ostream& {
+  switch (x) {
+    case FrameFormat::Plain:
+      os << "Plain";
+      break;
+    case FrameFormat::Checksum32:
+      os << "Checksum32";
+      break;
+    case FrameFormat::Checksum64:
+      os << "Checksum64";
+      break;
+    default:
+      os << "FrameFormat{" << static_cast<uint32_t>(x) << "}";
+      break;
+  }
+  return os;
+}
+
+/// @brief What a process maps and with which protection.
+enum class SegmentAccess : uint8_t {
+  Writer,   // header, control lines and ring read-write
+  Reader,   // header and ring read-only, control lines read-write
+  Monitor,  // header and control lines read-only, the ring is not mapped
+};
+
+inline auto operator<<(std::ostream& os, const SegmentAccess& x) -> std::ostream& {
+  switch (x) {
+    case SegmentAccess::Writer:
+      os << "Writer";
+      break;
+    case SegmentAccess::Reader:
+      os << "Reader";
+      break;
+    case SegmentAccess::Monitor:
+      os << "Monitor";
+      break;
+  }
+  return os;
+}
+
+// NOLINTBEGIN(misc-non-private-member-variables-in-classes)
+
+/// @brief The first page of a segment, written once by the writer, read-only for everybody else. The offsets let a
+/// reader map every region separately, with its own protection.
+struct SegmentHeader {
+  std::atomic<uint64_t> magic;  // `SEGMENT_MAGIC`, stored last, a reader that sees it sees the initialized segment
+  uint32_t version;
+  FrameFormat frame_format;
+  uint64_t buffer_size;        // `L`
+  uint32_t max_message_size;   // `M`
+  uint32_t control_type_size;  // `sizeof` of the control lines type, catches a layout mismatch
+  uint64_t control_offset;
+  uint64_t control_size;
+  uint64_t buffer_offset;  // `0`: the ring is a file of its own, see `ShmSegment::create_anonymous`
+  uint64_t total_size;     // of the file with the header
+};
+
+// NOLINTEND(misc-non-private-member-variables-in-classes)
+
+[[nodiscard]] constexpr auto page_align(const size_t n) noexcept -> size_t {
+  return (n + LINUX_PAGE_SIZE - 1) / LINUX_PAGE_SIZE * LINUX_PAGE_SIZE;
+}
+
+/// @throw `std::domain_error` with the `errno` description.
+[[noreturn]] inline auto throw_shm_error(const std::string& message, const std::string& name) noexcept(false) -> void {
+  throw std::domain_error("[ShmSegment] " + message + ": " + name + ", " + std::strerror(errno));
+}
+
+/// @brief Owns a file descriptor of a segment.
+class ShmFd {
+ public:
+  explicit ShmFd(const int fd) noexcept : fd_(fd) {}
+  ~ShmFd() {
+    if (this->fd_ >= 0) {
+      ::close(this->fd_);
+    }
+  }
+  ShmFd(const ShmFd&) = delete;
+  auto operator=(const ShmFd&) -> ShmFd& = delete;
+  ShmFd(ShmFd&& other) noexcept : fd_(std::exchange(other.fd_, -1)) {}
+  auto operator=(ShmFd&& other) noexcept -> ShmFd& {
+    std::swap(this->fd_, other.fd_);
+    return *this;
+  }
+
+  [[nodiscard]] auto get() const noexcept -> int { return this->fd_; }
+
+  /// @throw `std::domain_error` if the file is smaller than `expected`.
+  auto check_size(const size_t expected, const std::string& name) const noexcept(false) -> void {
+    struct stat st {};
+    if (::fstat(this->fd_, &st) != 0) {
+      throw_shm_error("could not stat segment", name);
+    }
+    if (static_cast<size_t>(st.st_size) < expected) {
+      throw std::domain_error(
+          "[ShmSegment] segment is too small: " + name + ", size: " + std::to_string(st.st_size) +
+          ", expected: " + std::to_string(expected)
+      );
+    }
+  }
+
+ private:
+  int fd_;
+};
+
+/// @brief Owns a shared mapping of a segment region.
+class ShmMapping {
+ public:
+  ShmMapping() noexcept = default;
+  /// @throw `std::domain_error` if the region cannot be mapped with the `protection`.
+  ShmMapping(const int fd, const size_t offset, const size_t size, const int protection, const std::string& name)
+      noexcept(false)
+      : size_(size) {
+    this->address_ = ::mmap(nullptr, size, protection, MAP_SHARED, fd, static_cast<off_t>(offset));
+    if (this->address_ == MAP_FAILED) {
+      this->address_ = nullptr;
+      throw_shm_error("could not map segment", name);
+    }
+  }
+  ~ShmMapping() {
+    if (this->address_ != nullptr) {
+      ::munmap(this->address_, this->size_);
+    }
+  }
+  ShmMapping(const ShmMapping&) = delete;
+  auto operator=(const ShmMapping&) -> ShmMapping& = delete;
+  ShmMapping(ShmMapping&& other) noexcept
+      : address_(std::exchange(other.address_, nullptr)), size_(std::exchange(other.size_, 0)) {}
+  auto operator=(ShmMapping&& other) noexcept -> ShmMapping& {
+    std::swap(this->address_, other.address_);
+    std::swap(this->size_, other.size_);
+    return *this;
+  }
+
+  [[nodiscard]] auto data() const noexcept -> uint8_t* { return static_cast<uint8_t*>(this->address_); }
+
+ private:
+  void* address_{nullptr};
+  size_t size_{0};
+};
+
+/// @brief Shared memory segment of one ring, a replacement for `managed_shared_memory` without named objects: a fixed
+/// layout of page-aligned regions, the header, the control lines `C` (the synchronization counters, stats, ...) and
+/// the circular buffer of `L` bytes. Backed by a named POSIX shared memory object (`/dev/shm/<name>`) or by two
+/// anonymous `memfd` files passed to the readers, the readers validate the header before they map the rest.
+/// @tparam `C` control lines, constructed by the writer with `C{}`, must be trivially destructible.
+template <class C, size_t L, uint16_t M>
+  requires(std::is_default_constructible_v<C> && std::is_trivially_destructible_v<C> && L >= M + 2 && M > 0)
+class ShmSegment {
+ public:
+  static constexpr size_t CONTROL_OFFSET = LINUX_PAGE_SIZE;
+  static constexpr size_t CONTROL_SIZE = page_align(sizeof(C));
+  static constexpr size_t BUFFER_OFFSET = CONTROL_OFFSET + CONTROL_SIZE;
+  static constexpr size_t TOTAL_SIZE = BUFFER_OFFSET + page_align(L);
+
+  /// @brief Seals of the anonymous ring: the size is fixed, and once the writer has mapped it nobody can map it
+  /// writable or `write` to it, a reader cannot corrupt the messages of the other readers.
+  static constexpr int RING_SEALS = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_FUTURE_WRITE | F_SEAL_SEAL;
+
+  /// @brief Seals of the anonymous file with the header and the control lines, a reader cannot shrink it under the
+  /// writer's mapping.
+  static constexpr int CONTROL_SEALS = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
+
+  static_assert(sizeof(SegmentHeader) <= LINUX_PAGE_SIZE);
+  static_assert(alignof(C) <= LINUX_PAGE_SIZE);
+
+  /// @brief Creates the named segment for the writer, fails if it exists.
+  /// @throw `std::domain_error` if the segment cannot be created.
+  [[nodiscard]] static auto create(const std::string& name, const FrameFormat format) noexcept(false) -> ShmSegment {
+    const int fd = ::shm_open(shm_name(name).c_str(), O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+      throw_shm_error("could not create segment", name);
+    }
+    return ShmSegment::initialize(ShmFd{fd}, ShmFd{-1}, name, format);
+  }
+
+  /// @brief Creates an anonymous segment for the writer: the header and the control lines in one `memfd`, the ring in
+  /// another, both sealed. It has no name, nothing is left behind when the processes exit, the readers get `fd()` and
+  /// `ring_fd()` from the writer, e.g. with `SegmentServer`. The `name` is only shown in `/proc/<pid>/fd`.
+  /// @throw `std::domain_error` if the segment cannot be created.
+  [[nodiscard]] static auto create_anonymous(const std::string& name, const FrameFormat format) noexcept(false)
+      -> ShmSegment {
+    ShmFd fd{::memfd_create((name + ".control").c_str(), MFD_CLOEXEC | MFD_ALLOW_SEALING)};
+    if (fd.get() < 0) {
+      throw_shm_error("could not create anonymous segment", name);
+    }
+    ShmFd ring_fd{::memfd_create((name + ".ring").c_str(), MFD_CLOEXEC | MFD_ALLOW_SEALING)};
+    if (ring_fd.get() < 0) {
+      throw_shm_error("could not create anonymous ring", name);
+    }
+    return ShmSegment::initialize(std::move(fd), std::move(ring_fd), name, format);
+  }
+
+  /// @brief Opens an existing named segment, validates the header against `L`, `M`, `C` and the `format`.
+  /// @throw `std::domain_error` if the segment does not exist or is not compatible.
+  [[nodiscard]] static auto open(const std::string& name, const FrameFormat format, const SegmentAccess access)
+      noexcept(false) -> ShmSegment {
+    const int flags = access == SegmentAccess::Monitor ? O_RDONLY : O_RDWR;
+    const int fd = ::shm_open(shm_name(name).c_str(), flags, 0);
+    if (fd < 0) {
+      throw_shm_error("could not open segment", name);
+    }
+    return ShmSegment::attach(ShmFd{fd}, ShmFd{-1}, false, name, format, access);
+  }
+
+  /// @brief Same as `open`, for an anonymous segment passed as file descriptors, takes the ownership of both. The ring
+  /// must carry the `RING_SEALS`, it cannot be mapped writable, so the `access` is `Reader` or `Monitor`.
+  /// @param `ring_fd` `-1` for `SegmentAccess::Monitor`.
+  [[nodiscard]] static auto
+  open_fds(const int fd, const int ring_fd, const FrameFormat format, const SegmentAccess access) noexcept(false)
+      -> ShmSegment {
+    ShmFd control{fd};
+    ShmFd ring{ring_fd};
+    if (access == SegmentAccess::Writer) {
+      throw std::invalid_argument("[ShmSegment::open_fds] an anonymous segment has one writer, its creator");
+    }
+    if (access == SegmentAccess::Reader && ring.get() < 0) {
+      throw std::invalid_argument("[ShmSegment::open_fds] a reader needs the ring_fd");
+    }
+    const std::string name = "fd:" + std::to_string(fd);
+    return ShmSegment::attach(std::move(control), std::move(ring), true, name, format, access);
+  }
+
+  /// @brief Removes the named segment, the processes that mapped it keep their mappings.
+  static auto remove(const std::string& name) noexcept -> bool { return ::shm_unlink(shm_name(name).c_str()) == 0; }
+
+  ~ShmSegment() = default;
+  ShmSegment(const ShmSegment&) = delete;
+  auto operator=(const ShmSegment&) -> ShmSegment& = delete;
+  ShmSegment(ShmSegment&&) noexcept = default;
+  auto operator=(ShmSegment&&) noexcept -> ShmSegment& = default;
+
+  [[nodiscard]] auto header() const noexcept -> const SegmentHeader& { return *this->header_; }
+
+  /// @brief Control lines, read-only for `SegmentAccess::Monitor`.
+  [[nodiscard]] auto control() const noexcept -> C* { return this->control_; }
+
+  /// @brief The circular buffer, read-only for `SegmentAccess::Reader`, not mapped for `SegmentAccess::Monitor`.
+  [[nodiscard]] auto buffer() const noexcept -> std::span<uint8_t, L> {
+    assert(this->buffer_ != nullptr);
+    return std::span<uint8_t, L>{this->buffer_, L};
+  }
+
+  /// @brief The file with the header and the control lines, the whole segment if it is named.
+  [[nodiscard]] auto fd() const noexcept -> int { return this->fd_.get(); }
+
+  /// @brief The file with the ring of an anonymous segment, `-1` if the segment is named.
+  [[nodiscard]] auto ring_fd() const noexcept -> int { return this->ring_fd_.get(); }
+
+  [[nodiscard]] auto access() const noexcept -> SegmentAccess { return this->access_; }
+
+  [[nodiscard]] auto name() const noexcept -> const std::string& { return this->name_; }
+
+ private:
+  ShmSegment(ShmFd fd, ShmFd ring_fd, std::string name, const SegmentAccess access) noexcept
+      : fd_(std::move(fd)), ring_fd_(std::move(ring_fd)), name_(std::move(name)), access_(access) {}
+
+  // POSIX requires a leading slash for portable names
+  static auto shm_name(const std::string& name) -> std::string { return name.starts_with('/') ? name : '/' + name; }
+
+  static auto resize(const ShmFd& fd, const size_t size, const std::string& name) noexcept(false) -> void {
+    if (::ftruncate(fd.get(), static_cast<off_t>(size)) != 0) {
+      throw_shm_error("could not resize segment", name);
+    }
+  }
+
+  static auto seal(const ShmFd& fd, const int seals, const std::string& name) noexcept(false) -> void {
+    if (::fcntl(fd.get(), F_ADD_SEALS, seals) != 0) {
+      throw_shm_error("could not seal segment", name);
+    }
+  }
+
+  static auto initialize(ShmFd fd, ShmFd ring_fd, const std::string& name, const FrameFormat format) noexcept(false)
+      -> ShmSegment {
+    const bool anonymous = ring_fd.get() >= 0;
+    const size_t size = anonymous ? BUFFER_OFFSET : TOTAL_SIZE;
+    resize(fd, size, name);
+    if (anonymous) {
+      resize(ring_fd, page_align(L), name);
+    }
+    ShmSegment result(std::move(fd), std::move(ring_fd), name, SegmentAccess::Writer);
+    // one mapping per file, the regions are only separate for the readers
+    result.mappings_[0] = ShmMapping(result.fd_.get(), 0, size, PROT_READ | PROT_WRITE, name);
+    uint8_t* base = result.mappings_[0].data();
+    // NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    result.header_ = new (base) SegmentHeader{};
+    result.control_ = new (base + CONTROL_OFFSET) C{};
+    if (anonymous) {
+      // sealed after the writer's mapping, `F_SEAL_FUTURE_WRITE` leaves the existing writable mappings alone
+      result.mappings_[2] = ShmMapping(result.ring_fd_.get(), 0, page_align(L), PROT_READ | PROT_WRITE, name);
+      result.buffer_ = result.mappings_[2].data();
+      seal(result.ring_fd_, RING_SEALS, name);
+      seal(result.fd_, CONTROL_SEALS, name);
+    } else {
+      result.buffer_ = base + BUFFER_OFFSET;  // zero-filled by `ftruncate`
+    }
+    // NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    result.header_->version = SEGMENT_VERSION;
+    result.header_->frame_format = format;
+    result.header_->buffer_size = L;
+    result.header_->max_message_size = M;
+    result.header_->control_type_size = sizeof(C);
+    result.header_->control_offset = CONTROL_OFFSET;
+    result.header_->control_size = CONTROL_SIZE;
+    result.header_->buffer_offset = anonymous ? 0 : BUFFER_OFFSET;
+    result.header_->total_size = size;
+    result.header_->magic.store(SEGMENT_MAGIC, std::memory_order_release);
+    LOG_INFO << "[ShmSegment::initialize] " << name << ", L: " << L << ", M: " << M << ", format: " << format
+             << ", control_size: " << CONTROL_SIZE << ", total_size: " << size << ", anonymous: " << anonymous;
+    return result;
+  }
+
+  // the ring of a named segment is in the same file, an `anonymous` one comes as a file of its own
+  static auto attach(
+      ShmFd fd,
+      ShmFd ring_fd,
+      const bool anonymous,
+      const std::string& name,
+      const FrameFormat format,
+      const SegmentAccess access
+  ) noexcept(false) -> ShmSegment {
+    fd.check_size(anonymous ? BUFFER_OFFSET : TOTAL_SIZE, name);
+    if (ring_fd.get() >= 0) {
+      ring_fd.check_size(page_align(L), name);
+      const int seals = ::fcntl(ring_fd.get(), F_GET_SEALS);
+      if (seals < 0 || (seals & RING_SEALS) != RING_SEALS) {
+        throw std::domain_error("[ShmSegment] ring is not sealed read-only: " + name);
+      }
+    }
+
+    ShmSegment result(std::move(fd), std::move(ring_fd), name, access);
+    const int descriptor = result.fd_.get();
+    const bool monitor = access == SegmentAccess::Monitor;
+    const bool writer = access == SegmentAccess::Writer;
+
+    result.mappings_[0] = ShmMapping(descriptor, 0, LINUX_PAGE_SIZE, writer ? PROT_READ | PROT_WRITE : PROT_READ, name);
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    result.header_ = reinterpret_cast<SegmentHeader*>(result.mappings_[0].data());
+    validate(*result.header_, name, format, anonymous);
+
+    const int control_protection = monitor ? PROT_READ : PROT_READ | PROT_WRITE;
+    result.mappings_[1] = ShmMapping(descriptor, CONTROL_OFFSET, CONTROL_SIZE, control_protection, name);
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    result.control_ = reinterpret_cast<C*>(result.mappings_[1].data());
+    if (!monitor) {
+      const int buffer_protection = writer ? PROT_READ | PROT_WRITE : PROT_READ;
+      result.mappings_[2] = anonymous
+                                ? ShmMapping(result.ring_fd_.get(), 0, page_align(L), buffer_protection, name)
+                                : ShmMapping(descriptor, BUFFER_OFFSET, page_align(L), buffer_protection, name);
+      result.buffer_ = result.mappings_[2].data();
+    }
+    LOG_INFO << "[ShmSegment::attach] " << name << ", L: " << L << ", M: " << M << ", format: " << format
+             << ", access: " << access;
+    return result;
+  }
+
+  static auto validate(const SegmentHeader& x, const std::string& name, const FrameFormat format, const bool anonymous)
+      noexcept(false) -> void {
+    const auto fail = [&name](const std::string& what, const uint64_t actual, const uint64_t expected) {
+      throw std::domain_error(
+          "[ShmSegment] incompatible segment: " + name + ", " + what + ": " + std::to_string(actual) +
+          ", expected: " + std::to_string(expected)
+      );
+    };
+    const uint64_t magic = x.magic.load(std::memory_order_acquire);
+    if (magic != SEGMENT_MAGIC) {
+      fail("magic, not a demux segment or not initialized yet", magic, SEGMENT_MAGIC);
+    }
+    if (x.version != SEGMENT_VERSION) {
+      fail("version", x.version, SEGMENT_VERSION);
+    }
+    if (x.frame_format != format) {
+      fail("frame_format", static_cast<uint32_t>(x.frame_format), static_cast<uint32_t>(format));
+    }
+    if (x.buffer_size != L) {
+      fail("buffer_size (L)", x.buffer_size, L);
+    }
+    if (x.max_message_size != M) {
+      fail("max_message_size (M)", x.max_message_size, M);
+    }
+    if (x.control_type_size != sizeof(C)) {
+      fail("control_type_size", x.control_type_size, sizeof(C));
+    }
+    const size_t buffer_offset = anonymous ? 0 : BUFFER_OFFSET;
+    const size_t total_size = anonymous ? BUFFER_OFFSET : TOTAL_SIZE;
+    if (x.control_offset != CONTROL_OFFSET || x.buffer_offset != buffer_offset || x.total_size != total_size) {
+      fail("layout, total_size", x.total_size, total_size);
+    }
+  }
+
+  ShmFd fd_;
+  ShmFd ring_fd_;
+  std::string name_;
+  SegmentAccess access_;
+  std::array<ShmMapping, 3> mappings_{};  // the writer maps the header and the control lines with the first one
+  SegmentHeader* header_{nullptr};
+  C* control_{nullptr};
+  uint8_t* buffer_{nullptr};
+};
+
+}  // namespace lshl::demux::util
@@ -0,0 +1,86 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "./futex.h"
+
+namespace lshl::demux::util {
+
+using std::atomic;
+using std::uint32_t;
+using std::uint64_t;
+
+/// @brief Startup rendezvous of the writer and the readers, allocated in its own shared memory segment that both sides
+/// open or create, so the readers can be started before the writer. The readers sleep until the writer has created
+/// the shared memory objects, the writer sleeps until the last expected reader has registered. Both sides sleep on a
+/// futex and are woken by the other side, startup takes as long as the slowest process, not a polling interval.
+class StartupHandshake {
+ public:
+  /// @brief Called by the writer before it (re)creates the shared memory objects, forgets the readers of a previous
+  /// run.
+  auto reset() noexcept -> void {
+    this->writer_ready_.store(0);
+    this->readers_mask_.store(0);
+  }
+
+  /// @brief Called by the writer when the shared memory objects are ready, wakes the waiting readers.
+  auto publish_writer_ready() noexcept -> void {
+    this->writer_ready_.store(1);
+    futex_wake_all(&this->writer_ready_);
+  }
+
+  /// @brief Called by a reader before it opens the shared memory objects of the writer.
+  /// @return `false` on timeout.
+  [[nodiscard]] auto wait_for_writer(const std::chrono::nanoseconds timeout) noexcept -> bool {
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (this->writer_ready_.load() == 0) {
+      const auto remaining = deadline - std::chrono::steady_clock::now();
+      if (remaining <= std::chrono::nanoseconds::zero()) {
+        return false;
+      }
+      futex_wait(&this->writer_ready_, 0, remaining);
+    }
+    return true;
+  }
+
+  /// @brief Called by a reader when it is ready to read, wakes the writer.
+  auto register_reader(const uint64_t mask) noexcept -> void {
+    this->readers_mask_.fetch_or(mask);
+    this->readers_seq_.fetch_add(1);
+    futex_wake_all(&this->readers_seq_);
+  }
+
+  /// @brief Called by the writer after `publish_writer_ready`.
+  /// @return `false` on timeout.
+  [[nodiscard]] auto wait_for_readers(const uint64_t all_readers_mask, const std::chrono::nanoseconds timeout) noexcept
+      -> bool {
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (true) {
+      // loaded before the mask, a registration after the check changes it and `futex_wait` returns at once
+      const uint32_t seq = this->readers_seq_.load();
+      if ((this->readers_mask_.load() & all_readers_mask) == all_readers_mask) {
+        return true;
+      }
+      const auto remaining = deadline - std::chrono::steady_clock::now();
+      if (remaining <= std::chrono::nanoseconds::zero()) {
+        return false;
+      }
+      futex_wait(&this->readers_seq_, seq, remaining);
+    }
+  }
+
+  [[nodiscard]] auto readers_mask() const noexcept -> uint64_t { return this->readers_mask_.load(); }
+
+  [[nodiscard]] auto writer_ready() const noexcept -> bool { return this->writer_ready_.load() != 0; }
+
+ private:
+  atomic<uint64_t> readers_mask_{0};  // registered readers
+  atomic<uint32_t> readers_seq_{0};   // futex word, incremented by every registration
+  atomic<uint32_t> writer_ready_{0};  // futex word, `1` when the writer has created the shared memory objects
+};
+
+}  // namespace lshl::demux::util
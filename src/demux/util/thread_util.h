@@ -0,0 +1,29 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+#include <cstddef>
+#include <cstring>
+#include "./boost_log_util.h"
+
+namespace lshl::demux::util {
+
+/// @brief Pins the calling thread to the specified CPU core.
+/// @param `cpu` zero-based CPU core number.
+/// @return false if the thread could not be pinned, the thread keeps running on any core.
+[[nodiscard]] inline auto pin_current_thread(const int cpu) noexcept -> bool {
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  CPU_SET(static_cast<size_t>(cpu), &cpu_set);  // NOLINT(hicpp-signed-bitwise)
+  const int error = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpu_set);
+  if (error != 0) {
+    LOG_WARNING << "[pin_current_thread] could not pin thread to CPU: " << cpu << ", error: " << std::strerror(error);
+    return false;
+  }
+  return true;
+}
+
+}  // namespace lshl::demux::util
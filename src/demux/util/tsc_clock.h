@@ -0,0 +1,156 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+namespace lshl::demux::util {
+
+using std::int64_t;
+using std::uint32_t;
+using std::uint64_t;
+
+/// @brief Checks the invariant TSC CPUID flag. The invariant TSC runs at a constant rate in all ACPI P-, C- and
+/// T-states and is synchronized across cores, it can be used as a wall clock.
+[[nodiscard]] inline auto has_invariant_tsc() noexcept -> bool {
+#if defined(__x86_64__)
+  constexpr uint32_t ADVANCED_POWER_MANAGEMENT_LEAF = 0x80000007;
+  constexpr uint32_t INVARIANT_TSC_BIT = 1U << 8U;
+  uint32_t eax = 0;
+  uint32_t ebx = 0;
+  uint32_t ecx = 0;
+  uint32_t edx = 0;
+  if (__get_cpuid(ADVANCED_POWER_MANAGEMENT_LEAF, &eax, &ebx, &ecx, &edx) == 0) {
+    return false;  // leaf is not supported
+  }
+  return (edx & INVARIANT_TSC_BIT) != 0;
+#else
+  return false;
+#endif
+}
+
+/// @brief Reads the TSC, not serializing, can be reordered with the preceding instructions.
+[[nodiscard]] inline auto rdtsc() noexcept -> uint64_t {
+#if defined(__x86_64__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+/// @brief Reads the TSC after all preceding instructions have executed and all preceding loads are globally visible.
+[[nodiscard]] inline auto rdtscp() noexcept -> uint64_t {
+#if defined(__x86_64__)
+  unsigned int aux = 0;
+  return __rdtscp(&aux);
+#else
+  return 0;
+#endif
+}
+
+[[nodiscard]] inline auto steady_clock_ns() noexcept -> uint64_t {
+  return static_cast<uint64_t>(
+      std::chrono::nanoseconds(std::chrono::steady_clock::now().time_since_epoch()).count()
+  );
+}
+
+/// @brief Maps TSC ticks to `steady_clock` nanoseconds. Calibrated once by the writer and stored in shared memory, so
+/// all processes convert timestamps the same way. Must stay trivially copyable, it lives in shared memory.
+// NOLINTBEGIN(misc-non-private-member-variables-in-classes)
+struct TscCalibration {
+  uint64_t tsc_base{0};     // TSC ticks at the calibration start
+  uint64_t ns_base{0};      // `steady_clock` nanoseconds at `tsc_base`
+  double ns_per_tick{0.0};  // zero when the TSC cannot be used
+  bool invariant_tsc{false};
+};
+// NOLINTEND(misc-non-private-member-variables-in-classes)
+
+inline auto operator<<(std::ostream& os, const TscCalibration& x) -> std::ostream& {
+  os << "TscCalibration{tsc_base: " << x.tsc_base << ", ns_base: " << x.ns_base << ", ns_per_tick: " << x.ns_per_tick
+     << ", invariant_tsc: " << x.invariant_tsc << "}";
+  return os;
+}
+
+constexpr std::chrono::milliseconds DEFAULT_TSC_CALIBRATION_DURATION{100};
+
+/// @brief Measures the TSC rate against `steady_clock`, busy-waits for `duration`. Returns a calibration that falls
+/// back to `steady_clock` when the CPU has no invariant TSC.
+[[nodiscard]] inline auto calibrate_tsc(
+    const std::chrono::nanoseconds duration = DEFAULT_TSC_CALIBRATION_DURATION
+) noexcept -> TscCalibration {
+  if (!has_invariant_tsc()) {
+    return TscCalibration{};
+  }
+
+  // `steady_clock` read between two TSC reads, take the middle
+  const auto sample = [](uint64_t* tsc, uint64_t* ns) {
+    const uint64_t t0 = rdtscp();
+    *ns = steady_clock_ns();
+    const uint64_t t1 = rdtscp();
+    *tsc = t0 + ((t1 - t0) / 2);
+  };
+
+  uint64_t tsc0 = 0;
+  uint64_t ns0 = 0;
+  sample(&tsc0, &ns0);
+
+  const auto deadline = static_cast<uint64_t>(duration.count()) + ns0;
+  while (steady_clock_ns() < deadline) {
+    // busy-wait, sleeping would let the thread migrate between cores in the middle of the measurement
+  }
+
+  uint64_t tsc1 = 0;
+  uint64_t ns1 = 0;
+  sample(&tsc1, &ns1);
+
+  if (tsc1 <= tsc0 || ns1 <= ns0) {
+    return TscCalibration{};
+  }
+
+  return TscCalibration{tsc0, ns0, static_cast<double>(ns1 - ns0) / static_cast<double>(tsc1 - tsc0), true};
+}
+
+/// @brief Nanosecond timestamps from the TSC, converted with the shared `TscCalibration`. The default-constructed clock
+/// and the clock with the fallback calibration read `steady_clock`.
+class TscClock {
+ public:
+  TscClock() noexcept = default;
+
+  explicit TscClock(const TscCalibration& calibration) noexcept
+      : enabled_(calibration.invariant_tsc && calibration.ns_per_tick > 0.0), calibration_(calibration) {}
+
+  /// @brief Cheap timestamp for stamping outgoing messages.
+  [[nodiscard]] auto now() const noexcept -> uint64_t {
+    return this->enabled_ ? this->to_ns(rdtsc()) : steady_clock_ns();
+  }
+
+  /// @brief Timestamp taken after the preceding loads, use it to measure the latency of a received message.
+  [[nodiscard]] auto now_serialized() const noexcept -> uint64_t {
+    return this->enabled_ ? this->to_ns(rdtscp()) : steady_clock_ns();
+  }
+
+  [[nodiscard]] auto to_ns(const uint64_t ticks) const noexcept -> uint64_t {
+    // signed, ticks read on another core right after the calibration can be slightly behind `tsc_base`
+    const auto delta = static_cast<double>(static_cast<int64_t>(ticks - this->calibration_.tsc_base));
+    const auto delta_ns = static_cast<int64_t>(delta * this->calibration_.ns_per_tick);
+    return this->calibration_.ns_base + static_cast<uint64_t>(delta_ns);
+  }
+
+  [[nodiscard]] auto is_tsc() const noexcept -> bool { return this->enabled_; }
+
+  [[nodiscard]] auto calibration() const noexcept -> const TscCalibration& { return this->calibration_; }
+
+ private:
+  bool enabled_{false};
+  TscCalibration calibration_{};
+};
+
+}  // namespace lshl::demux::util
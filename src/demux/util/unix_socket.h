@@ -0,0 +1,240 @@
+// Copyright 2024 Leonid Shlyapnikov.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace lshl::demux::util {
+
+using std::size_t;
+using std::uint8_t;
+
+/// @brief Connected or listening `SOCK_SEQPACKET` Unix domain socket in the abstract namespace: there is no file in the
+/// file system, the name disappears with the last socket, nothing is left behind by a crashed process. A message is
+/// delivered whole, with the file descriptors attached to it (`SCM_RIGHTS`).
+class UnixSocket {
+ public:
+  /// @brief Max number of file descriptors in one message.
+  static constexpr size_t MAX_FDS = 4;
+
+  /// @brief Number of bytes and file descriptors of a received message, zero bytes when the peer closed the socket.
+  struct Received {
+    size_t size;
+    size_t fd_count;
+  };
+
+  /// @throw `std::domain_error` if the `name` is taken or too long.
+  [[nodiscard]] static auto listen(const std::string& name) noexcept(false) -> UnixSocket {
+    UnixSocket result{::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)};
+    if (result.fd_ < 0) {
+      throw_errno("could not create socket", name);
+    }
+    sockaddr_un address{};
+    const socklen_t length = abstract_address(name, &address);
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    if (::bind(result.fd_, reinterpret_cast<const sockaddr*>(&address), length) != 0) {
+      throw_errno("could not bind socket", name);
+    }
+    if (::listen(result.fd_, SOMAXCONN) != 0) {
+      throw_errno("could not listen on socket", name);
+    }
+    return result;
+  }
+
+  /// @return `std::nullopt` if nobody listens on the `name`.
+  /// @throw `std::domain_error` on other errors.
+  [[nodiscard]] static auto connect(const std::string& name) noexcept(false) -> std::optional<UnixSocket> {
+    UnixSocket result{::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)};
+    if (result.fd_ < 0) {
+      throw_errno("could not create socket", name);
+    }
+    sockaddr_un address{};
+    const socklen_t length = abstract_address(name, &address);
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    if (::connect(result.fd_, reinterpret_cast<const sockaddr*>(&address), length) != 0) {
+      if (errno == ECONNREFUSED || errno == ENOENT) {
+        return std::nullopt;
+      }
+      throw_errno("could not connect socket", name);
+    }
+    return result;
+  }
+
+  ~UnixSocket() {
+    if (this->fd_ >= 0) {
+      ::close(this->fd_);
+    }
+  }
+
+  UnixSocket(const UnixSocket&) = delete;
+  auto operator=(const UnixSocket&) -> UnixSocket& = delete;
+  UnixSocket(UnixSocket&& other) noexcept : fd_(std::exchange(other.fd_, -1)) {}
+  auto operator=(UnixSocket&& other) noexcept -> UnixSocket& {
+    std::swap(this->fd_, other.fd_);
+    return *this;
+  }
+
+  /// @brief Waits up to the `timeout` for a connection on a listening socket.
+  /// @return `std::nullopt` on timeout.
+  [[nodiscard]] auto accept(const std::chrono::nanoseconds timeout) noexcept(false) -> std::optional<UnixSocket> {
+    if (!this->poll(timeout)) {
+      return std::nullopt;
+    }
+    UnixSocket result{::accept4(this->fd_, nullptr, nullptr, SOCK_CLOEXEC)};
+    if (result.fd_ < 0) {
+      throw_errno("could not accept connection", "");
+    }
+    return result;
+  }
+
+  /// @brief Sends one message, the `fds` stay open in this process.
+  auto send(const std::span<const uint8_t> bytes, const std::span<const int> fds = {}) noexcept(false) -> void {
+    if (fds.size() > MAX_FDS) {
+      throw std::invalid_argument("[UnixSocket::send] too many file descriptors: " + std::to_string(fds.size()));
+    }
+    iovec io{const_cast<uint8_t*>(bytes.data()), bytes.size()};  // NOLINT(cppcoreguidelines-pro-type-const-cast)
+    ControlBuffer control{};
+    msghdr message{};
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+    if (!fds.empty()) {
+      message.msg_control = control.bytes.data();
+      message.msg_controllen = CMSG_SPACE(fds.size_bytes());
+      cmsghdr* header = CMSG_FIRSTHDR(&message);
+      header->cmsg_level = SOL_SOCKET;
+      header->cmsg_type = SCM_RIGHTS;
+      header->cmsg_len = CMSG_LEN(fds.size_bytes());
+      std::memcpy(CMSG_DATA(header), fds.data(), fds.size_bytes());
+    }
+    const ssize_t n = ::sendmsg(this->fd_, &message, MSG_NOSIGNAL);
+    if (n < 0 || static_cast<size_t>(n) != bytes.size()) {
+      throw_errno("could not send message", "");
+    }
+  }
+
+  /// @brief Waits up to the `timeout` for one message. The received file descriptors are owned by the caller, they
+  /// are closed if they do not fit into the `fds`. A message longer than the `bytes` is an error.
+  /// @return `std::nullopt` on timeout.
+  [[nodiscard]] auto receive(
+      const std::span<uint8_t> bytes,
+      const std::span<int> fds,
+      const std::chrono::nanoseconds timeout
+  ) noexcept(false) -> std::optional<Received> {
+    if (!this->poll(timeout)) {
+      return std::nullopt;
+    }
+    iovec io{bytes.data(), bytes.size()};
+    ControlBuffer control{};
+    msghdr message{};
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+    message.msg_control = control.bytes.data();
+    message.msg_controllen = control.bytes.size();
+    const ssize_t n = ::recvmsg(this->fd_, &message, MSG_CMSG_CLOEXEC);
+    if (n < 0) {
+      throw_errno("could not receive message", "");
+    }
+    size_t fd_count = 0;
+    for (cmsghdr* header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header)) {
+      if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS) {
+        continue;
+      }
+      const size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      for (size_t i = 0; i < count; ++i) {
+        int fd = -1;
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+        std::memcpy(&fd, CMSG_DATA(header) + (i * sizeof(int)), sizeof(int));
+        if (fd_count < fds.size()) {
+          fds[fd_count++] = fd;
+        } else {
+          ::close(fd);
+        }
+      }
+    }
+    if ((message.msg_flags & MSG_TRUNC) != 0) {
+      close_all(fds.first(fd_count));
+      throw std::domain_error("[UnixSocket::receive] message is too long, buffer: " + std::to_string(bytes.size()));
+    }
+    return Received{static_cast<size_t>(n), fd_count};
+  }
+
+  /// @brief Effective user ID of the peer process when it connected, `SO_PEERCRED`, on a connected socket.
+  [[nodiscard]] auto peer_uid() const noexcept(false) -> uid_t {
+    ucred credentials{};
+    socklen_t size = sizeof(credentials);
+    if (::getsockopt(this->fd_, SOL_SOCKET, SO_PEERCRED, &credentials, &size) != 0) {
+      throw_errno("could not get peer credentials", "");
+    }
+    return credentials.uid;
+  }
+
+  [[nodiscard]] auto fd() const noexcept -> int { return this->fd_; }
+
+  /// @brief Closes the file descriptors that were not handed over, e.g. on a failed attach.
+  static auto close_all(const std::span<const int> fds) noexcept -> void {
+    for (const int fd : fds) {
+      if (fd >= 0) {
+        ::close(fd);
+      }
+    }
+  }
+
+ private:
+  // aligned for `cmsghdr`
+  struct ControlBuffer {
+    alignas(cmsghdr) std::array<uint8_t, CMSG_SPACE(MAX_FDS * sizeof(int))> bytes;
+  };
+
+  explicit UnixSocket(const int fd) noexcept : fd_(fd) {}
+
+  [[noreturn]] static auto throw_errno(const std::string& message, const std::string& name) noexcept(false) -> void {
+    throw std::domain_error("[UnixSocket] " + message + ": " + name + ", " + std::strerror(errno));
+  }
+
+  // the abstract namespace: the path starts with a zero byte, the length covers the name only
+  static auto abstract_address(const std::string& name, sockaddr_un* address) noexcept(false) -> socklen_t {
+    if (name.empty() || name.size() + 1 > sizeof(address->sun_path)) {
+      throw std::invalid_argument("[UnixSocket] invalid socket name: " + name);
+    }
+    address->sun_family = AF_UNIX;
+    address->sun_path[0] = '\0';
+    std::copy(name.begin(), name.end(), std::begin(address->sun_path) + 1);
+    return static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + name.size());
+  }
+
+  // `true` if the socket is readable, a connection to accept, a message or the end of the stream
+  auto poll(const std::chrono::nanoseconds timeout) const noexcept(false) -> bool {
+    pollfd x{this->fd_, POLLIN, 0};
+    const auto ms = std::chrono::ceil<std::chrono::milliseconds>(std::max(timeout, std::chrono::nanoseconds{0}));
+    while (true) {
+      const int n = ::poll(&x, 1, static_cast<int>(ms.count()));
+      if (n >= 0) {
+        return n > 0;
+      }
+      if (errno != EINTR) {
+        throw_errno("could not poll socket", "");
+      }
+    }
+  }
+
+  int fd_;
+};
+
+}  // namespace lshl::demux::util